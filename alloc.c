@@ -110,8 +110,9 @@ static unsigned int alloc_commit_index(void)
 
 void init_commit_node(struct commit *c)
 {
-	c->object.type = OBJ_COMMIT;
+	/* set the type last; object_as_type() checks it without a lock */
 	c->index = alloc_commit_index();
+	c->object.type = OBJ_COMMIT;
 }
 
 void *alloc_commit_node(struct repository *r)
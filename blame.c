@@ -1242,23 +1242,43 @@ static int fill_blob_sha1_and_mode(struct repository *r,
 
 struct blame_bloom_data {
 	/*
-	 * Changed-path Bloom filter keys. These can help prevent
-	 * computing diffs against first parents, but we need to
-	 * expand the list as code is moved or files are renamed.
+	 * Changed-path Bloom filter keys of each path that has been
+	 * blamed so far. These can help prevent computing diffs
+	 * against first parents; the list grows as files are renamed.
 	 */
 	struct bloom_filter_settings *settings;
-	struct bloom_key **keys;
+	struct blame_bloom_path {
+		char *path;
+		struct bloom_keyvec *keys;
+	} *paths;
 	int nr;
 	int alloc;
 };
 
 static int bloom_count_queries = 0;
 static int bloom_count_no = 0;
+
+static struct bloom_keyvec *get_bloom_keys(struct blame_bloom_data *bd,
+					   const char *path)
+{
+	struct blame_bloom_path *bp;
+	int i;
+
+	for (i = bd->nr - 1; i >= 0; i--)
+		if (!strcmp(bd->paths[i].path, path))
+			return bd->paths[i].keys;
+
+	ALLOC_GROW(bd->paths, bd->nr + 1, bd->alloc);
+	bp = &bd->paths[bd->nr++];
+	bp->path = xstrdup(path);
+	bp->keys = bloom_keyvec_new(path, strlen(path), bd->settings);
+	return bp->keys;
+}
+
 static int maybe_changed_path(struct repository *r,
 			      struct blame_origin *origin,
 			      struct blame_bloom_data *bd)
 {
-	int i;
 	struct bloom_filter *filter;
 
 	if (!bd)
@@ -1272,34 +1292,19 @@ static int maybe_changed_path(struct repository *r,
 	if (!filter)
 		return 1;
 
+	/*
+	 * find_origin() only diffs origin->path, so the keys of paths
+	 * this file had before or after a rename do not matter here.
+	 */
 	bloom_count_queries++;
-	for (i = 0; i < bd->nr; i++) {
-		if (bloom_filter_contains(filter,
-					  bd->keys[i],
-					  bd->settings))
-			return 1;
-	}
+	if (bloom_filter_contains_vec(filter, get_bloom_keys(bd, origin->path),
+				      bd->settings))
+		return 1;
 
 	bloom_count_no++;
 	return 0;
 }
 
-static void add_bloom_key(struct blame_bloom_data *bd,
-			  const char *path)
-{
-	if (!bd)
-		return;
-
-	if (bd->nr >= bd->alloc) {
-		bd->alloc *= 2;
-		REALLOC_ARRAY(bd->keys, bd->alloc);
-	}
-
-	bd->keys[bd->nr] = xmalloc(sizeof(struct bloom_key));
-	fill_bloom_key(path, strlen(path), bd->keys[bd->nr], bd->settings);
-	bd->nr++;
-}
-
 /*
  * We have an origin -- check if the same path exists in the
  * parent and return an origin structure to represent it.
@@ -1403,8 +1408,7 @@ static struct blame_origin *find_origin(struct repository *r,
  */
 static struct blame_origin *find_rename(struct repository *r,
 					struct commit *parent,
-					struct blame_origin *origin,
-					struct blame_bloom_data *bd)
+					struct blame_origin *origin)
 {
 	struct blame_origin *porigin = NULL;
 	struct diff_options diff_opts;
@@ -1429,7 +1433,6 @@ static struct blame_origin *find_rename(struct repository *r,
 		struct diff_filepair *p = diff_queued_diff.queue[i];
 		if ((p->status == 'R' || p->status == 'C') &&
 		    !strcmp(p->two->path, origin->path)) {
-			add_bloom_key(bd, p->one->path);
 			porigin = get_origin(parent, p->one->path);
 			oidcpy(&porigin->blob_oid, &p->one->oid);
 			porigin->mode = p->one->mode;
@@ -2390,11 +2393,6 @@ static void distribute_blame(struct blame_scoreboard *sb, struct blame_entry *bl
 
 #define MAXSG 16
 
-typedef struct blame_origin *(*blame_find_alg)(struct repository *,
-					       struct commit *,
-					       struct blame_origin *,
-					       struct blame_bloom_data *);
-
 static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin, int opt)
 {
 	struct rev_info *revs = sb->revs;
@@ -2419,8 +2417,6 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 	 * common cases, then we look for renames in the second pass.
 	 */
 	for (pass = 0; pass < 2 - sb->no_whole_file_rename; pass++) {
-		blame_find_alg find = pass ? find_rename : find_origin;
-
 		for (i = 0, sg = first_scapegoat(revs, commit, sb->reverse);
 		     i < num_sg && sg;
 		     sg = sg->next, i++) {
@@ -2431,7 +2427,11 @@ static void pass_blame(struct blame_scoreboard *sb, struct blame_origin *origin,
 				continue;
 			if (parse_commit(p))
 				continue;
-			porigin = find(sb->repo, p, origin, sb->bloom_data);
+			if (pass)
+				porigin = find_rename(sb->repo, p, origin);
+			else
+				porigin = find_origin(sb->repo, p, origin,
+						      sb->bloom_data);
 			if (!porigin)
 				continue;
 			if (oideq(&porigin->blob_oid, &origin->blob_oid)) {
@@ -2889,9 +2889,9 @@ void setup_blame_bloom_data(struct blame_scoreboard *sb)
 
 	bd->alloc = 4;
 	bd->nr = 0;
-	ALLOC_ARRAY(bd->keys, bd->alloc);
+	ALLOC_ARRAY(bd->paths, bd->alloc);
 
-	add_bloom_key(bd, sb->path);
+	get_bloom_keys(bd, sb->path);
 
 	sb->bloom_data = bd;
 }
@@ -2901,10 +2901,10 @@ void cleanup_scoreboard(struct blame_scoreboard *sb)
 	if (sb->bloom_data) {
 		int i;
 		for (i = 0; i < sb->bloom_data->nr; i++) {
-			free(sb->bloom_data->keys[i]->hashes);
-			free(sb->bloom_data->keys[i]);
+			free(sb->bloom_data->paths[i].path);
+			bloom_keyvec_free(sb->bloom_data->paths[i].keys);
 		}
-		free(sb->bloom_data->keys);
+		free(sb->bloom_data->paths);
 		FREE_AND_NULL(sb->bloom_data);
 
 		trace2_data_intmax("blame", sb->repo,
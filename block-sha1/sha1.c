@@ -11,6 +11,15 @@
 
 #include "sha1.h"
 
+/*
+ * On x86-64, use the SHA extensions when the CPU has them.  The check is
+ * done at runtime, so the same binary still runs everywhere else.
+ */
+#if defined(__x86_64__) && !defined(NO_SHA1_SHANI) && \
+	(defined(__clang__) || GIT_GNUC_PREREQ(4, 9))
+#define BLK_SHA1_SHANI
+#endif
+
 #define SHA_ROT(X,l,r)	(((X) << (l)) | ((X) >> (r)))
 #define SHA_ROL(X,n)	SHA_ROT(X,n,32-(n))
 #define SHA_ROR(X,n)	SHA_ROT(X,32-(n),n)
@@ -170,6 +179,123 @@ static void blk_SHA1_Block(blk_SHA_CTX *ctx, const void *block)
 	ctx->H[4] += E;
 }
 
+#ifdef BLK_SHA1_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+
+static int have_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & (1 << 9)) ||	/* SSSE3 */
+	    !(ecx & (1 << 19)))		/* SSE4.1 */
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return !!(ebx & (1 << 29));	/* SHA */
+}
+
+/*
+ * Four rounds with round function "f", consuming the message words in
+ * m0 and working on the next ones: m1 is completed, m3 started and m2
+ * brought one step further.  E alternates between "e" and "enext".
+ */
+#define QROUND(f, e, enext, m0, m1, m2, m3) \
+	e = _mm_sha1nexte_epu32(e, m0); \
+	enext = abcd; \
+	m1 = _mm_sha1msg2_epu32(m1, m0); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, f); \
+	m3 = _mm_sha1msg1_epu32(m3, m0); \
+	m2 = _mm_xor_si128(m2, m0)
+
+/*
+ * Process "nr" 64-byte blocks with the SHA extensions.  They keep A-D
+ * in one register, in reverse order, and E in the top lane of another.
+ */
+__attribute__((target("sha,sse4.1")))
+static void blk_SHA1_Blocks_shani(blk_SHA_CTX *ctx,
+				  const unsigned char *buf, size_t nr)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL,
+					     0x08090a0b0c0d0e0fULL);
+	__m128i abcd, e0, e1, m0, m1, m2, m3, save_abcd, save_e;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)ctx->H),
+				 0x1b);
+	e0 = _mm_set_epi32(ctx->H[4], 0, 0, 0);
+
+	for (; nr; nr--, buf += 64) {
+		save_abcd = abcd;
+		save_e = e0;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 0)), bswap);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), bswap);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), bswap);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), bswap);
+
+		/* rounds 0-11, before all four message registers are in use */
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+		e1 = _mm_sha1nexte_epu32(e1, m1);
+		e0 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+		m0 = _mm_sha1msg1_epu32(m0, m1);
+
+		e0 = _mm_sha1nexte_epu32(e0, m2);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = _mm_sha1msg1_epu32(m1, m2);
+		m0 = _mm_xor_si128(m0, m2);
+
+		QROUND(0, e1, e0, m3, m0, m1, m2);
+		QROUND(0, e0, e1, m0, m1, m2, m3);
+		QROUND(1, e1, e0, m1, m2, m3, m0);
+		QROUND(1, e0, e1, m2, m3, m0, m1);
+		QROUND(1, e1, e0, m3, m0, m1, m2);
+		QROUND(1, e0, e1, m0, m1, m2, m3);
+		QROUND(1, e1, e0, m1, m2, m3, m0);
+		QROUND(2, e0, e1, m2, m3, m0, m1);
+		QROUND(2, e1, e0, m3, m0, m1, m2);
+		QROUND(2, e0, e1, m0, m1, m2, m3);
+		QROUND(2, e1, e0, m1, m2, m3, m0);
+		QROUND(2, e0, e1, m2, m3, m0, m1);
+		QROUND(3, e1, e0, m3, m0, m1, m2);
+		QROUND(3, e0, e1, m0, m1, m2, m3);
+		QROUND(3, e1, e0, m1, m2, m3, m0);
+		QROUND(3, e0, e1, m2, m3, m0, m1);
+		QROUND(3, e1, e0, m3, m0, m1, m2);
+
+		e0 = _mm_sha1nexte_epu32(e0, save_e);
+		abcd = _mm_add_epi32(abcd, save_abcd);
+	}
+
+	_mm_storeu_si128((__m128i *)ctx->H, _mm_shuffle_epi32(abcd, 0x1b));
+	ctx->H[4] = _mm_extract_epi32(e0, 3);
+}
+
+#undef QROUND
+#endif
+
+static void blk_SHA1_Blocks(blk_SHA_CTX *ctx, const void *block, size_t nr)
+{
+#ifdef BLK_SHA1_SHANI
+	static int use_shani = -1;
+
+	if (use_shani < 0)
+		use_shani = have_shani();
+	if (use_shani) {
+		blk_SHA1_Blocks_shani(ctx, block, nr);
+		return;
+	}
+#endif
+	for (; nr; nr--, block = (const char *)block + 64)
+		blk_SHA1_Block(ctx, block);
+}
+
 void blk_SHA1_Init(blk_SHA_CTX *ctx)
 {
 	ctx->size = 0;
@@ -199,12 +325,13 @@ void blk_SHA1_Update(blk_SHA_CTX *ctx, const void *data, size_t len)
 		data = ((const char *)data + left);
 		if (lenW)
 			return;
-		blk_SHA1_Block(ctx, ctx->W);
+		blk_SHA1_Blocks(ctx, ctx->W, 1);
 	}
-	while (len >= 64) {
-		blk_SHA1_Block(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		size_t nr = len / 64;
+		blk_SHA1_Blocks(ctx, data, nr);
+		data = ((const char *)data + nr * 64);
+		len -= nr * 64;
 	}
 	if (len)
 		memcpy(ctx->W, data, len);
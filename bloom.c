@@ -6,6 +6,7 @@
 #include "hashmap.h"
 #include "commit-graph.h"
 #include "commit.h"
+#include "object-store.h"
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
@@ -143,6 +144,45 @@ void clear_bloom_key(struct bloom_key *key)
 	FREE_AND_NULL(key->hashes);
 }
 
+struct bloom_keyvec *bloom_keyvec_new(const char *path, size_t len,
+				      const struct bloom_filter_settings *settings)
+{
+	struct bloom_keyvec *vec;
+	size_t nr = 1, i;
+
+	/*
+	 * At this point, the path is normalized to use Unix-style
+	 * path separators. This is required due to how the
+	 * changed-path Bloom filters store the paths.
+	 */
+	for (i = 0; i < len; i++)
+		if (path[i] == '/')
+			nr++;
+
+	vec = xcalloc(1, st_add(sizeof(*vec),
+				st_mult(sizeof(vec->key[0]), nr)));
+	vec->count = nr;
+
+	fill_bloom_key(path, len, &vec->key[0], settings);
+	nr = 1;
+	for (i = len - 1; i > 0; i--)
+		if (path[i] == '/')
+			fill_bloom_key(path, i, &vec->key[nr++], settings);
+
+	return vec;
+}
+
+void bloom_keyvec_free(struct bloom_keyvec *vec)
+{
+	size_t i;
+
+	if (!vec)
+		return;
+	for (i = 0; i < vec->count; i++)
+		clear_bloom_key(&vec->key[i]);
+	free(vec);
+}
+
 void add_key_to_filter(const struct bloom_key *key,
 		       struct bloom_filter *filter,
 		       const struct bloom_filter_settings *settings)
@@ -183,18 +223,160 @@ static void init_truncated_large_filter(struct bloom_filter *filter)
 	filter->len = 1;
 }
 
-struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
-						 struct commit *c,
-						 int compute_if_not_present,
-						 const struct bloom_filter_settings *settings,
-						 enum bloom_filter_computed *computed)
+struct changed_paths {
+	struct hashmap pathmap;
+	int nr;
+	int max_changes;
+};
+
+static void add_changed_path(struct diff_options *opt, const char *fullpath)
 {
-	struct bloom_filter *filter;
-	int i;
+	struct changed_paths *paths = opt->change_fn_data;
+	struct pathmap_hash_entry *e;
+	char *path;
+
+	if (++paths->nr > paths->max_changes) {
+		/*
+		 * The filter is going to be truncated anyway, so there
+		 * is no point in walking the rest of the trees.
+		 */
+		opt->flags.quick = 1;
+		opt->flags.has_changes = 1;
+		return;
+	}
+
+	/*
+	 * Add each leading directory of the changed file, i.e. for
+	 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
+	 * the Bloom filter could be used to speed up commands like
+	 * 'git log dir/subdir', too.
+	 *
+	 * Note that directories are added without the trailing '/'.
+	 */
+	path = xstrdup(fullpath);
+	do {
+		char *last_slash = strrchr(path, '/');
+
+		FLEX_ALLOC_STR(e, path, path);
+		hashmap_entry_init(&e->entry, strhash(path));
+
+		if (!hashmap_get(&paths->pathmap, &e->entry, NULL))
+			hashmap_add(&paths->pathmap, &e->entry);
+		else
+			free(e);
+
+		if (!last_slash)
+			last_slash = path;
+		*last_slash = '\0';
+
+	} while (*path);
+	free(path);
+}
+
+/*
+ * Reading the submodule configuration is not thread-safe; serialize
+ * it with the object read lock like builtin/grep.c does.
+ */
+static int changed_submodule_is_ignored(struct diff_options *opt,
+					const char *fullpath)
+{
+	int ignored;
+
+	obj_read_lock();
+	ignored = diff_submodule_is_ignored(fullpath, opt);
+	obj_read_unlock();
+	return ignored;
+}
+
+static void changed_paths_add_remove(struct diff_options *opt,
+				     int addremove UNUSED, unsigned mode,
+				     const struct object_id *oid UNUSED,
+				     int oid_valid UNUSED,
+				     const char *fullpath,
+				     unsigned dirty_submodule UNUSED)
+{
+	if (S_ISGITLINK(mode) && changed_submodule_is_ignored(opt, fullpath))
+		return;
+	add_changed_path(opt, fullpath);
+}
+
+static void changed_paths_change(struct diff_options *opt,
+				 unsigned old_mode, unsigned new_mode,
+				 const struct object_id *old_oid UNUSED,
+				 const struct object_id *new_oid UNUSED,
+				 int old_oid_valid UNUSED, int new_oid_valid UNUSED,
+				 const char *fullpath,
+				 unsigned old_dirty_submodule UNUSED,
+				 unsigned new_dirty_submodule UNUSED)
+{
+	if (S_ISGITLINK(old_mode) && S_ISGITLINK(new_mode) &&
+	    changed_submodule_is_ignored(opt, fullpath))
+		return;
+	add_changed_path(opt, fullpath);
+}
+
+enum bloom_filter_computed compute_bloom_filter(struct repository *r,
+						struct commit *c,
+						struct bloom_filter *filter,
+						const struct bloom_filter_settings *settings)
+{
+	enum bloom_filter_computed computed = BLOOM_COMPUTED;
+	struct changed_paths paths = {
+		.pathmap = HASHMAP_INIT(pathmap_cmp, NULL),
+		.max_changes = settings->max_changed_paths,
+	};
+	struct pathmap_hash_entry *e;
+	struct hashmap_iter iter;
 	struct diff_options diffopt;
 
-	if (computed)
-		*computed = BLOOM_NOT_COMPUTED;
+	/*
+	 * Collect the changed paths with our own callbacks rather than
+	 * through diff_queued_diff, so that this can run concurrently
+	 * for different commits.
+	 */
+	repo_diff_setup(r, &diffopt);
+	diffopt.flags.recursive = 1;
+	diffopt.detect_rename = 0;
+	diffopt.add_remove = changed_paths_add_remove;
+	diffopt.change = changed_paths_change;
+	diffopt.change_fn_data = &paths;
+	diff_setup_done(&diffopt);
+
+	if (c->parents)
+		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
+	else
+		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
+
+	if (paths.nr > settings->max_changed_paths ||
+	    hashmap_get_size(&paths.pathmap) > settings->max_changed_paths) {
+		init_truncated_large_filter(filter);
+		computed |= BLOOM_TRUNC_LARGE;
+		goto cleanup;
+	}
+
+	filter->len = (hashmap_get_size(&paths.pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
+	if (!filter->len) {
+		computed |= BLOOM_TRUNC_EMPTY;
+		filter->len = 1;
+	}
+	CALLOC_ARRAY(filter->data, filter->len);
+
+	hashmap_for_each_entry(&paths.pathmap, &iter, e, entry) {
+		struct bloom_key key;
+		fill_bloom_key(e->path, strlen(e->path), &key, settings);
+		add_key_to_filter(&key, filter, settings);
+		clear_bloom_key(&key);
+	}
+
+cleanup:
+	hashmap_clear_and_free(&paths.pathmap, struct pathmap_hash_entry, entry);
+	return computed;
+}
+
+struct bloom_filter *get_bloom_filter_slot(struct repository *r,
+					   struct commit *c)
+{
+	struct bloom_filter *filter;
 
 	if (!bloom_filters.slab_size)
 		return NULL;
@@ -208,100 +390,36 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						     filter, graph_pos);
 	}
 
+	return filter;
+}
+
+struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
+						 struct commit *c,
+						 int compute_if_not_present,
+						 const struct bloom_filter_settings *settings,
+						 enum bloom_filter_computed *computed)
+{
+	struct bloom_filter *filter;
+	enum bloom_filter_computed result;
+
+	if (computed)
+		*computed = BLOOM_NOT_COMPUTED;
+
+	filter = get_bloom_filter_slot(r, c);
+	if (!filter)
+		return NULL;
+
 	if (filter->data && filter->len)
 		return filter;
 	if (!compute_if_not_present)
 		return NULL;
 
-	repo_diff_setup(r, &diffopt);
-	diffopt.flags.recursive = 1;
-	diffopt.detect_rename = 0;
-	diffopt.max_changes = settings->max_changed_paths;
-	diff_setup_done(&diffopt);
-
 	/* ensure commit is parsed so we have parent information */
 	repo_parse_commit(r, c);
 
-	if (c->parents)
-		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
-	else
-		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
-
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
-		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
-		struct pathmap_hash_entry *e;
-		struct hashmap_iter iter;
-
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
-
-			/*
-			 * Add each leading directory of the changed file, i.e. for
-			 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
-			 * the Bloom filter could be used to speed up commands like
-			 * 'git log dir/subdir', too.
-			 *
-			 * Note that directories are added without the trailing '/'.
-			 */
-			do {
-				char *last_slash = strrchr(path, '/');
-
-				FLEX_ALLOC_STR(e, path, path);
-				hashmap_entry_init(&e->entry, strhash(path));
-
-				if (!hashmap_get(&pathmap, &e->entry, NULL))
-					hashmap_add(&pathmap, &e->entry);
-				else
-					free(e);
-
-				if (!last_slash)
-					last_slash = (char*)path;
-				*last_slash = '\0';
-
-			} while (*path);
-
-			diff_free_filepair(diff_queued_diff.queue[i]);
-		}
-
-		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
-			init_truncated_large_filter(filter);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
-			goto cleanup;
-		}
-
-		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
-		if (!filter->len) {
-			if (computed)
-				*computed |= BLOOM_TRUNC_EMPTY;
-			filter->len = 1;
-		}
-		CALLOC_ARRAY(filter->data, filter->len);
-
-		hashmap_for_each_entry(&pathmap, &iter, e, entry) {
-			struct bloom_key key;
-			fill_bloom_key(e->path, strlen(e->path), &key, settings);
-			add_key_to_filter(&key, filter, settings);
-			clear_bloom_key(&key);
-		}
-
-	cleanup:
-		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
-	} else {
-		for (i = 0; i < diff_queued_diff.nr; i++)
-			diff_free_filepair(diff_queued_diff.queue[i]);
-		init_truncated_large_filter(filter);
-
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
-	}
-
+	result = compute_bloom_filter(r, c, filter, settings);
 	if (computed)
-		*computed |= BLOOM_COMPUTED;
-
-	free(diff_queued_diff.queue);
-	DIFF_QUEUE_CLEAR(&diff_queued_diff);
+		*computed |= result;
 
 	return filter;
 }
@@ -325,3 +443,16 @@ int bloom_filter_contains(const struct bloom_filter *filter,
 
 	return 1;
 }
+
+int bloom_filter_contains_vec(const struct bloom_filter *filter,
+			      const struct bloom_keyvec *vec,
+			      const struct bloom_filter_settings *settings)
+{
+	int ret = 1;
+	size_t i;
+
+	for (i = 0; ret && i < vec->count; i++)
+		ret = bloom_filter_contains(filter, &vec->key[i], settings);
+
+	return ret;
+}
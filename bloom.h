@@ -68,6 +68,17 @@ struct bloom_key {
 	uint32_t *hashes;
 };
 
+/*
+ * A bloom_keyvec holds the keys of a path and of each of its leading
+ * directories, in that order. A Bloom filter that does not contain
+ * all of them proves that the path was not changed, since every
+ * changed path adds its leading directories to the filter as well.
+ */
+struct bloom_keyvec {
+	size_t count;
+	struct bloom_key key[FLEX_ARRAY];
+};
+
 /*
  * Calculate the murmur3 32-bit hash value for the given data
  * using the given seed.
@@ -83,6 +94,14 @@ void fill_bloom_key(const char *data,
 		    const struct bloom_filter_settings *settings);
 void clear_bloom_key(struct bloom_key *key);
 
+/*
+ * Create a bloom_keyvec for the 'len' bytes of 'path', which must be
+ * non-empty and must not end with a slash.
+ */
+struct bloom_keyvec *bloom_keyvec_new(const char *path, size_t len,
+				      const struct bloom_filter_settings *settings);
+void bloom_keyvec_free(struct bloom_keyvec *vec);
+
 void add_key_to_filter(const struct bloom_key *key,
 		       struct bloom_filter *filter,
 		       const struct bloom_filter_settings *settings);
@@ -102,6 +121,27 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 const struct bloom_filter_settings *settings,
 						 enum bloom_filter_computed *computed);
 
+/*
+ * Return the slot holding the Bloom filter for 'c', filling it in from
+ * the commit-graph if the commit has a filter there, or NULL if
+ * init_bloom_filters() has not been called. The slot holds no filter
+ * while its 'data' is NULL or its 'len' is zero.
+ */
+struct bloom_filter *get_bloom_filter_slot(struct repository *r,
+					   struct commit *c);
+
+/*
+ * Compute the changed-path Bloom filter of the already parsed commit
+ * 'c' into 'filter', returning BLOOM_COMPUTED possibly combined with
+ * BLOOM_TRUNC_LARGE or BLOOM_TRUNC_EMPTY. This may be called from
+ * several threads at once for different commits while
+ * enable_obj_read_lock() is in effect.
+ */
+enum bloom_filter_computed compute_bloom_filter(struct repository *r,
+						struct commit *c,
+						struct bloom_filter *filter,
+						const struct bloom_filter_settings *settings);
+
 #define get_bloom_filter(r, c) get_or_compute_bloom_filter( \
 	(r), (c), 0, NULL, NULL)
 
@@ -109,4 +149,12 @@ int bloom_filter_contains(const struct bloom_filter *filter,
 			  const struct bloom_key *key,
 			  const struct bloom_filter_settings *settings);
 
+/*
+ * Return 0 if 'filter' proves that the path of 'vec' was not changed,
+ * and non-zero otherwise.
+ */
+int bloom_filter_contains_vec(const struct bloom_filter *filter,
+			      const struct bloom_keyvec *vec,
+			      const struct bloom_filter_settings *settings);
+
 #endif
@@ -17,6 +17,9 @@
 #include "object-store.h"
 #include "promisor-remote.h"
 #include "mailmap.h"
+#include "metadata-ipc.h"
+#include "replace-object.h"
+#include "thread-utils.h"
 
 enum batch_mode {
 	BATCH_MODE_CONTENTS,
@@ -33,7 +36,9 @@ struct batch_options {
 	int unordered;
 	int transform_mode; /* may be 'w' or 'c' for --filters or --textconv */
 	int nul_terminated;
+	int nr_threads;
 	const char *format;
+	struct batch_pipeline *pipeline;
 };
 
 static const char *force_path;
@@ -86,6 +91,26 @@ static int stream_blob(const struct object_id *oid)
 	return 0;
 }
 
+/*
+ * Answer "-e", "-t" and "-s" from a running metadata--daemon, if any.
+ */
+static int cat_one_file_from_daemon(int opt, const char *obj_name)
+{
+	struct object_id oid;
+	enum object_type type;
+	unsigned long size;
+
+	if (metadata_ipc_get_oid(the_repository, obj_name, &oid) ||
+	    metadata_ipc_object_info(the_repository, &oid, &type, &size))
+		return -1;
+
+	if (opt == 't')
+		printf("%s\n", type_name(type));
+	else if (opt == 's')
+		printf("%"PRIuMAX"\n", (uintmax_t)size);
+	return 0;
+}
+
 static int cat_one_file(int opt, const char *exp_type, const char *obj_name,
 			int unknown_type)
 {
@@ -106,6 +131,9 @@ static int cat_one_file(int opt, const char *exp_type, const char *obj_name,
 
 	if (unknown_type)
 		flags |= OBJECT_INFO_ALLOW_UNKNOWN_TYPE;
+	else if ((opt == 'e' || opt == 't' || opt == 's') &&
+		 !cat_one_file_from_daemon(opt, obj_name))
+		return 0;
 
 	if (get_oid_with_context(the_repository, obj_name, get_oid_flags, &oid,
 				 &obj_context))
@@ -344,6 +372,34 @@ static void batch_write(struct batch_options *opt, const void *data, int len)
 		write_or_die(1, data, len);
 }
 
+/*
+ * Write out the "contents" of an object that were read in one go, and
+ * free them. Blobs are written as-is.
+ */
+static void write_object_contents(struct batch_options *opt,
+				  struct expand_data *data,
+				  void *contents, enum object_type type,
+				  unsigned long size)
+{
+	const struct object_id *oid = &data->oid;
+
+	if (use_mailmap && data->type != OBJ_BLOB) {
+		size_t s = size;
+		contents = replace_idents_using_mailmap(contents, &s);
+		size = cast_size_t_to_ulong(s);
+	}
+
+	if (!contents)
+		die("object %s disappeared", oid_to_hex(oid));
+	if (type != data->type)
+		die("object %s changed type!?", oid_to_hex(oid));
+	if (data->info.sizep && size != data->size && !use_mailmap)
+		die("object %s changed size!?", oid_to_hex(oid));
+
+	batch_write(opt, contents, size);
+	free(contents);
+}
+
 static void print_object_or_die(struct batch_options *opt, struct expand_data *data)
 {
 	const struct object_id *oid = &data->oid;
@@ -390,22 +446,7 @@ static void print_object_or_die(struct batch_options *opt, struct expand_data *d
 		void *contents;
 
 		contents = read_object_file(oid, &type, &size);
-
-		if (use_mailmap) {
-			size_t s = size;
-			contents = replace_idents_using_mailmap(contents, &s);
-			size = cast_size_t_to_ulong(s);
-		}
-
-		if (!contents)
-			die("object %s disappeared", oid_to_hex(oid));
-		if (type != data->type)
-			die("object %s changed type!?", oid_to_hex(oid));
-		if (data->info.sizep && size != data->size && !use_mailmap)
-			die("object %s changed size!?", oid_to_hex(oid));
-
-		batch_write(opt, contents, size);
-		free(contents);
+		write_object_contents(opt, data, contents, type, size);
 	}
 }
 
@@ -416,6 +457,27 @@ static void print_default_format(struct strbuf *scratch, struct expand_data *dat
 		    (uintmax_t)data->size);
 }
 
+static void print_missing(const char *obj_name, struct expand_data *data)
+{
+	printf("%s missing\n", obj_name ? obj_name : oid_to_hex(&data->oid));
+	fflush(stdout);
+}
+
+static void print_header(struct strbuf *scratch, struct batch_options *opt,
+			 struct expand_data *data)
+{
+	strbuf_reset(scratch);
+
+	if (!opt->format) {
+		print_default_format(scratch, data);
+	} else {
+		strbuf_expand(scratch, opt->format, expand_format, data);
+		strbuf_addch(scratch, '\n');
+	}
+
+	batch_write(opt, scratch->buf, scratch->len);
+}
+
 /*
  * If "pack" is non-NULL, then "offset" is the byte offset within the pack from
  * which the object may be accessed (though note that we may also rely on
@@ -439,28 +501,264 @@ static void batch_object_write(const char *obj_name,
 						       &data->oid, &data->info,
 						       OBJECT_INFO_LOOKUP_REPLACE);
 		if (ret < 0) {
-			printf("%s missing\n",
-			       obj_name ? obj_name : oid_to_hex(&data->oid));
-			fflush(stdout);
+			print_missing(obj_name, data);
 			return;
 		}
 	}
 
-	strbuf_reset(scratch);
+	print_header(scratch, opt, data);
 
-	if (!opt->format) {
-		print_default_format(scratch, data);
+	if (opt->batch_mode == BATCH_MODE_CONTENTS) {
+		print_object_or_die(opt, data);
+		batch_write(opt, "\n", 1);
+	}
+}
+
+/*
+ * With --threads, objects are looked up and read by a pool of worker
+ * threads while the main thread resolves the names that are read from
+ * the input, and writes out the results in the order they were asked
+ * for. Up to "window" objects are in flight at any time.
+ */
+struct batch_job {
+	struct expand_data data;
+	char *obj_name;
+	char *rest;
+	struct packed_git *pack;
+	off_t offset;
+
+	/* filled in by the worker */
+	void *contents;
+	enum object_type contents_type;
+	unsigned long contents_size;
+	unsigned missing : 1;
+	unsigned done : 1;
+};
+
+struct batch_pipeline {
+	struct batch_options *opt;
+	struct strbuf *scratch;
+
+	struct batch_job *jobs;
+	size_t window;
+
+	/* number of jobs queued, picked up by a worker, and written out */
+	size_t queued, started, written;
+	int quit;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	pthread_t *threads;
+	int nr_threads;
+};
+
+static void copy_expand_data(struct expand_data *dst,
+			     const struct expand_data *src)
+{
+	*dst = *src;
+	if (src->info.typep)
+		dst->info.typep = &dst->type;
+	if (src->info.sizep)
+		dst->info.sizep = &dst->size;
+	if (src->info.disk_sizep)
+		dst->info.disk_sizep = &dst->disk_size;
+	if (src->info.delta_base_oid)
+		dst->info.delta_base_oid = &dst->delta_base_oid;
+}
+
+static void batch_job_run(struct batch_options *opt, struct batch_job *job)
+{
+	struct expand_data *data = &job->data;
+
+	if (!data->skip_object_info) {
+		int ret;
+
+		if (job->pack) {
+			obj_read_lock();
+			ret = packed_object_info(the_repository, job->pack,
+						 job->offset, &data->info);
+			obj_read_unlock();
+		} else {
+			ret = oid_object_info_extended(the_repository,
+						       &data->oid, &data->info,
+						       OBJECT_INFO_LOOKUP_REPLACE);
+		}
+		if (ret < 0) {
+			job->missing = 1;
+			return;
+		}
+	}
+
+	if (opt->batch_mode != BATCH_MODE_CONTENTS)
+		return;
+
+	/*
+	 * Blobs that are to be converted, or are big enough to be
+	 * streamed, are left to print_object_or_die() on the main thread.
+	 */
+	if (data->type == OBJ_BLOB &&
+	    (opt->transform_mode || data->size > big_file_threshold))
+		return;
+
+	job->contents = read_object_file(&data->oid, &job->contents_type,
+					 &job->contents_size);
+}
+
+static void *batch_pipeline_worker(void *vdata)
+{
+	struct batch_pipeline *p = vdata;
+
+	while (1) {
+		struct batch_job *job;
+
+		pthread_mutex_lock(&p->mutex);
+		while (!p->quit && p->started == p->queued)
+			pthread_cond_wait(&p->work_cond, &p->mutex);
+		if (p->started == p->queued) {
+			pthread_mutex_unlock(&p->mutex);
+			break;
+		}
+		job = &p->jobs[p->started++ % p->window];
+		pthread_mutex_unlock(&p->mutex);
+
+		batch_job_run(p->opt, job);
+
+		pthread_mutex_lock(&p->mutex);
+		job->done = 1;
+		pthread_cond_broadcast(&p->done_cond);
+		pthread_mutex_unlock(&p->mutex);
+	}
+	return NULL;
+}
+
+static void batch_pipeline_write_one(struct batch_pipeline *p)
+{
+	struct batch_options *opt = p->opt;
+	struct batch_job *job = &p->jobs[p->written % p->window];
+
+	pthread_mutex_lock(&p->mutex);
+	while (!job->done)
+		pthread_cond_wait(&p->done_cond, &p->mutex);
+	pthread_mutex_unlock(&p->mutex);
+
+	if (job->missing) {
+		print_missing(job->obj_name, &job->data);
 	} else {
-		strbuf_expand(scratch, opt->format, expand_format, data);
-		strbuf_addch(scratch, '\n');
+		print_header(p->scratch, opt, &job->data);
+		if (opt->batch_mode == BATCH_MODE_CONTENTS) {
+			if (job->contents)
+				write_object_contents(opt, &job->data,
+						      job->contents,
+						      job->contents_type,
+						      job->contents_size);
+			else {
+				/*
+				 * Streaming and conversion read the
+				 * object store without taking the lock.
+				 */
+				obj_read_lock();
+				print_object_or_die(opt, &job->data);
+				obj_read_unlock();
+			}
+			batch_write(opt, "\n", 1);
+		}
 	}
 
-	batch_write(opt, scratch->buf, scratch->len);
+	FREE_AND_NULL(job->obj_name);
+	FREE_AND_NULL(job->rest);
+	p->written++;
+}
 
-	if (opt->batch_mode == BATCH_MODE_CONTENTS) {
-		print_object_or_die(opt, data);
-		batch_write(opt, "\n", 1);
+static void batch_pipeline_drain(struct batch_pipeline *p)
+{
+	while (p->written < p->queued)
+		batch_pipeline_write_one(p);
+}
+
+static void batch_pipeline_add(struct batch_pipeline *p,
+			       const char *obj_name,
+			       struct expand_data *data,
+			       struct packed_git *pack, off_t offset)
+{
+	struct batch_job *job;
+
+	if (p->queued - p->written == p->window)
+		batch_pipeline_write_one(p);
+
+	job = &p->jobs[p->queued % p->window];
+	copy_expand_data(&job->data, data);
+	job->obj_name = xstrdup_or_null(obj_name);
+	job->rest = xstrdup_or_null(data->rest);
+	job->data.rest = job->rest;
+	job->pack = pack;
+	job->offset = offset;
+	job->contents = NULL;
+	job->missing = 0;
+	job->done = 0;
+
+	pthread_mutex_lock(&p->mutex);
+	p->queued++;
+	pthread_cond_signal(&p->work_cond);
+	pthread_mutex_unlock(&p->mutex);
+}
+
+static void batch_pipeline_start(struct batch_options *opt,
+				 struct strbuf *scratch)
+{
+	struct batch_pipeline *p;
+	int i;
+
+	CALLOC_ARRAY(p, 1);
+	p->opt = opt;
+	p->scratch = scratch;
+	p->nr_threads = opt->nr_threads;
+	p->window = 16 * p->nr_threads;
+	CALLOC_ARRAY(p->jobs, p->window);
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->work_cond, NULL);
+	pthread_cond_init(&p->done_cond, NULL);
+
+	/* the workers must not race to set these up */
+	if (read_replace_refs)
+		prepare_replace_object(the_repository);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(p->threads, p->nr_threads);
+	for (i = 0; i < p->nr_threads; i++) {
+		int err = pthread_create(&p->threads[i], NULL,
+					 batch_pipeline_worker, p);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
 	}
+	opt->pipeline = p;
+}
+
+static void batch_pipeline_finish(struct batch_options *opt)
+{
+	struct batch_pipeline *p = opt->pipeline;
+	int i;
+
+	if (!p)
+		return;
+
+	batch_pipeline_drain(p);
+	pthread_mutex_lock(&p->mutex);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->work_cond);
+	pthread_mutex_unlock(&p->mutex);
+	for (i = 0; i < p->nr_threads; i++)
+		pthread_join(p->threads[i], NULL);
+	disable_obj_read_lock();
+
+	pthread_cond_destroy(&p->done_cond);
+	pthread_cond_destroy(&p->work_cond);
+	pthread_mutex_destroy(&p->mutex);
+	free(p->threads);
+	free(p->jobs);
+	free(p);
+	opt->pipeline = NULL;
 }
 
 static void batch_one_object(const char *obj_name,
@@ -472,8 +770,17 @@ static void batch_one_object(const char *obj_name,
 	int flags = opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0;
 	enum get_oid_result result;
 
+	if (opt->pipeline)
+		obj_read_lock();
 	result = get_oid_with_context(the_repository, obj_name,
 				      flags, &data->oid, &ctx);
+	if (opt->pipeline)
+		obj_read_unlock();
+
+	/* what we print below must come after what is still in flight */
+	if ((result != FOUND || !ctx.mode) && opt->pipeline)
+		batch_pipeline_drain(opt->pipeline);
+
 	if (result != FOUND) {
 		switch (result) {
 		case MISSING_OBJECT:
@@ -511,7 +818,10 @@ static void batch_one_object(const char *obj_name,
 		return;
 	}
 
-	batch_object_write(obj_name, scratch, opt, data, NULL, 0);
+	if (opt->pipeline)
+		batch_pipeline_add(opt->pipeline, obj_name, data, NULL, 0);
+	else
+		batch_object_write(obj_name, scratch, opt, data, NULL, 0);
 }
 
 struct object_cb_data {
@@ -525,8 +835,12 @@ static int batch_object_cb(const struct object_id *oid, void *vdata)
 {
 	struct object_cb_data *data = vdata;
 	oidcpy(&data->expand->oid, oid);
-	batch_object_write(NULL, data->scratch, data->opt, data->expand,
-			   NULL, 0);
+	if (data->opt->pipeline)
+		batch_pipeline_add(data->opt->pipeline, NULL, data->expand,
+				   NULL, 0);
+	else
+		batch_object_write(NULL, data->scratch, data->opt,
+				   data->expand, NULL, 0);
 	return 0;
 }
 
@@ -557,8 +871,12 @@ static int batch_unordered_object(const struct object_id *oid,
 		return 0;
 
 	oidcpy(&data->expand->oid, oid);
-	batch_object_write(NULL, data->scratch, data->opt, data->expand,
-			   pack, offset);
+	if (data->opt->pipeline)
+		batch_pipeline_add(data->opt->pipeline, NULL, data->expand,
+				   pack, offset);
+	else
+		batch_object_write(NULL, data->scratch, data->opt,
+				   data->expand, pack, offset);
 	return 0;
 }
 
@@ -752,6 +1070,19 @@ static int batch_objects(struct batch_options *opt)
 	if (opt->batch_mode == BATCH_MODE_CONTENTS)
 		data.info.typep = &data.type;
 
+	/*
+	 * Reading requests ahead would keep a caller that waits for each
+	 * answer before asking the next question waiting forever, so
+	 * only use threads when the output is buffered anyway.
+	 */
+	if (opt->nr_threads > 1 && opt->buffer_output &&
+	    opt->batch_mode != BATCH_MODE_QUEUE_AND_DISPATCH) {
+		/* the workers need to know what they may stream */
+		if (opt->batch_mode == BATCH_MODE_CONTENTS)
+			data.info.sizep = &data.size;
+		batch_pipeline_start(opt, &output);
+	}
+
 	if (opt->all_objects) {
 		struct object_cb_data cb;
 		struct object_info empty = OBJECT_INFO_INIT;
@@ -789,6 +1120,7 @@ static int batch_objects(struct batch_options *opt)
 			oid_array_clear(&sa);
 		}
 
+		batch_pipeline_finish(opt);
 		strbuf_release(&output);
 		return 0;
 	}
@@ -836,6 +1168,7 @@ static int batch_objects(struct batch_options *opt)
 	}
 
  cleanup:
+	batch_pipeline_finish(opt);
 	strbuf_release(&input);
 	strbuf_release(&output);
 	warn_on_object_refname_ambiguity = save_warning;
@@ -893,7 +1226,7 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 		N_("git cat-file (-t | -s) [--allow-unknown-type] <object>"),
 		N_("git cat-file (--batch | --batch-check | --batch-command) [--batch-all-objects]\n"
 		   "             [--buffer] [--follow-symlinks] [--unordered]\n"
-		   "             [--textconv | --filters] [-z]"),
+		   "             [--textconv | --filters] [-z] [--threads=<n>]"),
 		N_("git cat-file (--textconv | --filters)\n"
 		   "             [<rev>:<path|tree-ish> | --path=<path|tree-ish> <rev>]"),
 		NULL
@@ -936,6 +1269,8 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 			 N_("follow in-tree symlinks")),
 		OPT_BOOL(0, "unordered", &batch.unordered,
 			 N_("do not order objects before emitting them")),
+		OPT_INTEGER(0, "threads", &batch.nr_threads,
+			    N_("read objects with <n> threads when buffering output")),
 		/* Textconv options, stand-ole*/
 		OPT_GROUP(N_("Emit object (blob or tree) with conversion or filter (stand-alone, or with batch)")),
 		OPT_CMDMODE(0, "textconv", &opt,
@@ -950,6 +1285,7 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 	git_config(git_cat_file_config, NULL);
 
 	batch.buffer_output = -1;
+	batch.nr_threads = 1;
 
 	argc = parse_options(argc, argv, prefix, options, usage, 0);
 	opt_cw = (opt == 'c' || opt == 'w');
@@ -984,6 +1320,19 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 	else if (batch.nul_terminated)
 		usage_msg_optf(_("'%s' requires a batch mode"), usage, options,
 			       "-z");
+	else if (batch.nr_threads != 1)
+		usage_msg_optf(_("'%s' requires a batch mode"), usage, options,
+			       "--threads");
+
+	if (batch.nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"),
+		    batch.nr_threads);
+	if (!batch.nr_threads)
+		batch.nr_threads = online_cpus();
+	if (!HAVE_THREADS && batch.nr_threads != 1) {
+		warning(_("no threads support, ignoring %s"), "--threads");
+		batch.nr_threads = 1;
+	}
 
 	/* Batch defaults */
 	if (batch.buffer_output < 0)
@@ -62,6 +62,7 @@ static char *remote_name = NULL;
 static char *option_branch = NULL;
 static struct string_list option_not = STRING_LIST_INIT_NODUP;
 static const char *real_git_dir;
+static const char *option_ref_format;
 static char *option_upload_pack = "git-upload-pack";
 static int option_verbosity;
 static int option_progress = -1;
@@ -147,6 +148,8 @@ static struct option builtin_clone_options[] = {
 		    N_("any cloned submodules will be shallow")),
 	OPT_STRING(0, "separate-git-dir", &real_git_dir, N_("gitdir"),
 		   N_("separate git dir from working tree")),
+	OPT_STRING(0, "ref-format", &option_ref_format, N_("format"),
+		   N_("specify the reference format to use")),
 	OPT_STRING_LIST('c', "config", &option_config, N_("key=value"),
 			N_("set config inside the new repository")),
 	OPT_STRING_LIST(0, "server-option", &server_options,
@@ -908,6 +911,8 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 	int err = 0, complete_refs_before_fetch = 1;
 	int submodule_progress;
 	int filter_submodules = 0;
+	enum ref_storage_format ref_storage_format = REF_STORAGE_FORMAT_UNKNOWN;
+	int have_refdb = 0;
 
 	struct transport_ls_refs_options transport_ls_refs_options =
 		TRANSPORT_LS_REFS_OPTIONS_INIT;
@@ -1074,8 +1079,24 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		}
 	}
 
-	init_db(git_dir, real_git_dir, option_template, GIT_HASH_UNKNOWN, NULL,
-		INIT_DB_QUIET);
+	if (option_ref_format) {
+		ref_storage_format = ref_storage_format_by_name(option_ref_format);
+		if (ref_storage_format == REF_STORAGE_FORMAT_UNKNOWN)
+			die(_("unknown ref storage format '%s'"), option_ref_format);
+	}
+
+	init_db(git_dir, real_git_dir, option_template, GIT_HASH_UNKNOWN,
+		ref_storage_format, NULL, INIT_DB_QUIET | INIT_DB_SKIP_REFDB);
+
+	/*
+	 * The reftable backend records the object format in its tables,
+	 * so its reference database has to wait until we know which
+	 * format the remote uses.
+	 */
+	if (the_repository->ref_storage_format == REF_STORAGE_FORMAT_FILES) {
+		create_reference_database(NULL, 1);
+		have_refdb = 1;
+	}
 
 	if (real_git_dir) {
 		free((char *)git_dir);
@@ -1248,6 +1269,10 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 	 * data from the --bundle-uri option.
 	 */
 	if (bundle_uri) {
+		if (!have_refdb) {
+			create_reference_database(NULL, 1);
+			have_refdb = 1;
+		}
 		/* At this point, we need the_repository to match the cloned repo. */
 		if (repo_init(the_repository, git_dir, work_tree))
 			warning(_("failed to initialize the repo, skipping bundle URI"));
@@ -1278,7 +1303,8 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		 * Now that we know what algorithm the remote side is using,
 		 * let's set ours to the same thing.
 		 */
-		initialize_repository_version(hash_algo, 1);
+		initialize_repository_version(hash_algo,
+					      the_repository->ref_storage_format, 1);
 		repo_set_hash_algo(the_repository, hash_algo);
 		/*
 		 * transport_get_remote_refs() may return refs with null sha-1
@@ -1302,6 +1328,11 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		}
 	}
 
+	if (!have_refdb) {
+		create_reference_database(NULL, 1);
+		have_refdb = 1;
+	}
+
 	remote_head = find_ref_by_name(refs, "HEAD");
 	remote_head_points_at = guess_remote_head(remote_head, mapped_refs, 0);
 
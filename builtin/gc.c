@@ -32,6 +32,7 @@
 #include "remote.h"
 #include "exec-cmd.h"
 #include "hook.h"
+#include "merge-ort.h"
 
 #define FAILED_RUN "failed to run %s"
 
@@ -52,6 +53,9 @@ static timestamp_t gc_log_expire_time;
 static const char *gc_log_expire = "1.day.ago";
 static const char *prune_expire = "2.weeks.ago";
 static const char *prune_worktrees_expire = "3.months.ago";
+static const char *merge_renames_expire = "2.weeks.ago";
+static timestamp_t merge_renames_expire_time;
+static int prune_threads = 1;
 static unsigned long big_pack_threshold;
 static unsigned long max_delta_cache_size = DEFAULT_DELTA_CACHE_SIZE;
 
@@ -156,6 +160,8 @@ static void gc_config(void)
 	git_config_get_bool("gc.cruftpacks", &cruft_packs);
 	git_config_get_expiry("gc.pruneexpire", &prune_expire);
 	git_config_get_expiry("gc.worktreepruneexpire", &prune_worktrees_expire);
+	git_config_get_expiry("gc.mergerenamesexpire", &merge_renames_expire);
+	git_config_get_int("gc.prunethreads", &prune_threads);
 	git_config_get_expiry("gc.logexpiry", &gc_log_expire);
 
 	git_config_get_ulong("gc.bigpackthreshold", &big_pack_threshold);
@@ -590,6 +596,10 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 	gc_config();
 	if (parse_expiry_date(gc_log_expire, &gc_log_expire_time))
 		die(_("failed to parse gc.logExpiry value %s"), gc_log_expire);
+	if (merge_renames_expire &&
+	    parse_expiry_date(merge_renames_expire, &merge_renames_expire_time))
+		die(_("failed to parse gc.mergeRenamesExpire value %s"),
+		    merge_renames_expire);
 
 	if (pack_refs < 0)
 		pack_refs = !is_bare_repository();
@@ -702,6 +712,9 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 			if (has_promisor_remote())
 				strvec_push(&prune,
 					    "--exclude-promisor-objects");
+			if (prune_threads != 1)
+				strvec_pushf(&prune, "--threads=%d",
+					     prune_threads);
 			prune_cmd.git_cmd = 1;
 			strvec_pushv(&prune_cmd.args, prune.v);
 			if (run_command(&prune_cmd))
@@ -724,6 +737,10 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 	if (run_command(&rerere_cmd))
 		die(FAILED_RUN, rerere.v[0]);
 
+	if (merge_renames_expire)
+		merge_prune_rename_cache(the_repository,
+					 merge_renames_expire_time);
+
 	report_garbage = report_pack_garbage;
 	reprepare_packed_git(the_repository);
 	if (pack_garbage.nr > 0) {
@@ -1212,6 +1229,69 @@ static int maintenance_task_incremental_repack(struct maintenance_run_opts *opts
 	return 0;
 }
 
+static int geometric_repack_auto_condition(void)
+{
+	struct packed_git *p;
+	int geometric_repack_auto_limit = 10;
+	int count = 0;
+
+	prepare_repo_settings(the_repository);
+	if (!the_repository->settings.core_multi_pack_index)
+		return 0;
+
+	git_config_get_int("maintenance.geometric-repack.auto",
+			   &geometric_repack_auto_limit);
+
+	if (!geometric_repack_auto_limit)
+		return 0;
+	if (geometric_repack_auto_limit < 0)
+		return 1;
+
+	/*
+	 * Packs that are not yet covered by the multi-pack-index are
+	 * also not covered by its reachability bitmap; count those
+	 * (typically one per push) to decide whether it is time to roll
+	 * them up.
+	 */
+	for (p = get_packed_git(the_repository);
+	     count < geometric_repack_auto_limit && p;
+	     p = p->next) {
+		if (p->pack_local && !p->pack_keep && !p->multi_pack_index)
+			count++;
+	}
+
+	return count >= geometric_repack_auto_limit;
+}
+
+static int maintenance_task_geometric_repack(struct maintenance_run_opts *opts)
+{
+	struct child_process child = CHILD_PROCESS_INIT;
+	int factor = 2;
+
+	prepare_repo_settings(the_repository);
+	if (!the_repository->settings.core_multi_pack_index) {
+		warning(_("skipping geometric-repack task because core.multiPackIndex is disabled"));
+		return 0;
+	}
+
+	git_config_get_int("maintenance.geometric-repack.splitFactor", &factor);
+	if (factor < 2)
+		factor = 2;
+
+	child.git_cmd = child.close_object_store = 1;
+	strvec_pushl(&child.args, "repack", "-d", "-l",
+		     "--write-midx", "--write-bitmap-index", NULL);
+	strvec_pushf(&child.args, "--geometric=%d", factor);
+
+	if (opts->quiet)
+		strvec_push(&child.args, "--quiet");
+
+	if (run_command(&child))
+		return error(_("'git repack --geometric' failed"));
+
+	return 0;
+}
+
 typedef int maintenance_task_fn(struct maintenance_run_opts *opts);
 
 /*
@@ -1237,6 +1317,7 @@ enum maintenance_task_label {
 	TASK_PREFETCH,
 	TASK_LOOSE_OBJECTS,
 	TASK_INCREMENTAL_REPACK,
+	TASK_GEOMETRIC_REPACK,
 	TASK_GC,
 	TASK_COMMIT_GRAPH,
 	TASK_PACK_REFS,
@@ -1260,6 +1341,11 @@ static struct maintenance_task tasks[] = {
 		maintenance_task_incremental_repack,
 		incremental_repack_auto_condition,
 	},
+	[TASK_GEOMETRIC_REPACK] = {
+		"geometric-repack",
+		maintenance_task_geometric_repack,
+		geometric_repack_auto_condition,
+	},
 	[TASK_GC] = {
 		"gc",
 		maintenance_task_gc,
@@ -24,6 +24,9 @@
 #include "submodule-config.h"
 #include "object-store.h"
 #include "packfile.h"
+#include "oid-array.h"
+#include "sparse-index.h"
+#include "trigram-index.h"
 
 static const char *grep_prefix;
 
@@ -36,6 +39,9 @@ static int recurse_submodules;
 
 static int num_threads;
 
+static int use_trigram_index = 1;
+static struct trigram_index *trigram_index;
+
 static pthread_t *threads;
 
 /* We use one producer thread and THREADS consumer
@@ -307,6 +313,9 @@ static int grep_cmd_config(const char *var, const char *value, void *cb)
 	if (!strcmp(var, "submodule.recurse"))
 		recurse_submodules = git_config_bool(var, value);
 
+	if (!strcmp(var, "grep.usetrigramindex"))
+		use_trigram_index = git_config_bool(var, value);
+
 	return st;
 }
 
@@ -349,6 +358,10 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 	struct strbuf pathbuf = STRBUF_INIT;
 	struct grep_source gs;
 
+	if (trigram_index && opt->repo == the_repository &&
+	    !trigram_index_may_match(trigram_index, oid))
+		return 0;
+
 	grep_source_name(opt, filename, tree_name_len, &pathbuf);
 	grep_source_init_oid(&gs, pathbuf.buf, path, oid, opt->repo);
 	strbuf_release(&pathbuf);
@@ -867,6 +880,95 @@ static int pattern_callback(const struct option *opt, const char *arg,
 	return 0;
 }
 
+static int is_literal(const char *pattern, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (is_regex_special(pattern[i]))
+			return 0;
+	return 1;
+}
+
+static void setup_trigram_index(struct grep_opt *opt)
+{
+	struct grep_pat *p;
+
+	/*
+	 * The trigram index can only rule out blobs when we look for
+	 * any of a set of literal strings, case-sensitively, in the
+	 * raw contents of blobs.
+	 */
+	if (opt->invert || opt->unmatch_name_only || opt->all_match ||
+	    opt->ignore_case || opt->allow_textconv)
+		return;
+	for (p = opt->pattern_list; p; p = p->next) {
+		if (p->token != GREP_PATTERN)
+			return;
+		if (opt->pattern_type_option != GREP_PATTERN_TYPE_FIXED &&
+		    !is_literal(p->pattern, p->patternlen))
+			return;
+	}
+
+	trigram_index = load_trigram_index(the_repository);
+	if (!trigram_index)
+		return;
+	for (p = opt->pattern_list; p; p = p->next)
+		trigram_index_add_literal(trigram_index,
+					  p->pattern, p->patternlen);
+}
+
+static int collect_trigram_blob(const struct object_id *oid,
+				struct strbuf *base UNUSED,
+				const char *pathname UNUSED,
+				unsigned mode, void *context)
+{
+	if (S_ISDIR(mode))
+		return READ_TREE_RECURSIVE;
+	if (S_ISREG(mode))
+		oid_array_append(context, oid);
+	return 0;
+}
+
+static int grep_write_trigram_index(int argc, const char **argv)
+{
+	struct oid_array blobs = OID_ARRAY_INIT;
+	struct index_state *istate = the_repository->index;
+	struct pathspec pathspec;
+	int i, ret;
+
+	if (!startup_info->have_repository)
+		die(_("--write-trigram-index requires a repository"));
+
+	if (repo_read_index(the_repository) < 0)
+		die(_("index file corrupt"));
+	ensure_full_index(istate);
+	for (i = 0; i < istate->cache_nr; i++) {
+		const struct cache_entry *ce = istate->cache[i];
+
+		if (!ce_stage(ce) && S_ISREG(ce->ce_mode))
+			oid_array_append(&blobs, &ce->oid);
+	}
+
+	memset(&pathspec, 0, sizeof(pathspec));
+	for (i = 0; i < argc; i++) {
+		struct object_id oid;
+		struct tree *tree;
+
+		if (get_oid(argv[i], &oid))
+			die(_("unable to resolve revision: %s"), argv[i]);
+		tree = parse_tree_indirect(&oid);
+		if (!tree)
+			die(_("not a tree object: %s"), argv[i]);
+		read_tree(the_repository, tree, &pathspec,
+			  collect_trigram_blob, &blobs);
+	}
+
+	ret = write_trigram_index(the_repository, &blobs, isatty(2));
+	oid_array_clear(&blobs);
+	return !!ret;
+}
+
 int cmd_grep(int argc, const char **argv, const char *prefix)
 {
 	int hit = 0;
@@ -882,6 +984,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	int dummy;
 	int use_index = 1;
 	int allow_revs;
+	int write_index = 0;
 
 	struct option options[] = {
 		OPT_BOOL(0, "cached", &cached,
@@ -894,6 +997,8 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 			    N_("ignore files specified via '.gitignore'"), 1),
 		OPT_BOOL(0, "recurse-submodules", &recurse_submodules,
 			 N_("recursively search in each submodule")),
+		OPT_BOOL(0, "write-trigram-index", &write_index,
+			 N_("write a trigram index of tracked blobs and exit")),
 		OPT_GROUP(""),
 		OPT_BOOL('v', "invert-match", &opt.invert,
 			N_("show non-matching lines")),
@@ -1038,6 +1143,9 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	if (!use_index)
 		recurse_submodules = 0;
 
+	if (write_index)
+		return grep_write_trigram_index(argc, argv);
+
 	/*
 	 * skip a -- separator; we know it cannot be
 	 * separating revisions from pathnames if
@@ -1222,6 +1330,9 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 				  untracked, "--untracked",
 				  cached, "--cached");
 
+	if (use_index && !untracked && use_trigram_index)
+		setup_trigram_index(&opt);
+
 	if (!use_index || untracked) {
 		int use_exclude = (opt_exclude < 0) ? use_index : !!opt_exclude;
 		hit = grep_directory(&opt, &pathspec, use_exclude, use_index);
@@ -1246,6 +1357,7 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 	clear_pathspec(&pathspec);
 	string_list_clear(&path_list, 0);
 	free_grep_patterns(&opt);
+	free_trigram_index(trigram_index);
 	object_array_clear(&list);
 	free_repos();
 	return !hit;
@@ -8,6 +8,8 @@
 #include "parse-options.h"
 #include "repository.h"
 #include "commit-reach.h"
+#include "metadata-ipc.h"
+#include "oid-array.h"
 
 static int show_merge_base(struct commit **rev, int rev_nr, int show_all)
 {
@@ -28,6 +30,29 @@ static int show_merge_base(struct commit **rev, int rev_nr, int show_all)
 	return 0;
 }
 
+/*
+ * The common case of two commits and no options may be answered by a
+ * running metadata--daemon, which already has the commits loaded.
+ */
+static int show_merge_base_from_daemon(const char *one, const char *two,
+				       int show_all, int *ret)
+{
+	struct oid_array bases = OID_ARRAY_INIT;
+	size_t i;
+
+	if (metadata_ipc_merge_bases(the_repository, one, two, &bases))
+		return -1;
+
+	for (i = 0; i < bases.nr; i++) {
+		printf("%s\n", oid_to_hex(&bases.oid[i]));
+		if (!show_all)
+			break;
+	}
+	*ret = !bases.nr;
+	oid_array_clear(&bases);
+	return 0;
+}
+
 static const char * const merge_base_usage[] = {
 	N_("git merge-base [-a | --all] <commit> <commit>..."),
 	N_("git merge-base [-a | --all] --octopus <commit>..."),
@@ -184,6 +209,10 @@ int cmd_merge_base(int argc, const char **argv, const char *prefix)
 	if (argc < 2)
 		usage_with_options(merge_base_usage, options);
 
+	if (argc == 2 &&
+	    !show_merge_base_from_daemon(argv[0], argv[1], show_all, &ret))
+		return ret;
+
 	ALLOC_ARRAY(rev, argc);
 	while (argc-- > 0)
 		rev[rev_nr++] = get_commit_reference(*argv++);
@@ -0,0 +1,343 @@
+#include "builtin.h"
+#include "config.h"
+#include "parse-options.h"
+#include "commit.h"
+#include "commit-graph.h"
+#include "commit-reach.h"
+#include "exec-cmd.h"
+#include "metadata-ipc.h"
+#include "object-store.h"
+#include "packfile.h"
+#include "run-command.h"
+#include "shallow.h"
+#include "simple-ipc.h"
+#include "trace2.h"
+
+static const char * const builtin_metadata__daemon_usage[] = {
+	N_("git metadata--daemon start [<options>]"),
+	N_("git metadata--daemon run [<options>]"),
+	"git metadata--daemon stop",
+	"git metadata--daemon status",
+	NULL
+};
+
+#ifdef SUPPORTS_SIMPLE_IPC
+
+static int ipc_threads = 4;
+static int start_timeout_sec = 60;
+
+struct metadata_daemon_state {
+	/*
+	 * The object store, the refs code and the parsed object pool are
+	 * not thread-safe, so requests are answered one at a time.
+	 */
+	pthread_mutex_t mutex;
+
+	/* set when the daemon must restart to drop removed packs */
+	int restart;
+};
+
+/*
+ * Objects in packs that appeared since we last looked are found without
+ * our help, as a failed lookup rescans the pack directory. Packs cannot
+ * be dropped from the list of packs, though, and the objects they held
+ * may be gone for good, so when one disappears we ask the daemon to
+ * restart itself instead.
+ */
+static int check_packs(void)
+{
+	struct packed_git *p;
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		if (p->pack_local && access(p->pack_name, F_OK))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Abbreviated object names are resolved against caches of the object
+ * directories that are never refreshed; leave them to the client.
+ */
+static int is_abbreviated_oid(const char *name)
+{
+	size_t len = strspn(name, "0123456789abcdefABCDEF");
+
+	return !name[len] && len < the_hash_algo->hexsz;
+}
+
+static int resolve_name(const char *name, struct object_id *oid)
+{
+	if (is_abbreviated_oid(name))
+		return -1;
+	return repo_get_oid(the_repository, name, oid);
+}
+
+static void answer_get_oid(const char *name, struct strbuf *answer)
+{
+	struct object_id oid;
+
+	if (resolve_name(name, &oid))
+		return;
+	strbuf_addf(answer, "ok %s", oid_to_hex(&oid));
+}
+
+static void answer_object_info(const char *hex, struct strbuf *answer)
+{
+	struct object_id oid;
+	enum object_type type;
+	unsigned long size;
+	struct object_info oi = OBJECT_INFO_INIT;
+
+	if (get_oid_hex(hex, &oid))
+		return;
+	oi.typep = &type;
+	oi.sizep = &size;
+	if (oid_object_info_extended(the_repository, &oid, &oi, 0) < 0)
+		return;
+	strbuf_addf(answer, "ok %s %lu", type_name(type), size);
+}
+
+static void answer_merge_base(const char *args, struct strbuf *answer)
+{
+	const char *sp = strchr(args, ' ');
+	char *one;
+	struct object_id oid;
+	struct commit *c1, *c2;
+	struct commit_list *bases, *b;
+
+	if (!sp)
+		return;
+	one = xmemdupz(args, sp - args);
+	c1 = resolve_name(one, &oid) ? NULL :
+		lookup_commit_reference_gently(the_repository, &oid, 1);
+	free(one);
+	c2 = resolve_name(sp + 1, &oid) ? NULL :
+		lookup_commit_reference_gently(the_repository, &oid, 1);
+	if (!c1 || !c2)
+		return;
+
+	bases = repo_get_merge_bases(the_repository, c1, c2);
+	strbuf_addstr(answer, "ok");
+	for (b = bases; b; b = b->next)
+		strbuf_addf(answer, " %s", oid_to_hex(&b->item->object.oid));
+	free_commit_list(bases);
+}
+
+static ipc_server_application_cb handle_client;
+
+static int handle_client(void *data,
+			 const char *command, size_t command_len,
+			 ipc_server_reply_cb *reply,
+			 struct ipc_server_reply_data *reply_data)
+{
+	struct metadata_daemon_state *state = data;
+	struct strbuf answer = STRBUF_INIT;
+	const char *arg;
+	int ret = 0;
+
+	if (command_len != strlen(command))
+		return reply(reply_data, "unknown", 7);
+
+	trace2_region_enter("metadata", "handle_client", the_repository);
+	trace2_data_string("metadata", the_repository, "request", command);
+
+	pthread_mutex_lock(&state->mutex);
+	if (!strcmp(command, "quit")) {
+		ret = SIMPLE_IPC_QUIT;
+	} else if (!strcmp(command, "ping")) {
+		strbuf_addstr(&answer, "ok");
+	} else if (check_packs()) {
+		state->restart = 1;
+		ret = SIMPLE_IPC_QUIT;
+	} else if (skip_prefix(command, "get-oid ", &arg)) {
+		answer_get_oid(arg, &answer);
+	} else if (skip_prefix(command, "object-info ", &arg)) {
+		answer_object_info(arg, &answer);
+	} else if (skip_prefix(command, "merge-base ", &arg)) {
+		answer_merge_base(arg, &answer);
+	}
+	pthread_mutex_unlock(&state->mutex);
+
+	if (!answer.len)
+		strbuf_addstr(&answer, "unknown");
+	reply(reply_data, answer.buf, answer.len);
+
+	trace2_region_leave("metadata", "handle_client", the_repository);
+	strbuf_release(&answer);
+	return ret;
+}
+
+static int run_daemon(const char **argv)
+{
+	struct metadata_daemon_state state = { 0 };
+	struct ipc_server_opts ipc_opts = {
+		.nr_threads = ipc_threads,
+	};
+	char *path;
+	int ret;
+
+	/*
+	 * Replace refs, grafts and the shallow file are read once and
+	 * never refreshed; clients do not ask us anything that they could
+	 * affect (see metadata-ipc.c), and we do not apply replacements.
+	 */
+	read_replace_refs = 0;
+	save_commit_buffer = 0;
+
+	pthread_mutex_init(&state.mutex, NULL);
+
+	/* load what we are here to keep warm */
+	get_all_packs(the_repository);
+	prepare_commit_graft(the_repository);
+	generation_numbers_enabled(the_repository);
+
+	path = metadata_ipc_get_path(the_repository);
+	ret = ipc_server_run(path, &ipc_opts, handle_client, &state);
+	free(path);
+	pthread_mutex_destroy(&state.mutex);
+	if (ret)
+		return error(_("could not start metadata--daemon in '%s'"),
+			     get_git_dir());
+
+	if (state.restart) {
+		trace2_data_intmax("metadata", the_repository, "restart", 1);
+		execv_git_cmd(argv);
+		die_errno(_("could not restart metadata--daemon"));
+	}
+	return 0;
+}
+
+static int try_to_run_foreground_daemon(const char **argv)
+{
+	if (metadata_ipc_get_state(the_repository) == IPC_STATE__LISTENING)
+		die(_("metadata--daemon is already running in '%s'"),
+		    get_git_dir());
+
+	return !!run_daemon(argv);
+}
+
+static start_bg_wait_cb bg_wait_cb;
+
+static int bg_wait_cb(const struct child_process *cp, void *cb_data)
+{
+	switch (metadata_ipc_get_state(the_repository)) {
+	case IPC_STATE__LISTENING:
+		/* child is "ready" */
+		return 0;
+
+	case IPC_STATE__NOT_LISTENING:
+	case IPC_STATE__PATH_NOT_FOUND:
+		/* give child more time */
+		return 1;
+
+	default:
+		/* all the time in world won't help */
+		return -1;
+	}
+}
+
+static int try_to_start_background_daemon(void)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+
+	if (metadata_ipc_get_state(the_repository) == IPC_STATE__LISTENING)
+		die(_("metadata--daemon is already running in '%s'"),
+		    get_git_dir());
+
+	cp.git_cmd = 1;
+	strvec_pushl(&cp.args, "metadata--daemon", "run", NULL);
+	strvec_pushf(&cp.args, "--ipc-threads=%d", ipc_threads);
+	cp.no_stdin = 1;
+	cp.no_stdout = 1;
+	cp.no_stderr = 1;
+
+	switch (start_bg_command(&cp, bg_wait_cb, NULL, start_timeout_sec)) {
+	case SBGR_READY:
+		return 0;
+	case SBGR_TIMEOUT:
+		return error(_("daemon not online yet"));
+	case SBGR_DIED:
+		return error(_("daemon terminated"));
+	default:
+		return error(_("daemon failed to start"));
+	}
+}
+
+static int do_as_client__send_stop(void)
+{
+	struct strbuf answer = STRBUF_INIT;
+	int ret;
+
+	ret = metadata_ipc_send_command(the_repository, "quit", &answer);
+	strbuf_release(&answer);
+	if (ret)
+		return error(_("metadata--daemon is not running"));
+
+	while (metadata_ipc_get_state(the_repository) == IPC_STATE__LISTENING)
+		sleep_millisec(50);
+	return 0;
+}
+
+static int do_as_client__status(void)
+{
+	if (metadata_ipc_get_state(the_repository) == IPC_STATE__LISTENING) {
+		printf(_("metadata--daemon is running in '%s'\n"),
+		       get_git_dir());
+		return 0;
+	}
+	printf(_("metadata--daemon is not running in '%s'\n"),
+	       get_git_dir());
+	return 1;
+}
+
+int cmd_metadata__daemon(int argc, const char **argv, const char *prefix)
+{
+	const char *subcmd;
+	const char **orig_argv;
+	struct option options[] = {
+		OPT_INTEGER(0, "ipc-threads", &ipc_threads,
+			    N_("use <n> ipc worker threads")),
+		OPT_INTEGER(0, "start-timeout", &start_timeout_sec,
+			    N_("max seconds to wait for background daemon startup")),
+		OPT_END()
+	};
+
+	git_config(git_default_config, NULL);
+
+	ALLOC_ARRAY(orig_argv, argc + 1);
+	COPY_ARRAY(orig_argv, argv, argc + 1);
+	argc = parse_options(argc, argv, prefix, options,
+			     builtin_metadata__daemon_usage, 0);
+	if (argc != 1)
+		usage_with_options(builtin_metadata__daemon_usage, options);
+	subcmd = argv[0];
+
+	if (ipc_threads < 1)
+		die(_("invalid 'ipc-threads' value (%d)"), ipc_threads);
+
+	if (!strcmp(subcmd, "start"))
+		return !!try_to_start_background_daemon();
+	if (!strcmp(subcmd, "run"))
+		return try_to_run_foreground_daemon(orig_argv);
+	if (!strcmp(subcmd, "stop"))
+		return !!do_as_client__send_stop();
+	if (!strcmp(subcmd, "status"))
+		return !!do_as_client__status();
+
+	die(_("Unhandled subcommand '%s'"), subcmd);
+}
+
+#else
+int cmd_metadata__daemon(int argc, const char **argv, const char *prefix)
+{
+	struct option options[] = {
+		OPT_END()
+	};
+
+	if (argc == 2 && !strcmp(argv[1], "-h"))
+		usage_with_options(builtin_metadata__daemon_usage, options);
+
+	die(_("metadata--daemon not supported on this platform"));
+}
+#endif
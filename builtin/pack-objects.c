@@ -2786,18 +2786,13 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 
 /*
  * The main object list is split into smaller lists, each is handed to
- * one worker.
+ * one worker. A worker consumes its list from the front.
  *
- * The main thread waits on the condition that (at least) one of the workers
- * has stopped working (which is indicated in the .working member of
- * struct thread_params).
- *
- * When a work thread has completed its work, it sets .working to 0 and
- * signals the main thread and waits on the condition that .data_ready
- * becomes 1.
- *
- * The main thread steals half of the work from the worker that has
- * most work left to hand it to the idle worker.
+ * When a worker has completed its work, it steals the back half of the
+ * list of the worker that has the most work left, and carries on with
+ * that. Workers exit once no list is long enough to be worth splitting
+ * anymore. The lists are only changed under progress_lock(), which
+ * find_deltas() also takes before taking each object off its list.
  */
 
 struct thread_params {
@@ -2807,14 +2802,17 @@ struct thread_params {
 	unsigned remaining;
 	int window;
 	int depth;
-	int working;
-	int data_ready;
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
 	unsigned *processed;
-};
 
-static pthread_cond_t progress_cond;
+	/* the lists of all workers, to steal from */
+	struct thread_params *all;
+	int nr;
+
+	/* statistics reported through trace2 */
+	unsigned nr_objects;
+	unsigned nr_steals;
+	uint64_t busy_ns;
+};
 
 /*
  * Mutex and conditional variable can't be statically-initialized on Windows.
@@ -2823,50 +2821,89 @@ static void init_threaded_search(void)
 {
 	pthread_mutex_init(&cache_mutex, NULL);
 	pthread_mutex_init(&progress_mutex, NULL);
-	pthread_cond_init(&progress_cond, NULL);
 }
 
 static void cleanup_threaded_search(void)
 {
-	pthread_cond_destroy(&progress_cond);
 	pthread_mutex_destroy(&cache_mutex);
 	pthread_mutex_destroy(&progress_mutex);
 }
 
+/*
+ * Give 'me' the back half of the largest remaining list of another
+ * worker. Returns the number of objects stolen, which is 0 if there
+ * was nothing worth stealing. Must be called under progress_lock().
+ */
+static unsigned steal_delta_work(struct thread_params *me)
+{
+	struct thread_params *victim = NULL;
+	struct object_entry **list;
+	unsigned sub_size;
+	int i;
+
+	for (i = 0; i < me->nr; i++)
+		if (me->all[i].remaining > 2 * me->window &&
+		    (!victim || victim->remaining < me->all[i].remaining))
+			victim = &me->all[i];
+	if (!victim)
+		return 0;
+
+	sub_size = victim->remaining / 2;
+	list = victim->list + victim->list_size - sub_size;
+	while (sub_size && list[0]->hash &&
+	       list[0]->hash == list[-1]->hash) {
+		list++;
+		sub_size--;
+	}
+	if (!sub_size) {
+		/*
+		 * It is possible for some "paths" to have
+		 * so many objects that no hash boundary
+		 * might be found.  Let's just steal the
+		 * exact half in that case.
+		 */
+		sub_size = victim->remaining / 2;
+		list -= sub_size;
+	}
+	victim->list_size -= sub_size;
+	victim->remaining -= sub_size;
+	victim->nr_objects -= sub_size;
+
+	me->list = list;
+	me->list_size = sub_size;
+	me->remaining = sub_size;
+	me->nr_objects += sub_size;
+	me->nr_steals++;
+	return sub_size;
+}
+
 static void *threaded_find_deltas(void *arg)
 {
 	struct thread_params *me = arg;
 
-	progress_lock();
-	while (me->remaining) {
-		progress_unlock();
+	trace2_thread_start("find-deltas");
+	for (;;) {
+		uint64_t start = getnanotime();
+		unsigned stolen;
 
 		find_deltas(me->list, &me->remaining,
 			    me->window, me->depth, me->processed);
+		me->busy_ns += getnanotime() - start;
 
 		progress_lock();
-		me->working = 0;
-		pthread_cond_signal(&progress_cond);
+		stolen = steal_delta_work(me);
 		progress_unlock();
-
-		/*
-		 * We must not set ->data_ready before we wait on the
-		 * condition because the main thread may have set it to 1
-		 * before we get here. In order to be sure that new
-		 * work is available if we see 1 in ->data_ready, it
-		 * was initialized to 0 before this thread was spawned
-		 * and we reset it to 0 right away.
-		 */
-		pthread_mutex_lock(&me->mutex);
-		while (!me->data_ready)
-			pthread_cond_wait(&me->cond, &me->mutex);
-		me->data_ready = 0;
-		pthread_mutex_unlock(&me->mutex);
-
-		progress_lock();
+		if (!stolen)
+			break;
 	}
-	progress_unlock();
-	/* leave ->working 1 so that this doesn't get more work assigned */
+
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta-search/objects", me->nr_objects);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta-search/steals", me->nr_steals);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta-search/busy-ms", me->busy_ns / 1000000);
+	trace2_thread_exit();
 	return NULL;
 }
 
@@ -2874,7 +2911,7 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 			   int window, int depth, unsigned *processed)
 {
 	struct thread_params *p;
-	int i, ret, active_threads = 0;
+	int i, ret;
 
 	init_threaded_search();
 
@@ -2899,8 +2936,8 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 		p[i].window = window;
 		p[i].depth = depth;
 		p[i].processed = processed;
-		p[i].working = 1;
-		p[i].data_ready = 0;
+		p[i].all = p;
+		p[i].nr = delta_search_threads;
 
 		/* try to split chunks on "path" boundaries */
 		while (sub_size && sub_size < list_size &&
@@ -2911,90 +2948,27 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 		p[i].list = list;
 		p[i].list_size = sub_size;
 		p[i].remaining = sub_size;
+		p[i].nr_objects = sub_size;
 
 		list += sub_size;
 		list_size -= sub_size;
 	}
 
-	/* Start work threads. */
+	/*
+	 * Start work threads. A worker without a list of its own starts by
+	 * stealing, so it does not sit idle while the others have plenty
+	 * left to do.
+	 */
 	for (i = 0; i < delta_search_threads; i++) {
-		if (!p[i].list_size)
-			continue;
-		pthread_mutex_init(&p[i].mutex, NULL);
-		pthread_cond_init(&p[i].cond, NULL);
 		ret = pthread_create(&p[i].thread, NULL,
 				     threaded_find_deltas, &p[i]);
 		if (ret)
 			die(_("unable to create thread: %s"), strerror(ret));
-		active_threads++;
 	}
 
-	/*
-	 * Now let's wait for work completion.  Each time a thread is done
-	 * with its work, we steal half of the remaining work from the
-	 * thread with the largest number of unprocessed objects and give
-	 * it to that newly idle thread.  This ensure good load balancing
-	 * until the remaining object list segments are simply too short
-	 * to be worth splitting anymore.
-	 */
-	while (active_threads) {
-		struct thread_params *target = NULL;
-		struct thread_params *victim = NULL;
-		unsigned sub_size = 0;
-
-		progress_lock();
-		for (;;) {
-			for (i = 0; !target && i < delta_search_threads; i++)
-				if (!p[i].working)
-					target = &p[i];
-			if (target)
-				break;
-			pthread_cond_wait(&progress_cond, &progress_mutex);
-		}
-
-		for (i = 0; i < delta_search_threads; i++)
-			if (p[i].remaining > 2*window &&
-			    (!victim || victim->remaining < p[i].remaining))
-				victim = &p[i];
-		if (victim) {
-			sub_size = victim->remaining / 2;
-			list = victim->list + victim->list_size - sub_size;
-			while (sub_size && list[0]->hash &&
-			       list[0]->hash == list[-1]->hash) {
-				list++;
-				sub_size--;
-			}
-			if (!sub_size) {
-				/*
-				 * It is possible for some "paths" to have
-				 * so many objects that no hash boundary
-				 * might be found.  Let's just steal the
-				 * exact half in that case.
-				 */
-				sub_size = victim->remaining / 2;
-				list -= sub_size;
-			}
-			target->list = list;
-			victim->list_size -= sub_size;
-			victim->remaining -= sub_size;
-		}
-		target->list_size = sub_size;
-		target->remaining = sub_size;
-		target->working = 1;
-		progress_unlock();
-
-		pthread_mutex_lock(&target->mutex);
-		target->data_ready = 1;
-		pthread_cond_signal(&target->cond);
-		pthread_mutex_unlock(&target->mutex);
+	for (i = 0; i < delta_search_threads; i++)
+		pthread_join(p[i].thread, NULL);
 
-		if (!sub_size) {
-			pthread_join(target->thread, NULL);
-			pthread_cond_destroy(&target->cond);
-			pthread_mutex_destroy(&target->mutex);
-			active_threads--;
-		}
-	}
 	cleanup_threaded_search();
 	free(p);
 }
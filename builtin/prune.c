@@ -9,9 +9,11 @@
 #include "prune-packed.h"
 #include "object-store.h"
 #include "shallow.h"
+#include "thread-utils.h"
 
 static const char * const prune_usage[] = {
-	N_("git prune [-n] [-v] [--progress] [--expire <time>] [--] [<head>...]"),
+	N_("git prune [-n] [-v] [--progress] [--expire <time>] [--threads=<n>]\n"
+	   "          [--] [<head>...]"),
 	NULL
 };
 static int show_only;
@@ -150,6 +152,8 @@ int cmd_prune(int argc, const char **argv, const char *prefix)
 				N_("expire objects older than <time>")),
 		OPT_BOOL(0, "exclude-promisor-objects", &exclude_promisor_objects,
 			 N_("limit traversal to objects outside promisor packfiles")),
+		OPT_INTEGER(0, "threads", &revs.object_walk_threads,
+			    N_("use threads when checking connectivity")),
 		OPT_END()
 	};
 	char *s;
@@ -163,6 +167,11 @@ int cmd_prune(int argc, const char **argv, const char *prefix)
 
 	if (repository_format_precious_objects)
 		die(_("cannot prune in a precious-objects repo"));
+	if (revs.object_walk_threads < 0)
+		die(_("invalid number of threads specified (%d)"),
+		    revs.object_walk_threads);
+	if (!revs.object_walk_threads)
+		revs.object_walk_threads = online_cpus();
 
 	while (argc--) {
 		struct object_id oid;
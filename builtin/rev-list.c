@@ -18,6 +18,7 @@
 #include "reflog-walk.h"
 #include "oidset.h"
 #include "packfile.h"
+#include "thread-utils.h"
 
 static const char rev_list_usage[] =
 "git rev-list [<options>] <commit>... [--] [<path>...]\n"
@@ -48,6 +49,7 @@ static const char rev_list_usage[] =
 "    --parents\n"
 "    --children\n"
 "    --objects | --objects-edge\n"
+"    --threads=<n>\n"
 "    --disk-usage[=human]\n"
 "    --unpacked\n"
 "    --header | --pretty\n"
@@ -606,6 +608,15 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 			show_progress = arg;
 			continue;
 		}
+		if (skip_prefix(arg, "--threads=", &arg)) {
+			if (strtol_i(arg, 10, &revs.object_walk_threads) ||
+			    revs.object_walk_threads < 0)
+				die(_("invalid number of threads specified (%s)"),
+				    arg);
+			if (!revs.object_walk_threads)
+				revs.object_walk_threads = online_cpus();
+			continue;
+		}
 		if (!strcmp(arg, "--filter-provided-objects")) {
 			filter_provided_objects = 1;
 			continue;
@@ -17,6 +17,7 @@
 #include "submodule.h"
 #include "commit-reach.h"
 #include "shallow.h"
+#include "metadata-ipc.h"
 
 #define DO_REVS		1
 #define DO_NOREV	2
@@ -1065,7 +1066,8 @@ int cmd_rev_parse(int argc, const char **argv, const char *prefix)
 			name++;
 			type = REVERSED;
 		}
-		if (!get_oid_with_context(the_repository, name,
+		if (!metadata_ipc_get_oid(the_repository, name, &oid) ||
+		    !get_oid_with_context(the_repository, name,
 					  flags, &oid, &unused)) {
 			if (verify)
 				revs_count++;
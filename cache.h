@@ -643,11 +643,22 @@ int path_inside_repo(const char *prefix, const char *path);
 
 #define INIT_DB_QUIET 0x0001
 #define INIT_DB_EXIST_OK 0x0002
+#define INIT_DB_SKIP_REFDB 0x0004
 
 int init_db(const char *git_dir, const char *real_git_dir,
 	    const char *template_dir, int hash_algo,
+	    enum ref_storage_format ref_storage_format,
 	    const char *initial_branch, unsigned int flags);
-void initialize_repository_version(int hash_algo, int reinit);
+void initialize_repository_version(int hash_algo,
+				   enum ref_storage_format ref_storage_format,
+				   int reinit);
+
+/*
+ * Create the reference database of the repository and point HEAD at
+ * the initial branch, unless HEAD already exists. init_db() does this
+ * itself unless it is given INIT_DB_SKIP_REFDB.
+ */
+void create_reference_database(const char *initial_branch, int quiet);
 
 void sanitize_stdfds(void);
 int daemonize(void);
@@ -1117,6 +1128,7 @@ extern int grafts_replace_parents;
 #define GIT_REPO_VERSION_READ 1
 extern int repository_format_precious_objects;
 extern int repository_format_worktree_config;
+extern int repository_format_packed_refs_delta;
 
 /*
  * You _have_ to initialize a `struct repository_format` using
@@ -1129,6 +1141,8 @@ struct repository_format {
 	int worktree_config;
 	int is_bare;
 	int hash_algo;
+	enum ref_storage_format ref_storage_format;
+	int packed_refs_delta;
 	int sparse_index;
 	char *work_tree;
 	struct string_list unknown_extensions;
@@ -1145,6 +1159,7 @@ struct repository_format {
 	.version = -1, \
 	.is_bare = -1, \
 	.hash_algo = GIT_HASH_SHA1, \
+	.ref_storage_format = REF_STORAGE_FORMAT_FILES, \
 	.unknown_extensions = STRING_LIST_INIT_DUP, \
 	.v1_only_extensions = STRING_LIST_INIT_DUP, \
 }
@@ -1231,6 +1246,12 @@ enum sharedrepo {
 	PERM_EVERYBODY      = 0664
 };
 int git_config_perm(const char *var, const char *value);
+
+/*
+ * Return the permission bits a file or directory created with "mode"
+ * should have according to core.sharedRepository.
+ */
+int calc_shared_perm(int mode);
 int adjust_shared_perm(const char *path);
 
 /*
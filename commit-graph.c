@@ -20,6 +20,7 @@
 #include "json-writer.h"
 #include "trace2.h"
 #include "chunk-format.h"
+#include "thread-utils.h"
 
 void git_test_write_commit_graph_or_die(void)
 {
@@ -1580,17 +1581,71 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_trunc_large);
 }
 
+struct bloom_compute_data {
+	struct repository *r;
+	const struct bloom_filter_settings *settings;
+	struct commit **commits;
+	struct bloom_filter **filters;
+	enum bloom_filter_computed *computed;
+	size_t nr, next;
+
+	struct progress *progress;
+	uint64_t progress_cnt;
+	pthread_mutex_t mutex;
+};
+
+static void *compute_bloom_filters_thread(void *cb_data)
+{
+	struct bloom_compute_data *data = cb_data;
+
+	pthread_mutex_lock(&data->mutex);
+	while (data->next < data->nr) {
+		size_t i = data->next++;
+
+		pthread_mutex_unlock(&data->mutex);
+		data->computed[i] = compute_bloom_filter(data->r,
+							 data->commits[i],
+							 data->filters[i],
+							 data->settings);
+		pthread_mutex_lock(&data->mutex);
+		display_progress(data->progress, ++data->progress_cnt);
+	}
+	pthread_mutex_unlock(&data->mutex);
+
+	return NULL;
+}
+
+static int bloom_filter_threads(struct write_commit_graph_context *ctx,
+				size_t nr)
+{
+	int nr_threads = 0;
+
+	if (!HAVE_THREADS)
+		return 1;
+
+	repo_config_get_int(ctx->r, "commitgraph.threads", &nr_threads);
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	if (nr_threads > nr)
+		nr_threads = nr;
+	return nr_threads > 0 ? nr_threads : 1;
+}
+
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 {
 	int i;
-	struct progress *progress = NULL;
 	struct commit **sorted_commits;
 	int max_new_filters;
+	struct bloom_compute_data data = {
+		.r = ctx->r,
+		.settings = ctx->bloom_settings,
+	};
+	int nr_threads;
 
 	init_bloom_filters();
 
 	if (ctx->report_progress)
-		progress = start_delayed_progress(
+		data.progress = start_delayed_progress(
 			_("Computing commit changed paths Bloom filters"),
 			ctx->commits.nr);
 
@@ -1605,33 +1660,73 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	/*
+	 * Decide which filters to compute in the same order as we would
+	 * compute them one at a time, so that --max-new-filters picks the
+	 * same commits regardless of the number of threads.
+	 */
+	ALLOC_ARRAY(data.commits, ctx->commits.nr);
+	ALLOC_ARRAY(data.filters, ctx->commits.nr);
 	for (i = 0; i < ctx->commits.nr; i++) {
-		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
-		struct bloom_filter *filter = get_or_compute_bloom_filter(
-			ctx->r,
-			c,
-			ctx->count_bloom_filter_computed < max_new_filters,
-			ctx->bloom_settings,
-			&computed);
-		if (computed & BLOOM_COMPUTED) {
-			ctx->count_bloom_filter_computed++;
-			if (computed & BLOOM_TRUNC_EMPTY)
-				ctx->count_bloom_filter_trunc_empty++;
-			if (computed & BLOOM_TRUNC_LARGE)
-				ctx->count_bloom_filter_trunc_large++;
-		} else if (computed & BLOOM_NOT_COMPUTED)
+		struct bloom_filter *filter = get_bloom_filter_slot(ctx->r, c);
+
+		if (filter->data && filter->len) {
 			ctx->count_bloom_filter_not_computed++;
-		ctx->total_bloom_filter_data_size += filter
-			? sizeof(unsigned char) * filter->len : 0;
-		display_progress(progress, i + 1);
+			ctx->total_bloom_filter_data_size += sizeof(unsigned char) * filter->len;
+		} else if (data.nr < max_new_filters) {
+			/* ensure commit is parsed so we have parent information */
+			repo_parse_commit(ctx->r, c);
+			data.commits[data.nr] = c;
+			data.filters[data.nr] = filter;
+			data.nr++;
+			continue;
+		} else
+			ctx->count_bloom_filter_not_computed++;
+		display_progress(data.progress, ++data.progress_cnt);
+	}
+	CALLOC_ARRAY(data.computed, data.nr);
+
+	nr_threads = bloom_filter_threads(ctx, data.nr);
+	pthread_mutex_init(&data.mutex, NULL);
+	if (nr_threads > 1) {
+		pthread_t *threads;
+
+		CALLOC_ARRAY(threads, nr_threads);
+		enable_obj_read_lock();
+		for (i = 0; i < nr_threads; i++) {
+			int err = pthread_create(&threads[i], NULL,
+						 compute_bloom_filters_thread,
+						 &data);
+			if (err)
+				die(_("unable to create thread: %s"),
+				    strerror(err));
+		}
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+		disable_obj_read_lock();
+		free(threads);
+	} else
+		compute_bloom_filters_thread(&data);
+	pthread_mutex_destroy(&data.mutex);
+
+	for (i = 0; i < data.nr; i++) {
+		ctx->count_bloom_filter_computed++;
+		if (data.computed[i] & BLOOM_TRUNC_EMPTY)
+			ctx->count_bloom_filter_trunc_empty++;
+		if (data.computed[i] & BLOOM_TRUNC_LARGE)
+			ctx->count_bloom_filter_trunc_large++;
+		ctx->total_bloom_filter_data_size += sizeof(unsigned char) * data.filters[i]->len;
 	}
 
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
 
+	free(data.commits);
+	free(data.filters);
+	free(data.computed);
 	free(sorted_commits);
-	stop_progress(&progress);
+	stop_progress(&data.progress);
 }
 
 struct refs_cb_data {
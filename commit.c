@@ -39,7 +39,7 @@ struct commit *lookup_commit_reference_gently(struct repository *r,
 
 	if (!obj)
 		return NULL;
-	return object_as_type(obj, OBJ_COMMIT, quiet);
+	return object_as_type(r, obj, OBJ_COMMIT, quiet);
 }
 
 struct commit *lookup_commit_reference(struct repository *r, const struct object_id *oid)
@@ -63,16 +63,14 @@ struct commit *lookup_commit_object(struct repository *r,
 				    const struct object_id *oid)
 {
 	struct object *obj = parse_object(r, oid);
-	return obj ? object_as_type(obj, OBJ_COMMIT, 0) : NULL;
+	return obj ? object_as_type(r, obj, OBJ_COMMIT, 0) : NULL;
 
 }
 
 struct commit *lookup_commit(struct repository *r, const struct object_id *oid)
 {
-	struct object *obj = lookup_object(r, oid);
-	if (!obj)
-		return create_object(r, oid, alloc_commit_node(r));
-	return object_as_type(obj, OBJ_COMMIT, 0);
+	struct object *obj = lookup_or_create_object(r, oid, alloc_commit_node);
+	return object_as_type(r, obj, OBJ_COMMIT, 0);
 }
 
 struct commit *lookup_commit_reference_by_name(const char *name)
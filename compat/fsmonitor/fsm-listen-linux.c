@@ -0,0 +1,609 @@
+#include "cache.h"
+#include "fsmonitor.h"
+#include "fsm-listen.h"
+#include "fsmonitor--daemon.h"
+#include "fsmonitor-path-utils.h"
+#include <sys/inotify.h>
+#include <poll.h>
+
+/*
+ * Events that we ask the kernel to report for each watched directory.
+ *
+ * We do not need IN_CLOSE_WRITE or IN_ACCESS: IN_MODIFY and IN_ATTRIB
+ * already cover content and mode changes, and reads are uninteresting.
+ */
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+		    IN_MOVED_FROM | IN_MOVED_TO | \
+		    IN_DELETE_SELF | IN_MOVE_SELF | \
+		    IN_DONT_FOLLOW | IN_EXCL_UNLINK | IN_ONLYDIR)
+
+/*
+ * inotify only watches a single directory per watch descriptor and
+ * reports the name of the affected entry relative to that directory,
+ * so we must remember the absolute path of each watched directory
+ * and add (and remove) watches as directories come and go.
+ */
+struct watch_entry {
+	struct hashmap_entry ent;
+	int wd;
+	char *path;
+};
+
+struct fsm_listen_data
+{
+	int fd_inotify;
+	int fd_stop[2];
+
+	struct hashmap watches; /* wd -> struct watch_entry */
+
+	int wd_worktree;
+	int wd_gitdir;
+
+	enum shutdown_style {
+		SHUTDOWN_EVENT = 0,
+		FORCE_SHUTDOWN,
+		FORCE_ERROR_STOP,
+	} shutdown_style;
+};
+
+static int watch_entry_cmp(const void *unused_cmp_data,
+			   const struct hashmap_entry *eptr,
+			   const struct hashmap_entry *entry_or_key,
+			   const void *unused_keydata)
+{
+	const struct watch_entry *a, *b;
+
+	a = container_of(eptr, const struct watch_entry, ent);
+	b = container_of(entry_or_key, const struct watch_entry, ent);
+
+	return a->wd != b->wd;
+}
+
+static struct watch_entry *find_watch(struct fsm_listen_data *data, int wd)
+{
+	struct watch_entry key;
+
+	hashmap_entry_init(&key.ent, memihash(&wd, sizeof(wd)));
+	key.wd = wd;
+
+	return hashmap_get_entry(&data->watches, &key, ent, NULL);
+}
+
+static void free_watch(struct watch_entry *w)
+{
+	free(w->path);
+	free(w);
+}
+
+static void forget_watch(struct fsm_listen_data *data, int wd)
+{
+	struct watch_entry key, *w;
+
+	hashmap_entry_init(&key.ent, memihash(&wd, sizeof(wd)));
+	key.wd = wd;
+
+	w = hashmap_remove_entry(&data->watches, &key, ent, NULL);
+	if (w)
+		free_watch(w);
+}
+
+static void log_mask_set(const char *path, uint32_t mask)
+{
+	struct strbuf msg = STRBUF_INIT;
+
+	if (mask & IN_ACCESS)
+		strbuf_addstr(&msg, "IN_ACCESS|");
+	if (mask & IN_MODIFY)
+		strbuf_addstr(&msg, "IN_MODIFY|");
+	if (mask & IN_ATTRIB)
+		strbuf_addstr(&msg, "IN_ATTRIB|");
+	if (mask & IN_CLOSE_WRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_WRITE|");
+	if (mask & IN_CLOSE_NOWRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_NOWRITE|");
+	if (mask & IN_OPEN)
+		strbuf_addstr(&msg, "IN_OPEN|");
+	if (mask & IN_MOVED_FROM)
+		strbuf_addstr(&msg, "IN_MOVED_FROM|");
+	if (mask & IN_MOVED_TO)
+		strbuf_addstr(&msg, "IN_MOVED_TO|");
+	if (mask & IN_CREATE)
+		strbuf_addstr(&msg, "IN_CREATE|");
+	if (mask & IN_DELETE)
+		strbuf_addstr(&msg, "IN_DELETE|");
+	if (mask & IN_DELETE_SELF)
+		strbuf_addstr(&msg, "IN_DELETE_SELF|");
+	if (mask & IN_MOVE_SELF)
+		strbuf_addstr(&msg, "IN_MOVE_SELF|");
+	if (mask & IN_UNMOUNT)
+		strbuf_addstr(&msg, "IN_UNMOUNT|");
+	if (mask & IN_Q_OVERFLOW)
+		strbuf_addstr(&msg, "IN_Q_OVERFLOW|");
+	if (mask & IN_IGNORED)
+		strbuf_addstr(&msg, "IN_IGNORED|");
+	if (mask & IN_ISDIR)
+		strbuf_addstr(&msg, "IN_ISDIR|");
+
+	trace_printf_key(&trace_fsmonitor, "inotify: '%s', mask=0x%x %s",
+			 path, mask, msg.buf);
+
+	strbuf_release(&msg);
+}
+
+/*
+ * Add the given worktree-relative path to the batch, with a trailing
+ * slash if it is a directory so that the client knows to invalidate
+ * everything below it.
+ */
+static void add_path_to_batch(struct fsmonitor_daemon_state *state,
+			      struct fsmonitor_batch **batch,
+			      const char *path, int is_dir)
+{
+	const char *rel = path + state->path_worktree_watch.len + 1;
+
+	if (!*batch)
+		*batch = fsmonitor_batch__new();
+
+	if (is_dir) {
+		struct strbuf tmp = STRBUF_INIT;
+
+		strbuf_addf(&tmp, "%s/", rel);
+		fsmonitor_batch__add_path(*batch, tmp.buf);
+		strbuf_release(&tmp);
+	} else {
+		fsmonitor_batch__add_path(*batch, rel);
+	}
+}
+
+/*
+ * Add a watch for a single directory.  If the kernel already has a
+ * watch on this inode (e.g. because the directory was moved), it
+ * hands back the existing descriptor and we just update its path.
+ *
+ * Returns the watch descriptor, -1 if the directory has gone away in
+ * the meantime, or -2 on a real error.
+ */
+static int add_one_watch(struct fsm_listen_data *data, const char *path)
+{
+	struct watch_entry *w;
+	int wd;
+
+	wd = inotify_add_watch(data->fd_inotify, path, WATCH_MASK);
+	if (wd < 0) {
+		/*
+		 * The directory may have been removed or replaced by a
+		 * non-directory before we got to it.  Any later events for
+		 * that path will be reported by its parent.
+		 */
+		if (errno == ENOENT || errno == ENOTDIR)
+			return -1;
+		if (errno == ENOSPC)
+			error(_("inotify watch limit reached while watching '%s'; "
+				"consider raising /proc/sys/fs/inotify/max_user_watches"),
+			      path);
+		else
+			error_errno(_("inotify_add_watch('%s') failed"), path);
+		return -2;
+	}
+
+	w = find_watch(data, wd);
+	if (w) {
+		free(w->path);
+		w->path = xstrdup(path);
+		return wd;
+	}
+
+	CALLOC_ARRAY(w, 1);
+	hashmap_entry_init(&w->ent, memihash(&wd, sizeof(wd)));
+	w->wd = wd;
+	w->path = xstrdup(path);
+	hashmap_add(&data->watches, &w->ent);
+
+	return wd;
+}
+
+/*
+ * Recursively watch the directory at `path` (which lives inside the
+ * worktree cone) and every directory below it, skipping ".git".
+ *
+ * If `batch` is not NULL, we are catching up on a directory that was
+ * just created or moved into the worktree; its contents may have been
+ * populated before our watch was in place, so also report everything
+ * that we find.
+ *
+ * Returns 0 on success and -1 on a fatal error (such as running out of
+ * watch descriptors).
+ */
+static int add_watches_recursive(struct fsmonitor_daemon_state *state,
+				 struct strbuf *path,
+				 struct fsmonitor_batch **batch)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	DIR *dir;
+	struct dirent *de;
+	size_t baselen;
+	int ret;
+
+	ret = add_one_watch(data, path->buf);
+	if (ret < 0)
+		return ret == -1 ? 0 : -1;
+	ret = 0;
+
+	dir = opendir(path->buf);
+	if (!dir)
+		return 0;
+
+	strbuf_complete(path, '/');
+	baselen = path->len;
+
+	while (!ret && (de = readdir_skip_dot_and_dotdot(dir))) {
+		int dtype = DTYPE(de);
+
+		strbuf_setlen(path, baselen);
+		strbuf_addstr(path, de->d_name);
+
+		if (dtype == DT_UNKNOWN) {
+			struct stat st;
+
+			if (lstat(path->buf, &st))
+				continue;
+			dtype = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+		}
+
+		if (dtype != DT_DIR) {
+			if (batch)
+				add_path_to_batch(state, batch, path->buf, 0);
+			continue;
+		}
+
+		if (fsmonitor_classify_path_absolute(state, path->buf) !=
+		    IS_WORKDIR_PATH)
+			continue;
+
+		if (batch)
+			add_path_to_batch(state, batch, path->buf, 1);
+		ret = add_watches_recursive(state, path, batch);
+	}
+
+	strbuf_setlen(path, baselen - 1);
+	closedir(dir);
+	return ret;
+}
+
+/*
+ * Remove the watches for the directory at `path` and everything below
+ * it.  This is used when a directory is moved away; the kernel would
+ * otherwise keep reporting events for it under its stale name.
+ */
+static void remove_watches_recursive(struct fsm_listen_data *data,
+				     const char *path)
+{
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+	size_t len = strlen(path);
+	int *wds = NULL;
+	size_t nr = 0, alloc = 0, k;
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent) {
+		if (w->wd == data->wd_worktree || w->wd == data->wd_gitdir)
+			continue;
+		if (strncmp(w->path, path, len) ||
+		    (w->path[len] && w->path[len] != '/'))
+			continue;
+		ALLOC_GROW(wds, nr + 1, alloc);
+		wds[nr++] = w->wd;
+	}
+
+	for (k = 0; k < nr; k++) {
+		inotify_rm_watch(data->fd_inotify, wds[k]);
+		forget_watch(data, wds[k]);
+	}
+
+	free(wds);
+}
+
+/*
+ * Process a buffer full of inotify events.  Returns 0 normally and -1
+ * if we need to shut the daemon down.
+ */
+static int process_events(struct fsmonitor_daemon_state *state,
+			  const char *buf, ssize_t len)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct fsmonitor_batch *batch = NULL;
+	struct string_list cookie_list = STRING_LIST_INIT_DUP;
+	struct strbuf path = STRBUF_INIT;
+	const char *p, *slash;
+
+	for (p = buf; p < buf + len;
+	     p += sizeof(struct inotify_event) + ((const struct inotify_event *)p)->len) {
+		const struct inotify_event *ev = (const struct inotify_event *)p;
+		struct watch_entry *w;
+		int is_dir = !!(ev->mask & IN_ISDIR);
+
+		if (ev->mask & IN_Q_OVERFLOW) {
+			/*
+			 * The kernel event queue overflowed and we have
+			 * lost sync with the filesystem.  Flush our cached
+			 * data and discard the batch we were building,
+			 * since it is relative to the flushed token.
+			 */
+			trace_printf_key(&trace_fsmonitor, "inotify: queue overflow");
+
+			fsmonitor_force_resync(state);
+			fsmonitor_batch__free_list(batch);
+			string_list_clear(&cookie_list, 0);
+			batch = NULL;
+			continue;
+		}
+
+		w = find_watch(data, ev->wd);
+		if (!w)
+			continue; /* a late event for a removed watch */
+
+		if (ev->mask & IN_IGNORED) {
+			if (ev->wd == data->wd_worktree || ev->wd == data->wd_gitdir) {
+				trace_printf_key(&trace_fsmonitor,
+						 "event: root watch removed");
+				goto force_shutdown;
+			}
+			forget_watch(data, ev->wd);
+			continue;
+		}
+
+		if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+			if (ev->wd == data->wd_worktree) {
+				trace_printf_key(&trace_fsmonitor,
+						 "event: worktree root removed");
+				goto force_shutdown;
+			}
+			if (ev->wd == data->wd_gitdir) {
+				trace_printf_key(&trace_fsmonitor,
+						 "event: gitdir removed");
+				goto force_shutdown;
+			}
+			/* the parent directory will report the change */
+			continue;
+		}
+
+		strbuf_reset(&path);
+		strbuf_addstr(&path, w->path);
+		if (ev->len && *ev->name) {
+			strbuf_addch(&path, '/');
+			strbuf_addstr(&path, ev->name);
+		}
+
+		switch (fsmonitor_classify_path_absolute(state, path.buf)) {
+
+		case IS_INSIDE_DOT_GIT_WITH_COOKIE_PREFIX:
+		case IS_INSIDE_GITDIR_WITH_COOKIE_PREFIX:
+			/* special case cookie files within .git or gitdir */
+
+			/* Use just the filename of the cookie file. */
+			slash = find_last_dir_sep(path.buf);
+			string_list_append(&cookie_list,
+					   slash ? slash + 1 : path.buf);
+			break;
+
+		case IS_INSIDE_DOT_GIT:
+		case IS_INSIDE_GITDIR:
+			/* ignore all other paths inside of .git or gitdir */
+			break;
+
+		case IS_DOT_GIT:
+		case IS_GITDIR:
+			/*
+			 * If .git directory is deleted or renamed away,
+			 * we have to quit.
+			 */
+			if (is_dir && (ev->mask & (IN_DELETE | IN_MOVED_FROM))) {
+				trace_printf_key(&trace_fsmonitor,
+						 "event: gitdir removed");
+				goto force_shutdown;
+			}
+			break;
+
+		case IS_WORKDIR_PATH:
+			/* try to queue normal pathnames */
+
+			if (trace_pass_fl(&trace_fsmonitor))
+				log_mask_set(path.buf, ev->mask);
+
+			if (path.len == state->path_worktree_watch.len)
+				break; /* the root itself, e.g. IN_ATTRIB */
+
+			add_path_to_batch(state, &batch, path.buf, is_dir);
+
+			if (!is_dir)
+				break;
+
+			if (ev->mask & IN_MOVED_FROM)
+				remove_watches_recursive(data, path.buf);
+			if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) &&
+			    add_watches_recursive(state, &path, &batch))
+				goto force_error_stop;
+			break;
+
+		case IS_OUTSIDE_CONE:
+		default:
+			trace_printf_key(&trace_fsmonitor,
+					 "ignoring '%s'", path.buf);
+			break;
+		}
+	}
+
+	fsmonitor_publish(state, batch, &cookie_list);
+	string_list_clear(&cookie_list, 0);
+	strbuf_release(&path);
+	return 0;
+
+force_error_stop:
+	state->listen_error_code = -1;
+	data->shutdown_style = FORCE_ERROR_STOP;
+	goto cleanup;
+
+force_shutdown:
+	data->shutdown_style = FORCE_SHUTDOWN;
+
+cleanup:
+	fsmonitor_batch__free_list(batch);
+	string_list_clear(&cookie_list, 0);
+	strbuf_release(&path);
+	return -1;
+}
+
+int fsm_listen__ctor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+	struct strbuf path = STRBUF_INIT;
+
+	CALLOC_ARRAY(data, 1);
+	state->listen_data = data;
+
+	hashmap_init(&data->watches, watch_entry_cmp, NULL, 0);
+	data->fd_stop[0] = data->fd_stop[1] = -1;
+	data->wd_worktree = data->wd_gitdir = -1;
+
+	data->fd_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (data->fd_inotify < 0) {
+		error_errno(_("inotify_init1() failed"));
+		goto failed;
+	}
+
+	if (pipe(data->fd_stop) < 0) {
+		error_errno(_("could not create pipe"));
+		goto failed;
+	}
+
+	/*
+	 * Watch the whole worktree (minus ".git"), the <gitdir> itself
+	 * (so that we notice it being deleted or renamed), and the
+	 * cookie directory inside it so that we see our own cookie
+	 * files come and go.
+	 */
+	data->wd_worktree = add_one_watch(data, state->path_worktree_watch.buf);
+	if (data->wd_worktree < 0)
+		goto failed;
+
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	if (add_watches_recursive(state, &path, NULL))
+		goto failed;
+
+	data->wd_gitdir = add_one_watch(data, state->path_gitdir_watch.buf);
+	if (data->wd_gitdir < 0)
+		goto failed;
+
+	strbuf_reset(&path);
+	strbuf_addbuf(&path, &state->path_cookie_prefix);
+	strbuf_strip_suffix(&path, "/");
+	if (add_one_watch(data, path.buf) < 0)
+		goto failed;
+
+	strbuf_release(&path);
+	return 0;
+
+failed:
+	error(_("Unable to create inotify watches."));
+
+	strbuf_release(&path);
+	fsm_listen__dtor(state);
+	return -1;
+}
+
+void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+
+	if (!state || !state->listen_data)
+		return;
+
+	data = state->listen_data;
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent)
+		free(w->path);
+	hashmap_clear_and_free(&data->watches, struct watch_entry, ent);
+
+	if (data->fd_inotify >= 0)
+		close(data->fd_inotify);
+	if (data->fd_stop[0] >= 0)
+		close(data->fd_stop[0]);
+	if (data->fd_stop[1] >= 0)
+		close(data->fd_stop[1]);
+
+	FREE_AND_NULL(state->listen_data);
+}
+
+void fsm_listen__stop_async(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+
+	data = state->listen_data;
+	data->shutdown_style = SHUTDOWN_EVENT;
+
+	/* Wake up the poll() in the listener thread. */
+	if (write(data->fd_stop[1], "q", 1) < 0)
+		warning_errno(_("could not signal fsmonitor listener thread"));
+}
+
+void fsm_listen__loop(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct pollfd pfd[2];
+	char buf[64 * 1024]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	pfd[0].fd = data->fd_inotify;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = data->fd_stop[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		ssize_t len;
+
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			error_errno(_("poll() failed on inotify descriptor"));
+			goto force_error_stop;
+		}
+
+		if (pfd[1].revents)
+			break; /* normal shutdown */
+
+		if (!(pfd[0].revents & POLLIN))
+			continue;
+
+		/*
+		 * Drain the queue, publishing one batch per read so that
+		 * clients waiting on a cookie are woken up promptly.
+		 */
+		while ((len = read(data->fd_inotify, buf, sizeof(buf))) > 0)
+			if (process_events(state, buf, len))
+				goto shutdown;
+
+		if (len < 0 && errno != EAGAIN && errno != EINTR) {
+			error_errno(_("read() failed on inotify descriptor"));
+			goto force_error_stop;
+		}
+	}
+	return;
+
+force_error_stop:
+	data->shutdown_style = FORCE_ERROR_STOP;
+
+shutdown:
+	switch (data->shutdown_style) {
+	case FORCE_ERROR_STOP:
+		state->listen_error_code = -1;
+		/* fall thru */
+	case FORCE_SHUTDOWN:
+		ipc_server_stop_async(state->ipc_server_data);
+		/* fall thru */
+	case SHUTDOWN_EVENT:
+	default:
+		break;
+	}
+	return;
+}
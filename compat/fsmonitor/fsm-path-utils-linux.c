@@ -0,0 +1,96 @@
+#include "fsmonitor.h"
+#include "fsmonitor-path-utils.h"
+#include <errno.h>
+#include <sys/vfs.h>
+
+/*
+ * Linux does not give us a filesystem type name or a "local" flag from
+ * statfs(), only the superblock magic number, so map the ones we care
+ * about by hand.  See statfs(2) and <linux/magic.h>.
+ */
+static const struct {
+	unsigned long magic;
+	const char *name;
+	int is_remote;
+} fs_types[] = {
+	{ 0x6969,     "nfs",   1 },
+	{ 0xFF534D42, "cifs",  1 },
+	{ 0xFE534D42, "smb2",  1 },
+	{ 0x517B,     "smb",   1 },
+	{ 0x564C,     "ncp",   1 },
+	{ 0x5346414F, "afs",   1 },
+	{ 0x6B414653, "afs",   1 },
+	{ 0x73757245, "coda",  1 },
+	{ 0x01021997, "9p",    1 },
+	{ 0x00C36400, "ceph",  1 },
+	{ 0x47504653, "gpfs",  1 },
+	{ 0x0BD00BD0, "lustre", 1 },
+	{ 0x4D44,     "msdos", 0 },
+	{ 0x5346544E, "ntfs",  0 },
+	{ 0x65735546, "fuse",  0 },
+};
+
+int fsmonitor__get_fs_info(const char *path, struct fs_info *fs_info)
+{
+	struct statfs fs;
+	unsigned long magic;
+	size_t k;
+
+	if (statfs(path, &fs) == -1) {
+		int saved_errno = errno;
+		trace_printf_key(&trace_fsmonitor, "statfs('%s') failed: %s",
+				 path, strerror(saved_errno));
+		errno = saved_errno;
+		return -1;
+	}
+
+	magic = (unsigned long)fs.f_type & 0xFFFFFFFFUL;
+
+	trace_printf_key(&trace_fsmonitor,
+			 "statfs('%s') [type 0x%08lx]", path, magic);
+
+	fs_info->is_remote = 0;
+	fs_info->typename = NULL;
+	for (k = 0; k < ARRAY_SIZE(fs_types); k++) {
+		if (fs_types[k].magic != magic)
+			continue;
+		fs_info->is_remote = fs_types[k].is_remote;
+		fs_info->typename = xstrdup(fs_types[k].name);
+		break;
+	}
+	if (!fs_info->typename)
+		fs_info->typename = xstrfmt("0x%08lx", magic);
+
+	trace_printf_key(&trace_fsmonitor,
+				"'%s' is_remote: %d",
+				path, fs_info->is_remote);
+	return 0;
+}
+
+int fsmonitor__is_fs_remote(const char *path)
+{
+	struct fs_info fs;
+	if (fsmonitor__get_fs_info(path, &fs))
+		return -1;
+
+	free(fs.typename);
+
+	return fs.is_remote;
+}
+
+/*
+ * No-op for now.
+ */
+int fsmonitor__get_alias(const char *path, struct alias_info *info)
+{
+	return 0;
+}
+
+/*
+ * No-op for now.
+ */
+char *fsmonitor__resolve_alias(const char *path,
+	const struct alias_info *info)
+{
+	return NULL;
+}
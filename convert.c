@@ -9,6 +9,7 @@
 #include "sub-process.h"
 #include "utf8.h"
 #include "ll-merge.h"
+#include "streaming.h"
 
 /*
  * convert.c - convert a file when checking it out and checking it in.
@@ -1695,6 +1696,59 @@ static struct stream_filter *lf_to_crlf_filter(void)
 	return (struct stream_filter *)lf_to_crlf;
 }
 
+/*
+ * Like gather_stats(), but read the contents of the blob "oid" from a
+ * stream in pieces, so that a large blob does not have to be held in
+ * core to decide whether "auto" LF-to-CRLF conversion applies to it.
+ * Return -1 if the blob cannot be streamed.
+ */
+static int gather_stats_from_stream(const struct object_id *oid,
+				    struct text_stat *stats)
+{
+	struct git_istream *st;
+	enum object_type type;
+	unsigned long sz;
+	char buf[16384];
+	ssize_t readlen;
+	char last = 0;
+
+	st = open_istream(the_repository, oid, &type, &sz, NULL);
+	if (!st)
+		return -1;
+
+	memset(stats, 0, sizeof(*stats));
+	while ((readlen = read_istream(st, buf, sizeof(buf))) > 0) {
+		struct text_stat part;
+
+		gather_stats(buf, readlen, &part);
+
+		/* a CRLF split between two reads was counted as CR and LF */
+		if (last == '\r' && buf[0] == '\n') {
+			part.lonecr--;
+			part.lonelf--;
+			part.crlf++;
+		}
+		/* only a trailing EOF at the very end is discounted */
+		if (buf[readlen - 1] == '\032')
+			part.nonprintable++;
+		last = buf[readlen - 1];
+
+		stats->nul += part.nul;
+		stats->lonecr += part.lonecr;
+		stats->lonelf += part.lonelf;
+		stats->crlf += part.crlf;
+		stats->printable += part.printable;
+		stats->nonprintable += part.nonprintable;
+	}
+	close_istream(st);
+	if (readlen < 0)
+		return -1;
+
+	if (last == '\032')
+		stats->nonprintable--;
+	return 0;
+}
+
 /*
  * Cascade filter
  */
@@ -1966,7 +2020,28 @@ struct stream_filter *get_stream_filter_ca(const struct conv_attrs *ca,
 	if (ca->ident)
 		filter = ident_filter(oid);
 
-	if (output_eol(ca->crlf_action) == EOL_CRLF)
+	if (ca->crlf_action == CRLF_AUTO || ca->crlf_action == CRLF_AUTO_CRLF) {
+		struct text_stat stats;
+		unsigned long size;
+
+		/*
+		 * Whether to convert depends on the whole contents, so
+		 * read the blob once to decide and let the caller
+		 * stream it a second time. That is only worth it for
+		 * blobs too big to convert in core.
+		 */
+		if (oid_object_info(the_repository, oid, &size) != OBJ_BLOB ||
+		    size < big_file_threshold ||
+		    gather_stats_from_stream(oid, &stats)) {
+			if (filter)
+				free_stream_filter(filter);
+			return NULL;
+		}
+		if (will_convert_lf_to_crlf(&stats, ca->crlf_action))
+			filter = cascade_filter(filter, lf_to_crlf_filter());
+		else
+			filter = cascade_filter(filter, &null_filter_singleton);
+	} else if (output_eol(ca->crlf_action) == EOL_CRLF)
 		filter = cascade_filter(filter, lf_to_crlf_filter());
 	else
 		filter = cascade_filter(filter, &null_filter_singleton);
@@ -2029,8 +2104,5 @@ enum conv_attrs_classification classify_conv_attrs(const struct conv_attrs *ca)
 	if (ca->working_tree_encoding)
 		return CA_CLASS_INCORE;
 
-	if (ca->crlf_action == CRLF_AUTO || ca->crlf_action == CRLF_AUTO_CRLF)
-		return CA_CLASS_INCORE;
-
 	return CA_CLASS_STREAMABLE;
 }
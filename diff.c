@@ -6892,7 +6892,7 @@ int diff_can_quit_early(struct diff_options *opt)
  * Submodule changes can be configured to be ignored separately for each path,
  * but that configuration can be overridden from the command line.
  */
-static int is_submodule_ignored(const char *path, struct diff_options *options)
+int diff_submodule_is_ignored(const char *path, struct diff_options *options)
 {
 	int ignored = 0;
 	struct diff_flags orig_flags = options->flags;
@@ -6926,7 +6926,7 @@ void diff_addremove(struct diff_options *options,
 {
 	struct diff_filespec *one, *two;
 
-	if (S_ISGITLINK(mode) && is_submodule_ignored(concatpath, options))
+	if (S_ISGITLINK(mode) && diff_submodule_is_ignored(concatpath, options))
 		return;
 
 	/* This may look odd, but it is a preparation for
@@ -6976,7 +6976,7 @@ void diff_change(struct diff_options *options,
 	struct diff_filepair *p;
 
 	if (S_ISGITLINK(old_mode) && S_ISGITLINK(new_mode) &&
-	    is_submodule_ignored(concatpath, options))
+	    diff_submodule_is_ignored(concatpath, options))
 		return;
 
 	if (options->flags.reverse_diff) {
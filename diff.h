@@ -500,6 +500,12 @@ void diff_set_mnemonic_prefix(struct diff_options *options, const char *a, const
 
 int diff_can_quit_early(struct diff_options *);
 
+/*
+ * Shall changes to the submodule at "path" be ignored, given the
+ * submodule configuration and the flags in "options"?
+ */
+int diff_submodule_is_ignored(const char *path, struct diff_options *options);
+
 void diff_addremove(struct diff_options *,
 		    int addremove,
 		    unsigned mode,
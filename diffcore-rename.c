@@ -733,6 +733,40 @@ static void cleanup_dir_rename_info(struct dir_rename_info *info,
 	string_list_clear(&to_remove, 0);
 }
 
+void diffcore_rename_count_cached_pairs(struct strintmap *dirs_removed,
+					struct strmap *dir_rename_count,
+					struct strmap *cached_pairs)
+{
+	struct dir_rename_info info;
+	struct hashmap_iter iter;
+	struct strmap_entry *entry;
+
+	/*
+	 * Only the fields that update_dir_rename_counts() and
+	 * cleanup_dir_rename_info() look at need to be set up; there are
+	 * no rename_dst entries here, so idx_map and dir_rename_guess
+	 * simply stay empty.
+	 */
+	info.setup = 1;
+	info.dir_rename_count = dir_rename_count;
+	info.relevant_source_dirs = dirs_removed;
+	strintmap_init_with_options(&info.idx_map, -1, NULL, 0);
+	strmap_init_with_options(&info.dir_rename_guess, NULL, 0);
+
+	strmap_for_each_entry(cached_pairs, &iter, entry) {
+		const char *old_name = entry->key;
+		const char *new_name = entry->value;
+		if (!new_name)
+			/* known delete; ignore it */
+			continue;
+
+		update_dir_rename_counts(&info, dirs_removed,
+					 old_name, new_name);
+	}
+
+	cleanup_dir_rename_info(&info, dirs_removed, 1);
+}
+
 static const char *get_basename(const char *filename)
 {
 	/*
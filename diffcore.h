@@ -179,6 +179,16 @@ enum file_rename_relevance {
 
 void partial_clear_dir_rename_count(struct strmap *dir_rename_count);
 
+/*
+ * Add the renames recorded in cached_pairs (old path -> new path, or
+ * NULL for deletions) to dir_rename_count, as diffcore_rename_extended()
+ * would have done had it been run with them.  For callers that found
+ * every relevant rename in cached_pairs and skipped rename detection.
+ */
+void diffcore_rename_count_cached_pairs(struct strintmap *dirs_removed,
+					struct strmap *dir_rename_count,
+					struct strmap *cached_pairs);
+
 void diffcore_break(struct repository *, int);
 void diffcore_rename(struct diff_options *);
 void diffcore_rename_extended(struct diff_options *options,
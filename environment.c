@@ -34,6 +34,7 @@ int warn_ambiguous_refs = 1;
 int warn_on_object_refname_ambiguity = 1;
 int repository_format_precious_objects;
 int repository_format_worktree_config;
+int repository_format_packed_refs_delta;
 const char *git_commit_encoding;
 const char *git_log_output_encoding;
 char *apply_default_whitespace;
@@ -100,27 +100,54 @@ int oid_pos(const struct object_id *oid, const void *table, size_t nr,
 	return index_pos_to_insert_pos(lo);
 }
 
+/*
+ * Object names are uniformly distributed, so rather than always probing
+ * the middle of the slice of the table the fanout gives us, we can guess
+ * where a hash ought to be from its next four bytes. Every probe narrows
+ * down the values the remaining entries can have, so the guesses only
+ * get better; for a table of n entries this takes about log(log(n))
+ * probes instead of log(n). To keep a table of oddly distributed hashes
+ * from making this slower than a binary search, a probe that does not at
+ * least halve the range is followed by one in the middle.
+ */
 int bsearch_hash(const unsigned char *hash, const uint32_t *fanout_nbo,
 		 const unsigned char *table, size_t stride, uint32_t *result)
 {
 	uint32_t hi, lo;
+	/* all entries in [lo, hi) have values in [lov, hiv] */
+	uint64_t lov = 0, hiv = (uint64_t)1 << 32;
+	uint64_t want = get_be32(hash + 1);
+	int bisect = 0;
 
 	hi = ntohl(fanout_nbo[*hash]);
 	lo = ((*hash == 0x0) ? 0 : ntohl(fanout_nbo[*hash - 1]));
 
 	while (lo < hi) {
-		unsigned mi = lo + (hi - lo) / 2;
-		int cmp = hashcmp(table + mi * stride, hash);
+		uint32_t range = hi - lo;
+		unsigned mi;
+		int cmp;
+
+		if (bisect || hiv <= lov) {
+			mi = lo + range / 2;
+		} else {
+			uint64_t ofs = (want - lov) * range / (hiv - lov);
+			mi = lo + (ofs < range ? ofs : range - 1);
+		}
 
+		cmp = hashcmp(table + mi * stride, hash);
 		if (!cmp) {
 			if (result)
 				*result = mi;
 			return 1;
 		}
-		if (cmp > 0)
+		if (cmp > 0) {
 			hi = mi;
-		else
+			hiv = get_be32(table + mi * stride + 1);
+		} else {
 			lo = mi + 1;
+			lov = get_be32(table + mi * stride + 1);
+		}
+		bisect = !bisect && hi - lo > range / 2;
 	}
 
 	if (result)
@@ -10,7 +10,9 @@ int oid_pos(const struct object_id *oid,
 
 /*
  * Searches for hash in table, using the given fanout table to determine the
- * interval to search, then using binary search. Returns 1 if found, 0 if not.
+ * interval to search, then using interpolation search (falling back to
+ * binary search when the hashes are not evenly spread). Returns 1 if found,
+ * 0 if not.
  *
  * Takes the following parameters:
  *
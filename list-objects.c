@@ -12,6 +12,7 @@
 #include "packfile.h"
 #include "object-store.h"
 #include "trace.h"
+#include "thread-utils.h"
 
 struct traversal_context {
 	struct rev_info *revs;
@@ -433,6 +434,275 @@ static void do_traverse(struct traversal_context *ctx)
 	strbuf_release(&csp);
 }
 
+struct parallel_walk_item {
+	struct tree *tree;
+	char *path;
+};
+
+struct parallel_walk {
+	struct traversal_context *ctx;
+
+	/* protects the fields below */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct parallel_walk_item *queue;
+	size_t nr, alloc;
+	int nr_busy;
+	/* set once the calling thread will queue no more trees */
+	int done;
+
+	/* serializes calls to show_object() and show_commit() */
+	pthread_mutex_t show_mutex;
+};
+
+/*
+ * Mark "obj" as SEEN, returning 1 if this thread is the first to get
+ * to it (and should therefore show it), or 0 if it is UNINTERESTING or
+ * was already seen. The object table lock also serializes the updates
+ * to the flags of the object.
+ */
+static int parallel_mark_seen(struct parallel_walk *pw, struct object *obj,
+			      unsigned int flags)
+{
+	struct parsed_object_pool *pool = pw->ctx->revs->repo->parsed_objects;
+	int first = 0;
+
+	object_table_lock(pool);
+	obj->flags |= flags;
+	if (!(obj->flags & (UNINTERESTING | SEEN))) {
+		obj->flags |= SEEN;
+		first = 1;
+	}
+	object_table_unlock(pool);
+	return first;
+}
+
+static void parallel_show_object(struct parallel_walk *pw,
+				 struct object *obj, const char *path)
+{
+	pthread_mutex_lock(&pw->show_mutex);
+	show_object(pw->ctx, obj, path);
+	pthread_mutex_unlock(&pw->show_mutex);
+}
+
+static void parallel_queue_tree(struct parallel_walk *pw,
+				struct tree *tree, char *path)
+{
+	pthread_mutex_lock(&pw->mutex);
+	ALLOC_GROW(pw->queue, pw->nr + 1, pw->alloc);
+	pw->queue[pw->nr].tree = tree;
+	pw->queue[pw->nr].path = path;
+	pw->nr++;
+	pthread_cond_signal(&pw->cond);
+	pthread_mutex_unlock(&pw->mutex);
+}
+
+static void parallel_process_tree(struct parallel_walk *pw,
+				  struct parallel_walk_item *item)
+{
+	struct rev_info *revs = pw->ctx->revs;
+	struct tree *tree = item->tree;
+	struct strbuf base = STRBUF_INIT;
+	size_t baselen;
+	struct tree_desc desc;
+	struct name_entry entry;
+	enum object_type type;
+	unsigned long size;
+	void *buf;
+
+	/*
+	 * Read the tree ourselves instead of parsing it, so that
+	 * tree->buffer (which other threads may look at) stays alone.
+	 */
+	buf = repo_read_object_file(revs->repo, &tree->object.oid,
+				    &type, &size);
+	if (!buf || type != OBJ_TREE)
+		die("bad tree object %s", oid_to_hex(&tree->object.oid));
+
+	parallel_show_object(pw, &tree->object, item->path);
+
+	strbuf_addstr(&base, item->path);
+	if (base.len)
+		strbuf_addch(&base, '/');
+	baselen = base.len;
+
+	init_tree_desc(&desc, buf, size);
+	while (tree_entry(&desc, &entry)) {
+		strbuf_setlen(&base, baselen);
+		strbuf_addstr(&base, entry.path);
+
+		if (S_ISDIR(entry.mode)) {
+			struct tree *t = lookup_tree(revs->repo, &entry.oid);
+			if (!t) {
+				die(_("entry '%s' in tree %s has tree mode, "
+				      "but is not a tree"),
+				    entry.path, oid_to_hex(&tree->object.oid));
+			}
+			if (parallel_mark_seen(pw, &t->object, NOT_USER_GIVEN))
+				parallel_queue_tree(pw, t,
+						    xstrdup(base.buf));
+		} else if (S_ISGITLINK(entry.mode)) {
+			; /* see process_gitlink() */
+		} else if (revs->blob_objects) {
+			struct blob *b = lookup_blob(revs->repo, &entry.oid);
+			if (!b) {
+				die(_("entry '%s' in tree %s has blob mode, "
+				      "but is not a blob"),
+				    entry.path, oid_to_hex(&tree->object.oid));
+			}
+			if (parallel_mark_seen(pw, &b->object, NOT_USER_GIVEN))
+				parallel_show_object(pw, &b->object, base.buf);
+		}
+	}
+
+	strbuf_release(&base);
+	free(buf);
+}
+
+static void *parallel_walk_thread(void *data)
+{
+	struct parallel_walk *pw = data;
+
+	pthread_mutex_lock(&pw->mutex);
+	for (;;) {
+		struct parallel_walk_item item;
+
+		while (!pw->nr && !(pw->done && !pw->nr_busy))
+			pthread_cond_wait(&pw->cond, &pw->mutex);
+		if (!pw->nr)
+			break;
+
+		item = pw->queue[--pw->nr];
+		pw->nr_busy++;
+		pthread_mutex_unlock(&pw->mutex);
+
+		parallel_process_tree(pw, &item);
+		free(item.path);
+
+		pthread_mutex_lock(&pw->mutex);
+		pw->nr_busy--;
+		if (pw->done && !pw->nr_busy && !pw->nr)
+			pthread_cond_broadcast(&pw->cond);
+	}
+	pthread_mutex_unlock(&pw->mutex);
+	return NULL;
+}
+
+/*
+ * The parallel walk only works when the callbacks do not read objects
+ * themselves; "--verify-objects" parses each object it is shown.
+ */
+static int can_traverse_in_parallel(struct traversal_context *ctx)
+{
+	struct rev_info *revs = ctx->revs;
+
+	return HAVE_THREADS &&
+		revs->object_walk_threads > 1 &&
+		revs->tree_objects &&
+		!ctx->filter &&
+		!revs->diffopt.pathspec.nr &&
+		!revs->tree_blobs_in_commit_order &&
+		!revs->include_check_obj &&
+		!revs->ignore_missing_links &&
+		!revs->do_not_die_on_missing_tree &&
+		!revs->exclude_promisor_objects &&
+		!revs->verify_objects;
+}
+
+/*
+ * Like do_traverse(), but commits are walked in the calling thread
+ * while the trees they point at are walked by a pool of threads. Any
+ * tree is queued by whichever thread marks it SEEN first, so each
+ * object is still shown exactly once.
+ */
+static void do_traverse_parallel(struct traversal_context *ctx)
+{
+	struct rev_info *revs = ctx->revs;
+	struct parallel_walk pw = { .ctx = ctx };
+	struct parsed_object_pool *pool = revs->repo->parsed_objects;
+	int had_read_lock = obj_read_use_lock;
+	int had_table_lock = pool->obj_hash_use_lock;
+	pthread_t *threads;
+	struct commit *commit;
+	int i;
+
+	pthread_mutex_init(&pw.mutex, NULL);
+	pthread_cond_init(&pw.cond, NULL);
+	pthread_mutex_init(&pw.show_mutex, NULL);
+	enable_obj_read_lock();
+	enable_object_table_lock(pool);
+
+	CALLOC_ARRAY(threads, revs->object_walk_threads);
+	for (i = 0; i < revs->object_walk_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 parallel_walk_thread, &pw);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+
+	for (i = 0; i < revs->pending.nr; i++) {
+		struct object_array_entry *pending = revs->pending.objects + i;
+		struct object *obj = pending->item;
+		const char *path = pending->path ? pending->path : "";
+
+		if (obj->type == OBJ_TAG) {
+			if (parallel_mark_seen(&pw, obj, 0))
+				parallel_show_object(&pw, obj, pending->name);
+		} else if (obj->type == OBJ_TREE) {
+			if (parallel_mark_seen(&pw, obj, 0))
+				parallel_queue_tree(&pw, (struct tree *)obj,
+						    xstrdup(path));
+		} else if (obj->type == OBJ_BLOB) {
+			if (revs->blob_objects &&
+			    parallel_mark_seen(&pw, obj, 0))
+				parallel_show_object(&pw, obj, path);
+		} else if (!(obj->flags & (UNINTERESTING | SEEN))) {
+			die("unknown pending object %s (%s)",
+			    oid_to_hex(&obj->oid), pending->name);
+		}
+	}
+	object_array_clear(&revs->pending);
+
+	while ((commit = get_revision(revs)) != NULL) {
+		struct tree *tree = get_commit_tree(commit);
+
+		if (tree) {
+			if (parallel_mark_seen(&pw, &tree->object,
+					       NOT_USER_GIVEN))
+				parallel_queue_tree(&pw, tree, xstrdup(""));
+		} else if (commit->object.parsed) {
+			die(_("unable to load root tree for commit %s"),
+			      oid_to_hex(&commit->object.oid));
+		}
+
+		object_table_lock(pool);
+		commit->object.flags |= SEEN;
+		object_table_unlock(pool);
+
+		pthread_mutex_lock(&pw.show_mutex);
+		show_commit(ctx, commit);
+		pthread_mutex_unlock(&pw.show_mutex);
+	}
+
+	pthread_mutex_lock(&pw.mutex);
+	pw.done = 1;
+	pthread_cond_broadcast(&pw.cond);
+	pthread_mutex_unlock(&pw.mutex);
+
+	for (i = 0; i < revs->object_walk_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (!had_table_lock)
+		disable_object_table_lock(pool);
+	if (!had_read_lock)
+		disable_obj_read_lock();
+	free(pw.queue);
+	pthread_mutex_destroy(&pw.show_mutex);
+	pthread_cond_destroy(&pw.cond);
+	pthread_mutex_destroy(&pw.mutex);
+}
+
 void traverse_commit_list_filtered(
 	struct rev_info *revs,
 	show_commit_fn show_commit,
@@ -450,7 +720,10 @@ void traverse_commit_list_filtered(
 	if (revs->filter.choice)
 		ctx.filter = list_objects_filter__init(omitted, &revs->filter);
 
-	do_traverse(&ctx);
+	if (can_traverse_in_parallel(&ctx))
+		do_traverse_parallel(&ctx);
+	else
+		do_traverse(&ctx);
 
 	if (ctx.filter)
 		list_objects_filter__free(ctx.filter);
@@ -69,6 +69,28 @@ static int ref_match(const struct strvec *prefixes, const char *refname)
 	return 0;
 }
 
+/*
+ * Drop the prefixes that only refs sorting before "cursor" can start
+ * with, as none of those are on the requested page. Return the number
+ * of prefixes left.
+ */
+static int drop_prefixes_before_cursor(struct strvec *prefixes,
+				       const char *cursor)
+{
+	struct strvec kept = STRVEC_INIT;
+	int i;
+
+	for (i = 0; i < prefixes->nr; i++) {
+		const char *prefix = prefixes->v[i];
+
+		if (strcmp(prefix, cursor) > 0 || starts_with(cursor, prefix))
+			strvec_push(&kept, prefix);
+	}
+	strvec_clear(prefixes);
+	*prefixes = kept;
+	return prefixes->nr;
+}
+
 struct ls_refs_data {
 	unsigned peel;
 	unsigned symrefs;
@@ -76,6 +98,17 @@ struct ls_refs_data {
 	struct strbuf buf;
 	struct string_list hidden_refs;
 	unsigned unborn : 1;
+
+	/*
+	 * With "page-size", send at most page_size refs, followed by
+	 * a "next-cursor" line if there are more.
+	 */
+	unsigned int page_size;
+	unsigned int nr_sent;
+	struct strbuf last_sent;
+	unsigned more : 1;
+	/* With "cursor", only send refs that sort after it. */
+	char *cursor;
 };
 
 static int send_ref(const char *refname, const struct object_id *oid,
@@ -86,12 +119,25 @@ static int send_ref(const char *refname, const struct object_id *oid,
 
 	strbuf_reset(&data->buf);
 
+	/*
+	 * The ref iterators cannot seek, so every page walks the refs
+	 * before its cursor again; see "cursor" in gitprotocol-v2(5).
+	 */
+	if (data->cursor && strcmp(refname_nons, data->cursor) <= 0)
+		return 0;
+
 	if (ref_is_hidden(refname_nons, refname, &data->hidden_refs))
 		return 0;
 
 	if (!ref_match(&data->prefixes, refname_nons))
 		return 0;
 
+	if (data->page_size && data->nr_sent == data->page_size) {
+		/* the page is full; stop iterating */
+		data->more = 1;
+		return 1;
+	}
+
 	if (oid)
 		strbuf_addf(&data->buf, "%s %s", oid_to_hex(oid), refname_nons);
 	else
@@ -118,6 +164,11 @@ static int send_ref(const char *refname, const struct object_id *oid,
 	strbuf_addch(&data->buf, '\n');
 	packet_fwrite(stdout, data->buf.buf, data->buf.len);
 
+	if (data->page_size) {
+		data->nr_sent++;
+		strbuf_reset(&data->last_sent);
+		strbuf_addstr(&data->last_sent, refname_nons);
+	}
 	return 0;
 }
 
@@ -153,10 +204,12 @@ static int ls_refs_config(const char *var, const char *value,
 int ls_refs(struct repository *r, struct packet_reader *request)
 {
 	struct ls_refs_data data;
+	struct strvec excludes = STRVEC_INIT;
 
 	memset(&data, 0, sizeof(data));
 	strvec_init(&data.prefixes);
 	strbuf_init(&data.buf, 0);
+	strbuf_init(&data.last_sent, 0);
 	string_list_init_dup(&data.hidden_refs);
 
 	ensure_config_read();
@@ -176,6 +229,15 @@ int ls_refs(struct repository *r, struct packet_reader *request)
 		}
 		else if (!strcmp("unborn", arg))
 			data.unborn = allow_unborn;
+		else if (skip_prefix(arg, "page-size ", &out)) {
+			if (strtoul_ui(out, 10, &data.page_size) ||
+			    !data.page_size)
+				die(_("invalid page-size: '%s'"), out);
+		}
+		else if (skip_prefix(arg, "cursor ", &out)) {
+			free(data.cursor);
+			data.cursor = xstrdup(out);
+		}
 		else
 			die(_("unexpected line: '%s'"), arg);
 	}
@@ -191,15 +253,34 @@ int ls_refs(struct repository *r, struct packet_reader *request)
 	if (data.prefixes.nr >= TOO_MANY_PREFIXES)
 		strvec_clear(&data.prefixes);
 
-	send_possibly_unborn_head(&data);
-	if (!data.prefixes.nr)
-		strvec_push(&data.prefixes, "");
-	for_each_fullref_in_prefixes(get_git_namespace(), data.prefixes.v,
-				     send_ref, &data);
+	/*
+	 * Let the ref backend skip over whole namespaces of hidden refs
+	 * instead of having send_ref() reject them one at a time.
+	 */
+	hidden_refs_to_excludes(&data.hidden_refs, get_git_namespace(),
+				&excludes);
+
+	if (data.cursor && data.prefixes.nr &&
+	    !drop_prefixes_before_cursor(&data.prefixes, data.cursor)) {
+		; /* all of the refs asked for come before the cursor */
+	} else {
+		send_possibly_unborn_head(&data);
+		if (!data.prefixes.nr)
+			strvec_push(&data.prefixes, "");
+		for_each_fullref_in_prefixes(get_git_namespace(),
+					     data.prefixes.v, excludes.v,
+					     send_ref, &data);
+	}
+	if (data.more)
+		packet_fwrite_fmt(stdout, "next-cursor %s\n",
+				  data.last_sent.buf);
 	packet_fflush(stdout);
 	strvec_clear(&data.prefixes);
+	strvec_clear(&excludes);
 	strbuf_release(&data.buf);
+	strbuf_release(&data.last_sent);
 	string_list_clear(&data.hidden_refs, 0);
+	free(data.cursor);
 	return 0;
 }
 
@@ -208,7 +289,8 @@ int ls_refs_advertise(struct repository *r, struct strbuf *value)
 	if (value) {
 		ensure_config_read();
 		if (advertise_unborn)
-			strbuf_addstr(value, "unborn");
+			strbuf_addstr(value, "unborn ");
+		strbuf_addstr(value, "page");
 	}
 
 	return 1;
@@ -7,6 +7,13 @@
 
 #define BLOCK_GROWTH_SIZE (1024 * 1024 - sizeof(struct mp_block))
 
+/*
+ * Blocks at least this large are typically sized up front for a known
+ * amount of data (e.g. all the cache entries of a large index) and get
+ * filled right away.
+ */
+#define HUGE_PAGE_BLOCK_SIZE (8 * 1024 * 1024)
+
 /*
  * The inner union is an approximation for C11's max_align_t, and the
  * struct + offsetof computes _Alignof. This can all just be replaced
@@ -27,6 +34,23 @@ struct git_max_alignment {
 };
 #define GIT_MAX_ALIGNMENT offsetof(struct git_max_alignment, aligned)
 
+/*
+ * Ask the kernel to back a large block with transparent huge pages
+ * where supported; faulting in hundreds of megabytes one small page at
+ * a time otherwise costs more than filling them.
+ */
+static void advise_huge_pages(void *start, size_t len)
+{
+#if !defined(NO_MMAP) && defined(MADV_HUGEPAGE)
+	uintptr_t page_size = (uintptr_t)getpagesize();
+	uintptr_t begin = ((uintptr_t)start + page_size - 1) & ~(page_size - 1);
+	uintptr_t end = ((uintptr_t)start + len) & ~(page_size - 1);
+
+	if (begin < end)
+		madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+#endif
+}
+
 /*
  * Allocate a new mp_block and insert it after the block specified in
  * `insert_after`. If `insert_after` is NULL, then insert block at the
@@ -44,6 +68,9 @@ static struct mp_block *mem_pool_alloc_block(struct mem_pool *pool,
 	p->next_free = (char *)p->space;
 	p->end = p->next_free + block_alloc;
 
+	if (block_alloc >= HUGE_PAGE_BLOCK_SIZE)
+		advise_huge_pages(p->space, block_alloc);
+
 	if (insert_after) {
 		p->next_block = insert_after->next_block;
 		insert_after->next_block = p;
@@ -28,6 +28,7 @@
 #include "dir.h"
 #include "entry.h"
 #include "ll-merge.h"
+#include "lockfile.h"
 #include "object-store.h"
 #include "promisor-remote.h"
 #include "revision.h"
@@ -260,6 +261,18 @@ struct rename_info {
 	 */
 	struct strset cached_irrelevant[3];
 
+	/*
+	 * cached_pairs_from_disk: whether cached_pairs[side] was seeded
+	 *
+	 * With merge.renameCache, renames detected between the merge base
+	 * and each side are also saved on disk, keyed by the two trees, and
+	 * loaded into cached_pairs[side] by a later merge of the same trees.
+	 * Unlike cached_pairs carried over from a previous merge in this
+	 * process, those come without the matching dir_rename_count[side],
+	 * so this flag tells detect_regular_renames() to compute it.
+	 */
+	unsigned cached_pairs_from_disk[3];
+
 	/*
 	 * redo_after_renames: optimization flag for "restarting" the merge
 	 *
@@ -654,6 +667,7 @@ static void clear_or_reinit_internal_opts(struct merge_options_internal *opti,
 		strintmap_clear_func(&renames->dirs_removed[i]);
 		strmap_clear_func(&renames->dir_renames[i], 0);
 		strintmap_clear_func(&renames->relevant_sources[i]);
+		renames->cached_pairs_from_disk[i] = 0;
 		if (!reinitialize)
 			assert(renames->cached_pairs_valid_side == 0);
 		if (i != renames->cached_pairs_valid_side &&
@@ -3212,8 +3226,235 @@ static int compare_pairs(const void *a_, const void *b_)
 	return strcmp(a->one->path, b->one->path);
 }
 
+static void rename_cache_path(struct strbuf *sb,
+			      struct merge_options *opt,
+			      struct tree *merge_base,
+			      struct tree *side)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct object_id oid;
+	git_hash_ctx ctx;
+
+	/*
+	 * Anything that changes which renames diffcore_rename_extended()
+	 * would find for the same pair of trees must be part of the key.
+	 */
+	strbuf_addf(&key, "merge-renames v1\n%s\n%s\n%d\n",
+		    oid_to_hex(&merge_base->object.oid),
+		    oid_to_hex(&side->object.oid),
+		    opt->rename_score);
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, key.buf, key.len);
+	the_hash_algo->final_oid_fn(&oid, &ctx);
+	strbuf_release(&key);
+
+	strbuf_git_common_path(sb, opt->repo, "merge-renames/%s",
+			       oid_to_hex(&oid));
+}
+
+/*
+ * The cache file is a sequence of "<old path> NUL <new path> NUL" records,
+ * with an empty <new path> for a source that was found to be deleted.
+ * Calls fn() for each record and returns the number of records, or -1
+ * (before calling fn() at all) if the file is truncated.
+ */
+static int for_each_rename_cache_record(struct strbuf *buf,
+					void (*fn)(const char *old_path,
+						   const char *new_path,
+						   void *data),
+					void *data)
+{
+	const char *p = buf->buf, *end = buf->buf + buf->len;
+	int nr = 0;
+
+	if (buf->len && buf->buf[buf->len - 1])
+		return -1;
+	while (p < end) {
+		const char *new_path = p + strlen(p) + 1;
+		if (new_path >= end || !*p)
+			return -1;
+		p = new_path + strlen(new_path) + 1;
+		nr++;
+	}
+
+	for (p = buf->buf; p < end; p += strlen(p) + 1) {
+		const char *old_path = p;
+		p += strlen(p) + 1;
+		fn(old_path, p, data);
+	}
+	return nr;
+}
+
+struct load_cached_pair_data {
+	struct rename_info *renames;
+	unsigned side;
+};
+
+static void load_cached_pair(const char *old_path, const char *new_path,
+			     void *data_)
+{
+	struct load_cached_pair_data *data = data_;
+	struct rename_info *renames = data->renames;
+	unsigned side = data->side;
+
+	if (strmap_contains(&renames->cached_pairs[side], old_path))
+		return;
+	if (*new_path)
+		cache_new_pair(renames, side, (char *)old_path,
+			       (char *)new_path, 0);
+	else
+		strmap_put(&renames->cached_pairs[side], old_path, NULL);
+}
+
+static void load_rename_cache(struct merge_options *opt,
+			      struct tree *merge_base,
+			      struct tree *side,
+			      unsigned side_index)
+{
+	struct rename_info *renames = &opt->priv->renames;
+	struct load_cached_pair_data data = { renames, side_index };
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	int nr;
+
+	/*
+	 * cached_pairs left over from the previous merge in this process
+	 * are already at least as good; don't mix the two.
+	 */
+	if (renames->cached_pairs_valid_side == side_index ||
+	    renames->cached_pairs_valid_side == -1)
+		return;
+
+	rename_cache_path(&path, opt, merge_base, side);
+	if (strbuf_read_file(&buf, path.buf, 0) < 0)
+		goto out;
+
+	nr = for_each_rename_cache_record(&buf, load_cached_pair, &data);
+	if (nr > 0) {
+		renames->cached_pairs_from_disk[side_index] = 1;
+		/* Mark the entry as used, for merge_prune_rename_cache() */
+		if (utime(path.buf, NULL) < 0)
+			warning_errno(_("failed utime() on '%s'"), path.buf);
+	}
+	trace2_data_intmax("merge", opt->repo,
+			   side_index == MERGE_SIDE1 ?
+			   "rename_cache/loaded_side1" :
+			   "rename_cache/loaded_side2", nr);
+out:
+	strbuf_release(&buf);
+	strbuf_release(&path);
+}
+
+static void note_cached_path(const char *old_path, const char *new_path,
+			     void *data)
+{
+	strset_add(data, old_path);
+}
+
+static void save_rename_cache(struct merge_options *opt,
+			      struct tree *merge_base,
+			      struct tree *side,
+			      unsigned side_index)
+{
+	struct rename_info *renames = &opt->priv->renames;
+	struct diff_queue_struct *pairs = &renames->pairs[side_index];
+	struct lock_file lock = LOCK_INIT;
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	struct strset seen = STRSET_INIT;
+	int i, nr = 0;
+
+	rename_cache_path(&path, opt, merge_base, side);
+	if (safe_create_leading_directories(path.buf) ||
+	    hold_lock_file_for_update(&lock, path.buf, 0) < 0)
+		goto out; /* it is only a cache; another merge may be writing */
+
+	if (strbuf_read_file(&buf, path.buf, 0) < 0 ||
+	    for_each_rename_cache_record(&buf, note_cached_path, &seen) < 0)
+		strbuf_reset(&buf);
+
+	/*
+	 * Save the same renames and deletes that possibly_cache_new_pair()
+	 * would keep in cached_pairs for the next merge.  Renames induced
+	 * by directory rename detection depend on the other side of the
+	 * merge, so they are not known yet and are never saved.
+	 */
+	for (i = 0; i < pairs->nr; i++) {
+		struct diff_filepair *p = pairs->queue[i];
+
+		if (p->status != 'R' && p->status != 'D')
+			continue;
+		if (strintmap_get(&renames->relevant_sources[side_index],
+				  p->one->path) <= 0)
+			continue;
+		if (!strset_add(&seen, p->one->path))
+			continue;
+		strbuf_add(&buf, p->one->path, strlen(p->one->path) + 1);
+		if (p->status == 'R')
+			strbuf_addstr(&buf, p->two->path);
+		strbuf_addch(&buf, '\0');
+		nr++;
+	}
+
+	if (!nr) {
+		rollback_lock_file(&lock);
+		goto out;
+	}
+	if (write_in_full(get_lock_file_fd(&lock), buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lock) < 0) {
+		rollback_lock_file(&lock);
+		goto out;
+	}
+	trace2_data_intmax("merge", opt->repo,
+			   side_index == MERGE_SIDE1 ?
+			   "rename_cache/saved_side1" :
+			   "rename_cache/saved_side2", nr);
+out:
+	strset_clear(&seen);
+	strbuf_release(&buf);
+	strbuf_release(&path);
+}
+
+void merge_prune_rename_cache(struct repository *r, timestamp_t expire)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct object_id oid;
+	struct dirent *e;
+	size_t baselen;
+	DIR *dir;
+
+	strbuf_git_common_path(&path, r, "merge-renames");
+	dir = opendir(path.buf);
+	if (!dir)
+		goto out;
+	strbuf_addch(&path, '/');
+	baselen = path.len;
+
+	while ((e = readdir_skip_dot_and_dotdot(dir))) {
+		struct stat st;
+		const char *end;
+
+		/* leave alone what merge-ort did not write */
+		if (parse_oid_hex(e->d_name, &oid, &end) || *end)
+			continue;
+		strbuf_setlen(&path, baselen);
+		strbuf_addstr(&path, e->d_name);
+		if (!lstat(path.buf, &st) && S_ISREG(st.st_mode) &&
+		    st.st_mtime <= expire)
+			unlink_or_warn(path.buf);
+	}
+	closedir(dir);
+
+	strbuf_setlen(&path, baselen - 1);
+	rmdir(path.buf); /* only succeeds once the cache is empty */
+out:
+	strbuf_release(&path);
+}
+
 /* Call diffcore_rename() to update deleted/added pairs into rename pairs */
 static int detect_regular_renames(struct merge_options *opt,
+				  struct tree *merge_base,
+				  struct tree *side,
 				  unsigned side_index)
 {
 	struct diff_options diff_opts;
@@ -3227,6 +3468,12 @@ static int detect_regular_renames(struct merge_options *opt,
 		 * side had directory renames.
 		 */
 		resolve_diffpair_statuses(&renames->pairs[side_index]);
+		if (renames->cached_pairs_from_disk[side_index]) {
+			partial_clear_dir_rename_count(&renames->dir_rename_count[side_index]);
+			diffcore_rename_count_cached_pairs(&renames->dirs_removed[side_index],
+							   &renames->dir_rename_count[side_index],
+							   &renames->cached_pairs[side_index]);
+		}
 		return 0;
 	}
 
@@ -3260,6 +3507,9 @@ static int detect_regular_renames(struct merge_options *opt,
 		renames->needed_limit = diff_opts.needed_rename_limit;
 
 	renames->pairs[side_index] = diff_queued_diff;
+	if (!diff_opts.needed_rename_limit &&
+	    opt->rename_cache && !opt->priv->call_depth)
+		save_rename_cache(opt, merge_base, side, side_index);
 
 	diff_opts.output_format = DIFF_FORMAT_NO_OUTPUT;
 	diff_queued_diff.nr = 0;
@@ -3346,8 +3596,10 @@ static int detect_and_process_renames(struct merge_options *opt,
 		goto cleanup;
 
 	trace2_region_enter("merge", "regular renames", opt->repo);
-	detection_run |= detect_regular_renames(opt, MERGE_SIDE1);
-	detection_run |= detect_regular_renames(opt, MERGE_SIDE2);
+	detection_run |= detect_regular_renames(opt, merge_base, side1,
+						MERGE_SIDE1);
+	detection_run |= detect_regular_renames(opt, merge_base, side2,
+						MERGE_SIDE2);
 	if (renames->needed_limit) {
 		renames->cached_pairs_valid_side = 0;
 		renames->redo_after_renames = 0;
@@ -4955,6 +5207,13 @@ static void merge_ort_nonrecursive_internal(struct merge_options *opt,
 					       opt->subtree_shift);
 	}
 
+	if (opt->rename_cache && !opt->priv->call_depth) {
+		trace2_region_enter("merge", "load rename cache", opt->repo);
+		load_rename_cache(opt, merge_base, side1, MERGE_SIDE1);
+		load_rename_cache(opt, merge_base, side2, MERGE_SIDE2);
+		trace2_region_leave("merge", "load rename cache", opt->repo);
+	}
+
 redo:
 	trace2_region_enter("merge", "collect_merge_info", opt->repo);
 	if (collect_merge_info(opt, merge_base, side1, side2) != 0) {
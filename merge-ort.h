@@ -114,4 +114,10 @@ void merge_get_conflicted_files(struct merge_result *result,
 void merge_finalize(struct merge_options *opt,
 		    struct merge_result *result);
 
+/*
+ * Remove the entries of the merge.renameCache that have not been written
+ * or used since the `expire` time.
+ */
+void merge_prune_rename_cache(struct repository *r, timestamp_t expire);
+
 #endif
@@ -3851,6 +3851,7 @@ static void merge_recursive_config(struct merge_options *opt)
 	git_config_get_int("merge.verbosity", &opt->verbosity);
 	git_config_get_int("diff.renamelimit", &opt->rename_limit);
 	git_config_get_int("merge.renamelimit", &opt->rename_limit);
+	git_config_get_bool("merge.renamecache", &opt->rename_cache);
 	git_config_get_bool("merge.renormalize", &renormalize);
 	opt->renormalize = renormalize;
 	if (!git_config_get_string("diff.renames", &value)) {
@@ -28,6 +28,7 @@ struct merge_options {
 	int rename_limit;
 	int rename_score;
 	int show_rename_progress;
+	int rename_cache;
 
 	/* xdiff-related options (patience, ignore whitespace, ours/theirs) */
 	long xdl_opts;
@@ -0,0 +1,265 @@
+#include "cache.h"
+#include "config.h"
+#include "commit.h"
+#include "metadata-ipc.h"
+#include "object-store.h"
+#include "oid-array.h"
+#include "replace-object.h"
+#include "repository.h"
+#include "shallow.h"
+#include "simple-ipc.h"
+#include "trace2.h"
+
+#ifndef SUPPORTS_SIMPLE_IPC
+
+/*
+ * A trivial implementation of the metadata_ipc API for unsupported
+ * platforms.
+ */
+
+int metadata_ipc_is_supported(void)
+{
+	return 0;
+}
+
+char *metadata_ipc_get_path(struct repository *r)
+{
+	return NULL;
+}
+
+enum ipc_active_state metadata_ipc_get_state(struct repository *r)
+{
+	return IPC_STATE__OTHER_ERROR;
+}
+
+int metadata_ipc_send_command(struct repository *r, const char *command,
+			      struct strbuf *answer)
+{
+	return -1;
+}
+
+int metadata_ipc_get_oid(struct repository *r, const char *name,
+			 struct object_id *oid)
+{
+	return -1;
+}
+
+int metadata_ipc_object_info(struct repository *r,
+			     const struct object_id *oid,
+			     enum object_type *type, unsigned long *size)
+{
+	return -1;
+}
+
+int metadata_ipc_merge_bases(struct repository *r,
+			     const char *one, const char *two,
+			     struct oid_array *bases)
+{
+	return -1;
+}
+
+#else
+
+int metadata_ipc_is_supported(void)
+{
+	return 1;
+}
+
+char *metadata_ipc_get_path(struct repository *r)
+{
+	return repo_git_path(r, "metadata--daemon.ipc");
+}
+
+enum ipc_active_state metadata_ipc_get_state(struct repository *r)
+{
+	char *path = metadata_ipc_get_path(r);
+	enum ipc_active_state state = ipc_get_active_state(path);
+
+	free(path);
+	return state;
+}
+
+int metadata_ipc_send_command(struct repository *r, const char *command,
+			      struct strbuf *answer)
+{
+	struct ipc_client_connection *connection = NULL;
+	struct ipc_client_connect_options options
+		= IPC_CLIENT_CONNECT_OPTIONS_INIT;
+	enum ipc_active_state state;
+	char *path;
+	int ret;
+
+	strbuf_reset(answer);
+
+	options.wait_if_busy = 1;
+	options.wait_if_not_found = 0;
+
+	path = metadata_ipc_get_path(r);
+	state = ipc_client_try_connect(path, &options, &connection);
+	free(path);
+	if (state != IPC_STATE__LISTENING)
+		return -1;
+
+	trace2_region_enter("metadata_client", "query", r);
+	ret = ipc_client_send_command_to_connection(connection, command,
+						    strlen(command), answer);
+	ipc_client_close_connection(connection);
+	trace2_region_leave("metadata_client", "query", r);
+
+	return ret;
+}
+
+/*
+ * The daemon reads objects without replacements, and loads grafts and
+ * the shallow file only once; only ask it when neither can make a
+ * difference.
+ */
+static int use_daemon(struct repository *r, int walks_history)
+{
+	int enabled;
+
+	if (!r->gitdir)
+		return 0;
+	if (repo_config_get_bool(r, "core.metadatadaemon", &enabled) ||
+	    !enabled)
+		return 0;
+
+	if (read_replace_refs) {
+		prepare_replace_object(r);
+		if (hashmap_get_size(&r->objects->replace_map->map))
+			return 0;
+	}
+	if (walks_history) {
+		prepare_commit_graft(r);
+		if (r->parsed_objects->grafts_nr || is_repository_shallow(r))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Names that refer to the index (":path"), are relative to the current
+ * directory ("HEAD:./path") or depend on configuration ("@{upstream}")
+ * are resolved locally, as are names that would not fit the protocol.
+ */
+static int name_is_portable(const char *name)
+{
+	return *name && *name != '-' && !strpbrk(name, ": \n") &&
+		!strstr(name, "@{");
+}
+
+static int query(struct repository *r, const char *command,
+		 struct strbuf *answer, const char **rest)
+{
+	if (metadata_ipc_send_command(r, command, answer) < 0)
+		return -1;
+	if (!strcmp(answer->buf, "ok")) {
+		*rest = answer->buf + answer->len;
+		return 0;
+	}
+	if (skip_prefix(answer->buf, "ok ", rest))
+		return 0;
+	return -1;
+}
+
+int metadata_ipc_get_oid(struct repository *r, const char *name,
+			 struct object_id *oid)
+{
+	struct strbuf command = STRBUF_INIT;
+	struct strbuf answer = STRBUF_INIT;
+	const char *p;
+	int ret = -1;
+
+	if (!name_is_portable(name) || !use_daemon(r, 1))
+		return -1;
+
+	/* a full object name needs no round trip */
+	if (!parse_oid_hex_algop(name, oid, &p, r->hash_algo) && !*p)
+		return 0;
+
+	strbuf_addf(&command, "get-oid %s", name);
+	if (!query(r, command.buf, &answer, &p) &&
+	    !parse_oid_hex_algop(p, oid, &p, r->hash_algo) && !*p)
+		ret = 0;
+
+	strbuf_release(&command);
+	strbuf_release(&answer);
+	return ret;
+}
+
+int metadata_ipc_object_info(struct repository *r,
+			     const struct object_id *oid,
+			     enum object_type *type, unsigned long *size)
+{
+	struct strbuf command = STRBUF_INIT;
+	struct strbuf answer = STRBUF_INIT;
+	const char *p;
+	char *end;
+	int t;
+	unsigned long sz;
+	int ret = -1;
+
+	if (!use_daemon(r, 0))
+		return -1;
+
+	strbuf_addf(&command, "object-info %s", oid_to_hex(oid));
+	if (query(r, command.buf, &answer, &p))
+		goto out;
+	end = strchr(p, ' ');
+	if (!end || (t = type_from_string_gently(p, end - p, 1)) < 0)
+		goto out;
+	sz = strtoul(end + 1, &end, 10);
+	if (*end)
+		goto out;
+
+	if (type)
+		*type = t;
+	if (size)
+		*size = sz;
+	ret = 0;
+
+out:
+	strbuf_release(&command);
+	strbuf_release(&answer);
+	return ret;
+}
+
+int metadata_ipc_merge_bases(struct repository *r,
+			     const char *one, const char *two,
+			     struct oid_array *bases)
+{
+	struct strbuf command = STRBUF_INIT;
+	struct strbuf answer = STRBUF_INIT;
+	struct oid_array result = OID_ARRAY_INIT;
+	const char *p;
+	size_t i;
+	int ret = -1;
+
+	if (!name_is_portable(one) || !name_is_portable(two) ||
+	    !use_daemon(r, 1))
+		return -1;
+
+	strbuf_addf(&command, "merge-base %s %s", one, two);
+	if (query(r, command.buf, &answer, &p))
+		goto out;
+	while (*p) {
+		struct object_id oid;
+
+		if (parse_oid_hex_algop(p, &oid, &p, r->hash_algo) ||
+		    (*p && *p++ != ' '))
+			goto out;
+		oid_array_append(&result, &oid);
+	}
+
+	for (i = 0; i < result.nr; i++)
+		oid_array_append(bases, &result.oid[i]);
+	ret = 0;
+
+out:
+	oid_array_clear(&result);
+	strbuf_release(&command);
+	strbuf_release(&answer);
+	return ret;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef METADATA_IPC_H
+#define METADATA_IPC_H
+
+#include "simple-ipc.h"
+
+struct repository;
+struct object_id;
+struct oid_array;
+
+/*
+ * A `git metadata--daemon` process keeps the object store (pack
+ * indexes, multi-pack-index, commit-graph) and parsed commits of a
+ * repository loaded, and answers simple questions about objects, names
+ * and merge bases on behalf of short-lived Git processes that would
+ * otherwise have to load all of that themselves.
+ *
+ * The daemon is only consulted when `core.metadataDaemon` is true and
+ * the question can be answered without depending on state the daemon
+ * may not share with the caller (replace refs, grafts, shallow
+ * boundaries, the index, or the current directory). Every function
+ * below returns 0 when the daemon answered, and -1 when the caller
+ * must find out for itself, e.g. because no daemon is running, the
+ * daemon does not know, or the question is not one it may answer.
+ */
+
+/*
+ * Returns true if the metadata daemon is supported on this platform.
+ */
+int metadata_ipc_is_supported(void);
+
+/*
+ * Returns the pathname of the Unix domain socket (or named pipe) on
+ * which the daemon for the current worktree of `r` listens. The caller
+ * must free the result.
+ */
+char *metadata_ipc_get_path(struct repository *r);
+
+/*
+ * Try to determine whether there is a daemon listening for `r`.
+ */
+enum ipc_active_state metadata_ipc_get_state(struct repository *r);
+
+/*
+ * Send a raw command to the daemon, if one is listening, and store
+ * its response in `answer`.
+ */
+int metadata_ipc_send_command(struct repository *r, const char *command,
+			      struct strbuf *answer);
+
+/*
+ * Resolve `name` like repo_get_oid() would. A full hexadecimal object
+ * name is parsed right away, without asking the daemon.
+ */
+int metadata_ipc_get_oid(struct repository *r, const char *name,
+			 struct object_id *oid);
+
+/*
+ * Look up the type and size of an existing object. Either of `type`
+ * or `size` may be NULL.
+ */
+int metadata_ipc_object_info(struct repository *r,
+			     const struct object_id *oid,
+			     enum object_type *type, unsigned long *size);
+
+/*
+ * Resolve the two names to commits and append their merge bases to
+ * `bases`, in the order repo_get_merge_bases() returns them.
+ */
+int metadata_ipc_merge_bases(struct repository *r,
+			     const char *one, const char *two,
+			     struct oid_array *bases);
+
+#endif /* METADATA_IPC_H */
@@ -84,7 +84,8 @@ static void insert_obj_hash(struct object *obj, struct object **hash, unsigned i
  * Look up the record for the given sha1 in the hash map stored in
  * obj_hash.  Return NULL if it was not found.
  */
-struct object *lookup_object(struct repository *r, const struct object_id *oid)
+static struct object *lookup_object_unlocked(struct repository *r,
+					     const struct object_id *oid)
 {
 	unsigned int i, first;
 	struct object *obj;
@@ -112,6 +113,16 @@ struct object *lookup_object(struct repository *r, const struct object_id *oid)
 	return obj;
 }
 
+struct object *lookup_object(struct repository *r, const struct object_id *oid)
+{
+	struct object *obj;
+
+	object_table_lock(r->parsed_objects);
+	obj = lookup_object_unlocked(r, oid);
+	object_table_unlock(r->parsed_objects);
+	return obj;
+}
+
 /*
  * Increase the size of the hash map stored in obj_hash to the next
  * power of 2 (but at least 32).  Copy the existing values to the new
@@ -140,7 +151,8 @@ static void grow_object_hash(struct repository *r)
 	r->parsed_objects->obj_hash_size = new_hash_size;
 }
 
-void *create_object(struct repository *r, const struct object_id *oid, void *o)
+static void *create_object_unlocked(struct repository *r,
+				    const struct object_id *oid, void *o)
 {
 	struct object *obj = o;
 
@@ -157,32 +169,60 @@ void *create_object(struct repository *r, const struct object_id *oid, void *o)
 	return obj;
 }
 
-void *object_as_type(struct object *obj, enum object_type type, int quiet)
+void *create_object(struct repository *r, const struct object_id *oid, void *o)
+{
+	object_table_lock(r->parsed_objects);
+	o = create_object_unlocked(r, oid, o);
+	object_table_unlock(r->parsed_objects);
+	return o;
+}
+
+struct object *lookup_or_create_object(struct repository *r,
+				       const struct object_id *oid,
+				       void *(*alloc_node)(struct repository *))
+{
+	struct object *obj;
+
+	object_table_lock(r->parsed_objects);
+	obj = lookup_object_unlocked(r, oid);
+	if (!obj)
+		obj = create_object_unlocked(r, oid, alloc_node(r));
+	object_table_unlock(r->parsed_objects);
+	return obj;
+}
+
+void *object_as_type(struct repository *r, struct object *obj,
+		     enum object_type type, int quiet)
 {
+	/*
+	 * Once an object's type is set, it never changes, so reading it
+	 * without the lock is fine; only setting the type of an object
+	 * created by lookup_unknown_object() needs the lock.
+	 */
 	if (obj->type == type)
 		return obj;
-	else if (obj->type == OBJ_NONE) {
+
+	object_table_lock(r->parsed_objects);
+	if (obj->type == OBJ_NONE) {
 		if (type == OBJ_COMMIT)
 			init_commit_node((struct commit *) obj);
 		else
 			obj->type = type;
-		return obj;
-	}
-	else {
-		if (!quiet)
-			error(_("object %s is a %s, not a %s"),
-			      oid_to_hex(&obj->oid),
-			      type_name(obj->type), type_name(type));
-		return NULL;
 	}
+	object_table_unlock(r->parsed_objects);
+
+	if (obj->type == type)
+		return obj;
+	if (!quiet)
+		error(_("object %s is a %s, not a %s"),
+		      oid_to_hex(&obj->oid),
+		      type_name(obj->type), type_name(type));
+	return NULL;
 }
 
 struct object *lookup_unknown_object(struct repository *r, const struct object_id *oid)
 {
-	struct object *obj = lookup_object(r, oid);
-	if (!obj)
-		obj = create_object(r, oid, alloc_object_node(r));
-	return obj;
+	return lookup_or_create_object(r, oid, alloc_object_node);
 }
 
 struct object *lookup_object_by_type(struct repository *r,
@@ -516,6 +556,24 @@ struct parsed_object_pool *parsed_object_pool_new(void)
 	return o;
 }
 
+void enable_object_table_lock(struct parsed_object_pool *o)
+{
+	if (o->obj_hash_use_lock)
+		return;
+
+	init_recursive_mutex(&o->obj_hash_mutex);
+	o->obj_hash_use_lock = 1;
+}
+
+void disable_object_table_lock(struct parsed_object_pool *o)
+{
+	if (!o->obj_hash_use_lock)
+		return;
+
+	o->obj_hash_use_lock = 0;
+	pthread_mutex_destroy(&o->obj_hash_mutex);
+}
+
 struct raw_object_store *raw_object_store_new(void)
 {
 	struct raw_object_store *o = xmalloc(sizeof(*o));
@@ -597,6 +655,7 @@ void parsed_object_pool_clear(struct parsed_object_pool *o)
 
 	FREE_AND_NULL(o->obj_hash);
 	o->obj_hash_size = 0;
+	disable_object_table_lock(o);
 
 	free_commit_buffer_slab(o->buffer_slab);
 	o->buffer_slab = NULL;
@@ -2,6 +2,7 @@
 #define OBJECT_H
 
 #include "cache.h"
+#include "thread-utils.h"
 
 struct buffer_slab;
 
@@ -9,6 +10,10 @@ struct parsed_object_pool {
 	struct object **obj_hash;
 	int nr_objs, obj_hash_size;
 
+	/* see enable_object_table_lock() */
+	int obj_hash_use_lock;
+	pthread_mutex_t obj_hash_mutex;
+
 	/* TODO: migrate alloc_states to mem-pool? */
 	struct alloc_state *blob_state;
 	struct alloc_state *tree_state;
@@ -33,6 +38,43 @@ struct parsed_object_pool {
 struct parsed_object_pool *parsed_object_pool_new(void);
 void parsed_object_pool_clear(struct parsed_object_pool *o);
 
+/*
+ * Enabling the object table lock allows multiple threads to safely call
+ * the following functions in parallel on the same repository:
+ * lookup_object(), lookup_unknown_object(), lookup_object_by_type(),
+ * lookup_blob(), lookup_tree(), lookup_commit(), lookup_tag() and
+ * object_as_type(). Looking up an object that does not exist yet creates
+ * it exactly once, even if several threads race to do so.
+ *
+ * Together with enable_obj_read_lock(), this also makes
+ * parse_object_with_flags() safe to call from multiple threads with
+ * PARSE_OBJECT_SKIP_HASH_CHECK (checking a blob streams it, which is not
+ * thread-safe), as long as no two threads parse the same object at the
+ * same time, save_commit_buffer is off, and the lazily-loaded grafts (see
+ * prepare_commit_graft()) and commit-graph have been loaded or disabled
+ * beforehand.
+ *
+ * object_table_lock() and object_table_unlock() may be used to protect
+ * other sections which must not run in parallel with object lookups;
+ * the lock is a recursive mutex, so these sections may look up objects
+ * themselves. Iterating over the table with get_indexed_object() is not
+ * protected and must not race with lookups.
+ */
+void enable_object_table_lock(struct parsed_object_pool *o);
+void disable_object_table_lock(struct parsed_object_pool *o);
+
+static inline void object_table_lock(struct parsed_object_pool *o)
+{
+	if (o->obj_hash_use_lock)
+		pthread_mutex_lock(&o->obj_hash_mutex);
+}
+
+static inline void object_table_unlock(struct parsed_object_pool *o)
+{
+	if (o->obj_hash_use_lock)
+		pthread_mutex_unlock(&o->obj_hash_mutex);
+}
+
 struct object_list {
 	struct object *item;
 	struct object_list *next;
@@ -121,7 +163,21 @@ struct object *lookup_object(struct repository *r, const struct object_id *oid);
 
 void *create_object(struct repository *r, const struct object_id *oid, void *obj);
 
-void *object_as_type(struct object *obj, enum object_type type, int quiet);
+/*
+ * Returns the object named by oid, creating it with alloc_node() if it
+ * is not in the table yet.
+ */
+struct object *lookup_or_create_object(struct repository *r,
+				       const struct object_id *oid,
+				       void *(*alloc_node)(struct repository *));
+
+/*
+ * Sets the type of an object found in r's object pool, if it is not known
+ * yet, and returns it if its type matches. The type of an object never
+ * changes once it is set.
+ */
+void *object_as_type(struct repository *r, struct object *obj,
+		     enum object_type type, int quiet);
 
 /*
  * Returns the object, having parsed it to find out what it is.
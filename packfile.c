@@ -1826,8 +1826,19 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			      (uintmax_t)curpos, p->pack_name);
 			data = NULL;
 		} else {
+			/*
+			 * Both "base" and "delta_data" are private to us at
+			 * this point (a cached base was detached from the
+			 * cache in phase 1 and is only added back below), so
+			 * there is no need to hold obj_read_mutex while
+			 * applying the delta. Dropping it lets other threads
+			 * inflate and patch objects from deep delta chains
+			 * concurrently instead of serializing on us.
+			 */
+			obj_read_unlock();
 			data = patch_delta(base, base_size, delta_data,
 					   delta_size, &size);
+			obj_read_lock();
 
 			/*
 			 * We could not apply the delta; warn the user, but
@@ -2128,7 +2128,7 @@ static int for_each_fullref_in_pattern(struct ref_filter *filter,
 		return for_each_fullref_in("", cb, cb_data);
 	}
 
-	return for_each_fullref_in_prefixes(NULL, filter->name_patterns,
+	return for_each_fullref_in_prefixes(NULL, filter->name_patterns, NULL,
 					    cb, cb_data);
 }
 
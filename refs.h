@@ -12,6 +12,13 @@ struct string_list;
 struct string_list_item;
 struct worktree;
 
+/*
+ * Map a reference storage format ("files" or "reftable") to its
+ * enum value and back. Unknown names map to REF_STORAGE_FORMAT_UNKNOWN.
+ */
+enum ref_storage_format ref_storage_format_by_name(const char *name);
+const char *ref_storage_format_to_name(enum ref_storage_format format);
+
 /*
  * Resolve a reference, recursively following symbolic refererences.
  *
@@ -352,9 +359,13 @@ int for_each_fullref_in(const char *prefix, each_ref_fn fn, void *cb_data);
  * iterate all refs in "patterns" by partitioning patterns into disjoint sets
  * and iterating the longest-common prefix of each set.
  *
+ * refs starting with one of "exclude_patterns" (a NULL-terminated list, or
+ * NULL) may be skipped without being looked at; see hidden_refs_to_excludes().
+ *
  * callers should be prepared to ignore references that they did not ask for.
  */
 int for_each_fullref_in_prefixes(const char *namespace, const char **patterns,
+				 const char **exclude_patterns,
 				 each_ref_fn fn, void *cb_data);
 /**
  * iterate refs from the respective area.
@@ -821,6 +832,17 @@ int parse_hide_refs_config(const char *var, const char *value, const char *,
  */
 int ref_is_hidden(const char *, const char *, const struct string_list *);
 
+/*
+ * Append to `out` prefixes of full ref names that are certain to be
+ * hidden by `hide_refs` (as read by parse_hide_refs_config()), for use
+ * as the `exclude_patterns` of for_each_fullref_in_prefixes(). Hidden
+ * refs outside of these prefixes still have to be filtered out with
+ * ref_is_hidden(). `namespace` is the namespace of the refs being
+ * iterated over, as returned by get_git_namespace().
+ */
+void hidden_refs_to_excludes(const struct string_list *hide_refs,
+			     const char *namespace, struct strvec *out);
+
 /* Is this a per-worktree ref living in the refs/ namespace? */
 int is_per_worktree_ref(const char *refname);
 
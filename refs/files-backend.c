@@ -10,6 +10,7 @@
 #include "../object.h"
 #include "../dir.h"
 #include "../chdir-notify.h"
+#include "../thread-utils.h"
 #include "worktree.h"
 
 /*
@@ -62,6 +63,8 @@ struct files_ref_store {
 	char *gitcommondir;
 
 	struct ref_cache *loose;
+	/* number of threads reading loose references (core.looseRefThreads) */
+	int loose_threads;
 
 	struct ref_store *packed_ref_store;
 };
@@ -218,6 +221,262 @@ static void add_per_worktree_entries_to_dir(struct ref_dir *dir, const char *dir
 	}
 }
 
+static int read_ref_internal(struct ref_store *ref_store, const char *refname,
+			     struct object_id *oid, struct strbuf *referent,
+			     unsigned int *type, int *failure_errno, int skip_packed_refs);
+
+static void loose_fill_ref_dir_regular_file(struct files_ref_store *refs,
+					    const char *refname,
+					    struct ref_dir *dir)
+{
+	struct object_id oid;
+	int flag;
+
+	if (!refs_resolve_ref_unsafe(&refs->base, refname, RESOLVE_REF_READING,
+				     &oid, &flag)) {
+		oidclr(&oid);
+		flag |= REF_ISBROKEN;
+	} else if (is_null_oid(&oid)) {
+		/*
+		 * It is so astronomically unlikely
+		 * that null_oid is the OID of an
+		 * actual object that we consider its
+		 * appearance in a loose reference
+		 * file to be repo corruption
+		 * (probably due to a software bug).
+		 */
+		flag |= REF_ISBROKEN;
+	}
+
+	if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL)) {
+		if (!refname_is_safe(refname))
+			die("loose refname is dangerous: %s", refname);
+		oidclr(&oid);
+		flag |= REF_BAD_NAME | REF_ISBROKEN;
+	}
+	add_entry_to_dir(dir, create_ref_entry(refname, &oid, flag));
+}
+
+/*
+ * A unit of work for the threads filling the loose ref cache: either
+ * a directory to list (`name` is a dirname ending in '/' and `dir` is
+ * its ref_dir), or an entry of a directory to stat and read (`name`
+ * is its refname and `dir` the ref_dir it goes into).
+ */
+struct loose_fill_job {
+	struct ref_dir *dir;
+	char *name;
+	int is_dir;
+};
+
+struct loose_fill {
+	struct files_ref_store *refs;
+	/* also list the subdirectories found, and theirs, and so on */
+	int recursive;
+
+	/* protects the fields below and the ref_dirs being filled */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct loose_fill_job *queue;
+	size_t nr, alloc;
+	int nr_busy;
+
+	/*
+	 * References that cannot be added without resolving them
+	 * (symrefs, broken or badly-named refs), which the calling
+	 * thread does afterwards.
+	 */
+	struct loose_fill_job *deferred;
+	size_t deferred_nr, deferred_alloc;
+
+	/* the directories that have been listed */
+	struct loose_fill_job *listed;
+	size_t listed_nr, listed_alloc;
+};
+
+static void loose_fill_push(struct loose_fill *lf, struct ref_dir *dir,
+			    char *name, int is_dir)
+{
+	ALLOC_GROW(lf->queue, lf->nr + 1, lf->alloc);
+	lf->queue[lf->nr].dir = dir;
+	lf->queue[lf->nr].name = name;
+	lf->queue[lf->nr].is_dir = is_dir;
+	lf->nr++;
+	pthread_cond_signal(&lf->cond);
+}
+
+static void loose_fill_list_dir(struct loose_fill *lf,
+				struct loose_fill_job *job)
+{
+	struct strbuf path = STRBUF_INIT;
+	DIR *d;
+	struct dirent *de;
+
+	files_ref_path(lf->refs, &path, job->name);
+	d = opendir(path.buf);
+	strbuf_release(&path);
+
+	pthread_mutex_lock(&lf->mutex);
+	ALLOC_GROW(lf->listed, lf->listed_nr + 1, lf->listed_alloc);
+	lf->listed[lf->listed_nr++] = *job;
+	pthread_mutex_unlock(&lf->mutex);
+
+	if (!d)
+		return;
+	while ((de = readdir(d)) != NULL) {
+		char *refname;
+
+		if (de->d_name[0] == '.')
+			continue;
+		if (ends_with(de->d_name, ".lock"))
+			continue;
+		refname = xstrfmt("%s%s", job->name, de->d_name);
+		pthread_mutex_lock(&lf->mutex);
+		loose_fill_push(lf, job->dir, refname, 0);
+		pthread_mutex_unlock(&lf->mutex);
+	}
+	closedir(d);
+}
+
+static void loose_fill_read_entry(struct loose_fill *lf,
+				  struct loose_fill_job *job)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct strbuf referent = STRBUF_INIT;
+	struct ref_entry *entry = NULL;
+	struct object_id oid;
+	unsigned int type = 0;
+	int failure_errno;
+	struct stat st;
+
+	files_ref_path(lf->refs, &path, job->name);
+	if (stat(path.buf, &st) < 0) {
+		; /* silently ignore */
+	} else if (S_ISDIR(st.st_mode)) {
+		char *dirname = xstrfmt("%s/", job->name);
+
+		entry = create_dir_entry(job->dir->cache, dirname,
+					 strlen(dirname));
+		pthread_mutex_lock(&lf->mutex);
+		add_entry_to_dir(job->dir, entry);
+		if (lf->recursive) {
+			entry->flag &= ~REF_INCOMPLETE;
+			loose_fill_push(lf, get_ref_dir(entry), dirname, 1);
+			dirname = NULL;
+		}
+		pthread_mutex_unlock(&lf->mutex);
+		free(dirname);
+	} else if (!read_ref_internal(&lf->refs->base, job->name, &oid,
+				      &referent, &type, &failure_errno, 1) &&
+		   !(type & REF_ISSYMREF) && !is_null_oid(&oid) &&
+		   !check_refname_format(job->name, REFNAME_ALLOW_ONELEVEL)) {
+		/*
+		 * This is what loose_fill_ref_dir_regular_file() would
+		 * come up with, without having to look any further.
+		 */
+		entry = create_ref_entry(job->name, &oid, type);
+		pthread_mutex_lock(&lf->mutex);
+		add_entry_to_dir(job->dir, entry);
+		pthread_mutex_unlock(&lf->mutex);
+	} else {
+		pthread_mutex_lock(&lf->mutex);
+		ALLOC_GROW(lf->deferred, lf->deferred_nr + 1,
+			   lf->deferred_alloc);
+		lf->deferred[lf->deferred_nr++] = *job;
+		job->name = NULL;
+		pthread_mutex_unlock(&lf->mutex);
+	}
+
+	strbuf_release(&referent);
+	strbuf_release(&path);
+}
+
+static void *loose_fill_thread(void *data)
+{
+	struct loose_fill *lf = data;
+
+	pthread_mutex_lock(&lf->mutex);
+	for (;;) {
+		struct loose_fill_job job;
+
+		while (!lf->nr && lf->nr_busy)
+			pthread_cond_wait(&lf->cond, &lf->mutex);
+		if (!lf->nr)
+			break;
+
+		job = lf->queue[--lf->nr];
+		lf->nr_busy++;
+		pthread_mutex_unlock(&lf->mutex);
+
+		if (job.is_dir) {
+			loose_fill_list_dir(lf, &job);
+		} else {
+			loose_fill_read_entry(lf, &job);
+			free(job.name);
+		}
+
+		pthread_mutex_lock(&lf->mutex);
+		lf->nr_busy--;
+		if (!lf->nr_busy && !lf->nr)
+			pthread_cond_broadcast(&lf->cond);
+	}
+	pthread_mutex_unlock(&lf->mutex);
+	return NULL;
+}
+
+/*
+ * Read the loose references from the namespace dirname into dir like
+ * loose_fill_ref_dir() does, but list directories and read the
+ * files in them with a pool of refs->loose_threads threads. If
+ * `recursive` is set, fill all of the subdirectories of dir, too.
+ * Entries are added to their ref_dirs in no particular order; the
+ * ref_dirs get sorted when they are first searched or iterated over.
+ */
+static void loose_fill_ref_dir_parallel(struct files_ref_store *refs,
+					struct ref_dir *dir,
+					const char *dirname, int recursive)
+{
+	struct loose_fill lf = {
+		.refs = refs,
+		.recursive = recursive,
+	};
+	pthread_t *threads;
+	size_t i;
+	int t;
+
+	pthread_mutex_init(&lf.mutex, NULL);
+	pthread_cond_init(&lf.cond, NULL);
+	loose_fill_push(&lf, dir, xstrdup(dirname), 1);
+
+	CALLOC_ARRAY(threads, refs->loose_threads);
+	for (t = 0; t < refs->loose_threads; t++) {
+		int err = pthread_create(&threads[t], NULL,
+					 loose_fill_thread, &lf);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (t = 0; t < refs->loose_threads; t++)
+		pthread_join(threads[t], NULL);
+	free(threads);
+
+	for (i = 0; i < lf.deferred_nr; i++) {
+		loose_fill_ref_dir_regular_file(refs, lf.deferred[i].name,
+						lf.deferred[i].dir);
+		free(lf.deferred[i].name);
+	}
+	for (i = 0; i < lf.listed_nr; i++) {
+		add_per_worktree_entries_to_dir(lf.listed[i].dir,
+						lf.listed[i].name);
+		free(lf.listed[i].name);
+	}
+
+	free(lf.deferred);
+	free(lf.listed);
+	free(lf.queue);
+	pthread_cond_destroy(&lf.cond);
+	pthread_mutex_destroy(&lf.mutex);
+}
+
 /*
  * Read the loose references from the namespace dirname into dir
  * (without recursing).  dirname must end with '/'.  dir must be the
@@ -235,6 +494,11 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 	struct strbuf path = STRBUF_INIT;
 	size_t path_baselen;
 
+	if (refs->loose_threads > 1) {
+		loose_fill_ref_dir_parallel(refs, dir, dirname, 0);
+		return;
+	}
+
 	files_ref_path(refs, &path, dirname);
 	path_baselen = path.len;
 
@@ -248,9 +512,7 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 	strbuf_add(&refname, dirname, dirnamelen);
 
 	while ((de = readdir(d)) != NULL) {
-		struct object_id oid;
 		struct stat st;
-		int flag;
 
 		if (de->d_name[0] == '.')
 			continue;
@@ -266,33 +528,7 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 					 create_dir_entry(dir->cache, refname.buf,
 							  refname.len));
 		} else {
-			if (!refs_resolve_ref_unsafe(&refs->base,
-						     refname.buf,
-						     RESOLVE_REF_READING,
-						     &oid, &flag)) {
-				oidclr(&oid);
-				flag |= REF_ISBROKEN;
-			} else if (is_null_oid(&oid)) {
-				/*
-				 * It is so astronomically unlikely
-				 * that null_oid is the OID of an
-				 * actual object that we consider its
-				 * appearance in a loose reference
-				 * file to be repo corruption
-				 * (probably due to a software bug).
-				 */
-				flag |= REF_ISBROKEN;
-			}
-
-			if (check_refname_format(refname.buf,
-						 REFNAME_ALLOW_ONELEVEL)) {
-				if (!refname_is_safe(refname.buf))
-					die("loose refname is dangerous: %s", refname.buf);
-				oidclr(&oid);
-				flag |= REF_BAD_NAME | REF_ISBROKEN;
-			}
-			add_entry_to_dir(dir,
-					 create_ref_entry(refname.buf, &oid, flag));
+			loose_fill_ref_dir_regular_file(refs, refname.buf, dir);
 		}
 		strbuf_setlen(&refname, dirnamelen);
 		strbuf_setlen(&path, path_baselen);
@@ -304,6 +540,19 @@ static void loose_fill_ref_dir(struct ref_store *ref_store,
 	add_per_worktree_entries_to_dir(dir, dirname);
 }
 
+/*
+ * Read the loose references from the namespace dirname into dir and
+ * all of its subdirectories, using multiple threads.
+ */
+static void loose_fill_ref_tree(struct ref_store *ref_store,
+				struct ref_dir *dir, const char *dirname)
+{
+	struct files_ref_store *refs =
+		files_downcast(ref_store, REF_STORE_READ, "fill_ref_tree");
+
+	loose_fill_ref_dir_parallel(refs, dir, dirname, 1);
+}
+
 static struct ref_cache *get_loose_ref_cache(struct files_ref_store *refs)
 {
 	if (!refs->loose) {
@@ -314,6 +563,19 @@ static struct ref_cache *get_loose_ref_cache(struct files_ref_store *refs)
 		 */
 		refs->loose = create_ref_cache(&refs->base, loose_fill_ref_dir);
 
+		if (repo_config_get_int(refs->base.repo, "core.looserefthreads",
+					&refs->loose_threads))
+			refs->loose_threads = 1;
+		else if (refs->loose_threads < 0)
+			die(_("invalid number of threads specified (%d) for %s"),
+			    refs->loose_threads, "core.looseRefThreads");
+		else if (!refs->loose_threads)
+			refs->loose_threads = online_cpus();
+		if (!HAVE_THREADS)
+			refs->loose_threads = 1;
+		if (refs->loose_threads > 1)
+			refs->loose->fill_ref_tree = loose_fill_ref_tree;
+
 		/* We're going to fill the top level ourselves: */
 		refs->loose->root->flag &= ~REF_INCOMPLETE;
 
@@ -819,7 +1081,8 @@ static struct ref_iterator_vtable files_ref_iterator_vtable = {
 
 static struct ref_iterator *files_ref_iterator_begin(
 		struct ref_store *ref_store,
-		const char *prefix, unsigned int flags)
+		const char *prefix, const char **exclude_patterns,
+		unsigned int flags)
 {
 	struct files_ref_store *refs;
 	struct ref_iterator *loose_iter, *packed_iter, *overlay_iter;
@@ -864,7 +1127,7 @@ static struct ref_iterator *files_ref_iterator_begin(
 	 * the packed and loose references.
 	 */
 	packed_iter = refs_ref_iterator_begin(
-			refs->packed_ref_store, prefix, 0,
+			refs->packed_ref_store, prefix, exclude_patterns, 0,
 			DO_FOR_EACH_INCLUDE_BROKEN);
 
 	overlay_iter = overlay_ref_iterator_begin(loose_iter, packed_iter);
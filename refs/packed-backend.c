@@ -38,6 +38,32 @@ static enum mmap_strategy mmap_strategy = MMAP_OK;
 
 struct packed_ref_store;
 
+/*
+ * The identity of a `packed-refs` file, to tell whether a delta was
+ * written for it. The file is never modified in place, only replaced,
+ * so a new file has a new inode or modification time.
+ */
+struct packed_refs_stamp {
+	uint64_t size, ino;
+	uint32_t mtime, mtime_nsec;
+};
+
+static void stamp_from_stat(struct packed_refs_stamp *stamp,
+			    const struct stat *st)
+{
+	stamp->size = st->st_size;
+	stamp->ino = st->st_ino;
+	stamp->mtime = st->st_mtime;
+	stamp->mtime_nsec = ST_MTIME_NSEC(*st);
+}
+
+static int stamp_eq(const struct packed_refs_stamp *a,
+		    const struct packed_refs_stamp *b)
+{
+	return a->size == b->size && a->ino == b->ino &&
+		a->mtime == b->mtime && a->mtime_nsec == b->mtime_nsec;
+}
+
 /*
  * A `snapshot` represents one snapshot of a `packed-refs` file.
  *
@@ -53,6 +79,15 @@ struct packed_ref_store;
  * over it. Instances are garbage collected when their `referrers`
  * count goes to zero.
  *
+ * If `extensions.packedRefsDelta` is in use, small updates are not
+ * written to `packed-refs` itself but to `packed-refs.delta`, which
+ * holds all of the changes since `packed-refs` was last rewritten, in
+ * the same format: a record there replaces the record of the same
+ * name in `packed-refs`, and a record with a null object ID deletes
+ * it. The delta records which `packed-refs` file it was written for,
+ * and applies only to that one. The snapshot keeps the delta in memory
+ * next to the main file.
+ *
  * The most recent `snapshot`, if available, is referenced by the
  * `packed_ref_store`. Its freshness is checked whenever
  * `get_snapshot()` is called; if the existing snapshot is obsolete, a
@@ -106,6 +141,32 @@ struct snapshot {
 	 * replaced since we read it.
 	 */
 	struct stat_validity validity;
+
+	/*
+	 * The sorted contents of the `packed-refs.delta` file, if
+	 * any, in heap memory, and the metadata of that file.
+	 */
+	char *delta_buf, *delta_start, *delta_eof;
+	struct stat_validity delta_validity;
+
+	/*
+	 * The identity of the `packed-refs` file from which this
+	 * snapshot was created (all zeros if there is none). A delta
+	 * is only used if it was written for this very file.
+	 */
+	struct packed_refs_stamp stamp;
+
+	/*
+	 * The offsets of the records in `start`..`eof` as read from
+	 * `packed-refs.idx`, if it exists and matches the file, or
+	 * NULL. `index_map` and `index_size` describe the memory
+	 * holding the whole index file.
+	 */
+	const unsigned char *index_offsets;
+	size_t index_nr;
+	void *index_map;
+	size_t index_size;
+	int index_mmapped;
 };
 
 /*
@@ -131,6 +192,12 @@ struct packed_ref_store {
 	/* The path of the "packed-refs" file: */
 	char *path;
 
+	/* The path of the "packed-refs.delta" file: */
+	char *delta_path;
+
+	/* The path of the "packed-refs.idx" file: */
+	char *index_path;
+
 	/*
 	 * A snapshot of the values read from the `packed-refs` file,
 	 * if it might still be current; otherwise, NULL.
@@ -149,6 +216,18 @@ struct packed_ref_store {
 	 * `packed_ref_store`) must not be freed.
 	 */
 	struct tempfile *tempfile;
+
+	/*
+	 * Temporary file used when writing a new "packed-refs.delta"
+	 * file instead of rewriting "packed-refs".
+	 */
+	struct tempfile *delta_tempfile;
+
+	/*
+	 * Temporary file used when writing a new "packed-refs.idx"
+	 * file along with "packed-refs".
+	 */
+	struct tempfile *index_tempfile;
 };
 
 /*
@@ -177,6 +256,21 @@ static void clear_snapshot_buffer(struct snapshot *snapshot)
 	snapshot->buf = snapshot->start = snapshot->eof = NULL;
 }
 
+/*
+ * Unmap or free the offset index of `snapshot`, if any.
+ */
+static void clear_snapshot_index(struct snapshot *snapshot)
+{
+	if (snapshot->index_mmapped)
+		munmap(snapshot->index_map, snapshot->index_size);
+	else
+		free(snapshot->index_map);
+	snapshot->index_map = NULL;
+	snapshot->index_offsets = NULL;
+	snapshot->index_nr = snapshot->index_size = 0;
+	snapshot->index_mmapped = 0;
+}
+
 /*
  * Decrease the reference count of `*snapshot`. If it goes to zero,
  * free `*snapshot` and return true; otherwise return false.
@@ -185,7 +279,10 @@ static int release_snapshot(struct snapshot *snapshot)
 {
 	if (!--snapshot->referrers) {
 		stat_validity_clear(&snapshot->validity);
+		stat_validity_clear(&snapshot->delta_validity);
 		clear_snapshot_buffer(snapshot);
+		clear_snapshot_index(snapshot);
+		free(snapshot->delta_buf);
 		free(snapshot);
 		return 1;
 	} else {
@@ -207,6 +304,10 @@ struct ref_store *packed_ref_store_create(struct repository *repo,
 	strbuf_addf(&sb, "%s/packed-refs", gitdir);
 	refs->path = strbuf_detach(&sb, NULL);
 	chdir_notify_reparent("packed-refs", &refs->path);
+	refs->delta_path = xstrfmt("%s.delta", refs->path);
+	chdir_notify_reparent("packed-refs.delta", &refs->delta_path);
+	refs->index_path = xstrfmt("%s.idx", refs->path);
+	chdir_notify_reparent("packed-refs.idx", &refs->index_path);
 	return ref_store;
 }
 
@@ -469,12 +570,11 @@ static void verify_buffer_safe(struct snapshot *snapshot)
  * Depending on `mmap_strategy`, either mmap or read the contents of
  * the `packed-refs` file into the snapshot. Return 1 if the file
  * existed and was read, or 0 if the file was absent or empty. Die on
- * errors.
+ * errors. The file's metadata is stored in `st`.
  */
-static int load_contents(struct snapshot *snapshot)
+static int load_contents(struct snapshot *snapshot, struct stat *st)
 {
 	int fd;
-	struct stat st;
 	size_t size;
 	ssize_t bytes_read;
 
@@ -496,9 +596,9 @@ static int load_contents(struct snapshot *snapshot)
 
 	stat_validity_update(&snapshot->validity, fd);
 
-	if (fstat(fd, &st) < 0)
+	if (fstat(fd, st) < 0)
 		die_errno("couldn't stat %s", snapshot->refs->path);
-	size = xsize_t(st.st_size);
+	size = xsize_t(st->st_size);
 
 	if (!size) {
 		close(fd);
@@ -522,21 +622,214 @@ static int load_contents(struct snapshot *snapshot)
 }
 
 /*
- * Find the place in `snapshot->buf` where the start of the record for
- * `refname` starts. If `mustexist` is true and the reference doesn't
- * exist, then return NULL. If `mustexist` is false and the reference
- * doesn't exist, then return the point where that reference would be
- * inserted, or `snapshot->eof` (which might be NULL) if it would be
- * inserted at the end of the file. In the latter mode, `refname`
- * doesn't have to be a proper reference name; for example, one could
- * search for "refs/replace/" to find the start of any replace
- * references.
+ * The `packed-refs.idx` file lists where each record of `packed-refs`
+ * starts, so that lookups can bisect the records directly instead of
+ * looking for line boundaries around each probe. All numbers are in
+ * network byte order:
  *
- * The record is sought using a binary search, so `snapshot->buf` must
- * be sorted.
+ *   - 4-byte signature "PRIX" and 4-byte version (1)
+ *   - 8-byte size, 8-byte inode number, 4-byte mtime seconds and
+ *     4-byte mtime nanoseconds of the `packed-refs` file it describes
+ *   - 4-byte number of records
+ *   - for each record, the 8-byte offset of its first byte, counted
+ *     from the end of the header line
+ *
+ * A peeled value is on the line right after its record, so it is
+ * found without further help. The index is written next to a new
+ * `packed-refs` file, but the two cannot be replaced at once; a
+ * reader therefore only uses an index whose recorded metadata matches
+ * the `packed-refs` file it has read, and otherwise falls back to
+ * searching the text.
  */
-static const char *find_reference_location(struct snapshot *snapshot,
-					   const char *refname, int mustexist)
+#define PACKED_REFS_INDEX_SIGNATURE 0x50524958 /* "PRIX" */
+#define PACKED_REFS_INDEX_VERSION 1
+#define PACKED_REFS_INDEX_HEADER_SIZE (4 + 4 + 8 + 8 + 4 + 4 + 4)
+
+/*
+ * Load `packed-refs.idx` into `snapshot` if it describes the
+ * `packed-refs` file with metadata `st`. Problems with the index are
+ * not fatal; the snapshot just does without it.
+ */
+static void load_index(struct snapshot *snapshot, const struct stat *st)
+{
+	const char *path = snapshot->refs->index_path;
+	const unsigned char *p;
+	struct stat index_st;
+	size_t size;
+	uint32_t nr;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &index_st) < 0 ||
+	    index_st.st_size < PACKED_REFS_INDEX_HEADER_SIZE) {
+		close(fd);
+		return;
+	}
+
+	size = xsize_t(index_st.st_size);
+	if (mmap_strategy == MMAP_OK) {
+		snapshot->index_map = xmmap(NULL, size, PROT_READ, MAP_PRIVATE,
+					    fd, 0);
+		snapshot->index_mmapped = 1;
+	} else {
+		snapshot->index_map = xmalloc(size);
+		if (read_in_full(fd, snapshot->index_map, size) != size) {
+			close(fd);
+			free(snapshot->index_map);
+			snapshot->index_map = NULL;
+			return;
+		}
+	}
+	snapshot->index_size = size;
+	close(fd);
+
+	p = snapshot->index_map;
+	nr = get_be32(p + 32);
+	if (get_be32(p) != PACKED_REFS_INDEX_SIGNATURE ||
+	    get_be32(p + 4) != PACKED_REFS_INDEX_VERSION ||
+	    get_be64(p + 8) != (uint64_t)st->st_size ||
+	    get_be64(p + 16) != (uint64_t)st->st_ino ||
+	    get_be32(p + 24) != (uint32_t)st->st_mtime ||
+	    get_be32(p + 28) != ST_MTIME_NSEC(*st) ||
+	    (size - PACKED_REFS_INDEX_HEADER_SIZE) / 8 != nr ||
+	    (size - PACKED_REFS_INDEX_HEADER_SIZE) % 8) {
+		clear_snapshot_index(snapshot);
+		return;
+	}
+
+	snapshot->index_offsets = p + PACKED_REFS_INDEX_HEADER_SIZE;
+	snapshot->index_nr = nr;
+}
+
+/*
+ * Return the start of the `n`th record in the main file of
+ * `snapshot` according to its index.
+ */
+static const char *indexed_record(struct snapshot *snapshot, size_t n)
+{
+	uint64_t offset = get_be64(snapshot->index_offsets + 8 * n);
+
+	if (offset + the_hash_algo->hexsz + 2 > snapshot->eof - snapshot->start)
+		die("corrupt index %s: offset %"PRIuMAX" out of range",
+		    snapshot->refs->index_path, (uintmax_t)offset);
+	return snapshot->start + offset;
+}
+
+#define PACKED_REFS_DELTA_HEADER "# packed-refs delta for: "
+
+/*
+ * Parse the header line of `packed-refs.delta` between `p` and `eol`,
+ * which names the `packed-refs` file the delta was written for.
+ */
+static int parse_delta_header(const char *p, const char *eol,
+			      struct packed_refs_stamp *stamp)
+{
+	uintmax_t v[4];
+	char *end;
+	int i;
+
+	if (!skip_prefix(p, PACKED_REFS_DELTA_HEADER, &p))
+		return -1;
+	for (i = 0; i < ARRAY_SIZE(v); i++) {
+		if (!isdigit(*p))
+			return -1;
+		errno = 0;
+		v[i] = strtoumax(p, &end, 10);
+		if (errno || end > eol || *end != (i < 3 ? ' ' : '\n'))
+			return -1;
+		p = end + 1;
+	}
+	if (v[2] > UINT32_MAX || v[3] > UINT32_MAX)
+		return -1;
+	stamp->size = v[0];
+	stamp->ino = v[1];
+	stamp->mtime = v[2];
+	stamp->mtime_nsec = v[3];
+	return 0;
+}
+
+/*
+ * Read the `packed-refs.delta` file, if there is one, into the
+ * snapshot. The delta is small, so it is always read into memory. We
+ * write it ourselves, so it is sorted and fully peeled; only check
+ * that parsing it cannot run past the end of the buffer.
+ *
+ * The delta is read after `packed-refs`, and is only used if it was
+ * written for the file that `snapshot` holds. Otherwise, either
+ * `packed-refs` has been replaced since we read it, in which case
+ * return -1 so that the caller reads both files again, or the delta
+ * has been folded into the current `packed-refs` and is about to be
+ * removed (or was left behind by a writer that died), in which case
+ * it is ignored.
+ */
+static int load_delta(struct snapshot *snapshot)
+{
+	const char *path = snapshot->refs->delta_path;
+	struct packed_refs_stamp delta_stamp, current;
+	struct strbuf sb = STRBUF_INIT;
+	const char *last_line;
+	struct stat st;
+	char *eol;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 0;
+		die_errno("couldn't read %s", path);
+	}
+
+	stat_validity_update(&snapshot->delta_validity, fd);
+	if (strbuf_read(&sb, fd, 0) < 0)
+		die_errno("couldn't read %s", path);
+	close(fd);
+
+	if (!sb.len) {
+		strbuf_release(&sb);
+		return 0;
+	}
+
+	eol = memchr(sb.buf, '\n', sb.len);
+	if (!eol)
+		die_unterminated_line(path, sb.buf, sb.len);
+	if (parse_delta_header(sb.buf, eol, &delta_stamp))
+		die_invalid_line(path, sb.buf, sb.len);
+
+	if (!stamp_eq(&delta_stamp, &snapshot->stamp)) {
+		strbuf_release(&sb);
+		if (stat(snapshot->refs->path, &st)) {
+			if (errno != ENOENT)
+				die_errno("couldn't stat %s",
+					  snapshot->refs->path);
+			memset(&st, 0, sizeof(st));
+		}
+		stamp_from_stat(&current, &st);
+		return stamp_eq(&current, &snapshot->stamp) ? 0 : -1;
+	}
+
+	snapshot->delta_start = eol + 1;
+	snapshot->delta_eof = sb.buf + sb.len;
+	snapshot->delta_buf = strbuf_detach(&sb, NULL);
+
+	if (snapshot->delta_start == snapshot->delta_eof)
+		return 0;
+	last_line = find_start_of_record(snapshot->delta_start,
+					 snapshot->delta_eof - 1);
+	if (snapshot->delta_eof[-1] != '\n' ||
+	    snapshot->delta_eof - last_line < the_hash_algo->hexsz + 2)
+		die_invalid_line(path, last_line, snapshot->delta_eof - last_line);
+	return 0;
+}
+
+/*
+ * Find the place in the sorted records between `start` and `eof`
+ * where the record for `refname` starts, as described for
+ * `find_reference_location()` below.
+ */
+static const char *find_record(const char *start, const char *eof,
+			       const char *refname, int mustexist)
 {
 	/*
 	 * This is not *quite* a garden-variety binary search, because
@@ -552,13 +845,13 @@ static const char *find_reference_location(struct snapshot *snapshot,
 	 * preceding records all have reference names that come
 	 * *before* `refname`.
 	 */
-	const char *lo = snapshot->start;
+	const char *lo = start;
 
 	/*
 	 * A pointer to a the first character of a record whose
 	 * reference name comes *after* `refname`.
 	 */
-	const char *hi = snapshot->eof;
+	const char *hi = eof;
 
 	while (lo != hi) {
 		const char *mid, *rec;
@@ -582,6 +875,87 @@ static const char *find_reference_location(struct snapshot *snapshot,
 		return lo;
 }
 
+/*
+ * Find the place in `snapshot->buf` where the start of the record for
+ * `refname` starts. If `mustexist` is true and the reference doesn't
+ * exist, then return NULL. If `mustexist` is false and the reference
+ * doesn't exist, then return the point where that reference would be
+ * inserted, or `snapshot->eof` (which might be NULL) if it would be
+ * inserted at the end of the file. In the latter mode, `refname`
+ * doesn't have to be a proper reference name; for example, one could
+ * search for "refs/replace/" to find the start of any replace
+ * references.
+ *
+ * The record is sought using a binary search, so `snapshot->buf` must
+ * be sorted. If there is an index, the search only looks at the
+ * records it points to.
+ */
+static const char *find_reference_location(struct snapshot *snapshot,
+					   const char *refname, int mustexist)
+{
+	size_t lo = 0, hi = snapshot->index_nr;
+
+	if (!snapshot->index_offsets)
+		return find_record(snapshot->start, snapshot->eof,
+				   refname, mustexist);
+
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		const char *rec = indexed_record(snapshot, mi);
+		int cmp = cmp_record_to_refname(rec, refname);
+
+		if (cmp < 0)
+			lo = mi + 1;
+		else if (cmp > 0)
+			hi = mi;
+		else
+			return rec;
+	}
+
+	if (mustexist)
+		return NULL;
+	return lo < snapshot->index_nr ? indexed_record(snapshot, lo) :
+		snapshot->eof;
+}
+
+/*
+ * Like `find_reference_location()`, but look in the records of the
+ * `packed-refs.delta` file.
+ */
+static const char *find_delta_location(struct snapshot *snapshot,
+				       const char *refname, int mustexist)
+{
+	return find_record(snapshot->delta_start, snapshot->delta_eof,
+			   refname, mustexist);
+}
+
+/*
+ * Read the value of `refname` as `snapshot` sees it into `oid`,
+ * taking `packed-refs.delta` into account. Return 0 if the reference
+ * exists and -1 if it does not.
+ */
+static int read_snapshot_oid(struct snapshot *snapshot, const char *refname,
+			     struct object_id *oid)
+{
+	const char *rec;
+
+	rec = find_delta_location(snapshot, refname, 1);
+	if (rec) {
+		if (get_oid_hex(rec, oid))
+			die_invalid_line(snapshot->refs->delta_path, rec,
+					 snapshot->delta_eof - rec);
+		/* a null object ID means that the reference was deleted */
+		return is_null_oid(oid) ? -1 : 0;
+	}
+
+	rec = find_reference_location(snapshot, refname, 1);
+	if (!rec)
+		return -1;
+	if (get_oid_hex(rec, oid))
+		die_invalid_line(snapshot->refs->path, rec, snapshot->eof - rec);
+	return 0;
+}
+
 /*
  * Create a newly-allocated `snapshot` of the `packed-refs` file in
  * its current state and return it. The return value will already have
@@ -618,13 +992,28 @@ static const char *find_reference_location(struct snapshot *snapshot,
 static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 {
 	struct snapshot *snapshot = xcalloc(1, sizeof(*snapshot));
-	int sorted = 0;
+	struct stat st;
+	int sorted = 0, loaded;
 
 	snapshot->refs = refs;
 	acquire_snapshot(snapshot);
 	snapshot->peeled = PEELED_NONE;
 
-	if (!load_contents(snapshot))
+	/*
+	 * Read the main file before the delta, and start over if the
+	 * delta was written for a `packed-refs` that replaced the one
+	 * we read in the meantime.
+	 */
+	for (;;) {
+		memset(&st, 0, sizeof(st));
+		loaded = load_contents(snapshot, &st);
+		stamp_from_stat(&snapshot->stamp, &st);
+		if (!load_delta(snapshot))
+			break;
+		clear_snapshot_buffer(snapshot);
+	}
+
+	if (!loaded)
 		return snapshot;
 
 	/* If the file has a header line, process it: */
@@ -666,7 +1055,9 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 
 	verify_buffer_safe(snapshot);
 
-	if (!sorted) {
+	if (sorted) {
+		load_index(snapshot, &st);
+	} else {
 		sort_snapshot(snapshot);
 
 		/*
@@ -696,12 +1087,15 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 
 /*
  * Check that `refs->snapshot` (if present) still reflects the
- * contents of the `packed-refs` file. If not, clear the snapshot.
+ * contents of the `packed-refs` and `packed-refs.delta` files. If
+ * not, clear the snapshot.
  */
 static void validate_snapshot(struct packed_ref_store *refs)
 {
 	if (refs->snapshot &&
-	    !stat_validity_check(&refs->snapshot->validity, refs->path))
+	    (!stat_validity_check(&refs->snapshot->validity, refs->path) ||
+	     !stat_validity_check(&refs->snapshot->delta_validity,
+				  refs->delta_path)))
 		clear_snapshot(refs);
 }
 
@@ -732,21 +1126,15 @@ static int packed_read_raw_ref(struct ref_store *ref_store, const char *refname,
 	struct packed_ref_store *refs =
 		packed_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
 	struct snapshot *snapshot = get_snapshot(refs);
-	const char *rec;
 
 	*type = 0;
 
-	rec = find_reference_location(snapshot, refname, 1);
-
-	if (!rec) {
+	if (read_snapshot_oid(snapshot, refname, oid)) {
 		/* refname is not a packed reference. */
 		*failure_errno = ENOENT;
 		return -1;
 	}
 
-	if (get_oid_hex(rec, oid))
-		die_invalid_line(refs->path, rec, snapshot->eof - rec);
-
 	*type = REF_ISPACKED;
 	return 0;
 }
@@ -759,6 +1147,99 @@ static int packed_read_raw_ref(struct ref_store *ref_store, const char *refname,
  */
 #define REF_KNOWS_PEELED 0x40
 
+/*
+ * A sorted list of non-overlapping ranges of records in a buffer that
+ * an iteration can skip over, because they are for references that
+ * start with one of its `exclude_patterns`.
+ */
+struct jump_list {
+	struct jump_list_entry {
+		const char *start, *end;
+	} *entries;
+	size_t nr, alloc;
+	/* The first entry that may still be ahead of the iterator: */
+	size_t cur;
+};
+
+static int jump_list_entry_cmp(const void *va, const void *vb)
+{
+	const struct jump_list_entry *a = va, *b = vb;
+
+	if (a->start < b->start)
+		return -1;
+	return a->start > b->start;
+}
+
+/*
+ * Fill `jl` with the ranges of records between `start` and `eof` that
+ * are for references starting with one of `patterns`. `find` is used
+ * to look up where the records for a name would go.
+ */
+static void populate_jump_list(struct jump_list *jl, struct snapshot *snapshot,
+			       const char *start, const char *eof,
+			       const char **patterns,
+			       const char *(*find)(struct snapshot *,
+						   const char *, int))
+{
+	struct strbuf end = STRBUF_INIT;
+	size_t i, j;
+
+	if (start == eof)
+		return;
+
+	for (; *patterns; patterns++) {
+		struct jump_list_entry *e;
+
+		/*
+		 * The records for a pattern end where those for the
+		 * smallest name that is greater than all names
+		 * starting with the pattern would start. We find that
+		 * name by incrementing the last byte of the pattern.
+		 */
+		strbuf_reset(&end);
+		strbuf_addstr(&end, *patterns);
+		if (!end.len || (unsigned char)end.buf[end.len - 1] == 0xff)
+			continue;
+		end.buf[end.len - 1]++;
+
+		ALLOC_GROW(jl->entries, jl->nr + 1, jl->alloc);
+		e = &jl->entries[jl->nr];
+		e->start = find(snapshot, *patterns, 0);
+		e->end = find(snapshot, end.buf, 0);
+		if (e->start < e->end)
+			jl->nr++;
+	}
+	strbuf_release(&end);
+
+	QSORT(jl->entries, jl->nr, jump_list_entry_cmp);
+	for (i = j = 0; i < jl->nr; i++) {
+		if (j && jl->entries[i].start <= jl->entries[j - 1].end) {
+			if (jl->entries[j - 1].end < jl->entries[i].end)
+				jl->entries[j - 1].end = jl->entries[i].end;
+		} else {
+			jl->entries[j++] = jl->entries[i];
+		}
+	}
+	jl->nr = j;
+}
+
+/*
+ * If `*pos` is in one of the ranges of `jl`, move it to the end of
+ * that range. `*pos` must never move backwards between calls.
+ */
+static void skip_jump_list(struct jump_list *jl, const char **pos)
+{
+	while (jl->cur < jl->nr) {
+		struct jump_list_entry *e = &jl->entries[jl->cur];
+
+		if (*pos < e->start)
+			return;
+		if (*pos < e->end)
+			*pos = e->end;
+		jl->cur++;
+	}
+}
+
 /*
  * An iterator over a snapshot of a `packed-refs` file.
  */
@@ -773,6 +1254,12 @@ struct packed_ref_iterator {
 	/* The end of the part of the buffer that will be iterated over: */
 	const char *eof;
 
+	/* The same for the records of `packed-refs.delta`: */
+	const char *delta_pos, *delta_eof;
+
+	/* Records to skip in the main file and in the delta: */
+	struct jump_list jump, delta_jump;
+
 	/* Scratch space for current values: */
 	struct object_id oid, peeled;
 	struct strbuf refname_buf;
@@ -790,25 +1277,63 @@ struct packed_ref_iterator {
  */
 static int next_record(struct packed_ref_iterator *iter)
 {
-	const char *p = iter->pos, *eol;
+	const char *p, *eol, *start, *eof;
+	const char **pos;
+	const char *path;
+	int peeled, cmp, deleted;
 
+again:
 	strbuf_reset(&iter->refname_buf);
 
-	if (iter->pos == iter->eof)
+	skip_jump_list(&iter->jump, &iter->pos);
+	skip_jump_list(&iter->delta_jump, &iter->delta_pos);
+
+	/*
+	 * Take the next record from the delta if it sorts before the
+	 * next one in the main file; if both are for the same
+	 * reference, the one in the delta replaces the other.
+	 */
+	if (iter->pos == iter->eof && iter->delta_pos == iter->delta_eof) {
 		return ITER_DONE;
+	} else if (iter->delta_pos == iter->delta_eof) {
+		cmp = -1;
+	} else if (iter->pos == iter->eof) {
+		cmp = 1;
+	} else {
+		struct snapshot_record r1 = { .start = iter->pos };
+		struct snapshot_record r2 = { .start = iter->delta_pos };
+
+		cmp = cmp_packed_ref_records(&r1, &r2);
+		if (!cmp)
+			iter->pos = find_end_of_record(iter->pos, iter->eof);
+	}
+
+	if (cmp < 0) {
+		pos = &iter->pos;
+		eof = iter->eof;
+		path = iter->snapshot->refs->path;
+		peeled = iter->snapshot->peeled;
+	} else {
+		pos = &iter->delta_pos;
+		eof = iter->delta_eof;
+		path = iter->snapshot->refs->delta_path;
+		peeled = PEELED_FULLY;
+	}
+	start = p = *pos;
 
 	iter->base.flags = REF_ISPACKED;
 
-	if (iter->eof - p < the_hash_algo->hexsz + 2 ||
+	if (eof - p < the_hash_algo->hexsz + 2 ||
 	    parse_oid_hex(p, &iter->oid, &p) ||
 	    !isspace(*p++))
-		die_invalid_line(iter->snapshot->refs->path,
-				 iter->pos, iter->eof - iter->pos);
+		die_invalid_line(path, start, eof - start);
+
+	/* a null object ID in the delta means that the reference is gone */
+	deleted = pos == &iter->delta_pos && is_null_oid(&iter->oid);
 
-	eol = memchr(p, '\n', iter->eof - p);
+	eol = memchr(p, '\n', eof - p);
 	if (!eol)
-		die_unterminated_line(iter->snapshot->refs->path,
-				      iter->pos, iter->eof - iter->pos);
+		die_unterminated_line(path, start, eof - start);
 
 	strbuf_add(&iter->refname_buf, p, eol - p);
 	iter->base.refname = iter->refname_buf.buf;
@@ -820,21 +1345,20 @@ static int next_record(struct packed_ref_iterator *iter)
 		oidclr(&iter->oid);
 		iter->base.flags |= REF_BAD_NAME | REF_ISBROKEN;
 	}
-	if (iter->snapshot->peeled == PEELED_FULLY ||
-	    (iter->snapshot->peeled == PEELED_TAGS &&
+	if (peeled == PEELED_FULLY ||
+	    (peeled == PEELED_TAGS &&
 	     starts_with(iter->base.refname, "refs/tags/")))
 		iter->base.flags |= REF_KNOWS_PEELED;
 
-	iter->pos = eol + 1;
+	*pos = eol + 1;
 
-	if (iter->pos < iter->eof && *iter->pos == '^') {
-		p = iter->pos + 1;
-		if (iter->eof - p < the_hash_algo->hexsz + 1 ||
+	if (*pos < eof && **pos == '^') {
+		p = *pos + 1;
+		if (eof - p < the_hash_algo->hexsz + 1 ||
 		    parse_oid_hex(p, &iter->peeled, &p) ||
 		    *p++ != '\n')
-			die_invalid_line(iter->snapshot->refs->path,
-					 iter->pos, iter->eof - iter->pos);
-		iter->pos = p;
+			die_invalid_line(path, *pos, eof - *pos);
+		*pos = p;
 
 		/*
 		 * Regardless of what the file header said, we
@@ -851,6 +1375,9 @@ static int next_record(struct packed_ref_iterator *iter)
 		oidclr(&iter->peeled);
 	}
 
+	if (deleted)
+		goto again;
+
 	return ITER_OK;
 }
 
@@ -905,6 +1432,8 @@ static int packed_ref_iterator_abort(struct ref_iterator *ref_iterator)
 	int ok = ITER_DONE;
 
 	strbuf_release(&iter->refname_buf);
+	free(iter->jump.entries);
+	free(iter->delta_jump.entries);
 	release_snapshot(iter->snapshot);
 	base_ref_iterator_free(ref_iterator);
 	return ok;
@@ -918,11 +1447,12 @@ static struct ref_iterator_vtable packed_ref_iterator_vtable = {
 
 static struct ref_iterator *packed_ref_iterator_begin(
 		struct ref_store *ref_store,
-		const char *prefix, unsigned int flags)
+		const char *prefix, const char **exclude_patterns,
+		unsigned int flags)
 {
 	struct packed_ref_store *refs;
 	struct snapshot *snapshot;
-	const char *start;
+	const char *start, *delta_start;
 	struct packed_ref_iterator *iter;
 	struct ref_iterator *ref_iterator;
 	unsigned int required_flags = REF_STORE_READ;
@@ -938,12 +1468,15 @@ static struct ref_iterator *packed_ref_iterator_begin(
 	 */
 	snapshot = get_snapshot(refs);
 
-	if (prefix && *prefix)
+	if (prefix && *prefix) {
 		start = find_reference_location(snapshot, prefix, 0);
-	else
+		delta_start = find_delta_location(snapshot, prefix, 0);
+	} else {
 		start = snapshot->start;
+		delta_start = snapshot->delta_start;
+	}
 
-	if (start == snapshot->eof)
+	if (start == snapshot->eof && delta_start == snapshot->delta_eof)
 		return empty_ref_iterator_begin();
 
 	CALLOC_ARRAY(iter, 1);
@@ -955,8 +1488,18 @@ static struct ref_iterator *packed_ref_iterator_begin(
 
 	iter->pos = start;
 	iter->eof = snapshot->eof;
+	iter->delta_pos = delta_start;
+	iter->delta_eof = snapshot->delta_eof;
 	strbuf_init(&iter->refname_buf, 0);
 
+	if (exclude_patterns) {
+		populate_jump_list(&iter->jump, snapshot, start, snapshot->eof,
+				   exclude_patterns, find_reference_location);
+		populate_jump_list(&iter->delta_jump, snapshot, delta_start,
+				   snapshot->delta_eof, exclude_patterns,
+				   find_delta_location);
+	}
+
 	iter->base.oid = &iter->oid;
 
 	iter->repo = ref_store->repo;
@@ -1085,6 +1628,82 @@ static int packed_init_db(struct ref_store *ref_store UNUSED,
 	return 0;
 }
 
+/*
+ * The record offsets of a `packed-refs` file being written, for its
+ * `packed-refs.idx`.
+ */
+struct index_offsets {
+	uint64_t *v;
+	size_t nr, alloc;
+	uint64_t next;
+};
+
+/*
+ * Note the offset of an entry that is about to be written with
+ * `write_packed_entry()`.
+ */
+static void add_index_offset(struct index_offsets *offsets,
+			     const char *refname,
+			     const struct object_id *peeled)
+{
+	ALLOC_GROW(offsets->v, offsets->nr + 1, offsets->alloc);
+	offsets->v[offsets->nr++] = offsets->next;
+	offsets->next += the_hash_algo->hexsz + 1 + strlen(refname) + 1;
+	if (peeled)
+		offsets->next += 1 + the_hash_algo->hexsz + 1;
+}
+
+/*
+ * Write `offsets` to the `packed-refs.idx` tempfile, for the
+ * `packed-refs` tempfile that has just been closed. Return 0 on
+ * success. On failure, remove the tempfile and return -1; the new
+ * `packed-refs` is then used without an index.
+ */
+static int write_index(struct packed_ref_store *refs,
+		       struct index_offsets *offsets)
+{
+	unsigned char header[PACKED_REFS_INDEX_HEADER_SIZE];
+	unsigned char *data;
+	struct strbuf sb = STRBUF_INIT;
+	struct stat st;
+	size_t i;
+	int fd, ret = 0;
+
+	if (stat(get_tempfile_path(refs->tempfile), &st) ||
+	    offsets->nr > UINT32_MAX)
+		return -1;
+
+	strbuf_addf(&sb, "%s.new", refs->index_path);
+	refs->index_tempfile = create_tempfile(sb.buf);
+	strbuf_release(&sb);
+	if (!refs->index_tempfile)
+		return -1;
+	fd = get_tempfile_fd(refs->index_tempfile);
+
+	put_be32(header, PACKED_REFS_INDEX_SIGNATURE);
+	put_be32(header + 4, PACKED_REFS_INDEX_VERSION);
+	put_be64(header + 8, st.st_size);
+	put_be64(header + 16, st.st_ino);
+	put_be32(header + 24, st.st_mtime);
+	put_be32(header + 28, ST_MTIME_NSEC(st));
+	put_be32(header + 32, offsets->nr);
+
+	ALLOC_ARRAY(data, st_mult(offsets->nr, 8));
+	for (i = 0; i < offsets->nr; i++)
+		put_be64(data + 8 * i, offsets->v[i]);
+
+	if (write_in_full(fd, header, sizeof(header)) < 0 ||
+	    write_in_full(fd, data, 8 * offsets->nr) < 0 ||
+	    fsync_component(FSYNC_COMPONENT_REFERENCE, fd) ||
+	    close_tempfile_gently(refs->index_tempfile)) {
+		delete_tempfile(&refs->index_tempfile);
+		ret = -1;
+	}
+
+	free(data);
+	return ret;
+}
+
 /*
  * Write the packed refs from the current snapshot to the packed-refs
  * tempfile, incorporating any changes from `updates`. `updates` must
@@ -1100,8 +1719,9 @@ static int write_with_updates(struct packed_ref_store *refs,
 			      struct strbuf *err)
 {
 	struct ref_iterator *iter = NULL;
+	struct index_offsets offsets = { 0 };
 	size_t i;
-	int ok;
+	int ok, want_index = 0;
 	FILE *out;
 	struct strbuf sb = STRBUF_INIT;
 	char *packed_refs_path;
@@ -1109,6 +1729,8 @@ static int write_with_updates(struct packed_ref_store *refs,
 	if (!is_lock_file_locked(&refs->lock))
 		BUG("write_with_updates() called while unlocked");
 
+	git_config_get_bool("core.packedrefsindex", &want_index);
+
 	/*
 	 * If packed-refs is a symlink, we want to overwrite the
 	 * symlinked-to file, not the symlink itself. Also, put the
@@ -1143,7 +1765,7 @@ static int write_with_updates(struct packed_ref_store *refs,
 	 * list of refs is exhausted, set iter to NULL. When the list
 	 * of updates is exhausted, leave i set to updates->nr.
 	 */
-	iter = packed_ref_iterator_begin(&refs->base, "",
+	iter = packed_ref_iterator_begin(&refs->base, "", NULL,
 					 DO_FOR_EACH_INCLUDE_BROKEN);
 	if ((ok = ref_iterator_advance(iter)) != ITER_OK)
 		iter = NULL;
@@ -1227,6 +1849,8 @@ static int write_with_updates(struct packed_ref_store *refs,
 			struct object_id peeled;
 			int peel_error = ref_iterator_peel(iter, &peeled);
 
+			add_index_offset(&offsets, iter->refname,
+					 peel_error ? NULL : &peeled);
 			if (write_packed_entry(out, iter->refname,
 					       iter->oid,
 					       peel_error ? NULL : &peeled))
@@ -1248,6 +1872,8 @@ static int write_with_updates(struct packed_ref_store *refs,
 			int peel_error = peel_object(&update->new_oid,
 						     &peeled);
 
+			add_index_offset(&offsets, update->refname,
+					 peel_error ? NULL : &peeled);
 			if (write_packed_entry(out, update->refname,
 					       &update->new_oid,
 					       peel_error ? NULL : &peeled))
@@ -1269,10 +1895,15 @@ static int write_with_updates(struct packed_ref_store *refs,
 			    get_tempfile_path(refs->tempfile),
 			    strerror(errno));
 		strbuf_release(&sb);
+		free(offsets.v);
 		delete_tempfile(&refs->tempfile);
 		return -1;
 	}
 
+	if (want_index && write_index(refs, &offsets))
+		warning(_("unable to write %s"), refs->index_path);
+
+	free(offsets.v);
 	return 0;
 
 write_error:
@@ -1283,10 +1914,182 @@ static int write_with_updates(struct packed_ref_store *refs,
 	if (iter)
 		ref_iterator_abort(iter);
 
+	free(offsets.v);
 	delete_tempfile(&refs->tempfile);
 	return -1;
 }
 
+/*
+ * `packed-refs.delta` is folded back into `packed-refs` once it would
+ * grow beyond this fraction of the size of `packed-refs`. Each rewrite
+ * of `packed-refs` thus pays for at least as many bytes of updates to
+ * the delta, and the delta stays small enough to read in full.
+ */
+#define PACKED_REFS_DELTA_RATIO 8
+
+/*
+ * Should the `updates` be written to `packed-refs.delta` rather than
+ * rewriting `packed-refs`?
+ */
+static int use_delta(struct packed_ref_store *refs,
+		     struct string_list *updates)
+{
+	struct snapshot *snapshot = get_snapshot(refs);
+	size_t size = snapshot->delta_eof - snapshot->delta_start;
+	size_t i;
+
+	/*
+	 * Empty transactions are used to get a sorted and peeled
+	 * `packed-refs`, so rewrite it for them.
+	 */
+	if (!repository_format_packed_refs_delta || !updates->nr ||
+	    snapshot->start == snapshot->eof)
+		return 0;
+
+	for (i = 0; i < updates->nr; i++)
+		size += 2 * (the_hash_algo->hexsz + 2) +
+			strlen(updates->items[i].string);
+
+	return size * PACKED_REFS_DELTA_RATIO <=
+		snapshot->eof - snapshot->start;
+}
+
+/*
+ * Like `write_with_updates()`, but write the changes since the main
+ * `packed-refs` file was last written, including `updates`, to a new
+ * `packed-refs.delta` tempfile, leaving `packed-refs` alone. The cost
+ * of this depends on the size of the delta, not of `packed-refs`.
+ */
+static int write_delta_with_updates(struct packed_ref_store *refs,
+				    struct string_list *updates,
+				    struct strbuf *err)
+{
+	struct snapshot *snapshot = get_snapshot(refs);
+	const char *pos = snapshot->delta_start, *eof = snapshot->delta_eof;
+	struct strbuf sb = STRBUF_INIT;
+	FILE *out;
+	size_t i;
+
+	if (!is_lock_file_locked(&refs->lock))
+		BUG("write_delta_with_updates() called while unlocked");
+
+	strbuf_addf(&sb, "%s.new", refs->delta_path);
+	refs->delta_tempfile = create_tempfile(sb.buf);
+	if (!refs->delta_tempfile) {
+		strbuf_addf(err, "unable to create file %s: %s",
+			    sb.buf, strerror(errno));
+		strbuf_release(&sb);
+		return -1;
+	}
+	strbuf_release(&sb);
+
+	out = fdopen_tempfile(refs->delta_tempfile, "w");
+	if (!out) {
+		strbuf_addf(err, "unable to fdopen packed-refs.delta tempfile: %s",
+			    strerror(errno));
+		goto error;
+	}
+
+	if (fprintf(out, "%s%"PRIuMAX" %"PRIuMAX" %"PRIuMAX" %"PRIuMAX"\n",
+		    PACKED_REFS_DELTA_HEADER,
+		    (uintmax_t)snapshot->stamp.size,
+		    (uintmax_t)snapshot->stamp.ino,
+		    (uintmax_t)snapshot->stamp.mtime,
+		    (uintmax_t)snapshot->stamp.mtime_nsec) < 0)
+		goto write_error;
+
+	for (i = 0; i < updates->nr; i++) {
+		struct ref_update *update = updates->items[i].util;
+		struct object_id oid;
+		int exists = !read_snapshot_oid(snapshot, update->refname, &oid);
+		const char *end;
+
+		if ((update->flags & REF_HAVE_OLD)) {
+			if (is_null_oid(&update->old_oid)) {
+				if (exists) {
+					strbuf_addf(err, "cannot update ref '%s': "
+						    "reference already exists",
+						    update->refname);
+					goto error;
+				}
+			} else if (!exists) {
+				strbuf_addf(err, "cannot update ref '%s': "
+					    "reference is missing but expected %s",
+					    update->refname,
+					    oid_to_hex(&update->old_oid));
+				goto error;
+			} else if (!oideq(&update->old_oid, &oid)) {
+				strbuf_addf(err, "cannot update ref '%s': "
+					    "is at %s but expected %s",
+					    update->refname,
+					    oid_to_hex(&oid),
+					    oid_to_hex(&update->old_oid));
+				goto error;
+			}
+		}
+
+		/* Pass through the earlier changes to other references. */
+		for (; pos < eof &&
+		       cmp_record_to_refname(pos, update->refname) < 0;
+		     pos = end) {
+			end = find_end_of_record(pos, eof);
+			if (fwrite(pos, 1, end - pos, out) != end - pos)
+				goto write_error;
+		}
+
+		/* An earlier change to this reference is replaced, if any. */
+		if (pos < eof && !cmp_record_to_refname(pos, update->refname)) {
+			end = find_end_of_record(pos, eof);
+			if (!(update->flags & REF_HAVE_NEW) &&
+			    fwrite(pos, 1, end - pos, out) != end - pos)
+				goto write_error;
+			pos = end;
+		}
+
+		if (!(update->flags & REF_HAVE_NEW))
+			continue;
+
+		if (is_null_oid(&update->new_oid)) {
+			/* Only hide what is in the main file. */
+			if (find_reference_location(snapshot, update->refname, 1) &&
+			    write_packed_entry(out, update->refname,
+					       null_oid(), NULL))
+				goto write_error;
+		} else {
+			struct object_id peeled;
+			int peel_error = peel_object(&update->new_oid,
+						     &peeled);
+
+			if (write_packed_entry(out, update->refname,
+					       &update->new_oid,
+					       peel_error ? NULL : &peeled))
+				goto write_error;
+		}
+	}
+
+	if (pos < eof && fwrite(pos, 1, eof - pos, out) != eof - pos)
+		goto write_error;
+
+	if (fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(refs->delta_tempfile)) ||
+	    close_tempfile_gently(refs->delta_tempfile)) {
+		strbuf_addf(err, "error closing file %s: %s",
+			    get_tempfile_path(refs->delta_tempfile),
+			    strerror(errno));
+		delete_tempfile(&refs->delta_tempfile);
+		return -1;
+	}
+
+	return 0;
+
+write_error:
+	strbuf_addf(err, "error writing to %s: %s",
+		    get_tempfile_path(refs->delta_tempfile), strerror(errno));
+
+error:
+	delete_tempfile(&refs->delta_tempfile);
+	return -1;
+}
+
 int is_packed_transaction_needed(struct ref_store *ref_store,
 				 struct ref_transaction *transaction)
 {
@@ -1399,6 +2202,10 @@ static void packed_transaction_cleanup(struct packed_ref_store *refs,
 
 		if (is_tempfile_active(refs->tempfile))
 			delete_tempfile(&refs->tempfile);
+		if (is_tempfile_active(refs->delta_tempfile))
+			delete_tempfile(&refs->delta_tempfile);
+		if (is_tempfile_active(refs->index_tempfile))
+			delete_tempfile(&refs->index_tempfile);
 
 		if (data->own_lock && is_lock_file_locked(&refs->lock)) {
 			packed_refs_unlock(&refs->base);
@@ -1461,7 +2268,9 @@ static int packed_transaction_prepare(struct ref_store *ref_store,
 		data->own_lock = 1;
 	}
 
-	if (write_with_updates(refs, &data->updates, err))
+	if (use_delta(refs, &data->updates) ?
+	    write_delta_with_updates(refs, &data->updates, err) :
+	    write_with_updates(refs, &data->updates, err))
 		goto failure;
 
 	transaction->state = REF_TRANSACTION_PREPARED;
@@ -1493,11 +2302,34 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 			ref_store,
 			REF_STORE_READ | REF_STORE_WRITE | REF_STORE_ODB,
 			"ref_transaction_finish");
-	int ret = TRANSACTION_GENERIC_ERROR;
-	char *packed_refs_path;
+	int ret = TRANSACTION_GENERIC_ERROR, have_index = 0;
+	char *packed_refs_path = NULL;
 
 	clear_snapshot(refs);
 
+	if (is_tempfile_active(refs->delta_tempfile)) {
+		if (rename_tempfile(&refs->delta_tempfile, refs->delta_path)) {
+			strbuf_addf(err, "error replacing %s: %s",
+				    refs->delta_path, strerror(errno));
+			goto cleanup;
+		}
+		ret = 0;
+		goto cleanup;
+	}
+
+	/*
+	 * The new index does not match the old packed-refs file, nor
+	 * the old index the new file, so readers ignore a mismatched
+	 * pair until both are in place.
+	 */
+	if (is_tempfile_active(refs->index_tempfile)) {
+		if (rename_tempfile(&refs->index_tempfile, refs->index_path))
+			warning_errno(_("unable to replace %s"),
+				      refs->index_path);
+		else
+			have_index = 1;
+	}
+
 	packed_refs_path = get_locked_file_path(&refs->lock);
 	if (rename_tempfile(&refs->tempfile, packed_refs_path)) {
 		strbuf_addf(err, "error replacing %s: %s",
@@ -1505,6 +2337,21 @@ static int packed_transaction_finish(struct ref_store *ref_store,
 		goto cleanup;
 	}
 
+	/* Without a new index, the old one is of no use anymore. */
+	if (!have_index)
+		unlink_or_warn(refs->index_path);
+
+	/*
+	 * The new packed-refs file includes everything in the delta,
+	 * which readers ignore from now on, as it was written for the
+	 * old file.
+	 */
+	if (unlink(refs->delta_path) && errno != ENOENT) {
+		strbuf_addf(err, "error removing %s: %s",
+			    refs->delta_path, strerror(errno));
+		goto cleanup;
+	}
+
 	ret = 0;
 
 cleanup:
@@ -31,6 +31,23 @@ struct ref_dir *get_ref_dir(struct ref_entry *entry)
 	return dir;
 }
 
+/*
+ * Like get_ref_dir(), but if `entry` is still incomplete and the cache
+ * can fill a whole tree of directories at once, use that to read
+ * `entry` and all of its subdirectories.
+ */
+static struct ref_dir *get_ref_tree(struct ref_entry *entry)
+{
+	struct ref_dir *dir;
+	assert(entry->flag & REF_DIR);
+	dir = &entry->u.subdir;
+	if ((entry->flag & REF_INCOMPLETE) && dir->cache->fill_ref_tree) {
+		dir->cache->fill_ref_tree(dir->cache->ref_store, dir, entry->name);
+		entry->flag &= ~REF_INCOMPLETE;
+	}
+	return get_ref_dir(entry);
+}
+
 struct ref_entry *create_ref_entry(const char *refname,
 				   const struct object_id *oid, int flag)
 {
@@ -144,10 +161,13 @@ int search_ref_dir(struct ref_dir *dir, const char *refname, size_t len)
  * Search for a directory entry directly within dir (without
  * recursing).  Sort dir if necessary.  subdirname must be a directory
  * name (i.e., end in '/'). Returns NULL if the desired
- * directory cannot be found.  dir must already be complete.
+ * directory cannot be found.  dir must already be complete. If
+ * `whole_tree` is set, the caller is going to read all of the
+ * subdirectories of the directory, too.
  */
 static struct ref_dir *search_for_subdir(struct ref_dir *dir,
-					 const char *subdirname, size_t len)
+					 const char *subdirname, size_t len,
+					 int whole_tree)
 {
 	int entry_index = search_ref_dir(dir, subdirname, len);
 	struct ref_entry *entry;
@@ -156,7 +176,7 @@ static struct ref_dir *search_for_subdir(struct ref_dir *dir,
 		return NULL;
 
 	entry = dir->entries[entry_index];
-	return get_ref_dir(entry);
+	return whole_tree ? get_ref_tree(entry) : get_ref_dir(entry);
 }
 
 /*
@@ -165,16 +185,19 @@ static struct ref_dir *search_for_subdir(struct ref_dir *dir,
  * (i.e., it ends in '/'), then return that ref_dir itself. dir must
  * represent the top-level directory and must already be complete.
  * Sort ref_dirs and recurse into subdirectories as necessary. Will
- * return NULL if the desired directory cannot be found.
+ * return NULL if the desired directory cannot be found. If `prime`
+ * is set and refname is a directory name, the caller is going to
+ * read everything below that directory.
  */
 static struct ref_dir *find_containing_dir(struct ref_dir *dir,
-					   const char *refname)
+					   const char *refname, int prime)
 {
 	const char *slash;
 	for (slash = strchr(refname, '/'); slash; slash = strchr(slash + 1, '/')) {
 		size_t dirnamelen = slash - refname + 1;
 		struct ref_dir *subdir;
-		subdir = search_for_subdir(dir, refname, dirnamelen);
+		subdir = search_for_subdir(dir, refname, dirnamelen,
+					   prime && !slash[1]);
 		if (!subdir) {
 			dir = NULL;
 			break;
@@ -189,7 +212,7 @@ struct ref_entry *find_ref_entry(struct ref_dir *dir, const char *refname)
 {
 	int entry_index;
 	struct ref_entry *entry;
-	dir = find_containing_dir(dir, refname);
+	dir = find_containing_dir(dir, refname, 0);
 	if (!dir)
 		return NULL;
 	entry_index = search_ref_dir(dir, refname, strlen(refname));
@@ -301,7 +324,7 @@ static void prime_ref_dir(struct ref_dir *dir, const char *prefix)
 			/* Not a directory; no need to recurse. */
 		} else if (!prefix) {
 			/* Recurse in any case: */
-			prime_ref_dir(get_ref_dir(entry), NULL);
+			prime_ref_dir(get_ref_tree(entry), NULL);
 		} else {
 			switch (overlaps_prefix(entry->name, prefix)) {
 			case PREFIX_CONTAINS_DIR:
@@ -310,7 +333,7 @@ static void prime_ref_dir(struct ref_dir *dir, const char *prefix)
 				 * don't have to check the prefix
 				 * anymore:
 				 */
-				prime_ref_dir(get_ref_dir(entry), NULL);
+				prime_ref_dir(get_ref_tree(entry), NULL);
 				break;
 			case PREFIX_WITHIN_DIR:
 				prime_ref_dir(get_ref_dir(entry), prefix);
@@ -473,7 +496,7 @@ struct ref_iterator *cache_ref_iterator_begin(struct ref_cache *cache,
 
 	dir = get_ref_dir(cache->root);
 	if (prefix && *prefix)
-		dir = find_containing_dir(dir, prefix);
+		dir = find_containing_dir(dir, prefix, prime_dir);
 	if (!dir)
 		/* There's nothing to iterate over. */
 		return empty_ref_iterator_begin();
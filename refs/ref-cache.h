@@ -25,6 +25,15 @@ struct ref_cache {
 	 * NULL.
 	 */
 	fill_ref_dir_fn *fill_ref_dir;
+
+	/*
+	 * Function used (if set) instead of `fill_ref_dir` when a
+	 * directory is about to be read along with all of its
+	 * subdirectories, for example to prime it for iteration. It
+	 * must leave `dir` and every directory below it complete. May
+	 * be NULL.
+	 */
+	fill_ref_dir_fn *fill_ref_tree;
 };
 
 /*
@@ -365,11 +365,17 @@ int is_empty_ref_iterator(struct ref_iterator *ref_iterator);
  * which the refname begins with prefix. If trim is non-zero, then
  * trim that many characters off the beginning of each refname.
  * The output is ordered by refname.
+ *
+ * `exclude_patterns` is a NULL-terminated list of prefixes (or NULL)
+ * of references that the caller is not interested in. The backend
+ * may use them to skip over such references without reading them,
+ * but it does not have to, so callers must still filter them out
+ * themselves.
  */
 struct ref_iterator *refs_ref_iterator_begin(
 		struct ref_store *refs,
-		const char *prefix, int trim,
-		enum do_for_each_ref_flags flags);
+		const char *prefix, const char **exclude_patterns,
+		int trim, enum do_for_each_ref_flags flags);
 
 /*
  * A callback function used to instruct merge_ref_iterator how to
@@ -567,11 +573,13 @@ typedef int copy_ref_fn(struct ref_store *ref_store,
  * `prefix`. `prefix` is matched as a literal string, without regard
  * for path separators. If prefix is NULL or the empty string, iterate
  * over all references in `ref_store`. The output is ordered by
- * refname.
+ * refname. References starting with one of `exclude_patterns` may be
+ * left out; see refs_ref_iterator_begin().
  */
 typedef struct ref_iterator *ref_iterator_begin_fn(
 		struct ref_store *ref_store,
-		const char *prefix, unsigned int flags);
+		const char *prefix, const char **exclude_patterns,
+		unsigned int flags);
 
 /* reflog functions */
 
@@ -694,6 +702,7 @@ struct ref_storage_be {
 };
 
 extern struct ref_storage_be refs_be_files;
+extern struct ref_storage_be refs_be_reftable;
 extern struct ref_storage_be refs_be_packed;
 
 /*
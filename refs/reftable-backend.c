@@ -0,0 +1,1867 @@
+#include "../cache.h"
+#include "../config.h"
+#include "../dir.h"
+#include "../chdir-notify.h"
+#include "../iterator.h"
+#include "../object.h"
+#include "../refs.h"
+#include "../strmap.h"
+#include "../strvec.h"
+#include "refs-internal.h"
+#include "../reftable/reftable-error.h"
+#include "../reftable/reftable-iterator.h"
+#include "../reftable/reftable-merged.h"
+#include "../reftable/reftable-record.h"
+#include "../reftable/reftable-stack.h"
+#include "../reftable/reftable-writer.h"
+
+/*
+ * The reftable backend keeps references and their reflogs in a stack of
+ * reftables (see Documentation/technical/reftable.txt). Each worktree
+ * has its own stack for its per-worktree references in
+ * "$GIT_DIR/reftable", while everything else lives in the stack in
+ * "$GIT_COMMON_DIR/reftable". In the main worktree both are the same.
+ */
+struct reftable_ref_store {
+	struct ref_store base;
+
+	/*
+	 * The stack of the common directory, and the one of the worktree
+	 * this store was opened for, if it is a linked worktree.
+	 */
+	struct reftable_stack *main_stack;
+	struct reftable_stack *worktree_stack;
+	char *main_dir;
+	char *worktree_dir;
+
+	/* stacks of other worktrees, opened as they are asked for */
+	struct strmap worktree_stacks;
+
+	char *common_dir;
+	struct reftable_write_options write_options;
+	unsigned int store_flags;
+	int auto_compact;
+};
+
+/*
+ * Downcast ref_store to reftable_ref_store. Die if ref_store is not a
+ * reftable_ref_store. required_flags is compared with ref_store's
+ * store_flags to ensure the ref_store has all required capabilities.
+ * "caller" is used in any necessary error messages.
+ */
+static struct reftable_ref_store *reftable_downcast(struct ref_store *ref_store,
+						    unsigned int required_flags,
+						    const char *caller)
+{
+	struct reftable_ref_store *refs;
+
+	if (ref_store->be != &refs_be_reftable)
+		BUG("ref_store is type \"%s\" not \"reftable\" in %s",
+		    ref_store->be->name, caller);
+
+	refs = (struct reftable_ref_store *)ref_store;
+
+	if ((refs->store_flags & required_flags) != required_flags)
+		BUG("operation %s requires abilities 0x%x, but only have 0x%x",
+		    caller, required_flags, refs->store_flags);
+
+	return refs;
+}
+
+static struct ref_store *reftable_be_init(struct repository *repo,
+					  const char *gitdir,
+					  unsigned int flags)
+{
+	struct reftable_ref_store *refs = xcalloc(1, sizeof(*refs));
+	struct ref_store *ref_store = (struct ref_store *)refs;
+	struct strbuf sb = STRBUF_INIT;
+	int mask, ret;
+
+	base_ref_store_init(ref_store, repo, gitdir, &refs_be_reftable);
+	refs->store_flags = flags;
+	strmap_init(&refs->worktree_stacks);
+
+	get_common_dir_noenv(&sb, gitdir);
+	refs->common_dir = absolute_pathdup(sb.buf);
+	strbuf_reset(&sb);
+
+	mask = umask(0);
+	umask(mask);
+	refs->write_options.hash_id = repo->hash_algo->format_id;
+	refs->write_options.default_permissions = calc_shared_perm(0666 & ~mask);
+	/*
+	 * We check for directory/file conflicts ourselves, with the same
+	 * messages as the files backend, and without walking every deletion
+	 * still in the stack like the library's check would.
+	 */
+	refs->write_options.skip_name_check = 1;
+
+	refs->auto_compact = 1;
+	repo_config_get_bool(repo, "reftable.autocompaction", &refs->auto_compact);
+
+	refs->main_dir = xstrfmt("%s/reftable", refs->common_dir);
+	ret = reftable_new_stack(&refs->main_stack, refs->main_dir,
+				 refs->write_options);
+	if (ret)
+		die(_("unable to open reftable stack '%s': %s"),
+		    refs->main_dir, reftable_error_str(ret));
+
+	/* a linked worktree keeps its own references next to it */
+	strbuf_add_absolute_path(&sb, gitdir);
+	if (fspathcmp(sb.buf, refs->common_dir)) {
+		strbuf_addstr(&sb, "/reftable");
+		if (!mkdir(sb.buf, 0777))
+			adjust_shared_perm(sb.buf);
+		refs->worktree_dir = strbuf_detach(&sb, NULL);
+		ret = reftable_new_stack(&refs->worktree_stack,
+					 refs->worktree_dir,
+					 refs->write_options);
+		if (ret)
+			die(_("unable to open reftable stack '%s': %s"),
+			    refs->worktree_dir, reftable_error_str(ret));
+	}
+	strbuf_release(&sb);
+
+	chdir_notify_reparent("reftable-backend $GIT_DIR", &refs->base.gitdir);
+
+	return ref_store;
+}
+
+/*
+ * Return the stack that "refname" is stored in, and point "bare" to the
+ * name it has in there, without any "worktrees/<name>/" or
+ * "main-worktree/" prefix.
+ */
+static struct reftable_stack *stack_for(struct reftable_ref_store *refs,
+					const char *refname,
+					const char **bare)
+{
+	const char *wtname;
+	int wtname_len;
+
+	switch (parse_worktree_ref(refname, &wtname, &wtname_len, bare)) {
+	case REF_WORKTREE_OTHER: {
+		char *name = xmemdupz(wtname, wtname_len);
+		struct reftable_stack *stack;
+
+		stack = strmap_get(&refs->worktree_stacks, name);
+		if (!stack) {
+			char *dir = xstrfmt("%s/worktrees/%s/reftable",
+					    refs->common_dir, name);
+			int ret = reftable_new_stack(&stack, dir,
+						     refs->write_options);
+			if (ret)
+				die(_("unable to open reftable stack '%s': %s"),
+				    dir, reftable_error_str(ret));
+			strmap_put(&refs->worktree_stacks, name, stack);
+			free(dir);
+		}
+		free(name);
+		return stack;
+	}
+	case REF_WORKTREE_CURRENT:
+		if (refs->worktree_stack)
+			return refs->worktree_stack;
+		return refs->main_stack;
+	default:
+		return refs->main_stack;
+	}
+}
+
+/*
+ * Read "refname" from "stack" as it currently is, without reloading it.
+ * Returns 0 if the reference exists, 1 if it does not, and a negative
+ * reftable error code otherwise.
+ */
+static int read_ref_without_reload(struct reftable_stack *stack,
+				   const char *refname,
+				   struct object_id *oid,
+				   struct strbuf *referent,
+				   unsigned int *type)
+{
+	struct reftable_ref_record ref = { 0 };
+	int ret;
+
+	ret = reftable_stack_read_ref(stack, refname, &ref);
+	if (ret)
+		goto done;
+
+	if (ref.value_type == REFTABLE_REF_SYMREF) {
+		strbuf_reset(referent);
+		strbuf_addstr(referent, ref.value.symref);
+		*type |= REF_ISSYMREF;
+	} else if (reftable_ref_record_val1(&ref)) {
+		oidread(oid, reftable_ref_record_val1(&ref));
+	} else {
+		BUG("unhandled reference value type %d", ref.value_type);
+	}
+
+done:
+	reftable_ref_record_release(&ref);
+	return ret;
+}
+
+/*
+ * A few commands still write pseudorefs like MERGE_AUTOSTASH as plain
+ * files into $GIT_DIR, bypassing the reference backend. Look for them
+ * there if the stack does not know them.
+ */
+static int read_pseudoref_file(struct reftable_ref_store *refs,
+			       const char *refname,
+			       struct object_id *oid,
+			       struct strbuf *referent,
+			       unsigned int *type,
+			       int *failure_errno)
+{
+	struct strbuf path = STRBUF_INIT, content = STRBUF_INIT;
+	int ret = -1;
+
+	*failure_errno = ENOENT;
+	if (!strcmp(refname, "HEAD") ||
+	    refname[strspn(refname, "ABCDEFGHIJKLMNOPQRSTUVWXYZ-_")])
+		return -1;
+
+	strbuf_addf(&path, "%s/%s", refs->base.gitdir, refname);
+	if (strbuf_read_file(&content, path.buf, 256) >= 0)
+		ret = parse_loose_ref_contents(content.buf, oid, referent,
+					       type, failure_errno);
+
+	strbuf_release(&path);
+	strbuf_release(&content);
+	return ret;
+}
+
+static int reftable_be_read_raw_ref(struct ref_store *ref_store,
+				    const char *refname,
+				    struct object_id *oid,
+				    struct strbuf *referent,
+				    unsigned int *type,
+				    int *failure_errno)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "read_raw_ref");
+	const char *name;
+	struct reftable_stack *stack = stack_for(refs, refname, &name);
+	int ret;
+
+	ret = reftable_stack_reload(stack);
+	if (!ret)
+		ret = read_ref_without_reload(stack, name, oid, referent, type);
+	if (ret < 0) {
+		*failure_errno = EIO;
+		return error(_("unable to read ref '%s': %s"), refname,
+			     reftable_error_str(ret));
+	}
+	if (ret > 0)
+		return read_pseudoref_file(refs, refname, oid, referent, type,
+					   failure_errno);
+	return 0;
+}
+
+static int reftable_be_read_symbolic_ref(struct ref_store *ref_store,
+					 const char *refname,
+					 struct strbuf *referent)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "read_symbolic_ref");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct reftable_ref_record ref = { 0 };
+	int ret;
+
+	ret = reftable_stack_reload(stack);
+	if (!ret)
+		ret = reftable_stack_read_ref(stack, refname, &ref);
+	if (!ret && ref.value_type == REFTABLE_REF_SYMREF) {
+		strbuf_reset(referent);
+		strbuf_addstr(referent, ref.value.symref);
+	} else {
+		ret = -1;
+	}
+	reftable_ref_record_release(&ref);
+	return ret;
+}
+
+/*
+ * Take the lock of "stack" for an addition. Other writers only hold the
+ * lock for a moment, so we retry for as long as core.filesRefLockTimeout
+ * allows, reloading the stack if it was changed under us.
+ */
+static int lock_stack(struct reftable_stack *stack,
+		      struct reftable_addition **add,
+		      struct strbuf *err)
+{
+	uint64_t deadline = getnanotime() +
+		(uint64_t)get_files_ref_lock_timeout_ms() * 1000000;
+	long backoff_ms = 1;
+	int ret;
+
+	for (;;) {
+		ret = reftable_stack_reload(stack);
+		if (!ret)
+			ret = reftable_stack_new_addition(add, stack);
+		if (!ret)
+			return 0;
+		if (ret > 0)
+			continue;
+		if (ret != REFTABLE_LOCK_ERROR || getnanotime() >= deadline)
+			break;
+		sleep_millisec(backoff_ms);
+		if (backoff_ms < 100)
+			backoff_ms *= 2;
+	}
+
+	strbuf_addf(err, _("cannot lock references: %s"),
+		    reftable_error_str(ret));
+	return -1;
+}
+
+/*
+ * The records a single addition to a stack consists of. Records whose
+ * update_index is 0 are new and get the index of the addition.
+ */
+struct write_records_arg {
+	struct reftable_stack *stack;
+	struct reftable_ref_record *refs;
+	size_t refs_nr, refs_alloc;
+	struct reftable_log_record *logs;
+	size_t logs_nr, logs_alloc;
+};
+
+static void release_records(struct write_records_arg *arg)
+{
+	size_t i;
+
+	for (i = 0; i < arg->refs_nr; i++)
+		reftable_ref_record_release(&arg->refs[i]);
+	for (i = 0; i < arg->logs_nr; i++)
+		reftable_log_record_release(&arg->logs[i]);
+	FREE_AND_NULL(arg->refs);
+	FREE_AND_NULL(arg->logs);
+	arg->refs_nr = arg->refs_alloc = 0;
+	arg->logs_nr = arg->logs_alloc = 0;
+}
+
+static int write_records(struct reftable_writer *writer, void *cb_data)
+{
+	struct write_records_arg *arg = cb_data;
+	uint64_t ts = reftable_stack_next_update_index(arg->stack);
+	size_t i;
+	int ret;
+
+	reftable_writer_set_limits(writer, ts, ts);
+
+	for (i = 0; i < arg->refs_nr; i++)
+		arg->refs[i].update_index = ts;
+	for (i = 0; i < arg->logs_nr; i++)
+		if (!arg->logs[i].update_index)
+			arg->logs[i].update_index = ts;
+
+	ret = reftable_writer_add_refs(writer, arg->refs, arg->refs_nr);
+	if (!ret)
+		ret = reftable_writer_add_logs(writer, arg->logs, arg->logs_nr);
+	return ret;
+}
+
+/*
+ * Write the records to a new table, add it to the stack and unlock it.
+ * A failure to compact the stack afterwards is not a failure to write.
+ */
+static int commit_records(struct reftable_ref_store *refs,
+			  struct reftable_addition *add,
+			  struct write_records_arg *arg)
+{
+	int ret;
+
+	ret = reftable_addition_add(add, write_records, arg);
+	if (!ret)
+		ret = reftable_addition_commit(add);
+	if (!ret && refs->auto_compact)
+		reftable_stack_auto_compact(arg->stack);
+	return ret;
+}
+
+static void add_ref_record(struct write_records_arg *arg,
+			   const char *refname,
+			   const struct object_id *oid,
+			   const char *symref)
+{
+	struct reftable_ref_record *ref;
+	struct object_id peeled;
+
+	ALLOC_GROW(arg->refs, arg->refs_nr + 1, arg->refs_alloc);
+	ref = &arg->refs[arg->refs_nr++];
+	memset(ref, 0, sizeof(*ref));
+	ref->refname = xstrdup(refname);
+
+	if (symref) {
+		ref->value_type = REFTABLE_REF_SYMREF;
+		ref->value.symref = xstrdup(symref);
+	} else if (!oid || is_null_oid(oid)) {
+		ref->value_type = REFTABLE_REF_DELETION;
+	} else if (peel_object(oid, &peeled) == PEEL_PEELED) {
+		/* keep the peeled value of tags, like packed-refs does */
+		ref->value_type = REFTABLE_REF_VAL2;
+		ref->value.val2.value = xmemdupz(oid->hash, the_hash_algo->rawsz);
+		ref->value.val2.target_value =
+			xmemdupz(peeled.hash, the_hash_algo->rawsz);
+	} else {
+		ref->value_type = REFTABLE_REF_VAL1;
+		ref->value.val1 = xmemdupz(oid->hash, the_hash_algo->rawsz);
+	}
+}
+
+static struct reftable_log_record *new_log_record(struct write_records_arg *arg)
+{
+	struct reftable_log_record *log;
+
+	ALLOC_GROW(arg->logs, arg->logs_nr + 1, arg->logs_alloc);
+	log = &arg->logs[arg->logs_nr++];
+	memset(log, 0, sizeof(*log));
+	return log;
+}
+
+static void add_log_record(struct write_records_arg *arg,
+			   const char *refname,
+			   const struct object_id *old_oid,
+			   const struct object_id *new_oid,
+			   const char *msg)
+{
+	struct reftable_log_record *log = new_log_record(arg);
+	const char *info = git_committer_info(0);
+	struct ident_split ident;
+
+	log->refname = xstrdup(refname);
+	log->value_type = REFTABLE_LOG_UPDATE;
+	log->value.update.old_hash = xmemdupz(old_oid->hash, the_hash_algo->rawsz);
+	log->value.update.new_hash = xmemdupz(new_oid->hash, the_hash_algo->rawsz);
+	log->value.update.message = xstrdup(msg ? msg : "");
+
+	if (split_ident_line(&ident, info, strlen(info)))
+		BUG("unable to parse our own committer ident '%s'", info);
+	log->value.update.name =
+		xmemdupz(ident.name_begin, ident.name_end - ident.name_begin);
+	log->value.update.email =
+		xmemdupz(ident.mail_begin, ident.mail_end - ident.mail_begin);
+	if (ident.date_begin) {
+		log->value.update.time = parse_timestamp(ident.date_begin,
+							 NULL, 10);
+		log->value.update.tz_offset = strtol(ident.tz_begin, NULL, 10);
+	}
+}
+
+static void add_log_tombstone(struct write_records_arg *arg,
+			      const char *refname, uint64_t update_index)
+{
+	struct reftable_log_record *log = new_log_record(arg);
+
+	log->refname = xstrdup(refname);
+	log->update_index = update_index;
+	log->value_type = REFTABLE_LOG_DELETION;
+}
+
+static void copy_log_record(struct write_records_arg *arg,
+			    const char *refname,
+			    const struct reftable_log_record *src)
+{
+	struct reftable_log_record *log = new_log_record(arg);
+
+	log->refname = xstrdup(refname);
+	log->update_index = src->update_index;
+	log->value_type = REFTABLE_LOG_UPDATE;
+	log->value.update.old_hash =
+		xmemdupz(src->value.update.old_hash, the_hash_algo->rawsz);
+	log->value.update.new_hash =
+		xmemdupz(src->value.update.new_hash, the_hash_algo->rawsz);
+	log->value.update.name = xstrdup_or_null(src->value.update.name);
+	log->value.update.email = xstrdup_or_null(src->value.update.email);
+	log->value.update.time = src->value.update.time;
+	log->value.update.tz_offset = src->value.update.tz_offset;
+	log->value.update.message = xstrdup_or_null(src->value.update.message);
+}
+
+/*
+ * Collect the reflog entries of "refname" in "stack", newest first. The
+ * caller owns the records.
+ */
+static int read_log_records(struct reftable_stack *stack,
+			    const char *refname,
+			    struct reftable_log_record **logs,
+			    size_t *nr, size_t *alloc)
+{
+	struct reftable_merged_table *mt = reftable_stack_merged_table(stack);
+	struct reftable_iterator it = { 0 };
+	struct reftable_log_record log = { 0 };
+	int ret;
+
+	ret = reftable_merged_table_seek_log_with_deletions(mt, &it, refname);
+	while (!ret) {
+		ret = reftable_iterator_next_log(&it, &log);
+		if (ret)
+			break;
+		if (strcmp(log.refname, refname)) {
+			ret = 1;
+			break;
+		}
+		if (reftable_log_record_is_deletion(&log))
+			continue;
+		ALLOC_GROW(*logs, *nr + 1, *alloc);
+		(*logs)[(*nr)++] = log;
+		memset(&log, 0, sizeof(log));
+	}
+
+	reftable_log_record_release(&log);
+	reftable_iterator_destroy(&it);
+	return ret < 0 ? ret : 0;
+}
+
+static void free_log_records(struct reftable_log_record *logs, size_t nr)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+		reftable_log_record_release(&logs[i]);
+	free(logs);
+}
+
+static int reflog_exists_in_stack(struct reftable_stack *stack,
+				  const char *refname)
+{
+	struct reftable_log_record log = { 0 };
+	int ret;
+
+	ret = !reftable_stack_read_log(stack, refname, &log);
+	reftable_log_record_release(&log);
+	return ret;
+}
+
+/* Add tombstones for all of the reflog entries of "refname". */
+static int delete_log_records(struct write_records_arg *arg,
+			      const char *refname)
+{
+	struct reftable_log_record *logs = NULL;
+	size_t logs_nr = 0, logs_alloc = 0, i;
+	int ret;
+
+	ret = read_log_records(arg->stack, refname, &logs, &logs_nr,
+			       &logs_alloc);
+	for (i = 0; i < logs_nr; i++)
+		add_log_tombstone(arg, refname, logs[i].update_index);
+	free_log_records(logs, logs_nr);
+	return ret;
+}
+
+static int should_write_log(struct reftable_stack *stack,
+			    const char *refname, unsigned int flags)
+{
+	if (flags & REF_FORCE_CREATE_REFLOG)
+		return 1;
+	if (log_all_ref_updates == LOG_REFS_UNSET)
+		log_all_ref_updates = is_bare_repository() ?
+			LOG_REFS_NONE : LOG_REFS_NORMAL;
+	if (should_autocreate_reflog(refname))
+		return 1;
+	return reflog_exists_in_stack(stack, refname);
+}
+
+struct reftable_transaction_stack {
+	struct reftable_addition *addition;
+	struct write_records_arg records;
+};
+
+struct reftable_transaction_data {
+	struct reftable_transaction_stack *stacks;
+	size_t stacks_nr, stacks_alloc;
+
+	/*
+	 * The initial transaction fills an empty repository and need not
+	 * check new names against the existing ones.
+	 */
+	int initial;
+};
+
+/*
+ * Return the records to be added to "stack" by the transaction, taking
+ * its lock the first time it is asked for.
+ */
+static int transaction_records_for(struct reftable_transaction_data *tx_data,
+				   struct reftable_stack *stack,
+				   struct write_records_arg **out,
+				   struct strbuf *err)
+{
+	struct reftable_transaction_stack *ts;
+	size_t i;
+
+	for (i = 0; i < tx_data->stacks_nr; i++) {
+		if (tx_data->stacks[i].records.stack == stack) {
+			*out = &tx_data->stacks[i].records;
+			return 0;
+		}
+	}
+
+	ALLOC_GROW(tx_data->stacks, tx_data->stacks_nr + 1,
+		   tx_data->stacks_alloc);
+	ts = &tx_data->stacks[tx_data->stacks_nr];
+	memset(ts, 0, sizeof(*ts));
+	if (lock_stack(stack, &ts->addition, err))
+		return TRANSACTION_GENERIC_ERROR;
+	ts->records.stack = stack;
+	tx_data->stacks_nr++;
+
+	*out = &ts->records;
+	return 0;
+}
+
+static void transaction_cleanup(struct ref_transaction *transaction)
+{
+	struct reftable_transaction_data *tx_data = transaction->backend_data;
+	size_t i;
+
+	if (tx_data) {
+		for (i = 0; i < tx_data->stacks_nr; i++) {
+			reftable_addition_destroy(tx_data->stacks[i].addition);
+			release_records(&tx_data->stacks[i].records);
+		}
+		free(tx_data->stacks);
+		free(tx_data);
+		transaction->backend_data = NULL;
+	}
+	transaction->state = REF_TRANSACTION_CLOSED;
+}
+
+static int prepare_update(struct reftable_ref_store *refs,
+			  struct reftable_transaction_data *tx_data,
+			  struct ref_update *u,
+			  struct string_list *affected_refnames,
+			  const char *head_referent,
+			  struct strbuf *err)
+{
+	struct string_list symrefs = STRING_LIST_INIT_DUP;
+	struct strbuf referent = STRBUF_INIT, target = STRBUF_INIT;
+	struct write_records_arg *arg;
+	struct reftable_stack *stack;
+	struct object_id current_oid;
+	const char *refname = u->refname, *name;
+	unsigned int type;
+	int exists, ret;
+	size_t i;
+
+	/* find the reference that is really going to be updated */
+	for (;;) {
+		stack = stack_for(refs, refname, &name);
+		ret = transaction_records_for(tx_data, stack, &arg, err);
+		if (ret)
+			goto done;
+
+		type = 0;
+		oidclr(&current_oid);
+		ret = read_ref_without_reload(stack, name, &current_oid,
+					      &referent, &type);
+		if (ret < 0) {
+			strbuf_addf(err, _("cannot read ref '%s': %s"),
+				    refname, reftable_error_str(ret));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+		exists = !ret;
+		ret = 0;
+
+		if (!(type & REF_ISSYMREF))
+			break;
+		if (u->flags & REF_NO_DEREF) {
+			if (!refs_resolve_ref_unsafe(&refs->base, referent.buf,
+						     0, &current_oid, NULL))
+				oidclr(&current_oid);
+			break;
+		}
+
+		if (symrefs.nr >= SYMREF_MAXDEPTH) {
+			strbuf_addf(err, _("cannot lock ref '%s': "
+					   "symbolic ref chain is too long"),
+				    u->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+		if (string_list_has_string(affected_refnames, referent.buf)) {
+			strbuf_addf(err, _("multiple updates for '%s' (including one "
+					   "via symref '%s') are not allowed"),
+				    referent.buf, u->refname);
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto done;
+		}
+		string_list_insert(affected_refnames, referent.buf);
+		string_list_append(&symrefs, refname);
+
+		strbuf_swap(&target, &referent);
+		refname = target.buf;
+	}
+
+	if (u->flags & REF_HAVE_OLD) {
+		if (is_null_oid(&u->old_oid)) {
+			if (exists) {
+				strbuf_addf(err, _("cannot lock ref '%s': "
+						   "reference already exists"),
+					    u->refname);
+				ret = TRANSACTION_GENERIC_ERROR;
+				goto done;
+			}
+		} else if (!exists) {
+			strbuf_addf(err, _("cannot lock ref '%s': "
+					   "unable to resolve reference '%s'"),
+				    u->refname, refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		} else if (!oideq(&current_oid, &u->old_oid)) {
+			strbuf_addf(err, _("cannot lock ref '%s': is at %s but expected %s"),
+				    u->refname, oid_to_hex(&current_oid),
+				    oid_to_hex(&u->old_oid));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+	}
+
+	if (!(u->flags & REF_HAVE_NEW))
+		goto done;
+
+	if (!is_null_oid(&u->new_oid) && !(u->flags & REF_LOG_ONLY) &&
+	    !(u->flags & REF_SKIP_OID_VERIFICATION)) {
+		struct object *o = parse_object(refs->base.repo, &u->new_oid);
+
+		if (!o) {
+			strbuf_addf(err, _("trying to write ref '%s' with nonexistent object %s"),
+				    refname, oid_to_hex(&u->new_oid));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+		if (o->type != OBJ_COMMIT && starts_with(refname, "refs/heads/")) {
+			strbuf_addf(err, _("trying to write non-commit object %s to branch '%s'"),
+				    oid_to_hex(&u->new_oid), refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+	}
+
+	if (!is_null_oid(&u->new_oid)) {
+		/* report conflicts like the files backend does */
+		if (!exists && !tx_data->initial &&
+		    refs_verify_refname_available(&refs->base, refname,
+						  affected_refnames, NULL, err)) {
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto done;
+		}
+		if (!(u->flags & REF_LOG_ONLY))
+			add_ref_record(arg, name, &u->new_oid, NULL);
+		if (should_write_log(arg->stack, name, u->flags))
+			add_log_record(arg, name, &current_oid, &u->new_oid,
+				       u->msg);
+	} else if (!(u->flags & REF_LOG_ONLY)) {
+		/* a deleted reference takes its reflog with it */
+		if (exists)
+			add_ref_record(arg, name, NULL, NULL);
+		ret = delete_log_records(arg, name);
+		if (ret < 0) {
+			strbuf_addf(err, _("cannot read reflog of '%s': %s"),
+				    refname, reftable_error_str(ret));
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto done;
+		}
+	}
+
+	/* the symrefs we came through log the update, too */
+	for (i = 0; i < symrefs.nr; i++) {
+		struct write_records_arg *symref_arg;
+
+		stack = stack_for(refs, symrefs.items[i].string, &name);
+		ret = transaction_records_for(tx_data, stack, &symref_arg, err);
+		if (ret)
+			goto done;
+		if (should_write_log(stack, name, u->flags))
+			add_log_record(symref_arg, name, &current_oid,
+				       &u->new_oid, u->msg);
+	}
+
+	/*
+	 * An update of the branch HEAD points to shows up in the reflog
+	 * of HEAD, too.
+	 */
+	if (!symrefs.nr && head_referent && !strcmp(refname, head_referent) &&
+	    !(u->flags & REF_LOG_ONLY)) {
+		struct write_records_arg *head_arg;
+
+		if (string_list_has_string(affected_refnames, "HEAD")) {
+			strbuf_addf(err, _("multiple updates for 'HEAD' (including one "
+					   "via its referent '%s') are not allowed"),
+				    refname);
+			ret = TRANSACTION_NAME_CONFLICT;
+			goto done;
+		}
+		stack = stack_for(refs, "HEAD", &name);
+		ret = transaction_records_for(tx_data, stack, &head_arg, err);
+		if (ret)
+			goto done;
+		if (should_write_log(stack, name, u->flags))
+			add_log_record(head_arg, name, &current_oid,
+				       &u->new_oid, u->msg);
+	}
+
+done:
+	string_list_clear(&symrefs, 0);
+	strbuf_release(&referent);
+	strbuf_release(&target);
+	return ret;
+}
+
+static int transaction_prepare(struct reftable_ref_store *refs,
+			       struct ref_transaction *transaction,
+			       int initial, struct strbuf *err)
+{
+	struct string_list affected_refnames = STRING_LIST_INIT_DUP;
+	struct reftable_transaction_data *tx_data;
+	struct strbuf head_referent = STRBUF_INIT;
+	struct reftable_stack *head_stack;
+	struct object_id head_oid;
+	unsigned int head_type = 0;
+	const char *head_name;
+	size_t i;
+	int ret = 0;
+
+	CALLOC_ARRAY(tx_data, 1);
+	tx_data->initial = initial;
+	transaction->backend_data = tx_data;
+
+	for (i = 0; i < transaction->nr; i++)
+		string_list_append(&affected_refnames,
+				   transaction->updates[i]->refname);
+	string_list_sort(&affected_refnames);
+	if (ref_update_reject_duplicates(&affected_refnames, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto done;
+	}
+
+	head_stack = stack_for(refs, "HEAD", &head_name);
+	if (!reftable_stack_reload(head_stack))
+		read_ref_without_reload(head_stack, head_name, &head_oid,
+					&head_referent, &head_type);
+
+	for (i = 0; i < transaction->nr; i++) {
+		ret = prepare_update(refs, tx_data, transaction->updates[i],
+				     &affected_refnames,
+				     head_type & REF_ISSYMREF ?
+				     head_referent.buf : NULL, err);
+		if (ret)
+			goto done;
+	}
+
+done:
+	if (ret)
+		transaction_cleanup(transaction);
+	else
+		transaction->state = REF_TRANSACTION_PREPARED;
+	string_list_clear(&affected_refnames, 0);
+	strbuf_release(&head_referent);
+	return ret;
+}
+
+static int reftable_be_transaction_prepare(struct ref_store *ref_store,
+					   struct ref_transaction *transaction,
+					   struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "ref_transaction_prepare");
+
+	return transaction_prepare(refs, transaction, 0, err);
+}
+
+static int reftable_be_transaction_finish(struct ref_store *ref_store,
+					  struct ref_transaction *transaction,
+					  struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "ref_transaction_finish");
+	struct reftable_transaction_data *tx_data = transaction->backend_data;
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; tx_data && i < tx_data->stacks_nr; i++) {
+		struct reftable_transaction_stack *ts = &tx_data->stacks[i];
+
+		ret = commit_records(refs, ts->addition, &ts->records);
+		if (ret) {
+			strbuf_addf(err, _("cannot update references: %s"),
+				    reftable_error_str(ret));
+			ret = ret == REFTABLE_NAME_CONFLICT ?
+				TRANSACTION_NAME_CONFLICT :
+				TRANSACTION_GENERIC_ERROR;
+			break;
+		}
+	}
+
+	transaction_cleanup(transaction);
+	return ret;
+}
+
+static int reftable_be_transaction_abort(struct ref_store *ref_store UNUSED,
+					 struct ref_transaction *transaction,
+					 struct strbuf *err UNUSED)
+{
+	transaction_cleanup(transaction);
+	return 0;
+}
+
+static int reftable_be_initial_transaction_commit(struct ref_store *ref_store,
+						  struct ref_transaction *transaction,
+						  struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "initial_ref_transaction_commit");
+	int ret = transaction_prepare(refs, transaction, 1, err);
+
+	if (ret)
+		return ret;
+	return reftable_be_transaction_finish(ref_store, transaction, err);
+}
+
+static int reftable_be_pack_refs(struct ref_store *ref_store,
+				 unsigned int flags UNUSED)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE | REF_STORE_ODB,
+				  "pack_refs");
+	struct reftable_stack *stacks[2] = {
+		refs->main_stack, refs->worktree_stack,
+	};
+	size_t i;
+	int ret;
+
+	for (i = 0; i < ARRAY_SIZE(stacks) && stacks[i]; i++) {
+		ret = reftable_stack_reload(stacks[i]);
+		if (!ret)
+			ret = reftable_stack_compact_all(stacks[i], NULL);
+		if (!ret)
+			ret = reftable_stack_clean(stacks[i]);
+		if (ret)
+			return error(_("unable to compact references: %s"),
+				     reftable_error_str(ret));
+	}
+	return 0;
+}
+
+static int reftable_be_create_symref(struct ref_store *ref_store,
+				     const char *refname,
+				     const char *target,
+				     const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_symref");
+	const char *name;
+	struct reftable_stack *stack = stack_for(refs, refname, &name);
+	struct write_records_arg arg = { .stack = stack };
+	struct reftable_addition *add = NULL;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id old_oid, new_oid;
+	int ret;
+
+	ret = lock_stack(stack, &add, &err);
+	if (ret)
+		goto done;
+
+	if (refs_verify_refname_available(&refs->base, refname, NULL, NULL,
+					  &err)) {
+		ret = -1;
+		goto done;
+	}
+
+	add_ref_record(&arg, name, NULL, target);
+	if (logmsg && should_write_log(stack, name, 0) &&
+	    refs_resolve_ref_unsafe(&refs->base, target, RESOLVE_REF_READING,
+				    &new_oid, NULL)) {
+		if (!refs_resolve_ref_unsafe(&refs->base, refname,
+					     RESOLVE_REF_READING, &old_oid, NULL))
+			oidclr(&old_oid);
+		add_log_record(&arg, name, &old_oid, &new_oid, logmsg);
+	}
+
+	ret = commit_records(refs, add, &arg);
+	if (ret)
+		strbuf_addf(&err, _("unable to write symref for %s: %s"),
+			    refname, reftable_error_str(ret));
+
+done:
+	if (ret)
+		error("%s", err.buf);
+	reftable_addition_destroy(add);
+	release_records(&arg);
+	strbuf_release(&err);
+	return ret ? -1 : 0;
+}
+
+static int reftable_be_delete_refs(struct ref_store *ref_store,
+				   const char *msg,
+				   struct string_list *refnames,
+				   unsigned int flags)
+{
+	struct ref_transaction *transaction;
+	struct strbuf err = STRBUF_INIT;
+	struct string_list_item *item;
+	int ret = 0, failures = 0;
+
+	if (!refnames->nr)
+		return 0;
+
+	transaction = ref_store_transaction_begin(ref_store, &err);
+	if (!transaction) {
+		ret = error("%s", err.buf);
+		goto done;
+	}
+
+	for_each_string_list_item(item, refnames) {
+		if (ref_transaction_delete(transaction, item->string, NULL,
+					   flags, msg, &err)) {
+			warning(_("could not delete reference %s: %s"),
+				item->string, err.buf);
+			strbuf_reset(&err);
+			failures = 1;
+		}
+	}
+
+	if (ref_transaction_commit(transaction, &err)) {
+		if (refnames->nr == 1)
+			ret = error(_("could not delete reference %s: %s"),
+				    refnames->items[0].string, err.buf);
+		else
+			ret = error(_("could not delete references: %s"),
+				    err.buf);
+	} else if (failures)
+		ret = -1;
+
+done:
+	ref_transaction_free(transaction);
+	strbuf_release(&err);
+	return ret;
+}
+
+static int rename_or_copy_ref(struct reftable_ref_store *refs,
+			      const char *oldrefname, const char *newrefname,
+			      const char *logmsg, int delete_old)
+{
+	const char *old_name, *new_name;
+	struct reftable_stack *stack = stack_for(refs, newrefname, &new_name);
+	struct write_records_arg arg = { .stack = stack };
+	struct reftable_addition *add = NULL;
+	struct reftable_ref_record old_ref = { 0 };
+	struct reftable_log_record *old_logs = NULL, *new_logs = NULL;
+	size_t old_nr = 0, old_alloc = 0, new_nr = 0, new_alloc = 0, i, j;
+	struct string_list skip = STRING_LIST_INIT_NODUP;
+	struct strbuf err = STRBUF_INIT;
+	struct object_id oid;
+	int ret;
+
+	if (stack_for(refs, oldrefname, &old_name) != stack)
+		return error(_("cannot move '%s' to '%s' across worktrees"),
+			     oldrefname, newrefname);
+
+	ret = lock_stack(stack, &add, &err);
+	if (ret)
+		goto done;
+
+	ret = reftable_stack_read_ref(stack, old_name, &old_ref);
+	if (ret) {
+		strbuf_addf(&err, _("refname %s not found"), oldrefname);
+		goto done;
+	}
+	if (old_ref.value_type == REFTABLE_REF_SYMREF) {
+		if (delete_old)
+			strbuf_addf(&err, _("refname %s is a symbolic ref, renaming it is not supported"),
+				    oldrefname);
+		else
+			strbuf_addf(&err, _("refname %s is a symbolic ref, copying it is not supported"),
+				    oldrefname);
+		ret = -1;
+		goto done;
+	}
+	oidread(&oid, reftable_ref_record_val1(&old_ref));
+
+	/* moving a reference onto itself only leaves a note in its reflog */
+	if (!strcmp(old_name, new_name)) {
+		if (should_write_log(stack, new_name, 0))
+			add_log_record(&arg, new_name, &oid, &oid, logmsg);
+		goto write;
+	}
+
+	string_list_insert(&skip, oldrefname);
+	if (refs_verify_refname_available(&refs->base, newrefname,
+					  NULL, &skip, &err)) {
+		ret = -1;
+		goto done;
+	}
+
+	add_ref_record(&arg, new_name, &oid, NULL);
+	if (delete_old)
+		add_ref_record(&arg, old_name, NULL, NULL);
+
+	/*
+	 * The reflog goes along with the reference, replacing whatever
+	 * reflog there was under the new name.
+	 */
+	ret = read_log_records(stack, old_name, &old_logs, &old_nr, &old_alloc);
+	if (!ret)
+		ret = read_log_records(stack, new_name, &new_logs, &new_nr,
+				       &new_alloc);
+	if (ret) {
+		strbuf_addf(&err, _("cannot read reflog of '%s': %s"),
+			    oldrefname, reftable_error_str(ret));
+		goto done;
+	}
+	for (i = 0; i < new_nr; i++) {
+		for (j = 0; j < old_nr; j++)
+			if (old_logs[j].update_index == new_logs[i].update_index)
+				break;
+		if (j == old_nr)
+			add_log_tombstone(&arg, new_name, new_logs[i].update_index);
+	}
+	for (i = 0; i < old_nr; i++) {
+		copy_log_record(&arg, new_name, &old_logs[i]);
+		if (delete_old)
+			add_log_tombstone(&arg, old_name, old_logs[i].update_index);
+	}
+	if (old_nr || should_write_log(stack, new_name, 0))
+		add_log_record(&arg, new_name, &oid, &oid, logmsg);
+
+write:
+	ret = commit_records(refs, add, &arg);
+	if (ret)
+		strbuf_addf(&err, _("unable to write '%s': %s"), newrefname,
+			    reftable_error_str(ret));
+
+done:
+	if (ret)
+		error("%s", err.buf);
+	reftable_addition_destroy(add);
+	reftable_ref_record_release(&old_ref);
+	free_log_records(old_logs, old_nr);
+	free_log_records(new_logs, new_nr);
+	release_records(&arg);
+	string_list_clear(&skip, 0);
+	strbuf_release(&err);
+	return ret ? -1 : 0;
+}
+
+static int reftable_be_rename_ref(struct ref_store *ref_store,
+				  const char *oldrefname, const char *newrefname,
+				  const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "rename_ref");
+
+	return rename_or_copy_ref(refs, oldrefname, newrefname, logmsg, 1);
+}
+
+static int reftable_be_copy_ref(struct ref_store *ref_store,
+				const char *oldrefname, const char *newrefname,
+				const char *logmsg)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "copy_ref");
+
+	return rename_or_copy_ref(refs, oldrefname, newrefname, logmsg, 0);
+}
+
+/*
+ * Iterators work on a stack of their own, so that reloads of the store's
+ * stacks by anything done while iterating cannot pull the tables from
+ * under them.
+ */
+struct reftable_ref_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
+	struct reftable_iterator iter;
+	struct reftable_ref_record ref;
+	struct object_id oid;
+	char *prefix;
+	/* prefixes of refs that we may seek past; see refs_ref_iterator_begin() */
+	struct strvec exclude_patterns;
+	unsigned int flags;
+
+	/*
+	 * In a linked worktree, the common stack must not show per-worktree
+	 * refs and the worktree's stack shows nothing else.
+	 */
+	unsigned int skip_per_worktree : 1,
+		     only_per_worktree : 1;
+	int err;
+};
+
+/*
+ * If `refname` starts with one of the exclude patterns of `iter`,
+ * seek to the first ref after all of those that start with the
+ * pattern and return 1. Return 0 otherwise.
+ */
+static int reftable_ref_iterator_skip_excluded(struct reftable_ref_iterator *iter,
+					       const char *refname)
+{
+	struct strbuf next = STRBUF_INIT;
+	size_t i;
+
+	for (i = 0; i < iter->exclude_patterns.nr; i++) {
+		const char *pattern = iter->exclude_patterns.v[i];
+
+		if (*pattern && starts_with(refname, pattern))
+			break;
+	}
+	if (i == iter->exclude_patterns.nr)
+		return 0;
+
+	/*
+	 * Incrementing the last byte of the pattern gives the smallest
+	 * name that sorts after all names starting with it.
+	 */
+	strbuf_addstr(&next, iter->exclude_patterns.v[i]);
+	if ((unsigned char)next.buf[next.len - 1] == 0xff) {
+		strbuf_release(&next);
+		return 0;
+	}
+	next.buf[next.len - 1]++;
+
+	reftable_iterator_destroy(&iter->iter);
+	iter->err = reftable_merged_table_seek_ref_with_deletions(
+			reftable_stack_merged_table(iter->stack),
+			&iter->iter, next.buf);
+	strbuf_release(&next);
+	return 1;
+}
+
+static int reftable_ref_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	while (!iter->err) {
+		unsigned int flags = 0;
+		const char *refname;
+
+		iter->err = reftable_iterator_next_ref(&iter->iter, &iter->ref);
+		if (iter->err)
+			break;
+		refname = iter->ref.refname;
+
+		if (!starts_with(refname, iter->prefix)) {
+			iter->err = 1;
+			break;
+		}
+		if (reftable_ref_iterator_skip_excluded(iter, refname))
+			continue;
+		if (reftable_ref_record_is_deletion(&iter->ref))
+			continue;
+		if (!starts_with(refname, "refs/"))
+			continue;
+		if (iter->skip_per_worktree && is_per_worktree_ref(refname))
+			continue;
+		if (iter->only_per_worktree && !is_per_worktree_ref(refname))
+			continue;
+		if (iter->flags & DO_FOR_EACH_PER_WORKTREE_ONLY &&
+		    parse_worktree_ref(refname, NULL, NULL, NULL) !=
+		    REF_WORKTREE_CURRENT)
+			continue;
+
+		switch (iter->ref.value_type) {
+		case REFTABLE_REF_VAL1:
+		case REFTABLE_REF_VAL2:
+			oidread(&iter->oid, reftable_ref_record_val1(&iter->ref));
+			break;
+		case REFTABLE_REF_SYMREF:
+			flags |= REF_ISSYMREF;
+			if (!refs_resolve_ref_unsafe(&iter->refs->base, refname,
+						     RESOLVE_REF_READING,
+						     &iter->oid, NULL))
+				oidclr(&iter->oid);
+			break;
+		default:
+			BUG("unhandled reference value type %d",
+			    iter->ref.value_type);
+		}
+
+		if (is_null_oid(&iter->oid))
+			flags |= REF_ISBROKEN;
+
+		if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL)) {
+			if (!refname_is_safe(refname))
+				die(_("refname is dangerous: %s"), refname);
+			oidclr(&iter->oid);
+			flags |= REF_BAD_NAME | REF_ISBROKEN;
+		}
+
+		if (iter->flags & DO_FOR_EACH_OMIT_DANGLING_SYMREFS &&
+		    flags & REF_ISSYMREF && flags & REF_ISBROKEN)
+			continue;
+
+		if (!(iter->flags & DO_FOR_EACH_INCLUDE_BROKEN) &&
+		    !ref_resolves_to_object(refname, iter->refs->base.repo,
+					    &iter->oid, flags))
+			continue;
+
+		iter->base.refname = refname;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (iter->err > 0) {
+		if (ref_iterator_abort(ref_iterator) != ITER_DONE)
+			return ITER_ERROR;
+		return ITER_DONE;
+	}
+
+	ref_iterator_abort(ref_iterator);
+	return ITER_ERROR;
+}
+
+static int reftable_ref_iterator_peel(struct ref_iterator *ref_iterator,
+				      struct object_id *peeled)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	/* we keep the peeled value of every tag we write */
+	if (iter->ref.value_type == REFTABLE_REF_VAL2) {
+		oidread(peeled, reftable_ref_record_val2(&iter->ref));
+		return 0;
+	}
+	return -1;
+}
+
+static int reftable_ref_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_ref_iterator *iter =
+		(struct reftable_ref_iterator *)ref_iterator;
+
+	reftable_ref_record_release(&iter->ref);
+	reftable_iterator_destroy(&iter->iter);
+	if (iter->stack)
+		reftable_stack_destroy(iter->stack);
+	free(iter->prefix);
+	strvec_clear(&iter->exclude_patterns);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_ref_iterator_vtable = {
+	.advance = reftable_ref_iterator_advance,
+	.peel = reftable_ref_iterator_peel,
+	.abort = reftable_ref_iterator_abort
+};
+
+static struct reftable_ref_iterator *ref_iterator_for_stack(struct reftable_ref_store *refs,
+							    const char *dir,
+							    const char *prefix,
+							    const char **exclude_patterns,
+							    unsigned int flags)
+{
+	struct reftable_ref_iterator *iter;
+	int ret;
+
+	CALLOC_ARRAY(iter, 1);
+	base_ref_iterator_init(&iter->base, &reftable_ref_iterator_vtable, 1);
+	iter->refs = refs;
+	iter->prefix = xstrdup(prefix ? prefix : "");
+	strvec_init(&iter->exclude_patterns);
+	if (exclude_patterns)
+		strvec_pushv(&iter->exclude_patterns, exclude_patterns);
+	iter->flags = flags;
+
+	ret = reftable_new_stack(&iter->stack, dir, refs->write_options);
+	if (!ret)
+		/*
+		 * Skip deletions ourselves, so that we stop at the end of
+		 * the prefix instead of after all of the deletions there.
+		 */
+		ret = reftable_merged_table_seek_ref_with_deletions(reftable_stack_merged_table(iter->stack),
+								    &iter->iter, iter->prefix);
+	iter->err = ret;
+	return iter;
+}
+
+static enum iterator_selection iterator_select(struct ref_iterator *iter_worktree,
+					       struct ref_iterator *iter_common,
+					       void *cb_data UNUSED)
+{
+	int cmp;
+
+	if (!iter_worktree)
+		return iter_common ? ITER_SELECT_1 : ITER_SELECT_DONE;
+	if (!iter_common)
+		return ITER_SELECT_0;
+
+	cmp = strcmp(iter_worktree->refname, iter_common->refname);
+	if (cmp < 0)
+		return ITER_SELECT_0;
+	if (cmp > 0)
+		return ITER_SELECT_1;
+	return ITER_SELECT_0_SKIP_1;
+}
+
+static struct ref_iterator *reftable_be_iterator_begin(struct ref_store *ref_store,
+						       const char *prefix,
+						       const char **exclude_patterns,
+						       unsigned int flags)
+{
+	unsigned int required_flags = REF_STORE_READ;
+	struct reftable_ref_store *refs;
+	struct reftable_ref_iterator *main_iter, *worktree_iter;
+
+	if (!(flags & DO_FOR_EACH_INCLUDE_BROKEN))
+		required_flags |= REF_STORE_ODB;
+	refs = reftable_downcast(ref_store, required_flags, "ref_iterator_begin");
+
+	main_iter = ref_iterator_for_stack(refs, refs->main_dir, prefix,
+					   exclude_patterns, flags);
+	if (!refs->worktree_dir)
+		return &main_iter->base;
+	main_iter->skip_per_worktree = 1;
+
+	worktree_iter = ref_iterator_for_stack(refs, refs->worktree_dir,
+					       prefix, exclude_patterns, flags);
+	worktree_iter->only_per_worktree = 1;
+
+	return merge_ref_iterator_begin(1, &worktree_iter->base,
+					&main_iter->base, iterator_select, NULL);
+}
+
+struct reftable_reflog_iterator {
+	struct ref_iterator base;
+	struct reftable_ref_store *refs;
+	struct reftable_stack *stack;
+	struct reftable_iterator iter;
+	struct reftable_log_record log;
+	struct strbuf last_name;
+	struct object_id oid;
+	unsigned int skip_per_worktree : 1;
+	int err;
+};
+
+static int reftable_reflog_iterator_advance(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	while (!iter->err) {
+		int flags;
+
+		iter->err = reftable_iterator_next_log(&iter->iter, &iter->log);
+		if (iter->err)
+			break;
+
+		/* we only want each reference once */
+		if (!strcmp(iter->log.refname, iter->last_name.buf))
+			continue;
+		strbuf_reset(&iter->last_name);
+		strbuf_addstr(&iter->last_name, iter->log.refname);
+
+		if (iter->skip_per_worktree &&
+		    parse_worktree_ref(iter->log.refname, NULL, NULL, NULL) ==
+		    REF_WORKTREE_CURRENT)
+			continue;
+
+		if (!refs_resolve_ref_unsafe(&iter->refs->base,
+					     iter->last_name.buf, 0,
+					     &iter->oid, &flags)) {
+			error(_("bad ref for %s"), iter->last_name.buf);
+			continue;
+		}
+
+		iter->base.refname = iter->last_name.buf;
+		iter->base.oid = &iter->oid;
+		iter->base.flags = flags;
+		return ITER_OK;
+	}
+
+	if (iter->err > 0) {
+		if (ref_iterator_abort(ref_iterator) != ITER_DONE)
+			return ITER_ERROR;
+		return ITER_DONE;
+	}
+
+	ref_iterator_abort(ref_iterator);
+	return ITER_ERROR;
+}
+
+static int reftable_reflog_iterator_peel(struct ref_iterator *ref_iterator UNUSED,
+					 struct object_id *peeled UNUSED)
+{
+	BUG("ref_iterator_peel() called for reflog_iterator");
+}
+
+static int reftable_reflog_iterator_abort(struct ref_iterator *ref_iterator)
+{
+	struct reftable_reflog_iterator *iter =
+		(struct reftable_reflog_iterator *)ref_iterator;
+
+	reftable_log_record_release(&iter->log);
+	reftable_iterator_destroy(&iter->iter);
+	if (iter->stack)
+		reftable_stack_destroy(iter->stack);
+	strbuf_release(&iter->last_name);
+	base_ref_iterator_free(ref_iterator);
+	return ITER_DONE;
+}
+
+static struct ref_iterator_vtable reftable_reflog_iterator_vtable = {
+	.advance = reftable_reflog_iterator_advance,
+	.peel = reftable_reflog_iterator_peel,
+	.abort = reftable_reflog_iterator_abort
+};
+
+static struct reftable_reflog_iterator *reflog_iterator_for_stack(struct reftable_ref_store *refs,
+								  const char *dir)
+{
+	struct reftable_reflog_iterator *iter;
+	int ret;
+
+	CALLOC_ARRAY(iter, 1);
+	base_ref_iterator_init(&iter->base, &reftable_reflog_iterator_vtable, 1);
+	iter->refs = refs;
+	strbuf_init(&iter->last_name, 0);
+
+	ret = reftable_new_stack(&iter->stack, dir, refs->write_options);
+	if (!ret)
+		ret = reftable_merged_table_seek_log(reftable_stack_merged_table(iter->stack),
+						     &iter->iter, "");
+	iter->err = ret;
+	return iter;
+}
+
+static struct ref_iterator *reftable_be_reflog_iterator_begin(struct ref_store *ref_store)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "reflog_iterator_begin");
+	struct reftable_reflog_iterator *main_iter, *worktree_iter;
+
+	main_iter = reflog_iterator_for_stack(refs, refs->main_dir);
+	if (!refs->worktree_dir)
+		return &main_iter->base;
+	main_iter->skip_per_worktree = 1;
+
+	worktree_iter = reflog_iterator_for_stack(refs, refs->worktree_dir);
+
+	return merge_ref_iterator_begin(1, &worktree_iter->base,
+					&main_iter->base, iterator_select, NULL);
+}
+
+/*
+ * create_reflog() writes an entry without any object names to mark a
+ * reflog that has no entries yet; it is not shown to anybody.
+ */
+static int is_reflog_marker(const struct reftable_log_record *log)
+{
+	return hasheq(log->value.update.old_hash, null_oid()->hash) &&
+	       hasheq(log->value.update.new_hash, null_oid()->hash);
+}
+
+static int yield_log_record(struct reftable_log_record *log,
+			    each_reflog_ent_fn fn, void *cb_data)
+{
+	struct object_id old_oid, new_oid;
+	struct strbuf committer = STRBUF_INIT;
+	int ret;
+
+	if (is_reflog_marker(log))
+		return 0;
+
+	oidread(&old_oid, log->value.update.old_hash);
+	oidread(&new_oid, log->value.update.new_hash);
+	strbuf_addf(&committer, "%s <%s>", log->value.update.name,
+		    log->value.update.email);
+
+	ret = fn(&old_oid, &new_oid, committer.buf, log->value.update.time,
+		 log->value.update.tz_offset,
+		 log->value.update.message ? log->value.update.message : "",
+		 cb_data);
+	strbuf_release(&committer);
+	return ret;
+}
+
+static int for_each_log_record(struct ref_store *ref_store,
+			       const char *refname,
+			       each_reflog_ent_fn fn, void *cb_data,
+			       int reverse)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "for_each_reflog_ent");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+	struct reftable_log_record *logs = NULL;
+	size_t logs_nr = 0, logs_alloc = 0, i;
+	int ret;
+
+	/*
+	 * Collect all of the entries first; the callback is free to read
+	 * and write references, which reloads the stack.
+	 */
+	ret = reftable_stack_reload(stack);
+	if (!ret)
+		ret = read_log_records(stack, refname, &logs, &logs_nr,
+				       &logs_alloc);
+	if (ret < 0)
+		ret = error(_("unable to read reflog of '%s': %s"), refname,
+			    reftable_error_str(ret));
+
+	for (i = 0; !ret && i < logs_nr; i++)
+		ret = yield_log_record(&logs[reverse ? i : logs_nr - i - 1],
+				       fn, cb_data);
+
+	free_log_records(logs, logs_nr);
+	return ret;
+}
+
+static int reftable_be_for_each_reflog_ent(struct ref_store *ref_store,
+					   const char *refname,
+					   each_reflog_ent_fn fn,
+					   void *cb_data)
+{
+	return for_each_log_record(ref_store, refname, fn, cb_data, 0);
+}
+
+static int reftable_be_for_each_reflog_ent_reverse(struct ref_store *ref_store,
+						   const char *refname,
+						   each_reflog_ent_fn fn,
+						   void *cb_data)
+{
+	return for_each_log_record(ref_store, refname, fn, cb_data, 1);
+}
+
+static int reftable_be_reflog_exists(struct ref_store *ref_store,
+				     const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_READ, "reflog_exists");
+	struct reftable_stack *stack = stack_for(refs, refname, &refname);
+
+	if (reftable_stack_reload(stack))
+		return 0;
+	return reflog_exists_in_stack(stack, refname);
+}
+
+static int reftable_be_create_reflog(struct ref_store *ref_store,
+				     const char *refname,
+				     struct strbuf *err)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "create_reflog");
+	const char *name;
+	struct reftable_stack *stack = stack_for(refs, refname, &name);
+	struct write_records_arg arg = { .stack = stack };
+	struct reftable_addition *add = NULL;
+	int ret;
+
+	ret = lock_stack(stack, &add, err);
+	if (ret || reflog_exists_in_stack(stack, name))
+		goto done;
+
+	add_log_record(&arg, name, null_oid(), null_oid(), NULL);
+	ret = commit_records(refs, add, &arg);
+	if (ret) {
+		strbuf_addf(err, _("unable to create reflog for '%s': %s"),
+			    refname, reftable_error_str(ret));
+		ret = -1;
+	}
+
+done:
+	reftable_addition_destroy(add);
+	release_records(&arg);
+	return ret;
+}
+
+static int reftable_be_delete_reflog(struct ref_store *ref_store,
+				     const char *refname)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "delete_reflog");
+	const char *name;
+	struct reftable_stack *stack = stack_for(refs, refname, &name);
+	struct write_records_arg arg = { .stack = stack };
+	struct reftable_addition *add = NULL;
+	struct strbuf err = STRBUF_INIT;
+	int ret;
+
+	ret = lock_stack(stack, &add, &err);
+	if (!ret)
+		ret = delete_log_records(&arg, name);
+	if (!ret)
+		ret = commit_records(refs, add, &arg);
+	if (ret > 0)
+		ret = 0;
+	else if (ret < 0 && !err.len)
+		strbuf_addf(&err, _("unable to delete reflog of '%s': %s"),
+			    refname, reftable_error_str(ret));
+	if (ret)
+		error("%s", err.buf);
+
+	reftable_addition_destroy(add);
+	release_records(&arg);
+	strbuf_release(&err);
+	return ret ? -1 : 0;
+}
+
+static int reftable_be_reflog_expire(struct ref_store *ref_store,
+				     const char *refname,
+				     unsigned int flags,
+				     reflog_expiry_prepare_fn prepare_fn,
+				     reflog_expiry_should_prune_fn should_prune_fn,
+				     reflog_expiry_cleanup_fn cleanup_fn,
+				     void *policy_cb_data)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "reflog_expire");
+	const char *name;
+	struct reftable_stack *stack = stack_for(refs, refname, &name);
+	struct write_records_arg arg = { .stack = stack };
+	struct reftable_addition *add = NULL;
+	struct reftable_log_record *logs = NULL;
+	size_t logs_nr = 0, logs_alloc = 0, i;
+	struct object_id oid, last_kept_oid;
+	struct strbuf err = STRBUF_INIT;
+	int type = 0, update_ref, ret;
+
+	ret = lock_stack(stack, &add, &err);
+	if (ret)
+		goto done;
+
+	ret = read_log_records(stack, name, &logs, &logs_nr, &logs_alloc);
+	if (ret < 0) {
+		strbuf_addf(&err, _("cannot read reflog of '%s': %s"),
+			    refname, reftable_error_str(ret));
+		goto done;
+	}
+	if (!logs_nr)
+		goto done;
+
+	update_ref = !!refs_resolve_ref_unsafe(&refs->base, refname,
+					       RESOLVE_REF_NO_RECURSE,
+					       &oid, &type) &&
+		     !(type & REF_ISSYMREF);
+	if (!update_ref)
+		oidclr(&oid);
+	prepare_fn(refname, &oid, policy_cb_data);
+
+	/* the policy wants to see the entries oldest first */
+	oidclr(&last_kept_oid);
+	for (i = logs_nr; i--; ) {
+		struct reftable_log_record *log = &logs[i];
+		struct object_id old_oid, new_oid;
+		struct strbuf committer = STRBUF_INIT;
+		int prune;
+
+		if (is_reflog_marker(log))
+			continue;
+
+		if (flags & EXPIRE_REFLOGS_REWRITE)
+			oidcpy(&old_oid, &last_kept_oid);
+		else
+			oidread(&old_oid, log->value.update.old_hash);
+		oidread(&new_oid, log->value.update.new_hash);
+		strbuf_addf(&committer, "%s <%s>", log->value.update.name,
+			    log->value.update.email);
+
+		prune = should_prune_fn(&old_oid, &new_oid, committer.buf,
+					log->value.update.time,
+					log->value.update.tz_offset,
+					log->value.update.message ?
+					log->value.update.message : "",
+					policy_cb_data);
+		strbuf_release(&committer);
+
+		if (prune) {
+			add_log_tombstone(&arg, name, log->update_index);
+			continue;
+		}
+		if (!hasheq(old_oid.hash, log->value.update.old_hash)) {
+			memcpy(log->value.update.old_hash, old_oid.hash,
+			       the_hash_algo->rawsz);
+			copy_log_record(&arg, name, log);
+		}
+		oidcpy(&last_kept_oid, &new_oid);
+	}
+
+	cleanup_fn(policy_cb_data);
+
+	if (flags & EXPIRE_REFLOGS_DRY_RUN)
+		goto done;
+
+	if (flags & EXPIRE_REFLOGS_UPDATE_REF && update_ref &&
+	    !is_null_oid(&last_kept_oid))
+		add_ref_record(&arg, name, &last_kept_oid, NULL);
+
+	ret = commit_records(refs, add, &arg);
+	if (ret)
+		strbuf_addf(&err, _("unable to write reflog of '%s': %s"),
+			    refname, reftable_error_str(ret));
+
+done:
+	if (ret)
+		error("%s", err.buf);
+	reftable_addition_destroy(add);
+	free_log_records(logs, logs_nr);
+	release_records(&arg);
+	strbuf_release(&err);
+	return ret ? -1 : 0;
+}
+
+static int reftable_be_init_db(struct ref_store *ref_store,
+			       struct strbuf *err UNUSED)
+{
+	struct reftable_ref_store *refs =
+		reftable_downcast(ref_store, REF_STORE_WRITE, "init_db");
+	struct strbuf sb = STRBUF_INIT;
+
+	safe_create_dir(refs->main_dir, 1);
+
+	/*
+	 * Git recognizes a repository by its HEAD file and its "refs"
+	 * directory. Point HEAD at a branch that cannot exist, and make
+	 * "refs/heads" a file, so that versions of Git that do not
+	 * understand reftables cannot mistake the repository for an
+	 * empty one and start writing loose references into it.
+	 */
+	strbuf_addf(&sb, "%s/HEAD", refs->base.gitdir);
+	if (access(sb.buf, F_OK)) {
+		write_file(sb.buf, "ref: refs/heads/.invalid");
+		adjust_shared_perm(sb.buf);
+	}
+
+	strbuf_reset(&sb);
+	strbuf_addf(&sb, "%s/refs/heads", refs->common_dir);
+	if (access(sb.buf, F_OK)) {
+		write_file(sb.buf, "this repository uses the reftable format");
+		adjust_shared_perm(sb.buf);
+	}
+
+	strbuf_release(&sb);
+	return 0;
+}
+
+struct ref_storage_be refs_be_reftable = {
+	.next = &refs_be_files,
+	.name = "reftable",
+	.init = reftable_be_init,
+	.init_db = reftable_be_init_db,
+	.transaction_prepare = reftable_be_transaction_prepare,
+	.transaction_finish = reftable_be_transaction_finish,
+	.transaction_abort = reftable_be_transaction_abort,
+	.initial_transaction_commit = reftable_be_initial_transaction_commit,
+
+	.pack_refs = reftable_be_pack_refs,
+	.create_symref = reftable_be_create_symref,
+	.delete_refs = reftable_be_delete_refs,
+	.rename_ref = reftable_be_rename_ref,
+	.copy_ref = reftable_be_copy_ref,
+
+	.iterator_begin = reftable_be_iterator_begin,
+	.read_raw_ref = reftable_be_read_raw_ref,
+	.read_symbolic_ref = reftable_be_read_symbolic_ref,
+
+	.reflog_iterator_begin = reftable_be_reflog_iterator_begin,
+	.for_each_reflog_ent = reftable_be_for_each_reflog_ent,
+	.for_each_reflog_ent_reverse = reftable_be_for_each_reflog_ent_reverse,
+	.reflog_exists = reftable_be_reflog_exists,
+	.create_reflog = reftable_be_create_reflog,
+	.delete_reflog = reftable_be_delete_reflog,
+	.reflog_expire = reftable_be_reflog_expire
+};
@@ -237,9 +237,10 @@ static int reftable_table_seek_record(struct reftable_table *tab,
 	return tab->ops->seek_record(tab->table_arg, it, rec);
 }
 
-static int merged_table_seek_record(struct reftable_merged_table *mt,
-				    struct reftable_iterator *it,
-				    struct reftable_record *rec)
+static int merged_table_seek_record_1(struct reftable_merged_table *mt,
+				      struct reftable_iterator *it,
+				      struct reftable_record *rec,
+				      int suppress_deletions)
 {
 	struct reftable_iterator *iters = reftable_calloc(
 		sizeof(struct reftable_iterator) * mt->stack_len);
@@ -247,7 +248,7 @@ static int merged_table_seek_record(struct reftable_merged_table *mt,
 		.stack = iters,
 		.typ = reftable_record_type(rec),
 		.hash_id = mt->hash_id,
-		.suppress_deletions = mt->suppress_deletions,
+		.suppress_deletions = suppress_deletions,
 	};
 	int n = 0;
 	int err = 0;
@@ -285,6 +286,13 @@ static int merged_table_seek_record(struct reftable_merged_table *mt,
 	return 0;
 }
 
+static int merged_table_seek_record(struct reftable_merged_table *mt,
+				    struct reftable_iterator *it,
+				    struct reftable_record *rec)
+{
+	return merged_table_seek_record_1(mt, it, rec, mt->suppress_deletions);
+}
+
 int reftable_merged_table_seek_ref(struct reftable_merged_table *mt,
 				   struct reftable_iterator *it,
 				   const char *name)
@@ -318,6 +326,31 @@ int reftable_merged_table_seek_log(struct reftable_merged_table *mt,
 	return reftable_merged_table_seek_log_at(mt, it, name, max);
 }
 
+int reftable_merged_table_seek_ref_with_deletions(struct reftable_merged_table *mt,
+						 struct reftable_iterator *it,
+						 const char *name)
+{
+	struct reftable_record rec = {
+		.type = BLOCK_TYPE_REF,
+		.u.ref = {
+			.refname = (char *)name,
+		},
+	};
+	return merged_table_seek_record_1(mt, it, &rec, 0);
+}
+
+int reftable_merged_table_seek_log_with_deletions(struct reftable_merged_table *mt,
+						 struct reftable_iterator *it,
+						 const char *name)
+{
+	struct reftable_record rec = { .type = BLOCK_TYPE_LOG,
+				       .u.log = {
+					       .refname = (char *)name,
+					       .update_index = ~((uint64_t)0),
+				       } };
+	return merged_table_seek_record_1(mt, it, &rec, 0);
+}
+
 uint32_t reftable_merged_table_hash_id(struct reftable_merged_table *mt)
 {
 	return mt->hash_id;
@@ -51,6 +51,18 @@ int reftable_merged_table_seek_log(struct reftable_merged_table *mt,
 				   struct reftable_iterator *it,
 				   const char *name);
 
+/* like reftable_merged_table_seek_ref and reftable_merged_table_seek_log,
+   but also return deletions, even if the table suppresses them. A lookup
+   does not have to walk past every deletion after 'name' this way; the
+   caller checks reftable_{ref,log}_record_is_deletion itself.
+*/
+int reftable_merged_table_seek_ref_with_deletions(struct reftable_merged_table *mt,
+						 struct reftable_iterator *it,
+						 const char *name);
+int reftable_merged_table_seek_log_with_deletions(struct reftable_merged_table *mt,
+						 struct reftable_iterator *it,
+						 const char *name);
+
 /* returns the max update_index covered by this merged table. */
 uint64_t
 reftable_merged_table_max_update_index(struct reftable_merged_table *mt);
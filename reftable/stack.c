@@ -749,6 +749,11 @@ static int stack_compact_locked(struct reftable_stack *st, int first, int last,
 	strbuf_addstr(temp_tab, ".temp.XXXXXX");
 
 	tab_fd = mkstemp(temp_tab->buf);
+	if (st->config.default_permissions &&
+	    chmod(temp_tab->buf, st->config.default_permissions) < 0) {
+		err = REFTABLE_IO_ERROR;
+		goto done;
+	}
 	wr = reftable_new_writer(reftable_fd_write, &tab_fd, &st->config);
 
 	err = stack_write_compact(st, wr, first, last, config);
@@ -1214,9 +1219,30 @@ reftable_stack_compaction_stats(struct reftable_stack *st)
 int reftable_stack_read_ref(struct reftable_stack *st, const char *refname,
 			    struct reftable_ref_record *ref)
 {
-	struct reftable_table tab = { NULL };
-	reftable_table_from_merged_table(&tab, reftable_stack_merged_table(st));
-	return reftable_table_read_ref(&tab, refname, ref);
+	struct reftable_iterator it = { NULL };
+	struct reftable_merged_table *mt = reftable_stack_merged_table(st);
+
+	/* don't skip over the deletions following 'refname' to find nothing */
+	int err = reftable_merged_table_seek_ref_with_deletions(mt, &it, refname);
+	if (err)
+		goto done;
+
+	err = reftable_iterator_next_ref(&it, ref);
+	if (err)
+		goto done;
+
+	if (strcmp(ref->refname, refname) ||
+	    reftable_ref_record_is_deletion(ref)) {
+		err = 1;
+		goto done;
+	}
+
+done:
+	if (err) {
+		reftable_ref_record_release(ref);
+	}
+	reftable_iterator_destroy(&it);
+	return err;
 }
 
 int reftable_stack_read_log(struct reftable_stack *st, const char *refname,
@@ -1224,18 +1250,21 @@ int reftable_stack_read_log(struct reftable_stack *st, const char *refname,
 {
 	struct reftable_iterator it = { NULL };
 	struct reftable_merged_table *mt = reftable_stack_merged_table(st);
-	int err = reftable_merged_table_seek_log(mt, &it, refname);
+	int err = reftable_merged_table_seek_log_with_deletions(mt, &it, refname);
 	if (err)
 		goto done;
 
-	err = reftable_iterator_next_log(&it, log);
-	if (err)
-		goto done;
+	while (1) {
+		err = reftable_iterator_next_log(&it, log);
+		if (err)
+			goto done;
 
-	if (strcmp(log->refname, refname) ||
-	    reftable_log_record_is_deletion(log)) {
-		err = 1;
-		goto done;
+		if (strcmp(log->refname, refname)) {
+			err = 1;
+			goto done;
+		}
+		if (!reftable_log_record_is_deletion(log))
+			break;
 	}
 
 done:
@@ -649,25 +649,67 @@ static void trace2_bloom_filter_statistics_atexit(void)
 
 static int forbid_bloom_filters(struct pathspec *spec)
 {
-	if (spec->has_wildcard)
-		return 1;
-	if (spec->nr > 1)
-		return 1;
-	if (spec->magic & ~PATHSPEC_LITERAL)
+	int i, nr_positive = 0;
+
+	if (spec->magic & (PATHSPEC_ICASE | PATHSPEC_ATTR))
 		return 1;
-	if (spec->nr && (spec->items[0].magic & ~PATHSPEC_LITERAL))
+
+	for (i = 0; i < spec->nr; i++) {
+		/*
+		 * Excluded items only narrow down what the other items
+		 * match, so a commit that changes none of the paths of
+		 * the other items cannot be interesting either.
+		 */
+		if (!(spec->items[i].magic & PATHSPEC_EXCLUDE))
+			nr_positive++;
+	}
+	if (spec->nr && !nr_positive)
 		return 1;
 
 	return 0;
 }
 
+static void release_revisions_bloom_keyvecs(struct rev_info *revs)
+{
+	int i;
+
+	for (i = 0; i < revs->bloom_keyvecs_nr; i++)
+		bloom_keyvec_free(revs->bloom_keyvecs[i]);
+	FREE_AND_NULL(revs->bloom_keyvecs);
+	revs->bloom_keyvecs_nr = revs->bloom_keyvecs_alloc = 0;
+}
+
+/*
+ * Return the length of the leading part of 'pi' that every path it
+ * matches must be inside of, or that it must be equal to, or 0 if
+ * there is no such part.
+ */
+static size_t bloom_filter_prefix_len(const struct pathspec_item *pi)
+{
+	size_t len = pi->len;
+
+	if (pi->nowildcard_len < pi->len) {
+		/*
+		 * A wildcard may match any part of a path component
+		 * (or, without ":(glob)", several of them), so only
+		 * the complete directories before it are fixed.
+		 */
+		len = pi->nowildcard_len;
+		while (len && pi->match[len - 1] != '/')
+			len--;
+	}
+
+	/* remove trailing slash from path, if needed */
+	while (len && pi->match[len - 1] == '/')
+		len--;
+
+	return len;
+}
+
 static void prepare_to_use_bloom_filter(struct rev_info *revs)
 {
-	struct pathspec_item *pi;
-	char *path_alloc = NULL;
-	const char *path, *p;
-	size_t len;
-	int path_component_nr = 1;
+	struct pathspec *spec = &revs->pruning.pathspec;
+	int i;
 
 	if (!revs->commits)
 		return;
@@ -681,59 +723,35 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 	if (!revs->bloom_filter_settings)
 		return;
 
-	if (!revs->pruning.pathspec.nr)
-		return;
-
-	pi = &revs->pruning.pathspec.items[0];
-
-	/* remove single trailing slash from path, if needed */
-	if (pi->len > 0 && pi->match[pi->len - 1] == '/') {
-		path_alloc = xmemdupz(pi->match, pi->len - 1);
-		path = path_alloc;
-	} else
-		path = pi->match;
-
-	len = strlen(path);
-	if (!len) {
-		revs->bloom_filter_settings = NULL;
-		free(path_alloc);
+	if (!spec->nr)
 		return;
-	}
 
-	p = path;
-	while (*p) {
-		/*
-		 * At this point, the path is normalized to use Unix-style
-		 * path separators. This is required due to how the
-		 * changed-path Bloom filters store the paths.
-		 */
-		if (*p == '/')
-			path_component_nr++;
-		p++;
-	}
+	for (i = 0; i < spec->nr; i++) {
+		const struct pathspec_item *pi = &spec->items[i];
+		size_t len;
 
-	revs->bloom_keys_nr = path_component_nr;
-	ALLOC_ARRAY(revs->bloom_keys, revs->bloom_keys_nr);
+		if (pi->magic & PATHSPEC_EXCLUDE)
+			continue;
 
-	fill_bloom_key(path, len, &revs->bloom_keys[0],
-		       revs->bloom_filter_settings);
-	path_component_nr = 1;
+		len = bloom_filter_prefix_len(pi);
+		if (!len) {
+			/* this item may match any path */
+			release_revisions_bloom_keyvecs(revs);
+			revs->bloom_filter_settings = NULL;
+			return;
+		}
 
-	p = path + len - 1;
-	while (p > path) {
-		if (*p == '/')
-			fill_bloom_key(path, p - path,
-				       &revs->bloom_keys[path_component_nr++],
-				       revs->bloom_filter_settings);
-		p--;
+		ALLOC_GROW(revs->bloom_keyvecs, revs->bloom_keyvecs_nr + 1,
+			   revs->bloom_keyvecs_alloc);
+		revs->bloom_keyvecs[revs->bloom_keyvecs_nr++] =
+			bloom_keyvec_new(pi->match, len,
+					 revs->bloom_filter_settings);
 	}
 
 	if (trace2_is_enabled() && !bloom_filter_atexit_registered) {
 		atexit(trace2_bloom_filter_statistics_atexit);
 		bloom_filter_atexit_registered = 1;
 	}
-
-	free(path_alloc);
 }
 
 static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
@@ -755,10 +773,12 @@ static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 		return -1;
 	}
 
-	for (j = 0; result && j < revs->bloom_keys_nr; j++) {
-		result = bloom_filter_contains(filter,
-					       &revs->bloom_keys[j],
-					       revs->bloom_filter_settings);
+	for (j = 0; j < revs->bloom_keyvecs_nr; j++) {
+		result = bloom_filter_contains_vec(filter,
+						   revs->bloom_keyvecs[j],
+						   revs->bloom_filter_settings);
+		if (result)
+			break;
 	}
 
 	if (result)
@@ -799,7 +819,7 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
-	if (revs->bloom_keys_nr && !nth_parent) {
+	if (revs->bloom_keyvecs_nr && !nth_parent) {
 		bloom_ret = check_maybe_different_in_bloom_filter(revs, commit);
 
 		if (bloom_ret == 0)
@@ -3058,6 +3078,7 @@ void release_revisions(struct rev_info *revs)
 	diff_free(&revs->pruning);
 	reflog_walk_info_release(revs->reflog_info);
 	release_revisions_topo_walk_info(revs->topo_walk_info);
+	release_revisions_bloom_keyvecs(revs);
 }
 
 static void add_child(struct rev_info *revs, struct commit *parent, struct commit *child)
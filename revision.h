@@ -59,7 +59,7 @@ struct repository;
 struct rev_info;
 struct string_list;
 struct saved_parents;
-struct bloom_key;
+struct bloom_keyvec;
 struct bloom_filter_settings;
 define_shared_commit_slab(revision_sources, char *);
 
@@ -224,6 +224,14 @@ struct rev_info {
 			/* for internal use only */
 			exclude_promisor_objects:1;
 
+	/*
+	 * If more than one, traverse_commit_list() may walk trees with
+	 * this many threads, showing trees and blobs in no particular
+	 * order (and from any thread, though never concurrently). See
+	 * traverse_commit_list_filtered() for the restrictions.
+	 */
+	int object_walk_threads;
+
 	/* Diff flags */
 	unsigned int	diff:1,
 			full_diff:1,
@@ -352,9 +360,13 @@ struct rev_info {
 	struct topo_walk_info *topo_walk_info;
 
 	/* Commit graph bloom filter fields */
-	/* The bloom filter key(s) for the pathspec */
-	struct bloom_key *bloom_keys;
-	int bloom_keys_nr;
+	/*
+	 * The bloom filter keys for each non-excluded pathspec item; a
+	 * commit may be interesting if its filter contains all keys of
+	 * any one of them.
+	 */
+	struct bloom_keyvec **bloom_keyvecs;
+	int bloom_keyvecs_nr, bloom_keyvecs_alloc;
 
 	/*
 	 * The bloom filter settings used to generate the key.
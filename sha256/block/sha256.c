@@ -6,6 +6,15 @@
 
 #define BLKSIZE blk_SHA256_BLKSIZE
 
+/*
+ * On x86-64, use the SHA extensions when the CPU has them.  The check is
+ * done at runtime, so the same binary still runs everywhere else.
+ */
+#if defined(__x86_64__) && !defined(NO_SHA256_SHANI) && \
+	(defined(__clang__) || GIT_GNUC_PREREQ(4, 9))
+#define BLK_SHA256_SHANI
+#endif
+
 void blk_SHA256_Init(blk_SHA256_CTX *ctx)
 {
 	ctx->offset = 0;
@@ -148,6 +157,135 @@ static void blk_SHA256_Transform(blk_SHA256_CTX *ctx, const unsigned char *buf)
 		ctx->state[i] += S[i];
 }
 
+#ifdef BLK_SHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static int have_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & (1 << 9)) ||	/* SSSE3 */
+	    !(ecx & (1 << 19)))		/* SSE4.1 */
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return !!(ebx & (1 << 29));	/* SHA */
+}
+
+/* four rounds, consuming the four message words in msg */
+#define QROUND(i, msg) \
+	tmp = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i *)&sha256_k[i])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, tmp); \
+	tmp = _mm_shuffle_epi32(tmp, 0x0e); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, tmp)
+
+/* replace m0, the oldest four message words, with the next four */
+#define SCHEDULE(m0, m1, m2, m3) \
+	m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), \
+						_mm_alignr_epi8(m3, m2, 4)), \
+				  m3)
+
+/*
+ * Process "nr" 64-byte blocks with the SHA extensions.  The instructions
+ * want the state as ABEF and CDGH rather than ABCD and EFGH, so shuffle
+ * it on the way in and out.
+ */
+__attribute__((target("sha,sse4.1")))
+static void blk_SHA256_Transform_shani(blk_SHA256_CTX *ctx,
+				       const unsigned char *buf, size_t nr)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					     0x0405060700010203ULL);
+	__m128i state0, state1, tmp, m0, m1, m2, m3, save0, save1;
+
+	tmp = _mm_loadu_si128((const __m128i *)&ctx->state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&ctx->state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);
+	state1 = _mm_shuffle_epi32(state1, 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	for (; nr; nr--, buf += 64) {
+		save0 = state0;
+		save1 = state1;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 0)), bswap);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 16)), bswap);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 32)), bswap);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + 48)), bswap);
+
+		QROUND(0, m0);
+		QROUND(4, m1);
+		QROUND(8, m2);
+		QROUND(12, m3);
+		SCHEDULE(m0, m1, m2, m3); QROUND(16, m0);
+		SCHEDULE(m1, m2, m3, m0); QROUND(20, m1);
+		SCHEDULE(m2, m3, m0, m1); QROUND(24, m2);
+		SCHEDULE(m3, m0, m1, m2); QROUND(28, m3);
+		SCHEDULE(m0, m1, m2, m3); QROUND(32, m0);
+		SCHEDULE(m1, m2, m3, m0); QROUND(36, m1);
+		SCHEDULE(m2, m3, m0, m1); QROUND(40, m2);
+		SCHEDULE(m3, m0, m1, m2); QROUND(44, m3);
+		SCHEDULE(m0, m1, m2, m3); QROUND(48, m0);
+		SCHEDULE(m1, m2, m3, m0); QROUND(52, m1);
+		SCHEDULE(m2, m3, m0, m1); QROUND(56, m2);
+		SCHEDULE(m3, m0, m1, m2); QROUND(60, m3);
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&ctx->state[0], state0);
+	_mm_storeu_si128((__m128i *)&ctx->state[4], state1);
+}
+
+#undef QROUND
+#undef SCHEDULE
+#endif
+
+static void blk_SHA256_Blocks(blk_SHA256_CTX *ctx,
+			      const unsigned char *buf, size_t nr)
+{
+#ifdef BLK_SHA256_SHANI
+	static int use_shani = -1;
+
+	if (use_shani < 0)
+		use_shani = have_shani();
+	if (use_shani) {
+		blk_SHA256_Transform_shani(ctx, buf, nr);
+		return;
+	}
+#endif
+	for (; nr; nr--, buf += 64)
+		blk_SHA256_Transform(ctx, buf);
+}
+
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
 {
 	unsigned int len_buf = ctx->size & 63;
@@ -165,12 +303,13 @@ void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
 		data = ((const char *)data + left);
 		if (len_buf)
 			return;
-		blk_SHA256_Transform(ctx, ctx->buf);
+		blk_SHA256_Blocks(ctx, ctx->buf, 1);
 	}
-	while (len >= 64) {
-		blk_SHA256_Transform(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		size_t nr = len / 64;
+		blk_SHA256_Blocks(ctx, data, nr);
+		data = ((const char *)data + nr * 64);
+		len -= nr * 64;
 	}
 	if (len)
 		memcpy(ctx->buf, data, len);
@@ -7,6 +7,8 @@
 #include "object-store.h"
 #include "replace-object.h"
 #include "packfile.h"
+#include "delta.h"
+#include "tempfile.h"
 
 typedef int (*open_istream_fn)(struct git_istream *,
 			       struct repository *,
@@ -55,6 +57,18 @@ struct git_istream {
 			off_t pos;
 		} in_pack;
 
+		struct pack_delta_istream {
+			struct git_istream *delta; /* inflated delta data */
+			unsigned char *base;
+			size_t base_size;
+			struct tempfile *base_file; /* base is mmap'd from it */
+			unsigned char buf[FILTER_BUFFER];
+			size_t ptr, end;
+			int delta_done;
+			size_t copy_off, copy_left, insert_left;
+			size_t out_left;
+		} delta;
+
 		struct filtered_istream filtered;
 	} u;
 };
@@ -286,8 +300,16 @@ static ssize_t read_istream_pack_non_delta(struct git_istream *st, char *buf,
 		struct pack_window *window = NULL;
 		unsigned char *mapped;
 
+		/*
+		 * Pack windows are shared with other threads reading
+		 * objects; only hold the lock while we pick a window, as
+		 * unpack_compressed_entry() does. The window stays in use
+		 * (and mapped) until unuse_pack().
+		 */
+		obj_read_lock();
 		mapped = use_pack(st->u.in_pack.pack, &window,
 				  st->u.in_pack.pos, &st->z.avail_in);
+		obj_read_unlock();
 
 		st->z.next_out = (unsigned char *)buf + total_read;
 		st->z.avail_out = sz - total_read;
@@ -296,7 +318,9 @@ static ssize_t read_istream_pack_non_delta(struct git_istream *st, char *buf,
 
 		st->u.in_pack.pos += st->z.next_in - mapped;
 		total_read = st->z.next_out - (unsigned char *)buf;
+		obj_read_lock();
 		unuse_pack(&window);
+		obj_read_unlock();
 
 		if (status == Z_STREAM_END) {
 			git_inflate_end(&st->z);
@@ -337,11 +361,13 @@ static int open_istream_pack_non_delta(struct git_istream *st,
 
 	window = NULL;
 
+	obj_read_lock();
 	in_pack_type = unpack_object_header(st->u.in_pack.pack,
 					    &window,
 					    &st->u.in_pack.pos,
 					    &st->size);
 	unuse_pack(&window);
+	obj_read_unlock();
 	switch (in_pack_type) {
 	default:
 		return -1; /* we do not do deltas for now */
@@ -359,6 +385,304 @@ static int open_istream_pack_non_delta(struct git_istream *st,
 }
 
 
+/*****************************************************************
+ *
+ * Deltified packed object stream
+ *
+ * The delta is inflated and applied a piece at a time, so the result
+ * is never held in memory as a whole. Copy instructions may refer to
+ * any part of the base, though, so the base has to be at hand: a base
+ * larger than core.bigFileThreshold is itself streamed to a temporary
+ * file and mapped from there.
+ *
+ *****************************************************************/
+
+static struct git_istream *open_istream_pack_entry(struct repository *r,
+						   struct packed_git *p,
+						   off_t offset);
+
+/*
+ * Make sure that at least 'want' bytes of delta data are buffered,
+ * unless the delta ends before that.
+ */
+static int fill_delta_buffer(struct pack_delta_istream *d, size_t want)
+{
+	if (d->end - d->ptr >= want || d->delta_done)
+		return 0;
+
+	memmove(d->buf, d->buf + d->ptr, d->end - d->ptr);
+	d->end -= d->ptr;
+	d->ptr = 0;
+	while (d->end < want && !d->delta_done) {
+		ssize_t readlen = read_istream(d->delta, d->buf + d->end,
+					       sizeof(d->buf) - d->end);
+		if (readlen < 0)
+			return -1;
+		if (!readlen)
+			d->delta_done = 1;
+		d->end += readlen;
+	}
+	return 0;
+}
+
+static ssize_t read_istream_pack_delta(struct git_istream *st, char *buf,
+				       size_t sz)
+{
+	struct pack_delta_istream *d = &st->u.delta;
+	size_t filled = 0;
+
+	while (filled < sz && d->out_left) {
+		const unsigned char *data, *top;
+		unsigned char cmd;
+		size_t len;
+
+		if (d->copy_left) {
+			len = d->copy_left < sz - filled ? d->copy_left : sz - filled;
+			memcpy(buf + filled, d->base + d->copy_off, len);
+			d->copy_off += len;
+			d->copy_left -= len;
+			d->out_left -= len;
+			filled += len;
+			continue;
+		}
+		if (d->insert_left) {
+			if (fill_delta_buffer(d, 1) < 0)
+				return -1;
+			if (d->ptr == d->end)
+				goto bad_length;
+			len = d->end - d->ptr;
+			if (d->insert_left < len)
+				len = d->insert_left;
+			if (sz - filled < len)
+				len = sz - filled;
+			memcpy(buf + filled, d->buf + d->ptr, len);
+			d->ptr += len;
+			d->insert_left -= len;
+			d->out_left -= len;
+			filled += len;
+			continue;
+		}
+
+		/* an instruction takes at most 8 bytes; see patch_delta() */
+		if (fill_delta_buffer(d, 8) < 0)
+			return -1;
+		if (d->ptr == d->end)
+			goto bad_length;
+		data = d->buf + d->ptr;
+		top = d->buf + d->end;
+		cmd = *data++;
+		if (cmd & 0x80) {
+			size_t cp_off = 0, cp_size = 0;
+#define PARSE_CP_PARAM(bit, var, shift) do { \
+			if (cmd & (bit)) { \
+				if (data >= top) \
+					goto bad_length; \
+				var |= ((unsigned) *data++ << (shift)); \
+			} } while (0)
+			PARSE_CP_PARAM(0x01, cp_off, 0);
+			PARSE_CP_PARAM(0x02, cp_off, 8);
+			PARSE_CP_PARAM(0x04, cp_off, 16);
+			PARSE_CP_PARAM(0x08, cp_off, 24);
+			PARSE_CP_PARAM(0x10, cp_size, 0);
+			PARSE_CP_PARAM(0x20, cp_size, 8);
+			PARSE_CP_PARAM(0x40, cp_size, 16);
+#undef PARSE_CP_PARAM
+			if (cp_size == 0) cp_size = 0x10000;
+			if (unsigned_add_overflows(cp_off, cp_size) ||
+			    cp_off + cp_size > d->base_size ||
+			    cp_size > d->out_left)
+				goto bad_length;
+			d->copy_off = cp_off;
+			d->copy_left = cp_size;
+		} else if (cmd) {
+			if (cmd > d->out_left)
+				goto bad_length;
+			d->insert_left = cmd;
+		} else {
+			error("unexpected delta opcode 0");
+			return -1;
+		}
+		d->ptr = data - d->buf;
+	}
+
+	/* sanity check: the delta must end where the result does */
+	if (!d->out_left) {
+		if (fill_delta_buffer(d, 1) < 0)
+			return -1;
+		if (d->ptr != d->end)
+			goto bad_length;
+	}
+	return filled;
+
+bad_length:
+	error("delta replay has gone wild");
+	return -1;
+}
+
+static int close_istream_pack_delta(struct git_istream *st)
+{
+	struct pack_delta_istream *d = &st->u.delta;
+
+	if (d->delta)
+		close_istream(d->delta);
+	if (d->base_file) {
+		munmap(d->base, d->base_size);
+		delete_tempfile(&d->base_file);
+	} else
+		free(d->base);
+	return 0;
+}
+
+static int spill_delta_base(struct pack_delta_istream *d,
+			    struct repository *r, struct packed_git *p,
+			    off_t base_offset, unsigned long base_size)
+{
+	struct git_istream *base;
+	struct strbuf path = STRBUF_INIT;
+	struct tempfile *tmp;
+	size_t total = 0;
+
+	base = open_istream_pack_entry(r, p, base_offset);
+	if (!base)
+		return -1;
+	/*
+	 * The base can be huge; keep it next to the objects like
+	 * index-pack does with its temporary packs, rather than in
+	 * $TMPDIR, which is often small.
+	 */
+	strbuf_addf(&path, "%s/tmp_delta_base_XXXXXX", r->objects->odb->path);
+	tmp = mks_tempfile(path.buf);
+	strbuf_release(&path);
+	if (!tmp) {
+		close_istream(base);
+		return -1;
+	}
+	for (;;) {
+		char buf[FILTER_BUFFER];
+		ssize_t readlen = read_istream(base, buf, sizeof(buf));
+
+		if (!readlen)
+			break;
+		if (readlen < 0 ||
+		    write_in_full(get_tempfile_fd(tmp), buf, readlen) < 0) {
+			close_istream(base);
+			delete_tempfile(&tmp);
+			return -1;
+		}
+		total += readlen;
+	}
+	close_istream(base);
+	if (total != base_size) {
+		delete_tempfile(&tmp);
+		return -1;
+	}
+
+	d->base = xmmap(NULL, base_size, PROT_READ, MAP_PRIVATE,
+			get_tempfile_fd(tmp), 0);
+	d->base_size = base_size;
+	d->base_file = tmp;
+	return 0;
+}
+
+static int open_istream_pack_delta(struct git_istream *st,
+				   struct repository *r,
+				   const struct object_id *oid UNUSED,
+				   enum object_type *type UNUSED)
+{
+	struct pack_delta_istream *d = &st->u.delta;
+	struct packed_git *p = st->u.in_pack.pack;
+	off_t obj_offset = st->u.in_pack.pos;
+	off_t pos = obj_offset, base_offset;
+	struct pack_window *window = NULL;
+	struct object_info oi = OBJECT_INFO_INIT;
+	enum object_type in_pack_type;
+	unsigned long delta_size, base_size;
+	const unsigned char *data, *top;
+
+	obj_read_lock();
+	in_pack_type = unpack_object_header(p, &window, &pos, &delta_size);
+	if (in_pack_type != OBJ_OFS_DELTA && in_pack_type != OBJ_REF_DELTA) {
+		unuse_pack(&window);
+		obj_read_unlock();
+		return -1;
+	}
+	base_offset = get_delta_base(p, &window, &pos, in_pack_type,
+				     obj_offset);
+	unuse_pack(&window);
+	oi.sizep = &base_size;
+	if (!base_offset || packed_object_info(r, p, base_offset, &oi) < 0) {
+		obj_read_unlock();
+		return -1;
+	}
+	obj_read_unlock();
+
+	memset(d, 0, sizeof(*d));
+	if (base_size <= big_file_threshold) {
+		enum object_type base_type;
+		unsigned long size;
+
+		/* unpack_entry() uses the shared delta base cache */
+		obj_read_lock();
+		d->base = unpack_entry(r, p, base_offset, &base_type, &size);
+		obj_read_unlock();
+		if (!d->base)
+			return -1;
+		d->base_size = size;
+	} else if (spill_delta_base(d, r, p, base_offset, base_size))
+		return -1;
+
+	CALLOC_ARRAY(d->delta, 1);
+	d->delta->u.in_pack.pack = p;
+	d->delta->u.in_pack.pos = pos;
+	d->delta->z_state = z_unused;
+	d->delta->close = close_istream_pack_non_delta;
+	d->delta->read = read_istream_pack_non_delta;
+
+	/* the delta starts with the sizes of the base and of the result */
+	if (fill_delta_buffer(d, 2 * 10) < 0)
+		goto error;
+	data = d->buf;
+	top = d->buf + d->end;
+	if (get_delta_hdr_size(&data, top) != d->base_size)
+		goto error;
+	st->size = get_delta_hdr_size(&data, top);
+	d->out_left = st->size;
+	d->ptr = data - d->buf;
+
+	st->close = close_istream_pack_delta;
+	st->read = read_istream_pack_delta;
+	return 0;
+
+error:
+	close_istream_pack_delta(st);
+	return -1;
+}
+
+/*
+ * Open a stream on the object at 'offset' in 'p', whether it is
+ * deltified or not.
+ */
+static struct git_istream *open_istream_pack_entry(struct repository *r,
+						   struct packed_git *p,
+						   off_t offset)
+{
+	struct git_istream *st = xmalloc(sizeof(*st));
+	enum object_type type;
+
+	st->u.in_pack.pack = p;
+	st->u.in_pack.pos = offset;
+	if (!open_istream_pack_non_delta(st, r, NULL, &type))
+		return st;
+
+	st->u.in_pack.pos = offset;
+	if (!open_istream_pack_delta(st, r, NULL, &type))
+		return st;
+
+	free(st);
+	return NULL;
+}
+
+
 /*****************************************************************
  *
  * In-core stream
@@ -420,10 +744,12 @@ static int istream_source(struct git_istream *st,
 		st->open = open_istream_loose;
 		return 0;
 	case OI_PACKED:
-		if (!oi.u.packed.is_delta && big_file_threshold < size) {
+		if (big_file_threshold < size) {
 			st->u.in_pack.pack = oi.u.packed.pack;
 			st->u.in_pack.pos = oi.u.packed.offset;
-			st->open = open_istream_pack_non_delta;
+			st->open = oi.u.packed.is_delta ?
+				open_istream_pack_delta :
+				open_istream_pack_non_delta;
 			return 0;
 		}
 		/* fallthru */
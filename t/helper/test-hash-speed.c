@@ -1,11 +1,23 @@
 #include "test-tool.h"
 #include "cache.h"
+#include "config.h"
+#include "parse-options.h"
 
-#define NUM_SECONDS 3
+static const char *const hash_speed_usage[] = {
+	"test-tool hash-speed [--seconds=<n>] [--chunk=<n>] <algo> [<size>...]",
+	NULL
+};
 
-static inline void compute_hash(const struct git_hash_algo *algo, git_hash_ctx *ctx, uint8_t *final, const void *p, size_t len)
+static inline void compute_hash(const struct git_hash_algo *algo, git_hash_ctx *ctx,
+				uint8_t *final, const unsigned char *p, size_t len,
+				size_t chunk)
 {
 	algo->init_fn(ctx);
+	while (len > chunk) {
+		algo->update_fn(ctx, p, chunk);
+		p += chunk;
+		len -= chunk;
+	}
 	algo->update_fn(ctx, p, len);
 	algo->final_fn(final, ctx);
 }
@@ -14,48 +26,72 @@ int cmd__hash_speed(int ac, const char **av)
 {
 	git_hash_ctx ctx;
 	unsigned char hash[GIT_MAX_RAWSZ];
-	clock_t initial, start, end;
-	unsigned bufsizes[] = { 64, 256, 1024, 8192, 16384 };
-	int i;
-	void *p;
+	unsigned long default_sizes[] = {
+		64, 256, 1024, 8192, 16384, 65536, 1024 * 1024
+	};
+	unsigned long *sizes = default_sizes;
+	size_t nr_sizes = ARRAY_SIZE(default_sizes);
+	int seconds = 3;
+	unsigned long chunk = 0;
 	const struct git_hash_algo *algo = NULL;
+	struct option options[] = {
+		OPT_INTEGER(0, "seconds", &seconds,
+			    "how long to hash buffers of each size"),
+		OPT_MAGNITUDE(0, "chunk", &chunk,
+			      "feed each buffer to the hash in pieces of this size"),
+		OPT_END()
+	};
+	size_t i;
+	int j;
 
-	if (ac == 2) {
-		for (i = 1; i < GIT_HASH_NALGOS; i++) {
-			if (!strcmp(av[1], hash_algos[i].name)) {
-				algo = &hash_algos[i];
-				break;
-			}
+	ac = parse_options(ac, av, NULL, options, hash_speed_usage, 0);
+	if (ac < 1 || seconds <= 0)
+		usage_with_options(hash_speed_usage, options);
+	for (j = 1; j < GIT_HASH_NALGOS; j++) {
+		if (!strcmp(av[0], hash_algos[j].name)) {
+			algo = &hash_algos[j];
+			break;
 		}
 	}
 	if (!algo)
-		die("usage: test-tool hash-speed algo_name");
-
-	/* Use this as an offset to make overflow less likely. */
-	initial = clock();
+		die("unknown hash algorithm '%s'", av[0]);
+	if (ac > 1) {
+		nr_sizes = ac - 1;
+		ALLOC_ARRAY(sizes, nr_sizes);
+		for (i = 0; i < nr_sizes; i++)
+			if (!git_parse_ulong(av[i + 1], &sizes[i]) || !sizes[i])
+				die("invalid size '%s'", av[i + 1]);
+	}
 
 	printf("algo: %s\n", algo->name);
 
-	for (i = 0; i < ARRAY_SIZE(bufsizes); i++) {
-		unsigned long j, kb;
-		double kb_per_sec;
-		p = xcalloc(1, bufsizes[i]);
-		start = end = clock() - initial;
-		for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
-			compute_hash(algo, &ctx, hash, p, bufsizes[i]);
+	for (i = 0; i < nr_sizes; i++) {
+		unsigned long iters;
+		uint64_t start, end;
+		double secs, kb;
+		unsigned char *p = xcalloc(1, sizes[i]);
+
+		start = end = getnanotime();
+		for (iters = 0; end - start < seconds * 1000000000ULL; iters++) {
+			compute_hash(algo, &ctx, hash, p, sizes[i],
+				     chunk ? chunk : sizes[i]);
 
 			/*
 			 * Only check elapsed time every 128 iterations to avoid
 			 * dominating the runtime with system calls.
 			 */
-			if (!(j & 127))
-				end = clock() - initial;
+			if (!(iters & 127))
+				end = getnanotime();
 		}
-		kb = j * bufsizes[i];
-		kb_per_sec = kb / (1024 * ((double)end - start) / CLOCKS_PER_SEC);
-		printf("size %u: %lu iters; %lu KiB; %0.2f KiB/s\n", bufsizes[i], j, kb, kb_per_sec);
+		end = getnanotime();
+		secs = (end - start) / 1e9;
+		kb = (double)iters * sizes[i] / 1024;
+		printf("size %lu: %lu iters; %.0f KiB; %0.2f KiB/s; %0.2f MiB/s\n",
+		       sizes[i], iters, kb, kb / secs, kb / 1024 / secs);
 		free(p);
 	}
 
+	if (sizes != default_sizes)
+		free(sizes);
 	return 0;
 }
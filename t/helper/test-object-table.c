@@ -0,0 +1,187 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "object.h"
+#include "object-store.h"
+#include "commit.h"
+#include "commit-graph.h"
+#include "repository.h"
+#include "parse-options.h"
+#include "thread-utils.h"
+
+static const char *const object_table_usage[] = {
+	"test-tool object-table lookup [--threads=<n>] < <oid-and-type-list>",
+	"test-tool object-table parse [--threads=<n>] < <oid-and-type-list>",
+	NULL
+};
+
+struct object_entry {
+	struct object_id oid;
+	enum object_type type;
+};
+
+static struct object_entry *entries;
+static size_t entries_nr, entries_alloc;
+
+struct lookup_thread_data {
+	pthread_t thread;
+	int nr;
+	struct object **objs;
+};
+
+static int nr_threads = 1;
+
+/*
+ * Every thread looks up every object, starting at a different place in
+ * the list so that the threads race to create the same objects. Half of
+ * the objects are first looked up without naming their type, to exercise
+ * object_as_type().
+ */
+static void *lookup_thread(void *data)
+{
+	struct lookup_thread_data *td = data;
+	size_t start = entries_nr * td->nr / nr_threads;
+	size_t i;
+
+	for (i = 0; i < entries_nr; i++) {
+		size_t j = (start + i) % entries_nr;
+		struct object_entry *e = &entries[j];
+
+		if ((j + td->nr) % 2)
+			lookup_unknown_object(the_repository, &e->oid);
+		td->objs[j] = lookup_object_by_type(the_repository, &e->oid,
+						    e->type);
+	}
+	return NULL;
+}
+
+static void *parse_thread(void *data)
+{
+	struct lookup_thread_data *td = data;
+	size_t i;
+
+	for (i = td->nr; i < entries_nr; i += nr_threads) {
+		td->objs[i] = parse_object_with_flags(the_repository,
+						      &entries[i].oid,
+						      PARSE_OBJECT_SKIP_HASH_CHECK);
+		if (!td->objs[i])
+			die("unable to parse %s", oid_to_hex(&entries[i].oid));
+	}
+	return NULL;
+}
+
+static void run_threads(void *(*fn)(void *), struct lookup_thread_data *td)
+{
+	int i;
+
+	if (!HAVE_THREADS || nr_threads == 1) {
+		for (i = 0; i < nr_threads; i++)
+			fn(&td[i]);
+		return;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&td[i].thread, NULL, fn, &td[i]);
+		if (err)
+			die(_("unable to create thread: %s"), strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(td[i].thread, NULL);
+}
+
+static void read_entries(void)
+{
+	struct strbuf line = STRBUF_INIT;
+
+	while (strbuf_getline(&line, stdin) != EOF) {
+		const char *p;
+		struct object_entry *e;
+
+		ALLOC_GROW(entries, entries_nr + 1, entries_alloc);
+		e = &entries[entries_nr++];
+		if (parse_oid_hex(line.buf, &e->oid, &p) || *p++ != ' ')
+			die("malformed line: %s", line.buf);
+		e->type = type_from_string(p);
+	}
+	strbuf_release(&line);
+}
+
+int cmd__object_table(int argc, const char **argv)
+{
+	struct lookup_thread_data *td;
+	const char *mode;
+	int parse;
+	struct option options[] = {
+		OPT_INTEGER(0, "threads", &nr_threads,
+			    "number of threads to use"),
+		OPT_END()
+	};
+	size_t i;
+	int t;
+
+	setup_git_directory();
+	argc = parse_options(argc, argv, NULL, options, object_table_usage, 0);
+	if (argc != 1 || nr_threads < 1)
+		usage_with_options(object_table_usage, options);
+	mode = argv[0];
+
+	read_entries();
+
+	/*
+	 * In "lookup" mode each thread records what it saw for every
+	 * object; in "parse" mode the threads fill in disjoint parts of
+	 * a single array.
+	 */
+	parse = !strcmp(mode, "parse");
+	CALLOC_ARRAY(td, nr_threads);
+	for (t = 0; t < nr_threads; t++) {
+		td[t].nr = t;
+		if (!t || !parse)
+			CALLOC_ARRAY(td[t].objs, entries_nr);
+		else
+			td[t].objs = td[0].objs;
+	}
+
+	enable_object_table_lock(the_repository->parsed_objects);
+	if (!strcmp(mode, "lookup")) {
+		run_threads(lookup_thread, td);
+	} else if (parse) {
+		/*
+		 * Load what parse_object() would otherwise load lazily
+		 * (and racily) up front.
+		 */
+		save_commit_buffer = 0;
+		prepare_commit_graft(the_repository);
+		disable_commit_graph(the_repository);
+		enable_obj_read_lock();
+		run_threads(parse_thread, td);
+		disable_obj_read_lock();
+	} else {
+		usage_with_options(object_table_usage, options);
+	}
+	disable_object_table_lock(the_repository->parsed_objects);
+
+	for (i = 0; i < entries_nr; i++) {
+		struct object *obj = td[0].objs[i];
+
+		for (t = 1; t < nr_threads; t++)
+			if (td[t].objs[i] != obj)
+				die("threads disagree about %s",
+				    oid_to_hex(&entries[i].oid));
+		if (obj != lookup_object(the_repository, &entries[i].oid))
+			die("%s is not in the table",
+			    oid_to_hex(&entries[i].oid));
+		if (obj->type != entries[i].type)
+			die("%s has type %s, not %s",
+			    oid_to_hex(&entries[i].oid),
+			    type_name(obj->type), type_name(entries[i].type));
+		if (parse && !obj->parsed)
+			die("%s was not parsed", oid_to_hex(&entries[i].oid));
+	}
+	printf("%d objects\n", the_repository->parsed_objects->nr_objs);
+
+	for (t = 0; t < (parse ? 1 : nr_threads); t++)
+		free(td[t].objs);
+	free(td);
+	free(entries);
+	return 0;
+}
@@ -0,0 +1,209 @@
+#include "test-tool.h"
+#include "cache.h"
+#include "midx.h"
+#include "object-store.h"
+#include "packfile.h"
+#include "repository.h"
+
+static const char oid_lookup_usage[] =
+	"test-tool oid-lookup (verify [<random-probes>] | bench <lookups>)";
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/* xorshift64*; good enough to spread probes, and reproducible */
+static uint64_t next_random(void)
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static void random_oid(struct object_id *oid)
+{
+	size_t i;
+
+	for (i = 0; i < the_hash_algo->rawsz; i += sizeof(uint32_t))
+		put_be32(oid->hash + i, next_random() >> 32);
+	oid->algo = hash_algo_by_ptr(the_hash_algo);
+}
+
+/*
+ * An index to search: either a pack index or a multi-pack-index.
+ */
+struct index {
+	struct packed_git *pack;
+	struct multi_pack_index *midx;
+	uint32_t nr;
+};
+
+static struct index *indexes;
+static size_t indexes_nr, indexes_alloc;
+
+static void load_indexes(void)
+{
+	struct packed_git *p;
+	struct multi_pack_index *m;
+
+	for (m = get_multi_pack_index(the_repository); m; m = m->next) {
+		ALLOC_GROW(indexes, indexes_nr + 1, indexes_alloc);
+		indexes[indexes_nr].pack = NULL;
+		indexes[indexes_nr].midx = m;
+		indexes[indexes_nr].nr = m->num_objects;
+		indexes_nr++;
+	}
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		if (open_pack_index(p))
+			die("cannot open index of %s", p->pack_name);
+		ALLOC_GROW(indexes, indexes_nr + 1, indexes_alloc);
+		indexes[indexes_nr].pack = p;
+		indexes[indexes_nr].midx = NULL;
+		indexes[indexes_nr].nr = p->num_objects;
+		indexes_nr++;
+	}
+}
+
+static void nth_oid(struct index *ix, uint32_t n, struct object_id *oid)
+{
+	if (ix->midx)
+		nth_midxed_object_oid(oid, ix->midx, n);
+	else
+		nth_packed_object_id(oid, ix->pack, n);
+}
+
+static int lookup(struct index *ix, const struct object_id *oid,
+		  uint32_t *pos)
+{
+	if (ix->midx)
+		return bsearch_midx(oid, ix->midx, pos);
+	return bsearch_pack(oid, ix->pack, pos);
+}
+
+/* the position of the first entry not less than "oid", the slow way */
+static uint32_t lower_bound(struct index *ix, const struct object_id *oid)
+{
+	uint32_t lo = 0, hi = ix->nr;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		struct object_id cur;
+
+		nth_oid(ix, mi, &cur);
+		if (oidcmp(&cur, oid) < 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return lo;
+}
+
+static void check(struct index *ix, const struct object_id *oid)
+{
+	uint32_t want = lower_bound(ix, oid), pos;
+	struct object_id cur;
+	int found = 0, got;
+
+	if (want < ix->nr) {
+		nth_oid(ix, want, &cur);
+		found = oideq(&cur, oid);
+	}
+	got = lookup(ix, oid, &pos);
+	if (got != found || pos != want)
+		die("lookup of %s gave %d at %"PRIu32", expected %d at %"PRIu32,
+		    oid_to_hex(oid), got, pos, found, want);
+}
+
+static int verify(int probes)
+{
+	size_t i;
+	int j;
+	uint32_t n;
+
+	for (i = 0; i < indexes_nr; i++) {
+		struct index *ix = &indexes[i];
+
+		for (n = 0; n < ix->nr; n++) {
+			struct object_id oid;
+
+			nth_oid(ix, n, &oid);
+			check(ix, &oid);
+
+			/* just above and just below an existing entry */
+			oid.hash[the_hash_algo->rawsz - 1]++;
+			check(ix, &oid);
+			oid.hash[the_hash_algo->rawsz - 1] -= 2;
+			check(ix, &oid);
+		}
+		for (j = 0; j < probes; j++) {
+			struct object_id oid;
+
+			random_oid(&oid);
+			check(ix, &oid);
+		}
+	}
+	printf("%"PRIuMAX" indexes ok\n", (uintmax_t)indexes_nr);
+	return 0;
+}
+
+static int bench(int count)
+{
+	struct object_id *oids;
+	uint64_t start, elapsed;
+	uintmax_t found = 0;
+	int i;
+	size_t j;
+
+	if (!indexes_nr)
+		die("no pack indexes to look objects up in");
+
+	/* half of the lookups are for objects that exist */
+	ALLOC_ARRAY(oids, count);
+	for (i = 0; i < count; i++) {
+		struct index *ix = &indexes[next_random() % indexes_nr];
+
+		if (i % 2 && ix->nr)
+			nth_oid(ix, next_random() % ix->nr, &oids[i]);
+		else
+			random_oid(&oids[i]);
+	}
+
+	start = getnanotime();
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < indexes_nr; j++) {
+			uint32_t pos;
+
+			if (lookup(&indexes[j], &oids[i], &pos)) {
+				found++;
+				break;
+			}
+		}
+	}
+	elapsed = getnanotime() - start;
+
+	printf("%d lookups in %"PRIuMAX" indexes, %"PRIuMAX" found\n",
+	       count, (uintmax_t)indexes_nr, found);
+	fprintf(stderr, "%.3f s, %.0f lookups/s\n", elapsed / 1e9,
+		elapsed ? count / (elapsed / 1e9) : 0);
+	free(oids);
+	return 0;
+}
+
+int cmd__oid_lookup(int argc, const char **argv)
+{
+	int ret;
+
+	setup_git_directory();
+	if (argc < 2 || argc > 3)
+		usage(oid_lookup_usage);
+
+	load_indexes();
+	if (!strcmp(argv[1], "verify"))
+		ret = verify(argc > 2 ? strtol(argv[2], NULL, 10) : 0);
+	else if (!strcmp(argv[1], "bench") && argc == 3)
+		ret = bench(strtol(argv[2], NULL, 10));
+	else
+		usage(oid_lookup_usage);
+
+	free(indexes);
+	return ret;
+}
@@ -43,7 +43,9 @@ static struct test_cmd cmds[] = {
 	{ "match-trees", cmd__match_trees },
 	{ "mergesort", cmd__mergesort },
 	{ "mktemp", cmd__mktemp },
+	{ "object-table", cmd__object_table },
 	{ "oid-array", cmd__oid_array },
+	{ "oid-lookup", cmd__oid_lookup },
 	{ "oidmap", cmd__oidmap },
 	{ "oidtree", cmd__oidtree },
 	{ "online-cpus", cmd__online_cpus },
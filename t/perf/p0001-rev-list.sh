@@ -14,6 +14,10 @@ test_perf 'rev-list --all --objects' '
 	git rev-list --all --objects >/dev/null
 '
 
+test_perf 'rev-list --all --objects --threads=0' '
+	git rev-list --all --objects --threads=0 >/dev/null
+'
+
 test_perf 'rev-list --parents' '
 	git rev-list --parents HEAD >/dev/null
 '
@@ -11,4 +11,33 @@ test_perf "read_cache/discard_cache $count times" "
 	test-tool read-cache $count
 "
 
+for threads in false true
+do
+	test_expect_success "set index.threads=$threads" "
+		git config index.threads $threads
+	"
+
+	test_perf "read_cache/discard_cache $count times (index.threads=$threads)" "
+		test-tool read-cache $count
+	"
+done
+
+# An index this large is read into a mem-pool block big enough to be
+# backed by huge pages; override the number of entries for a quicker run.
+nr_entries=${GIT_PERF_READ_CACHE_NR:-500000}
+
+test_expect_success "setup an index of $nr_entries entries" '
+	git init large &&
+	blob=$(echo content | git -C large hash-object -w --stdin) &&
+	awk -v blob=$blob -v nr=$nr_entries "BEGIN {
+		for (i = 0; i < nr; i++)
+			printf \"100644 %s\td%03d/sub/file-%04d.txt\n\",
+				blob, i / 1000, i % 1000
+	}" | git -C large update-index --index-info
+'
+
+test_perf "read_cache/discard_cache 20 times ($nr_entries entries)" '
+	(cd large && test-tool read-cache 20)
+'
+
 test_done
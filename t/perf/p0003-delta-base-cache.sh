@@ -14,6 +14,11 @@ depth of 50.
 The setting of core.deltaBaseCacheLimit in the source repository is also
 relevant (depending on the size of your test repo), so be sure it is consistent
 between runs.
+
+The "grep" tests read every blob of HEAD through the object store from
+several threads at once, which shows how well concurrent readers of deep
+delta chains scale. Set GIT_PERF_0003_THREADS to a list of thread counts
+(e.g. "1 4 8") to choose which ones to test.
 '
 . ./perf-lib.sh
 
@@ -28,4 +33,11 @@ test_perf 'log -S' '
 	git log --raw -Sfoo >/dev/null
 '
 
+for threads in ${GIT_PERF_0003_THREADS:-1 4}
+do
+	test_perf "grep HEAD with $threads threads" --prereq PTHREADS "
+		git grep --threads=$threads some_nonexistent_string HEAD || :
+	"
+done
+
 test_done
@@ -0,0 +1,27 @@
+#!/bin/sh
+
+test_description='Tests multi-threaded object lookup and parsing'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'list objects' '
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype)" >objects
+'
+
+for threads in 1 2 4 8
+do
+	test_perf "lookup_object_by_type() with $threads threads" "
+		test-tool object-table lookup --threads=$threads <objects
+	"
+done
+
+for threads in 1 2 4 8
+do
+	test_perf "parse_object() with $threads threads" "
+		test-tool object-table parse --threads=$threads <objects
+	"
+done
+
+test_done
@@ -9,4 +9,24 @@ test_perf 'cat-file --batch-check' '
 	git cat-file --batch-all-objects --batch-check
 '
 
+test_expect_success 'set up thread-counting tests' '
+	git cat-file --batch-all-objects --batch-check="%(objectname)" >objects &&
+	t=$(test-tool online-cpus) &&
+	threads= &&
+	while test $t -gt 0
+	do
+		threads="$t $threads" &&
+		t=$((t / 2)) || return 1
+	done
+'
+
+for t in $threads
+do
+	THREADS=$t
+	export THREADS
+	test_perf "cat-file --batch with $t threads" '
+		git cat-file --batch --buffer --threads=$THREADS <objects >/dev/null
+	'
+done
+
 test_done
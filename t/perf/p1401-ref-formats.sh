@@ -0,0 +1,54 @@
+#!/bin/sh
+
+test_description='Compare the files and reftable reference formats'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'setup' '
+	test_commit PRE &&
+	test_commit POST &&
+	for i in $(test_seq 10000)
+	do
+		echo "create refs/heads/branch-$i PRE" || return 1
+	done >create &&
+	sed -e "s/^create /delete /" -e "s/ PRE$//" create >delete &&
+	for format in files reftable
+	do
+		git clone --bare --ref-format=$format . $format.git &&
+		git -C $format.git update-ref --stdin <create &&
+		git -C $format.git pack-refs --all || return 1
+	done
+'
+
+for format in files reftable
+do
+	test_perf "for-each-ref ($format)" "
+		git -C $format.git for-each-ref >/dev/null
+	"
+
+	test_perf "look up single refs ($format)" "
+		for i in \$(test_seq 1000 1000 10000)
+		do
+			git -C $format.git rev-parse --verify -q refs/heads/branch-\$i >/dev/null ||
+			return 1
+		done
+	"
+
+	test_perf "update-ref ($format)" "
+		for i in \$(test_seq 200)
+		do
+			git -C $format.git update-ref refs/heads/branch PRE &&
+			git -C $format.git update-ref refs/heads/branch POST PRE &&
+			git -C $format.git update-ref -d refs/heads/branch || return 1
+		done
+	"
+
+	test_perf "update-ref --stdin, 10000 refs ($format)" "
+		git -C $format.git update-ref --stdin <delete &&
+		git -C $format.git update-ref --stdin <create
+	"
+done
+
+test_done
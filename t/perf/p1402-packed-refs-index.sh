@@ -0,0 +1,63 @@
+#!/bin/sh
+
+test_description='Tests lookups in a large packed-refs file with and without its index'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+# The number of references to create; override for a quicker run.
+nr_refs=${GIT_PERF_PACKED_REFS_NR:-1000000}
+
+test_expect_success 'setup' '
+	test_commit PRE &&
+	oid=$(git rev-parse PRE) &&
+	{
+		echo "# pack-refs with: peeled fully-peeled sorted " &&
+		awk -v oid=$oid -v nr=$nr_refs "BEGIN {
+			for (i = 0; i < nr; i++)
+				printf \"%s refs/heads/topic-%07d\n\", oid, i
+		}" &&
+		echo "$oid refs/tags/PRE"
+	} >packed-refs &&
+	for variant in plain indexed
+	do
+		git init --bare $variant.git &&
+		cp -R .git/objects $variant.git/ &&
+		cp packed-refs $variant.git/packed-refs || return 1
+	done &&
+	git -C indexed.git -c core.packedRefsIndex=true pack-refs --all &&
+	test_path_is_file indexed.git/packed-refs.idx &&
+	test_path_is_missing plain.git/packed-refs.idx &&
+
+	test-tool pkt-line pack >ls-refs-input <<-EOF
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	ref-prefix refs/heads/topic-0500
+	ref-prefix refs/heads/topic-09999
+	ref-prefix refs/tags/
+	0000
+	EOF
+'
+
+for variant in plain indexed
+do
+	test_perf "ls-refs with ref-prefix ($variant)" "
+		for i in \$(test_seq 20)
+		do
+			test-tool -C $variant.git serve-v2 --stateless-rpc \
+				<ls-refs-input >/dev/null || return 1
+		done
+	"
+
+	test_perf "look up single refs ($variant)" "
+		for i in \$(test_seq 20)
+		do
+			git -C $variant.git rev-parse --verify -q \
+				refs/heads/topic-000\${i}00 >/dev/null || return 1
+		done
+	"
+done
+
+test_done
@@ -0,0 +1,33 @@
+#!/bin/sh
+
+test_description='Tests iterating over many loose references with threads'
+
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+# The number of loose references to create; override for a quicker run.
+nr_refs=${GIT_PERF_LOOSE_REFS_NR:-200000}
+
+test_expect_success 'setup' '
+	test_commit PRE &&
+	awk -v nr=$nr_refs "BEGIN {
+		for (i = 0; i < nr; i++)
+			printf \"create refs/heads/%d/topic-%07d HEAD\n\", i % 100, i
+	}" >input &&
+	git update-ref --stdin <input
+'
+
+for threads in 1 8
+do
+	test_perf "for-each-ref (core.looseRefThreads=$threads)" "
+		git -c core.looseRefThreads=$threads for-each-ref >/dev/null
+	"
+
+	test_perf "for-each-ref with prefix (core.looseRefThreads=$threads)" "
+		git -c core.looseRefThreads=$threads for-each-ref \
+			refs/heads/42/ >/dev/null
+	"
+done
+
+test_done
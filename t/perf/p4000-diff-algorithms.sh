@@ -26,4 +26,20 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_expect_success 'setup multi-megabyte generated files' '
+	for i in $(test_seq 1 100000)
+	do
+		echo "	int value_$i = compute($i, $i * 3);  /* entry $i */" || return 1
+	done >large-one &&
+	sed -e "/0 = /s/compute/recompute/" -e "/5 \*\/\$/s/\$/  /" \
+		<large-one >large-two
+'
+
+for opt in "" -w -b --ignore-space-at-eol
+do
+	test_perf "diff --no-index $opt on large generated files" "
+		git diff --no-index $opt large-one large-two >/dev/null || :
+	"
+done
+
 test_done
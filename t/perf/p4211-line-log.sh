@@ -39,4 +39,31 @@ test_perf 'git log --oneline --raw --parents -1000' '
 	git log --oneline --raw --parents -1000 >/dev/null
 '
 
+test_expect_success 'write commit-graph with changed-path Bloom filters' '
+	git commit-graph write --reachable --changed-paths &&
+	git ls-tree --name-only HEAD | sort | head -3 >pathlist &&
+	dir=$(git ls-tree -d --name-only HEAD | sort | head -1) &&
+	echo "$dir" >dirname
+'
+
+paths=$(cat pathlist)
+dir=$(cat dirname)
+export paths dir
+
+test_perf 'git log -- <several paths> (Bloom filters)' '
+	git log --oneline -- $paths >/dev/null
+'
+
+test_perf 'git log -- <wildcard> (Bloom filters)' '
+	git log --oneline -- "$dir/*.c" >/dev/null
+'
+
+test_perf 'git log -L (Bloom filters)' '
+	git log -M -L 1:"$file" >/dev/null
+'
+
+test_perf 'git blame (Bloom filters)' '
+	git blame -- "$file" >/dev/null
+'
+
 test_done
@@ -94,6 +94,10 @@ do
 		git rev-list --abbrev-commit HEAD >/dev/null
 	'
 
+	test_perf "random oid lookups ($nr_packs)" '
+		test-tool oid-lookup bench 1000000 >/dev/null
+	'
+
 	# This simulates the interesting part of the repack, which is the
 	# actual pack generation, without smudging the on-disk setup
 	# between trials.
@@ -0,0 +1,43 @@
+#!/bin/sh
+
+test_description="Tests delta search performance with multiple threads"
+
+. ./perf-lib.sh
+
+test_perf_large_repo
+
+# Rather than counting up and doubling each time, count down from the endpoint,
+# halving each time. That ensures that our final test uses as many threads as
+# CPUs, even if it isn't a power of 2.
+test_expect_success 'set up thread-counting tests' '
+	t=$(test-tool online-cpus) &&
+	threads= &&
+	while test $t -gt 0
+	do
+		threads="$t $threads" &&
+		t=$((t / 2)) || return 1
+	done
+'
+
+for t in $threads
+do
+	THREADS=$t
+	export THREADS
+	test_perf "pack-objects delta search, $t threads" '
+		git pack-objects --all --no-reuse-delta --threads=$THREADS \
+			--stdout </dev/null >/dev/null
+	'
+done
+
+# Show how much of the delta search each worker did and how long it was
+# busy; with good load balancing, the busy times are close together.
+test_expect_success 'per-thread delta search statistics' '
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git pack-objects --all --no-reuse-delta --stdout \
+		</dev/null >/dev/null &&
+	sed -n "s/.*\"thread\":\"\([^\"]*\)\".*\"key\":\"delta-search\/\([^\"]*\)\",\"value\":\"\([^\"]*\)\".*/\1 \2 \3/p" \
+		trace &&
+	rm -f trace
+'
+
+test_done
@@ -61,7 +61,68 @@ test_bitmap () {
 	test_partial_bitmap
 }
 
+# Simulate a server that received a series of pushes since its
+# multi-pack bitmap was last written, and compare fetches before and
+# after the geometric-repack maintenance task covers the new packs.
+test_geometric_repack () {
+	test_expect_success 'remove existing repo (geometric-repack)' '
+		rm -fr * .git
+	'
+
+	test_perf_large_repo
+
+	test_expect_success 'bitmap old history, then push 10 packs' '
+		cutoff=$(git rev-list HEAD~100 -1) &&
+		orig_tip=$(git rev-parse HEAD) &&
+
+		rm -rf .git/logs .git/refs/* .git/packed-refs &&
+		git update-ref HEAD $cutoff &&
+		git repack -Ad &&
+		git multi-pack-index write --bitmap &&
+
+		prev=$cutoff &&
+		for i in $(test_seq 90 -10 0)
+		do
+			tip=$(git rev-parse $orig_tip~$i) &&
+			printf "%s\n^%s\n" $tip $prev |
+			git pack-objects --revs .git/objects/pack/pack &&
+			prev=$tip || return 1
+		done &&
+		git prune-packed &&
+		git update-ref HEAD $orig_tip
+	'
+
+	test_perf 'simulated fetch (10 pushes since bitmap)' '
+		have=$(git rev-list HEAD~100 -1) &&
+		{
+			echo HEAD &&
+			echo ^$have
+		} | git pack-objects --revs --stdout >/dev/null
+	'
+
+	test_perf 'clone (10 pushes since bitmap)' '
+		git pack-objects --stdout --all </dev/null >/dev/null
+	'
+
+	test_expect_success 'run the geometric-repack task' '
+		git maintenance run --task=geometric-repack
+	'
+
+	test_perf 'simulated fetch (after geometric-repack)' '
+		have=$(git rev-list HEAD~100 -1) &&
+		{
+			echo HEAD &&
+			echo ^$have
+		} | git pack-objects --revs --stdout >/dev/null
+	'
+
+	test_perf 'clone (after geometric-repack)' '
+		git pack-objects --stdout --all </dev/null >/dev/null
+	'
+}
+
 test_bitmap false
 test_bitmap true
+test_geometric_repack
 
 test_done
@@ -20,4 +20,19 @@ test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
 
+test_expect_success 'write trigram index' '
+	git grep --write-trigram-index HEAD
+'
+
+test_perf 'grep --cached, cheap regex, trigram index' '
+	git grep --cached some_nonexistent_string || :
+'
+test_perf 'grep HEAD, cheap regex, trigram index' '
+	git grep some_nonexistent_string HEAD || :
+'
+
+test_expect_success 'remove trigram index' '
+	rm -f "$(git rev-parse --git-path objects/info/trigram-index)"
+'
+
 test_done
@@ -0,0 +1,157 @@
+#!/bin/sh
+
+test_description='metadata--daemon answers queries of short-lived commands'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+test-tool simple-ipc SUPPORTS_SIMPLE_IPC || {
+	skip_all='simple IPC not supported on this platform'
+	test_done
+}
+
+stop_daemon () {
+	git metadata--daemon stop 2>/dev/null || :
+}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	git checkout -b topic &&
+	test_commit side &&
+	git checkout main &&
+	test_commit two &&
+	git repack -ad &&
+	test_commit loose &&
+	git config core.metadataDaemon true
+'
+
+test_expect_success 'start the daemon' '
+	test_atexit stop_daemon &&
+	git metadata--daemon start &&
+	git metadata--daemon status
+'
+
+test_expect_success 'cannot start a second daemon' '
+	test_must_fail git metadata--daemon run
+'
+
+wait_for_daemon () {
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		git metadata--daemon status >/dev/null && return 0
+		sleep 1
+	done
+	return 1
+}
+
+used_daemon () {
+	grep -q "\"category\":\"metadata_client\"" "$1"
+}
+
+test_expect_success 'rev-parse asks the daemon' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git rev-parse HEAD topic~1 two^{tree} >actual &&
+	used_daemon trace &&
+	git -c core.metadataDaemon=false rev-parse \
+		HEAD topic~1 two^{tree} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rev-parse resolves names the daemon must not' '
+	oid=$(git rev-parse HEAD) &&
+	git rev-parse $(test_oid_to_abbrev $oid) HEAD:loose.t \
+		HEAD@{0} >actual &&
+	git -c core.metadataDaemon=false rev-parse $(test_oid_to_abbrev $oid) \
+		HEAD:loose.t HEAD@{0} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rev-parse parses full object names itself' '
+	git rev-parse HEAD >expect &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git rev-parse $(cat expect) >actual &&
+	! used_daemon trace &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cat-file -e/-t/-s ask the daemon' '
+	blob=$(git rev-parse two:two.t) &&
+	for obj in HEAD $blob topic^{tree} loose
+	do
+		GIT_TRACE2_EVENT="$(pwd)/trace" git cat-file -t $obj &&
+		used_daemon trace &&
+		rm trace &&
+		git cat-file -s $obj &&
+		git cat-file -e $obj || return 1
+	done >actual &&
+	for obj in HEAD $blob topic^{tree} loose
+	do
+		git -c core.metadataDaemon=false cat-file -t $obj &&
+		git -c core.metadataDaemon=false cat-file -s $obj || return 1
+	done >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cat-file -e on a missing object' '
+	test_must_fail git cat-file -e $ZERO_OID
+'
+
+test_expect_success 'merge-base asks the daemon' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git merge-base --all main topic >actual &&
+	used_daemon trace &&
+	git rev-parse base >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'merge-base without a common ancestor' '
+	git checkout --orphan orphan &&
+	test_commit orphan &&
+	git checkout main &&
+	test_expect_code 1 git merge-base main orphan >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'the daemon is bypassed with replace refs' '
+	test_when_finished "git replace -d topic" &&
+	git replace topic main &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git rev-parse topic^{tree} >actual &&
+	! used_daemon trace &&
+	git rev-parse main^{tree} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the daemon sees new refs and objects' '
+	test_commit new &&
+	git rev-parse HEAD >expect &&
+	git rev-parse new >actual &&
+	test_cmp expect actual &&
+	git cat-file -t $(git -c core.metadataDaemon=false rev-parse new:new.t) >actual &&
+	echo blob >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the daemon survives removed packs' '
+	git repack -ad &&
+	git cat-file -t base >actual &&
+	echo commit >expect &&
+	test_cmp expect actual &&
+	# the daemon restarts itself to forget the removed pack
+	wait_for_daemon &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git cat-file -t base &&
+	used_daemon trace
+'
+
+test_expect_success 'stop the daemon' '
+	git metadata--daemon stop &&
+	test_must_fail git metadata--daemon status &&
+	git rev-parse HEAD
+'
+
+test_done
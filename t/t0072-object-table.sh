@@ -0,0 +1,42 @@
+#!/bin/sh
+
+test_description='concurrent lookups in the parsed object table'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	for i in $(test_seq 20)
+	do
+		mkdir -p dir$i &&
+		echo $i >dir$i/file &&
+		git add dir$i &&
+		git commit -q -m "commit $i" &&
+		git tag -a -m "tag $i" tag$i || return 1
+	done &&
+	git cat-file --batch-all-objects \
+		--batch-check="%(objectname) %(objecttype)" >objects &&
+	echo "$(wc -l <objects) objects" >expect
+'
+
+test_expect_success 'lookup with a single thread' '
+	test-tool object-table lookup <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'concurrent lookups create each object once' '
+	test-tool object-table lookup --threads=8 <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'concurrent parsing' '
+	test-tool object-table parse --threads=8 <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'concurrent parsing of packed objects' '
+	git repack -adq &&
+	test-tool object-table parse --threads=8 <objects >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,41 @@
+#!/bin/sh
+
+test_description='looking up objects in pack indexes and multi-pack-indexes'
+
+TEST_PASSES_SANITIZE_LEAK=true
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit_bulk --id=file 200 &&
+	git repack -d &&
+	test_commit_bulk --id=other 50 &&
+	git repack -d
+'
+
+test_expect_success 'lookups in pack indexes agree with binary search' '
+	test-tool oid-lookup verify 1000 >actual &&
+	echo "2 indexes ok" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'lookups in a multi-pack-index agree with binary search' '
+	git multi-pack-index write &&
+	test-tool oid-lookup verify 1000 >actual &&
+	echo "3 indexes ok" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'bench finds the objects that exist' '
+	test-tool oid-lookup bench 100 >actual 2>err &&
+	echo "100 lookups in 3 indexes, 50 found" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'lookups in an empty repository' '
+	git init empty &&
+	test-tool -C empty oid-lookup verify 10 >actual &&
+	echo "0 indexes ok" >expect &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,302 @@
+#!/bin/sh
+
+test_description='reftable reference storage backend'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+test_expect_success 'init: creates reftable repository' '
+	git init --ref-format=reftable repo &&
+	test_path_is_dir repo/.git/reftable &&
+	test_path_is_file repo/.git/reftable/tables.list &&
+	echo reftable >expect &&
+	git -C repo config extensions.refstorage >actual &&
+	test_cmp expect actual &&
+	echo 1 >expect &&
+	git -C repo config core.repositoryformatversion >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'init: HEAD and refs stubs keep older Git away' '
+	echo "ref: refs/heads/.invalid" >expect &&
+	test_cmp expect repo/.git/HEAD &&
+	test_path_is_file repo/.git/refs/heads &&
+	echo refs/heads/main >expect &&
+	git -C repo symbolic-ref HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'init: rejects unknown format' '
+	test_must_fail git init --ref-format=garbage unknown 2>err &&
+	test_i18ngrep "unknown ref storage format ${SQ}garbage${SQ}" err
+'
+
+test_expect_success 'init: cannot change the format on reinit' '
+	test_must_fail git -C repo init --ref-format=files 2>err &&
+	test_i18ngrep "different reference storage format" err &&
+	git -C repo init --ref-format=reftable
+'
+
+test_expect_success 'init: GIT_DEFAULT_REF_FORMAT applies to new repositories' '
+	GIT_DEFAULT_REF_FORMAT=reftable git init from-env &&
+	echo reftable >expect &&
+	git -C from-env config extensions.refstorage >actual &&
+	test_cmp expect actual &&
+	GIT_DEFAULT_REF_FORMAT=reftable git init files-repo-env --ref-format=files &&
+	test_must_fail git -C files-repo-env config extensions.refstorage
+'
+
+test_expect_success 'unknown extensions.refstorage value is refused' '
+	git init bogus &&
+	git -C bogus config core.repositoryformatversion 1 &&
+	git -C bogus config extensions.refstorage garbage &&
+	test_must_fail git -C bogus rev-parse HEAD 2>err &&
+	test_i18ngrep "invalid value for ${SQ}extensions.refstorage${SQ}" err
+'
+
+test_expect_success 'commits and branches' '
+	test_commit -C repo one &&
+	test_commit -C repo two &&
+	git -C repo branch topic HEAD~ &&
+	git -C repo rev-parse one >expect &&
+	git -C repo rev-parse topic >actual &&
+	test_cmp expect actual &&
+	cat >expect <<-EOF &&
+	refs/heads/main
+	refs/heads/topic
+	refs/tags/one
+	refs/tags/two
+	EOF
+	git -C repo for-each-ref --format="%(refname)" >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'update-ref verifies old values' '
+	test_must_fail git -C repo update-ref refs/heads/topic two two 2>err &&
+	test_i18ngrep "is at $(git -C repo rev-parse one) but expected" err &&
+	git -C repo update-ref refs/heads/topic two one &&
+	test_must_fail git -C repo update-ref refs/heads/new one two 2>err &&
+	test_i18ngrep "unable to resolve reference" err
+'
+
+test_expect_success 'update-ref --stdin updates atomically' '
+	one=$(git -C repo rev-parse one) &&
+	two=$(git -C repo rev-parse two) &&
+	cat >input <<-EOF &&
+	create refs/heads/a $one
+	create refs/heads/b $one
+	update refs/heads/topic $one $one
+	EOF
+	test_must_fail git -C repo update-ref --stdin <input &&
+	test_must_fail git -C repo rev-parse --verify refs/heads/a &&
+	cat >input <<-EOF &&
+	create refs/heads/a $one
+	create refs/heads/b $one
+	update refs/heads/topic $one $two
+	EOF
+	git -C repo update-ref --stdin <input &&
+	git -C repo rev-parse --verify refs/heads/a &&
+	git -C repo rev-parse --verify refs/heads/b
+'
+
+test_expect_success 'directory/file conflicts are refused' '
+	test_must_fail git -C repo update-ref refs/heads/a/b HEAD
+'
+
+test_expect_success 'annotated tags are peeled' '
+	git -C repo tag -a -m annotated annotated &&
+	cat >expect <<-EOF &&
+	$(git -C repo rev-parse annotated) refs/tags/annotated
+	$(git -C repo rev-parse annotated^{}) refs/tags/annotated^{}
+	EOF
+	git -C repo show-ref -d annotated >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'symbolic refs' '
+	git -C repo symbolic-ref refs/heads/sym refs/heads/topic &&
+	echo refs/heads/topic >expect &&
+	git -C repo symbolic-ref refs/heads/sym >actual &&
+	test_cmp expect actual &&
+	git -C repo update-ref refs/heads/sym one &&
+	git -C repo rev-parse one >expect &&
+	git -C repo rev-parse topic >actual &&
+	test_cmp expect actual &&
+	git -C repo symbolic-ref --delete refs/heads/sym &&
+	test_must_fail git -C repo rev-parse --verify refs/heads/sym
+'
+
+test_expect_success 'reflogs record updates of HEAD and its branch' '
+	test_commit -C repo three &&
+	git -C repo reflog show --format=%gs main >actual &&
+	test_line_count = 3 actual &&
+	head -n 1 actual >first &&
+	echo "commit: three" >expect &&
+	test_cmp expect first &&
+	git -C repo reflog show --format=%gs HEAD >actual &&
+	test_line_count = 3 actual &&
+	git -C repo rev-parse main@{1} >actual &&
+	git -C repo rev-parse two >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'reflog exists and can be created and deleted' '
+	git -C repo reflog exists refs/heads/main &&
+	test_must_fail git -C repo reflog exists refs/tags/one &&
+	git -C repo update-ref --create-reflog refs/heads/logged one &&
+	git -C repo reflog exists refs/heads/logged &&
+	git -C repo reflog delete refs/heads/logged@{0} &&
+	git -C repo update-ref -d refs/heads/logged &&
+	test_must_fail git -C repo reflog exists refs/heads/logged
+'
+
+test_expect_success 'reflog expire' '
+	git -C repo reflog expire --expire=all refs/heads/main &&
+	git -C repo reflog show main >actual &&
+	test_must_be_empty actual &&
+	git -C repo rev-parse three >expect &&
+	git -C repo rev-parse main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rename and copy branches with their reflogs' '
+	git -C repo branch -m topic renamed &&
+	test_must_fail git -C repo rev-parse --verify refs/heads/topic &&
+	test_must_fail git -C repo reflog exists refs/heads/topic &&
+	git -C repo reflog show --format=%gs renamed >actual &&
+	head -n 1 actual >first &&
+	echo "Branch: renamed refs/heads/topic to refs/heads/renamed" >expect &&
+	test_cmp expect first &&
+	git -C repo branch -c renamed copied &&
+	git -C repo rev-parse renamed >expect &&
+	git -C repo rev-parse copied >actual &&
+	test_cmp expect actual &&
+	git -C repo reflog exists refs/heads/renamed &&
+	git -C repo reflog exists refs/heads/copied
+'
+
+test_expect_success 'deleting branches' '
+	git -C repo branch -D renamed copied a b &&
+	test_must_fail git -C repo reflog exists refs/heads/renamed &&
+	cat >expect <<-EOF &&
+	refs/heads/main
+	EOF
+	git -C repo for-each-ref --format="%(refname)" refs/heads/ >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'pack-refs compacts the stack' '
+	for i in $(test_seq 10)
+	do
+		git -C repo update-ref refs/heads/branch-$i HEAD || return 1
+	done &&
+	git -C repo pack-refs &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+	git -C repo for-each-ref refs/heads/branch-* >actual &&
+	test_line_count = 10 actual
+'
+
+test_expect_success 'many updates are compacted automatically' '
+	test_config -C repo reftable.autoCompaction false &&
+	for i in $(test_seq 10)
+	do
+		git -C repo update-ref -d refs/heads/branch-$i || return 1
+	done &&
+	test_line_count = 11 repo/.git/reftable/tables.list &&
+	test_unconfig -C repo reftable.autoCompaction &&
+	git -C repo update-ref refs/heads/branch-1 HEAD &&
+	test_line_count -lt 11 repo/.git/reftable/tables.list
+'
+
+test_expect_success 'fsck and gc keep the references' '
+	git -C repo for-each-ref >expect &&
+	git -C repo fsck &&
+	git -C repo gc &&
+	git -C repo for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'worktrees have their own HEAD' '
+	git -C repo worktree add -b wt-branch ../wt &&
+	test_path_is_file repo/.git/worktrees/wt/reftable/tables.list &&
+	echo refs/heads/wt-branch >expect &&
+	git -C wt symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	echo refs/heads/main >expect &&
+	git -C repo symbolic-ref HEAD >actual &&
+	test_cmp expect actual &&
+	test_commit -C wt in-worktree &&
+	git -C repo rev-parse wt-branch >expect &&
+	git -C repo rev-parse worktrees/wt/HEAD >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse main >expect &&
+	git -C wt rev-parse main-worktree/HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'per-worktree refs stay in their worktree' '
+	git -C wt update-ref refs/bisect/wt HEAD &&
+	test_must_fail git -C repo rev-parse --verify refs/bisect/wt &&
+	git -C wt for-each-ref --format="%(refname)" refs/bisect/ >actual &&
+	echo refs/bisect/wt >expect &&
+	test_cmp expect actual &&
+	git -C repo for-each-ref refs/bisect/ >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'clone --ref-format' '
+	git clone --ref-format=reftable repo clone &&
+	echo reftable >expect &&
+	git -C clone config extensions.refstorage >actual &&
+	test_cmp expect actual &&
+	git -C repo rev-parse main >expect &&
+	git -C clone rev-parse origin/main >actual &&
+	test_cmp expect actual &&
+	echo refs/remotes/origin/main >expect &&
+	git -C clone symbolic-ref refs/remotes/origin/HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone of a reftable repository into the files format' '
+	git clone --ref-format=files --bare repo files-clone.git &&
+	test_must_fail git -C files-clone.git config extensions.refstorage &&
+	git -C repo for-each-ref --format="%(refname)" refs/heads/ >expect &&
+	git -C files-clone.git for-each-ref --format="%(refname)" refs/heads/ >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'fetch into a reftable repository' '
+	test_commit -C repo after-clone &&
+	git -C clone fetch &&
+	git -C repo rev-parse main >expect &&
+	git -C clone rev-parse origin/main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs skips hidden refs' '
+	for i in $(test_seq 20)
+	do
+		echo "create refs/hidden/$i HEAD" || return 1
+	done >input &&
+	echo "create refs/hiddenx/shown HEAD" >>input &&
+	git -C repo update-ref --stdin <input &&
+	git -C repo config transfer.hiderefs refs/hidden &&
+	test-tool pkt-line pack >in <<-EOF &&
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	ref-prefix refs/hidden
+	0000
+	EOF
+	cat >expect <<-EOF &&
+	$(git -C repo rev-parse HEAD) refs/hiddenx/shown
+	0000
+	EOF
+	test-tool -C repo serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -1034,6 +1034,46 @@ test_expect_success 'cat-file --batch="batman" with --batch-all-objects will wor
 	cmp expect actual
 '
 
+test_expect_success 'cat-file --threads requires a batch mode' '
+	test_incompatible_usage git cat-file --threads=2 -t HEAD
+'
+
+test_expect_success 'cat-file --batch --threads gives the same output' '
+	{
+		cat objects &&
+		echo $ZERO_OID &&
+		echo HEAD:file &&
+		echo does-not-exist &&
+		cat objects
+	} >input &&
+	git -C all-two cat-file --batch --buffer <input >expect &&
+	git -C all-two cat-file --batch --buffer --threads=4 <input >actual &&
+	cmp expect actual &&
+	git -C all-two cat-file --batch-check="%(objectname) %(rest)" \
+		--buffer <input >expect &&
+	git -C all-two cat-file --batch-check="%(objectname) %(rest)" \
+		--buffer --threads=4 <input >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cat-file --batch-all-objects --threads gives the same output' '
+	git -C all-two cat-file --batch-all-objects --batch >expect &&
+	git -C all-two cat-file --batch-all-objects --batch --threads=3 >actual &&
+	cmp expect actual &&
+	git -C all-two cat-file --batch-all-objects --unordered \
+		--batch-check >expect &&
+	git -C all-two cat-file --batch-all-objects --unordered \
+		--batch-check --threads=3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cat-file --threads streams big blobs' '
+	git -C all-two -c core.bigFileThreshold=1 \
+		cat-file --batch --buffer --threads=2 <objects >actual &&
+	git -C all-two cat-file --batch <objects >expect &&
+	cmp expect actual
+'
+
 test_expect_success 'set up replacement object' '
 	orig=$(git rev-parse HEAD) &&
 	git cat-file commit $orig >orig &&
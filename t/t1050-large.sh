@@ -93,6 +93,69 @@ test_expect_success 'checkout a large file' '
 	test_cmp large1 another
 '
 
+test_expect_success 'checkout a deltified large file' '
+	test_create_repo delta &&
+	(
+		cd delta &&
+		for i in 1 2 3
+		do
+			{
+				cat ../large1 &&
+				test_seq $i
+			} >file &&
+			cp file expect$i &&
+			git add file &&
+			git commit -q -m $i || return 1
+		done &&
+		# deltify the large blobs, which needs more memory than
+		# GIT_ALLOC_LIMIT allows
+		GIT_ALLOC_LIMIT=0 git -c core.bigfilethreshold=10m repack -adf &&
+		git rev-parse HEAD~2:file >blob &&
+		git cat-file --batch-check="%(deltabase)" <blob >base &&
+		! grep "^$ZERO_OID$" base &&
+
+		git cat-file blob HEAD~2:file >actual &&
+		test_cmp expect1 actual &&
+		git cat-file blob HEAD~1:file >actual &&
+		test_cmp expect2 actual &&
+		rm file &&
+		git checkout HEAD~2 -- file &&
+		test_cmp expect1 file
+	)
+'
+
+test_expect_success 'checkout a large binary file with core.autocrlf' '
+	{
+		cat large1 &&
+		printf "\000\n"
+	} >binary &&
+	git add binary &&
+	rm binary &&
+	# checkout-index without -u does not write the index, which
+	# would read the blob into core if the entry were racily clean
+	git -c core.autocrlf=true checkout-index binary &&
+	{
+		cat large1 &&
+		printf "\000\n"
+	} >expect &&
+	test_cmp expect binary
+'
+
+test_expect_success 'checkout a large LF-only text file with core.autocrlf' '
+	{
+		cat large1 &&
+		echo
+	} >text &&
+	git add text &&
+	rm text &&
+	git -c core.autocrlf=true checkout-index text &&
+	{
+		cat large1 &&
+		printf "\r\n"
+	} >expect &&
+	test_cmp expect text
+'
+
 test_expect_success 'packsize limit' '
 	test_create_repo mid &&
 	(
@@ -0,0 +1,135 @@
+#!/bin/sh
+
+test_description='small packed-refs updates go to packed-refs.delta'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config core.repositoryformatversion 1 &&
+	git config extensions.packedRefsDelta true &&
+	test_commit one &&
+	test_commit two &&
+	git tag -a -m annotated annotated one &&
+	for i in $(test_seq 100)
+	do
+		echo "create refs/heads/branch-$i HEAD" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git pack-refs --all &&
+	test_path_is_file .git/packed-refs &&
+	test_path_is_missing .git/packed-refs.delta
+'
+
+test_expect_success 'deleting a packed reference writes a delta' '
+	cp .git/packed-refs packed-refs.orig &&
+	git branch -D branch-1 &&
+	test_cmp packed-refs.orig .git/packed-refs &&
+	test_path_is_file .git/packed-refs.delta &&
+	test_must_fail git rev-parse --verify refs/heads/branch-1 &&
+	git for-each-ref --format="%(refname)" refs/heads/branch-1 >actual &&
+	test_must_be_empty actual &&
+	git for-each-ref refs/heads/ >actual &&
+	test_line_count = 100 actual
+'
+
+test_expect_success 'packing references into the delta' '
+	git update-ref refs/heads/branch-1 one &&
+	git update-ref refs/heads/branch-2 one &&
+	git tag -a -m new new-tag two &&
+	git pack-refs --all &&
+	test_cmp packed-refs.orig .git/packed-refs &&
+	git rev-parse one >expect &&
+	git rev-parse refs/heads/branch-1 >actual &&
+	test_cmp expect actual &&
+	git rev-parse refs/heads/branch-2 >actual &&
+	test_cmp expect actual &&
+	cat >expect <<-EOF &&
+	$(git rev-parse new-tag) refs/tags/new-tag
+	$(git rev-parse two) refs/tags/new-tag^{}
+	EOF
+	git show-ref -d new-tag >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'old values are checked against the delta' '
+	test_must_fail git update-ref -d refs/heads/branch-2 $(git rev-parse two) &&
+	git update-ref -d refs/heads/branch-2 $(git rev-parse one) &&
+	test_must_fail git rev-parse --verify refs/heads/branch-2 &&
+	test_cmp packed-refs.orig .git/packed-refs
+'
+
+test_expect_success 'iteration merges the delta into the packed references' '
+	git for-each-ref --format="%(refname)" >actual &&
+	{
+		echo refs/heads/branch-1 &&
+		for i in $(test_seq 3 100)
+		do
+			echo refs/heads/branch-$i || return 1
+		done &&
+		echo refs/heads/main &&
+		echo refs/tags/annotated &&
+		echo refs/tags/new-tag &&
+		echo refs/tags/one &&
+		echo refs/tags/two
+	} | sort >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a large delta is folded into packed-refs' '
+	for i in $(test_seq 3 60)
+	do
+		echo "delete refs/heads/branch-$i" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	test_path_is_missing .git/packed-refs.delta &&
+	! test_cmp packed-refs.orig .git/packed-refs &&
+	test_must_fail git rev-parse --verify refs/heads/branch-3 &&
+	git rev-parse --verify refs/heads/branch-61 &&
+	git rev-parse --verify refs/tags/new-tag
+'
+
+test_expect_success 'no delta without extensions.packedRefsDelta' '
+	test_config extensions.packedRefsDelta false &&
+	cp .git/packed-refs packed-refs.orig &&
+	git branch -D branch-61 &&
+	test_path_is_missing .git/packed-refs.delta &&
+	! test_cmp packed-refs.orig .git/packed-refs
+'
+
+test_expect_success 'a delta written for an older packed-refs is ignored' '
+	git config extensions.packedRefsDelta true &&
+	git branch -D branch-62 &&
+	git update-ref refs/heads/branch-63 one &&
+	git pack-refs --all &&
+	test_path_is_file .git/packed-refs.delta &&
+	cp .git/packed-refs.delta delta.old &&
+
+	# Fold the delta into a new packed-refs file that re-creates
+	# branch-62 and changes branch-63 again, then put the old delta
+	# back, as a reader would see it before the writer removed it.
+	git config extensions.packedRefsDelta false &&
+	git update-ref refs/heads/branch-62 one &&
+	git update-ref refs/heads/branch-63 two &&
+	git pack-refs --all &&
+	test_path_is_missing .git/packed-refs.delta &&
+	cp delta.old .git/packed-refs.delta &&
+	git config extensions.packedRefsDelta true &&
+
+	git rev-parse one two >expect &&
+	git rev-parse refs/heads/branch-62 refs/heads/branch-63 >actual &&
+	test_cmp expect actual &&
+	git for-each-ref --format="%(objectname)" \
+		refs/heads/branch-62 refs/heads/branch-63 >actual &&
+	test_cmp expect actual &&
+
+	# The next delta replaces the stale one without reviving it.
+	git branch -D branch-64 &&
+	test_must_fail git rev-parse --verify refs/heads/branch-64 &&
+	git rev-parse refs/heads/branch-62 refs/heads/branch-63 >actual &&
+	test_cmp expect actual
+'
+
+test_done
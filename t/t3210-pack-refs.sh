@@ -256,4 +256,83 @@ test_expect_success SYMLINKS 'pack symlinked packed-refs' '
 	test "$(test_readlink .git/packed-refs)" = "my-deviant-packed-refs"
 '
 
+test_expect_success 'core.packedRefsIndex writes an offset index' '
+	test_config core.packedRefsIndex true &&
+	for i in $(test_seq 50)
+	do
+		echo "create refs/indexed/ref-$i HEAD" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git tag -a -m annotated indexed-tag HEAD &&
+	git pack-refs --all --prune &&
+	test_path_is_file .git/packed-refs.idx &&
+	git for-each-ref >with-index &&
+	git show-ref -d >show-with-index &&
+	git rev-parse refs/indexed/ref-25 refs/tags/indexed-tag^{} >rev-with-index &&
+	test_must_fail git rev-parse --verify refs/indexed/ref-2a &&
+	mv .git/packed-refs.idx packed-refs.idx.bak &&
+	git for-each-ref >without-index &&
+	git show-ref -d >show-without-index &&
+	git rev-parse refs/indexed/ref-25 refs/tags/indexed-tag^{} >rev-without-index &&
+	mv packed-refs.idx.bak .git/packed-refs.idx &&
+	test_cmp without-index with-index &&
+	test_cmp show-without-index show-with-index &&
+	test_cmp rev-without-index rev-with-index &&
+	git for-each-ref refs/indexed/ref-4 refs/indexed/ref-4* >actual &&
+	test_line_count = 11 actual
+'
+
+test_expect_success 'an index for another packed-refs file is ignored' '
+	cp .git/packed-refs packed-refs.bak &&
+	test_when_finished "cp packed-refs.bak .git/packed-refs" &&
+	grep -v "refs/indexed/ref-1" packed-refs.bak >.git/packed-refs &&
+	test_path_is_file .git/packed-refs.idx &&
+	test_must_fail git rev-parse --verify refs/indexed/ref-1 &&
+	git rev-parse --verify refs/indexed/ref-50 &&
+	git for-each-ref refs/indexed/ >actual &&
+	test_line_count = 39 actual
+'
+
+test_expect_success 'rewriting packed-refs without core.packedRefsIndex drops the index' '
+	git update-ref -d refs/indexed/ref-1 &&
+	test_path_is_missing .git/packed-refs.idx &&
+	test_must_fail git rev-parse --verify refs/indexed/ref-1
+'
+
+
+test_expect_success 'loose references are read the same with core.looseRefThreads' '
+	for i in $(test_seq 30)
+	do
+		echo "create refs/threads/$((i % 4))/deep/ref-$i HEAD" &&
+		echo "create refs/threads/top-$i HEAD" || return 1
+	done >input &&
+	git update-ref --stdin <input &&
+	git symbolic-ref refs/threads/symref refs/threads/top-1 &&
+	git symbolic-ref refs/threads/dangling refs/threads/missing &&
+	echo "not an object name" >.git/refs/threads/broken &&
+	test_when_finished "rm -f .git/refs/threads/broken" &&
+	mkdir .git/refs/threads/empty &&
+	for prefix in refs/threads/2/ refs/threads/top-2 refs/threads/ ""
+	do
+		git for-each-ref --format="%(refname) %(objectname) %(symref)" \
+			$prefix >expect 2>expect.err &&
+		git -c core.looseRefThreads=4 for-each-ref \
+			--format="%(refname) %(objectname) %(symref)" \
+			$prefix >actual 2>actual.err &&
+		test_cmp expect actual &&
+		test_cmp expect.err actual.err || return 1
+	done &&
+	grep "refs/threads/broken" expect.err &&
+	grep "refs/threads/symref" expect
+'
+
+test_expect_success 'pack-refs with core.looseRefThreads' '
+	rm -f .git/refs/threads/broken &&
+	git show-ref -d >expect &&
+	git -c core.looseRefThreads=4 pack-refs --all --prune &&
+	test_path_is_missing .git/refs/threads/3/deep/ref-3 &&
+	git show-ref -d >actual &&
+	test_cmp expect actual
+'
+
 test_done
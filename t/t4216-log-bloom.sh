@@ -121,8 +121,9 @@ test_expect_success 'git log with --walk-reflogs does not use Bloom filters' '
 	test_bloom_filters_not_used "--walk-reflogs -- A"
 '
 
-test_expect_success 'git log -- multiple path specs does not use Bloom filters' '
-	test_bloom_filters_not_used "-- file4 A/file1"
+test_expect_success 'git log -- multiple path specs uses Bloom filters' '
+	test_bloom_filters_used "-- file4 A/file1" &&
+	test_bloom_filters_used "-- A/B/C file_to_be_deleted"
 '
 
 test_expect_success 'git log -- "." pathspec at root does not use Bloom filters' '
@@ -134,9 +135,29 @@ test_expect_success 'git log with wildcard that resolves to a single path uses B
 	test_bloom_filters_used "-- *renamed"
 '
 
-test_expect_success 'git log with wildcard that resolves to a multiple paths does not uses Bloom filters' '
-	test_bloom_filters_not_used "-- *" &&
-	test_bloom_filters_not_used "-- file*"
+test_expect_success 'git log with wildcard that resolves to a multiple paths uses Bloom filters' '
+	test_bloom_filters_used "-- *" &&
+	test_bloom_filters_used "-- file*"
+'
+
+test_expect_success 'git log with wildcard pathspec uses Bloom filters for its leading directories' '
+	test_bloom_filters_used "-- A/B/*3" &&
+	test_bloom_filters_used "-- :(glob)A/**/file*" &&
+	test_bloom_filters_used "-- A/B/C/fil?3 file4"
+'
+
+test_expect_success 'git log with wildcard in the first path component does not use Bloom filters' '
+	test_bloom_filters_not_used "-- :(glob)*/file1" &&
+	test_bloom_filters_not_used "-- file4 :(glob)fi*5"
+'
+
+test_expect_success 'git log with excluded pathspec items' '
+	test_bloom_filters_used "-- A :(exclude)A/B" &&
+	test_bloom_filters_not_used "-- :(exclude)A/B"
+'
+
+test_expect_success 'git log with case-insensitive pathspec does not use Bloom filters' '
+	test_bloom_filters_not_used "-- :(icase)a/file1"
 '
 
 test_expect_success 'setup - add commit-graph to the chain without Bloom filters' '
@@ -404,4 +425,71 @@ test_expect_success 'Bloom generation backfills empty commits' '
 	)
 '
 
+test_expect_success 'Bloom filters do not depend on commitGraph.threads' '
+	git init threads &&
+	test_when_finished "rm -fr threads" &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p d$i/e &&
+			test_seq $i >d$i/e/file &&
+			git add d$i &&
+			git commit -m "$i" || return 1
+		done &&
+		git update-index --add --cacheinfo 160000,$(git rev-parse HEAD),sub &&
+		git commit -m "gitlink" &&
+		for i in $(test_seq 1 20)
+		do
+			test_seq 0 $i >d$i/e/file || return 1
+		done &&
+		git commit -a -m "many changes" &&
+
+		graph=.git/objects/info/commit-graph &&
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=10 \
+			git -c commitGraph.threads=1 commit-graph write \
+			--reachable --changed-paths &&
+		mv $graph expect &&
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=10 \
+			GIT_TRACE2_EVENT="$(pwd)/trace" \
+			git -c commitGraph.threads=4 commit-graph write \
+			--reachable --changed-paths &&
+		test_filter_computed 22 trace &&
+		test_filter_trunc_large 1 trace &&
+		test_cmp_bin expect $graph &&
+
+		rm -f $graph &&
+		GIT_TRACE2_EVENT="$(pwd)/trace-max" \
+			git -c commitGraph.threads=4 commit-graph write \
+			--reachable --changed-paths --max-new-filters=5 &&
+		test_filter_computed 5 trace-max &&
+		test_filter_not_computed 17 trace-max
+	)
+'
+
+test_expect_success 'blame uses Bloom filters for the path before a rename' '
+	git init blame-rename &&
+	(
+		cd blame-rename &&
+		test_write_lines 1 2 3 >old &&
+		git add old &&
+		git commit -m one &&
+		test_commit unrelated-1 other &&
+		test_write_lines 1 2 3 4 >old &&
+		git commit -a -m two &&
+		git mv old new &&
+		git commit -m rename &&
+		test_commit unrelated-2 other &&
+		test_write_lines 1 2 3 4 5 >new &&
+		git commit -a -m three &&
+		test_commit unrelated-3 other &&
+		git commit-graph write --reachable --changed-paths &&
+
+		git -c core.commitGraph=false blame new >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/trace" git blame new >actual &&
+		test_cmp expect actual &&
+		grep "\"key\":\"bloom/response-no\",\"value\":\"3\"" trace
+	)
+'
+
 test_done
@@ -125,6 +125,34 @@ test_expect_success 'prune: do not prune heads listed as an argument' '
 	git reset $tmp_head --
 '
 
+test_expect_success 'prune --threads prunes the same objects' '
+	mkdir -p dir/sub &&
+	echo reachable >dir/sub/file &&
+	git add dir &&
+	git commit -m reachable &&
+	git tag -a -m tag reachable-tag &&
+	echo unreachable | git hash-object -w --stdin >expect &&
+	git prune -n >serial &&
+	cut -d" " -f1 serial >actual &&
+	test_cmp expect actual &&
+	git prune -n --threads=4 >threaded &&
+	test_cmp serial threaded &&
+	git prune -n --threads=0 >threaded &&
+	test_cmp serial threaded &&
+	test_must_fail git prune --threads=-1 &&
+	git prune --threads=4 &&
+	git prune -n >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'gc passes gc.pruneThreads to prune' '
+	GIT_TRACE2_EVENT="$(pwd)/trace" git -c gc.pruneThreads=4 gc &&
+	grep "\"prune\",.*\"--threads=4\"" trace &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git gc &&
+	! grep "\"--threads=" trace
+'
+
 test_expect_success 'gc --no-prune' '
 	add_blob &&
 	test-tool chmtime =-$((5001*$day)) $BLOB_FILE &&
@@ -127,7 +127,7 @@ test_expect_success 'git upload-pack --advertise-refs: v2' '
 	cat >expect <<-EOF &&
 	version 2
 	agent=FAKE
-	ls-refs=unborn
+	ls-refs=unborn page
 	fetch=shallow wait-for-done
 	server-option
 	object-format=$(test_oid algo)
@@ -16,7 +16,7 @@ test_expect_success 'test capability advertisement' '
 	cat >expect <<-EOF &&
 	version 2
 	agent=git/$(git version | cut -d" " -f3)
-	ls-refs=unborn
+	ls-refs=unborn page
 	fetch=shallow wait-for-done
 	server-option
 	object-format=$(test_oid algo)
@@ -317,6 +317,185 @@ test_expect_success 'unexpected lines are not allowed in fetch request' '
 	grep "unexpected line: .this-is-not-a-command." err
 '
 
+test_expect_success 'ls-refs with page-size sends a cursor' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	page-size 3
+	0000
+	EOF
+
+	cat >expect <<-EOF &&
+	$(git rev-parse HEAD) HEAD
+	$(git rev-parse refs/heads/dev) refs/heads/dev
+	$(git rev-parse refs/heads/main) refs/heads/main
+	next-cursor refs/heads/main
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs pages through all refs' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	symrefs
+	0000
+	EOF
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >expect &&
+
+	cursor= &&
+	>actual &&
+	while :
+	do
+		{
+			echo command=ls-refs &&
+			echo object-format=$(test_oid algo) &&
+			echo 0001 &&
+			echo symrefs &&
+			echo page-size 2 &&
+			if test -n "$cursor"
+			then
+				echo "cursor $cursor"
+			fi &&
+			echo 0000
+		} | test-tool pkt-line pack >in &&
+		test-tool serve-v2 --stateless-rpc <in >out &&
+		test-tool pkt-line unpack <out >page &&
+		grep -v -e "^next-cursor " -e "^0000$" page >>actual &&
+		cursor=$(sed -n "s/^next-cursor //p" page) &&
+		if test -z "$cursor"
+		then
+			break
+		fi || return 1
+	done &&
+	echo 0000 >>actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs cursor with ref-prefix' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	ref-prefix HEAD
+	ref-prefix refs/heads/
+	ref-prefix refs/tags/
+	cursor refs/heads/release
+	0000
+	EOF
+
+	cat >expect <<-EOF &&
+	$(git rev-parse refs/tags/annotated-tag) refs/tags/annotated-tag
+	$(git rev-parse refs/tags/one) refs/tags/one
+	$(git rev-parse refs/tags/two) refs/tags/two
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual &&
+
+	test-tool pkt-line pack >in <<-EOF &&
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	ref-prefix refs/heads/
+	cursor refs/tags/one
+	0000
+	EOF
+
+	echo 0000 >expect &&
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs rejects an invalid page-size' '
+	test-tool pkt-line pack >in <<-EOF &&
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	page-size 0
+	0000
+	EOF
+
+	test_must_fail test-tool serve-v2 --stateless-rpc 2>err <in &&
+	grep "invalid page-size" err
+'
+
+test_expect_success 'setup hidden refs' '
+	for i in $(test_seq 50)
+	do
+		echo "create refs/hidden/$i HEAD" || return 1
+	done >input &&
+	echo "create refs/hidden/keep HEAD" >>input &&
+	echo "create refs/hiddenx/shown HEAD" >>input &&
+	echo "create refs/namespaces/ns/refs/heads/visible HEAD" >>input &&
+	echo "create refs/namespaces/ns/refs/hidden/secret HEAD" >>input &&
+	git update-ref --stdin <input &&
+	git pack-refs --all &&
+	git update-ref refs/hidden/loose HEAD &&
+
+	test-tool pkt-line pack >in <<-EOF
+	command=ls-refs
+	object-format=$(test_oid algo)
+	0001
+	ref-prefix refs/h
+	0000
+	EOF
+'
+
+test_expect_success 'ls-refs skips hidden refs' '
+	test_config transfer.hiderefs refs/hidden &&
+	cat >expect <<-EOF &&
+	$(git rev-parse refs/heads/dev) refs/heads/dev
+	$(git rev-parse refs/heads/main) refs/heads/main
+	$(git rev-parse refs/heads/release) refs/heads/release
+	$(git rev-parse refs/hiddenx/shown) refs/hiddenx/shown
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs shows refs that hideRefs un-hides again' '
+	test_config transfer.hiderefs refs/hidden &&
+	git config --add transfer.hiderefs "!refs/hidden/keep" &&
+	cat >expect <<-EOF &&
+	$(git rev-parse refs/heads/dev) refs/heads/dev
+	$(git rev-parse refs/heads/main) refs/heads/main
+	$(git rev-parse refs/heads/release) refs/heads/release
+	$(git rev-parse refs/hidden/keep) refs/hidden/keep
+	$(git rev-parse refs/hiddenx/shown) refs/hiddenx/shown
+	0000
+	EOF
+
+	test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-refs skips hidden refs in a namespace' '
+	test_config uploadpack.hiderefs refs/hidden &&
+	cat >expect <<-EOF &&
+	$(git rev-parse refs/namespaces/ns/refs/heads/visible) refs/heads/visible
+	0000
+	EOF
+
+	GIT_NAMESPACE=ns test-tool serve-v2 --stateless-rpc <in >out &&
+	test-tool pkt-line unpack <out >actual &&
+	test_cmp expect actual
+'
+
 # Test the basics of object-info
 #
 test_expect_success 'basics of object-info' '
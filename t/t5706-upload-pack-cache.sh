@@ -0,0 +1,146 @@
+#!/bin/sh
+
+test_description='upload-pack pack cache'
+
+. ./test-lib.sh
+
+cache_dir=src/.git/upload-pack-cache
+
+test_expect_success 'setup' '
+	git init src &&
+	test_commit -C src one &&
+	test_commit -C src two &&
+	test_commit -C src --no-tag three &&
+	git -C src tag -a -m "annotated" three &&
+	git -C src config uploadpack.packCacheSize 10m &&
+	git -C src config uploadpack.allowFilter true
+'
+
+pack_cache_event () {
+	grep "\"key\":\"pack-cache\",\"value\":\"$1\"" "$2"
+}
+
+test_expect_success 'first clone stores its pack' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone "file://$(pwd)/src" dst1 &&
+	pack_cache_event stored trace &&
+	! pack_cache_event hit trace &&
+	ls $cache_dir/*.pack >packs &&
+	test_line_count = 1 packs
+'
+
+test_expect_success 'identical clone is served from the cache' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone "file://$(pwd)/src" dst2 &&
+	pack_cache_event hit trace &&
+	! pack_cache_event stored trace &&
+	git -C dst2 fsck &&
+	git -C dst1 for-each-ref >expect &&
+	git -C dst2 for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'protocol v0 uses the same cache' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c protocol.version=0 clone "file://$(pwd)/src" dst-v0 &&
+	pack_cache_event hit trace &&
+	git -C dst-v0 fsck
+'
+
+test_expect_success 'different requests get different packs' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --filter=blob:none \
+		"file://$(pwd)/src" dst-filter &&
+	pack_cache_event stored trace &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --single-branch \
+		--branch one "file://$(pwd)/src" dst-one &&
+	pack_cache_event stored trace &&
+	test_must_fail git -C dst-one rev-parse --verify two
+'
+
+test_expect_success 'new tags change the key when tags are included' '
+	git -C src tag -a -m "new tag" new-tag two &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --single-branch \
+		--branch one "file://$(pwd)/src" dst-one-2 &&
+	pack_cache_event stored trace &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --single-branch \
+		--branch one "file://$(pwd)/src" dst-one-3 &&
+	pack_cache_event hit trace
+'
+
+test_expect_success 'shallow clones are not cached' '
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --depth=1 \
+		"file://$(pwd)/src" dst-shallow &&
+	! grep "\"key\":\"pack-cache\"" trace
+'
+
+test_expect_success 'corrupt cache entries are discarded' '
+	rm -rf $cache_dir dst1 dst2 &&
+	git clone "file://$(pwd)/src" dst1 &&
+	pack=$(ls $cache_dir/*.pack) &&
+	echo garbage >"$pack" &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone "file://$(pwd)/src" dst2 &&
+	pack_cache_event stored trace &&
+	git -C dst2 fsck &&
+	test_path_is_file "$pack"
+'
+
+test_expect_success 'a stale lock does not keep the pack from being saved' '
+	rm -rf $cache_dir dst1 dst2 &&
+	git clone "file://$(pwd)/src" dst1 &&
+	pack=$(ls $cache_dir/*.pack) &&
+	mv "$pack" "$pack.lock" &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone "file://$(pwd)/src" dst2 &&
+	! pack_cache_event stored trace &&
+	test_path_is_missing "$pack" &&
+	test-tool chmtime =-7200 "$pack.lock" &&
+	rm -rf dst2 trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone "file://$(pwd)/src" dst2 &&
+	pack_cache_event stored trace &&
+	test_path_is_file "$pack" &&
+	test_path_is_missing "$pack.lock"
+'
+
+test_expect_success 'eviction removes stale locks' '
+	rm -rf $cache_dir dst1 dst2 &&
+	mkdir -p $cache_dir &&
+	echo stale >$cache_dir/stale.pack.lock &&
+	test-tool chmtime =-7200 $cache_dir/stale.pack.lock &&
+	echo live >$cache_dir/live.pack.lock &&
+	git clone "file://$(pwd)/src" dst1 &&
+	test_path_is_missing $cache_dir/stale.pack.lock &&
+	test_path_is_file $cache_dir/live.pack.lock
+'
+
+test_expect_success 'packs larger than the cache are not stored' '
+	rm -rf $cache_dir dst1 &&
+	git -C src config uploadpack.packCacheSize 10 &&
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone "file://$(pwd)/src" dst1 &&
+	! grep "\"key\":\"pack-cache\"" trace &&
+	test_path_is_missing $cache_dir/*.pack
+'
+
+test_expect_success 'least recently used packs are evicted' '
+	rm -rf $cache_dir dst1 dst-one &&
+	git -C src config uploadpack.packCacheSize 10m &&
+	git clone "file://$(pwd)/src" dst1 &&
+	old=$(ls $cache_dir/*.pack) &&
+	test-tool chmtime =-100 "$old" &&
+	size=$(test-tool path-utils file-size "$old") &&
+	git -C src config uploadpack.packCacheSize $((size - 1)) &&
+	git clone --single-branch --branch one --no-tags \
+		"file://$(pwd)/src" dst-one &&
+	test_path_is_missing "$old" &&
+	ls $cache_dir/*.pack >packs &&
+	test_line_count = 1 packs
+'
+
+test_done
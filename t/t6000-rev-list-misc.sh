@@ -169,4 +169,26 @@ test_expect_success 'rev-list --count --objects' '
 	test_line_count = $count actual
 '
 
+test_expect_success 'rev-list --objects --threads lists the same objects' '
+	git rev-list --objects --all >serial &&
+	git rev-list --objects --all --threads=4 >threaded &&
+	cut -d" " -f1 serial | sort >expect &&
+	cut -d" " -f1 threaded | sort >actual &&
+	test_cmp expect actual &&
+
+	roots=$(git rev-list --all --max-parents=0) &&
+	git rev-list --objects --no-object-names --all --not $roots >serial &&
+	git rev-list --objects --no-object-names --threads=4 \
+		--all --not $roots >threaded &&
+	sort serial >expect &&
+	sort threaded >actual &&
+	test_cmp expect actual &&
+
+	git rev-list --objects --verify-objects --all >serial &&
+	git rev-list --objects --verify-objects --threads=4 --all >threaded &&
+	test_cmp serial threaded &&
+
+	test_must_fail git rev-list --objects --threads=-1 HEAD
+'
+
 test_done
@@ -764,4 +764,167 @@ test_expect_success 'avoid assuming we detected renames' '
 	)
 '
 
+
+#
+# In the following testcase:
+#   Base:     numbers_1, values_1
+#   Upstream: numbers_2, values_2
+#   Topic_1:  sequence_3, values_1
+# or, in english, the same rename as in the first test above, but with
+# merge.renameCache the renames found when rebasing topic the first time
+# are saved on disk, and rebasing the same commits again (in a new process)
+# should not need to detect any renames.
+#
+test_expect_success 'merge.renameCache reuses renames across processes' '
+	git init rename-cache-on-disk &&
+	(
+		cd rename-cache-on-disk &&
+
+		test_seq 2 10 >numbers &&
+		test_seq 2 10 >values &&
+		git add numbers values &&
+		git commit -m orig &&
+
+		git branch upstream &&
+		git branch topic &&
+
+		git switch upstream &&
+		test_seq 1 10 >numbers &&
+		test_seq 1 10 >values &&
+		git add numbers values &&
+		git commit -m "Tweaked both files" &&
+
+		git switch topic &&
+
+		test_seq 2 12 >numbers &&
+		git add numbers &&
+		git mv numbers sequence &&
+		git commit -m A &&
+
+		#
+		# Actual testing
+		#
+
+		git switch --detach topic &&
+		GIT_TRACE2_PERF="$(pwd)/trace.output" &&
+		export GIT_TRACE2_PERF &&
+		git -c merge.renameCache=true rebase upstream &&
+		grep region_enter.*diffcore_rename trace.output >calls &&
+		test_line_count = 1 calls &&
+		ls .git/merge-renames >cache-files &&
+		test_line_count = 1 cache-files &&
+		git rev-parse HEAD^{tree} >expect &&
+
+		git switch --detach topic &&
+		rm trace.output &&
+		git -c merge.renameCache=true rebase upstream &&
+		! grep region_enter.*diffcore_rename trace.output &&
+		git rev-parse HEAD^{tree} >actual &&
+		test_cmp expect actual &&
+
+		test_seq 1 12 >expect &&
+		test_cmp expect sequence
+	)
+'
+
+test_expect_success 'git gc expires unused merge.renameCache entries' '
+	(
+		cd rename-cache-on-disk &&
+
+		git switch --detach topic &&
+		git -c merge.renameCache=true rebase upstream &&
+		ls .git/merge-renames >cache-files &&
+		test_line_count = 1 cache-files &&
+		entry=.git/merge-renames/$(cat cache-files) &&
+
+		git gc &&
+		test_path_is_file $entry &&
+
+		test-tool chmtime =-1209700 $entry &&
+		git -c gc.mergeRenamesExpire=never gc &&
+		test_path_is_file $entry &&
+
+		git gc &&
+		test_path_is_missing .git/merge-renames
+	)
+'
+
+test_expect_success 'reusing a merge.renameCache entry keeps it from expiring' '
+	(
+		cd rename-cache-on-disk &&
+
+		git switch --detach topic &&
+		git -c merge.renameCache=true rebase upstream &&
+		entry=.git/merge-renames/$(ls .git/merge-renames) &&
+		test-tool chmtime =-1209700 $entry &&
+
+		git switch --detach topic &&
+		git -c merge.renameCache=true rebase upstream &&
+		git gc &&
+		test_path_is_file $entry
+	)
+'
+
+#
+# In the following testcase:
+#   Base:     olddir/{a_1,b,c}
+#   Upstream: newdir/{a_2,b,c}
+#   Topic_1:  olddir/{a_3,b,c,d}
+# or, in english, upstream renames olddir/ -> newdir/ and topic adds a new
+# file to olddir/.  When the upstream renames come from the on-disk cache
+# rather than from diffcore_rename_extended(), the directory rename still
+# has to be noticed so that d ends up in newdir/.
+#
+test_expect_success 'merge.renameCache still detects directory renames' '
+	git init rename-cache-dir-rename &&
+	(
+		cd rename-cache-dir-rename &&
+
+		mkdir olddir &&
+		test_seq 2 10 >olddir/a &&
+		echo b >olddir/b &&
+		echo c >olddir/c &&
+		git add olddir &&
+		git commit -m orig &&
+
+		git branch upstream &&
+		git branch topic &&
+
+		git switch upstream &&
+		test_seq 1 10 >olddir/a &&
+		git add olddir/a &&
+		git mv olddir newdir &&
+		git commit -m "Rename olddir/ to newdir/" &&
+
+		git switch topic &&
+
+		test_seq 2 12 >olddir/a &&
+		echo d >olddir/d &&
+		git add olddir &&
+		git commit -m A &&
+
+		#
+		# Actual testing
+		#
+
+		git switch --detach topic &&
+		git -c merge.renameCache=true -c merge.directoryRenames=true \
+			rebase upstream &&
+		git ls-files >expect &&
+
+		git switch --detach topic &&
+		GIT_TRACE2_PERF="$(pwd)/trace.output" &&
+		export GIT_TRACE2_PERF &&
+		git -c merge.renameCache=true -c merge.directoryRenames=true \
+			rebase upstream &&
+		! grep region_enter.*diffcore_rename trace.output &&
+		git ls-files >actual &&
+		test_cmp expect actual &&
+		grep newdir/d actual &&
+
+		test_seq 1 12 >expect &&
+		test_cmp expect newdir/a
+	)
+'
+
 test_done
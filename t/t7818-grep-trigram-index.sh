@@ -0,0 +1,102 @@
+#!/bin/sh
+
+test_description='git grep with a trigram index'
+
+TEST_PASSES_SANITIZE_LEAK=true
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	echo "hello world" >hello &&
+	echo "goodbye world" >goodbye &&
+	mkdir dir &&
+	echo "Hello again" >dir/again &&
+	printf "no newline" >dir/partial &&
+	git add . &&
+	git commit -m initial &&
+	git grep --write-trigram-index &&
+	test_path_is_file .git/objects/info/trigram-index
+'
+
+for opts in \
+	"hello" \
+	"-F world" \
+	"-e hello -e again" \
+	"-w world" \
+	"-i hello" \
+	"-v hello" \
+	"-L hello" \
+	"-c o" \
+	"wor.d" \
+	"-e hello --and -e world" \
+	"newline" \
+	"nothing-to-see"
+do
+	test_expect_success "grep $opts gives the same result with the index" '
+		test_might_fail git -c grep.useTrigramIndex=false \
+			grep --cached $opts >expect &&
+		test_might_fail git grep --cached $opts >actual &&
+		test_cmp expect actual &&
+		test_might_fail git -c grep.useTrigramIndex=false \
+			grep $opts HEAD >expect &&
+		test_might_fail git grep $opts HEAD >actual &&
+		test_cmp expect actual
+	'
+done
+
+test_expect_success 'blobs that cannot match are not read' '
+	blob=$(git rev-parse HEAD:goodbye) &&
+	file=.git/objects/$(test_oid_to_path $blob) &&
+	test_when_finished "mv goodbye.obj $file" &&
+	mv $file goodbye.obj &&
+	git grep --cached hello >actual 2>err &&
+	cat >expect <<-\EOF &&
+	hello:hello world
+	EOF
+	test_cmp expect actual &&
+	test_must_be_empty err &&
+	git -c grep.useTrigramIndex=false grep --cached hello 2>err &&
+	test_i18ngrep "unable to read $blob" err
+'
+
+test_expect_success 'rewriting the index reuses existing filters' '
+	blob=$(git rev-parse HEAD:goodbye) &&
+	file=.git/objects/$(test_oid_to_path $blob) &&
+	test_when_finished "mv goodbye.obj $file" &&
+	mv $file goodbye.obj &&
+	echo "hello there" >new &&
+	git add new &&
+	git grep --write-trigram-index &&
+	git grep --cached hello >actual 2>err &&
+	cat >expect <<-\EOF &&
+	hello:hello world
+	new:hello there
+	EOF
+	test_cmp expect actual &&
+	test_must_be_empty err
+'
+
+test_expect_success 'work tree files are always searched' '
+	test_when_finished "git checkout goodbye" &&
+	echo "hello from the work tree" >goodbye &&
+	git grep hello >actual &&
+	grep "^goodbye:hello from the work tree" actual
+'
+
+test_expect_success 'index covers blobs of given trees' '
+	git commit -m second &&
+	git rm -q hello &&
+	git grep --write-trigram-index HEAD &&
+	git -c grep.useTrigramIndex=false grep hello HEAD~1 >expect &&
+	git grep hello HEAD~1 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt index is ignored' '
+	rm -f .git/objects/info/trigram-index &&
+	echo garbage >.git/objects/info/trigram-index &&
+	git grep --cached hello >actual 2>err &&
+	grep "^new:hello there" actual &&
+	test_i18ngrep "trigram-index" err
+'
+
+test_done
@@ -365,6 +365,53 @@ test_expect_success 'maintenance.incremental-repack.auto (when config is unset)'
 	)
 '
 
+test_expect_success 'geometric-repack task' '
+	rm -rf geometric-repack &&
+	git init geometric-repack &&
+	(
+		cd geometric-repack &&
+		test_commit_bulk --id=base 10 &&
+		git repack -ad --write-midx --write-bitmap-index &&
+		midx_bitmap=$(ls .git/objects/pack/multi-pack-index-*.bitmap) &&
+
+		# Simulate two pushes, each leaving behind a pack that is
+		# not covered by the multi-pack-index or its bitmap.
+		for i in 1 2
+		do
+			test_commit push-$i &&
+			git pack-objects --revs .git/objects/pack/pack <<-\EOF || return 1
+			HEAD
+			^HEAD~1
+			EOF
+		done &&
+		git prune-packed &&
+
+		# not enabled by default, even when its condition is met
+		GIT_TRACE2_EVENT="$(pwd)/trace-default" git \
+			-c maintenance.geometric-repack.auto=-1 \
+			maintenance run --auto 2>/dev/null &&
+		test_subcommand ! git repack -d -l --write-midx \
+			--write-bitmap-index --geometric=2 --quiet <trace-default &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace-skip" git \
+			-c maintenance.geometric-repack.auto=3 \
+			maintenance run --auto --task=geometric-repack 2>/dev/null &&
+		test_subcommand ! git repack -d -l --write-midx \
+			--write-bitmap-index --geometric=2 --quiet <trace-skip &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace-run" git \
+			-c maintenance.geometric-repack.auto=2 \
+			maintenance run --auto --task=geometric-repack 2>/dev/null &&
+		test_subcommand git repack -d -l --write-midx \
+			--write-bitmap-index --geometric=2 --quiet <trace-run &&
+
+		test_path_is_missing $midx_bitmap &&
+		ls .git/objects/pack/multi-pack-index-*.bitmap >bitmaps &&
+		test_line_count = 1 bitmaps &&
+		git rev-list --test-bitmap HEAD
+	)
+'
+
 test_expect_success 'pack-refs task' '
 	for n in $(test_seq 1 5)
 	do
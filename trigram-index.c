@@ -0,0 +1,501 @@
+#include "cache.h"
+#include "trigram-index.h"
+#include "bloom.h"
+#include "chunk-format.h"
+#include "csum-file.h"
+#include "hash-lookup.h"
+#include "lockfile.h"
+#include "object-store.h"
+#include "oid-array.h"
+#include "progress.h"
+#include "repository.h"
+
+#define TRIGRAM_INDEX_SIGNATURE 0x54524749 /* "TRGI" */
+#define TRIGRAM_INDEX_VERSION 1
+#define TRIGRAM_INDEX_HEADER_SIZE 8
+
+#define TRIGRAM_CHUNKID_OIDFANOUT 0x4f494446 /* "OIDF" */
+#define TRIGRAM_CHUNKID_OIDLOOKUP 0x4f49444c /* "OIDL" */
+#define TRIGRAM_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
+#define TRIGRAM_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
+
+#define TRIGRAM_FANOUT_SIZE (4 * 256)
+#define TRIGRAM_BLOOMDATA_HEADER_SIZE (3 * sizeof(uint32_t))
+
+/*
+ * Blobs with more distinct trigrams than this get a filter that
+ * matches everything; they contain so many trigrams that a precise
+ * filter would rarely rule them out.
+ */
+#define TRIGRAM_MAX_PER_BLOB (1 << 17)
+
+#define TRIGRAM_SPACE (1 << 24)
+
+static const struct bloom_filter_settings trigram_bloom_settings = {
+	.hash_version = 1,
+	.num_hashes = 7,
+	.bits_per_entry = 10,
+};
+
+struct trigram_literal {
+	struct bloom_key *keys;
+	size_t nr;
+};
+
+struct trigram_index {
+	const unsigned char *data;
+	size_t data_len;
+
+	uint32_t num_blobs;
+	const unsigned char *chunk_oid_fanout;
+	const unsigned char *chunk_oid_lookup;
+	const unsigned char *chunk_bloom_indexes;
+	const unsigned char *chunk_bloom_data;
+	size_t bloom_data_len;
+	struct bloom_filter_settings settings;
+
+	struct trigram_literal *literals;
+	size_t literals_nr, literals_alloc;
+	unsigned match_all:1;
+};
+
+static char *get_trigram_index_filename(struct repository *r)
+{
+	return xstrfmt("%s/info/trigram-index", r->objects->odb->path);
+}
+
+static int trigram_read_chunk_size(const unsigned char *chunk_start UNUSED,
+				   size_t chunk_size, void *data)
+{
+	*(size_t *)data = chunk_size;
+	return 0;
+}
+
+static int parse_trigram_index(struct trigram_index *ti)
+{
+	const unsigned char *data = ti->data;
+	const unsigned hashsz = the_hash_algo->rawsz;
+	struct chunkfile *cf;
+	size_t oid_lookup_size = 0, bloom_indexes_size = 0;
+	int num_chunks, ret = -1;
+
+	if (ti->data_len < TRIGRAM_INDEX_HEADER_SIZE + hashsz)
+		return error(_("trigram-index file is too small"));
+	if (get_be32(data) != TRIGRAM_INDEX_SIGNATURE)
+		return error(_("trigram-index signature %X does not match signature %X"),
+			     get_be32(data), TRIGRAM_INDEX_SIGNATURE);
+	if (data[4] != TRIGRAM_INDEX_VERSION)
+		return error(_("trigram-index version %X does not match version %X"),
+			     data[4], TRIGRAM_INDEX_VERSION);
+	if (data[5] != oid_version(the_hash_algo))
+		return error(_("trigram-index hash version %X does not match version %X"),
+			     data[5], oid_version(the_hash_algo));
+	num_chunks = data[6];
+
+	cf = init_chunkfile(NULL);
+	if (read_table_of_contents(cf, data, ti->data_len,
+				   TRIGRAM_INDEX_HEADER_SIZE, num_chunks))
+		goto cleanup;
+
+	pair_chunk(cf, TRIGRAM_CHUNKID_OIDFANOUT, &ti->chunk_oid_fanout);
+	pair_chunk(cf, TRIGRAM_CHUNKID_OIDLOOKUP, &ti->chunk_oid_lookup);
+	pair_chunk(cf, TRIGRAM_CHUNKID_BLOOMINDEXES, &ti->chunk_bloom_indexes);
+	pair_chunk(cf, TRIGRAM_CHUNKID_BLOOMDATA, &ti->chunk_bloom_data);
+	read_chunk(cf, TRIGRAM_CHUNKID_OIDLOOKUP,
+		   trigram_read_chunk_size, &oid_lookup_size);
+	read_chunk(cf, TRIGRAM_CHUNKID_BLOOMINDEXES,
+		   trigram_read_chunk_size, &bloom_indexes_size);
+	read_chunk(cf, TRIGRAM_CHUNKID_BLOOMDATA,
+		   trigram_read_chunk_size, &ti->bloom_data_len);
+
+	if (!ti->chunk_oid_fanout || !ti->chunk_oid_lookup ||
+	    !ti->chunk_bloom_indexes || !ti->chunk_bloom_data) {
+		error(_("trigram-index is missing a required chunk"));
+		goto cleanup;
+	}
+
+	ti->num_blobs = get_be32(ti->chunk_oid_fanout + 4 * 255);
+	if (oid_lookup_size != st_mult(ti->num_blobs, hashsz) ||
+	    bloom_indexes_size != st_mult(ti->num_blobs, sizeof(uint64_t)) ||
+	    ti->bloom_data_len < TRIGRAM_BLOOMDATA_HEADER_SIZE) {
+		error(_("trigram-index chunks have unexpected sizes"));
+		goto cleanup;
+	}
+
+	ti->settings.hash_version = get_be32(ti->chunk_bloom_data);
+	ti->settings.num_hashes = get_be32(ti->chunk_bloom_data + 4);
+	ti->settings.bits_per_entry = get_be32(ti->chunk_bloom_data + 8);
+	if (ti->settings.hash_version != 1) {
+		error(_("trigram-index uses unknown Bloom filter version %u"),
+		      ti->settings.hash_version);
+		goto cleanup;
+	}
+
+	ret = 0;
+cleanup:
+	free_chunkfile(cf);
+	return ret;
+}
+
+struct trigram_index *load_trigram_index(struct repository *r)
+{
+	struct trigram_index *ti;
+	char *filename = get_trigram_index_filename(r);
+	struct stat st;
+	int fd;
+
+	fd = git_open(filename);
+	free(filename);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	CALLOC_ARRAY(ti, 1);
+	ti->data_len = xsize_t(st.st_size);
+	ti->data = xmmap(NULL, ti->data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (parse_trigram_index(ti)) {
+		free_trigram_index(ti);
+		return NULL;
+	}
+	return ti;
+}
+
+void free_trigram_index(struct trigram_index *ti)
+{
+	size_t i, j;
+
+	if (!ti)
+		return;
+	for (i = 0; i < ti->literals_nr; i++) {
+		for (j = 0; j < ti->literals[i].nr; j++)
+			clear_bloom_key(&ti->literals[i].keys[j]);
+		free(ti->literals[i].keys);
+	}
+	free(ti->literals);
+	if (ti->data)
+		munmap((void *)ti->data, ti->data_len);
+	free(ti);
+}
+
+static int trigram_index_lookup(struct trigram_index *ti,
+				const struct object_id *oid,
+				struct bloom_filter *filter)
+{
+	uint32_t pos;
+	uint64_t start, end;
+
+	if (!bsearch_hash(oid->hash, (const uint32_t *)ti->chunk_oid_fanout,
+			  ti->chunk_oid_lookup, the_hash_algo->rawsz, &pos))
+		return 0;
+
+	end = get_be64(ti->chunk_bloom_indexes + 8 * pos);
+	start = pos ? get_be64(ti->chunk_bloom_indexes + 8 * (pos - 1)) : 0;
+	if (start > end ||
+	    end > ti->bloom_data_len - TRIGRAM_BLOOMDATA_HEADER_SIZE)
+		return 0;
+
+	filter->data = (unsigned char *)ti->chunk_bloom_data +
+		       TRIGRAM_BLOOMDATA_HEADER_SIZE + start;
+	filter->len = end - start;
+	return 1;
+}
+
+void trigram_index_add_literal(struct trigram_index *ti,
+			       const char *literal, size_t len)
+{
+	struct trigram_literal *l;
+	size_t i;
+
+	/* A literal without trigrams may be in any blob. */
+	if (len < 3) {
+		ti->match_all = 1;
+		return;
+	}
+
+	ALLOC_GROW(ti->literals, ti->literals_nr + 1, ti->literals_alloc);
+	l = &ti->literals[ti->literals_nr++];
+	l->nr = len - 2;
+	CALLOC_ARRAY(l->keys, l->nr);
+	for (i = 0; i < l->nr; i++)
+		fill_bloom_key(literal + i, 3, &l->keys[i], &ti->settings);
+}
+
+int trigram_index_may_match(struct trigram_index *ti,
+			    const struct object_id *oid)
+{
+	struct bloom_filter filter;
+	size_t i, j;
+
+	if (ti->match_all || !ti->literals_nr)
+		return 1;
+	if (!trigram_index_lookup(ti, oid, &filter))
+		return 1;
+
+	for (i = 0; i < ti->literals_nr; i++) {
+		struct trigram_literal *l = &ti->literals[i];
+
+		for (j = 0; j < l->nr; j++)
+			if (!bloom_filter_contains(&filter, &l->keys[j],
+						   &ti->settings))
+				break;
+		if (j == l->nr)
+			return 1;
+	}
+	return 0;
+}
+
+struct trigram_entry {
+	struct object_id oid;
+	struct bloom_filter filter;
+	unsigned owned:1;
+};
+
+struct write_trigram_context {
+	struct trigram_entry *entries;
+	size_t nr, alloc;
+	uint64_t total_filter_size;
+
+	/* scratch space for compute_trigram_filter() */
+	unsigned char *seen;
+	uint32_t *trigrams;
+	size_t trigrams_alloc;
+};
+
+static void compute_trigram_filter(struct write_trigram_context *ctx,
+				   const unsigned char *buf, unsigned long size,
+				   struct bloom_filter *filter)
+{
+	const struct bloom_filter_settings *settings = &trigram_bloom_settings;
+	size_t nr = 0, i;
+	int truncated;
+
+	for (i = 0; i + 2 < size; i++) {
+		uint32_t t;
+
+		/* patterns never span lines */
+		if (buf[i] == '\n' || buf[i + 1] == '\n' || buf[i + 2] == '\n')
+			continue;
+
+		t = (buf[i] << 16) | (buf[i + 1] << 8) | buf[i + 2];
+		if (ctx->seen[t >> 3] & (1 << (t & 7)))
+			continue;
+		ctx->seen[t >> 3] |= 1 << (t & 7);
+		ALLOC_GROW(ctx->trigrams, nr + 1, ctx->trigrams_alloc);
+		ctx->trigrams[nr++] = t;
+		if (nr > TRIGRAM_MAX_PER_BLOB)
+			break;
+	}
+
+	truncated = nr > TRIGRAM_MAX_PER_BLOB;
+	if (truncated) {
+		filter->len = 1;
+		filter->data = xmalloc(1);
+		filter->data[0] = 0xFF;
+	} else {
+		filter->len = (nr * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
+		if (!filter->len)
+			filter->len = 1;
+		CALLOC_ARRAY(filter->data, filter->len);
+	}
+
+	for (i = 0; i < nr; i++) {
+		uint32_t t = ctx->trigrams[i];
+		unsigned char trigram[3];
+		struct bloom_key key;
+
+		ctx->seen[t >> 3] &= ~(1 << (t & 7));
+		if (truncated)
+			continue;
+		trigram[0] = t >> 16;
+		trigram[1] = t >> 8;
+		trigram[2] = t;
+		fill_bloom_key((const char *)trigram, 3, &key, settings);
+		add_key_to_filter(&key, filter, settings);
+		clear_bloom_key(&key);
+	}
+}
+
+static int write_trigram_chunk_fanout(struct hashfile *f, void *data)
+{
+	struct write_trigram_context *ctx = data;
+	size_t i, count = 0;
+
+	for (i = 0; i < 256; i++) {
+		while (count < ctx->nr && ctx->entries[count].oid.hash[0] == i)
+			count++;
+		hashwrite_be32(f, count);
+	}
+	return 0;
+}
+
+static int write_trigram_chunk_oids(struct hashfile *f, void *data)
+{
+	struct write_trigram_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->nr; i++)
+		hashwrite(f, ctx->entries[i].oid.hash, the_hash_algo->rawsz);
+	return 0;
+}
+
+static int write_trigram_chunk_bloom_indexes(struct hashfile *f, void *data)
+{
+	struct write_trigram_context *ctx = data;
+	uint64_t offset = 0;
+	size_t i;
+
+	for (i = 0; i < ctx->nr; i++) {
+		offset += ctx->entries[i].filter.len;
+		hashwrite_be64(f, offset);
+	}
+	return 0;
+}
+
+static int write_trigram_chunk_bloom_data(struct hashfile *f, void *data)
+{
+	struct write_trigram_context *ctx = data;
+	const struct bloom_filter_settings *settings = &trigram_bloom_settings;
+	size_t i;
+
+	hashwrite_be32(f, settings->hash_version);
+	hashwrite_be32(f, settings->num_hashes);
+	hashwrite_be32(f, settings->bits_per_entry);
+	for (i = 0; i < ctx->nr; i++)
+		hashwrite(f, ctx->entries[i].filter.data,
+			  ctx->entries[i].filter.len);
+	return 0;
+}
+
+static int same_bloom_settings(const struct bloom_filter_settings *a,
+			       const struct bloom_filter_settings *b)
+{
+	return a->hash_version == b->hash_version &&
+	       a->num_hashes == b->num_hashes &&
+	       a->bits_per_entry == b->bits_per_entry;
+}
+
+int write_trigram_index(struct repository *r, struct oid_array *blobs,
+			int report_progress)
+{
+	struct write_trigram_context ctx = { 0 };
+	struct trigram_index *old;
+	struct progress *progress = NULL;
+	struct lock_file lk = LOCK_INIT;
+	struct hashfile *f;
+	struct chunkfile *cf;
+	char *filename;
+	size_t i;
+	int ret = 0;
+
+	old = load_trigram_index(r);
+	if (old && !same_bloom_settings(&old->settings, &trigram_bloom_settings)) {
+		free_trigram_index(old);
+		old = NULL;
+	}
+
+	oid_array_sort(blobs);
+	if (report_progress)
+		progress = start_delayed_progress(
+			_("Computing trigram Bloom filters"), blobs->nr);
+	ctx.seen = xcalloc(1, TRIGRAM_SPACE / 8);
+
+	for (i = 0; i < blobs->nr; i++) {
+		const struct object_id *oid = &blobs->oid[i];
+		struct trigram_entry *e;
+		struct bloom_filter filter;
+		enum object_type type;
+		unsigned long size;
+		void *buf;
+
+		display_progress(progress, i + 1);
+		if (i && oideq(oid, &blobs->oid[i - 1]))
+			continue;
+
+		if (old && trigram_index_lookup(old, oid, &filter)) {
+			ALLOC_GROW(ctx.entries, ctx.nr + 1, ctx.alloc);
+			e = &ctx.entries[ctx.nr++];
+			oidcpy(&e->oid, oid);
+			e->filter = filter;
+			e->owned = 0;
+			ctx.total_filter_size += filter.len;
+			continue;
+		}
+
+		/*
+		 * Blobs we cannot or prefer not to read are left out of
+		 * the index, which means they will always be searched.
+		 */
+		if (oid_object_info(r, oid, &size) != OBJ_BLOB ||
+		    size > big_file_threshold)
+			continue;
+		buf = repo_read_object_file(r, oid, &type, &size);
+		if (!buf)
+			continue;
+
+		ALLOC_GROW(ctx.entries, ctx.nr + 1, ctx.alloc);
+		e = &ctx.entries[ctx.nr++];
+		oidcpy(&e->oid, oid);
+		compute_trigram_filter(&ctx, buf, size, &e->filter);
+		e->owned = 1;
+		ctx.total_filter_size += e->filter.len;
+		free(buf);
+	}
+	stop_progress(&progress);
+
+	if (ctx.nr > UINT32_MAX) {
+		ret = error(_("too many blobs for a trigram index"));
+		goto cleanup;
+	}
+
+	filename = get_trigram_index_filename(r);
+	if (safe_create_leading_directories(filename)) {
+		ret = error(_("unable to create leading directories of %s"),
+			    filename);
+		free(filename);
+		goto cleanup;
+	}
+	hold_lock_file_for_update_mode(&lk, filename, LOCK_DIE_ON_ERROR, 0444);
+	free(filename);
+	f = hashfd(get_lock_file_fd(&lk), get_lock_file_path(&lk));
+
+	cf = init_chunkfile(f);
+	add_chunk(cf, TRIGRAM_CHUNKID_OIDFANOUT, TRIGRAM_FANOUT_SIZE,
+		  write_trigram_chunk_fanout);
+	add_chunk(cf, TRIGRAM_CHUNKID_OIDLOOKUP,
+		  st_mult(ctx.nr, the_hash_algo->rawsz),
+		  write_trigram_chunk_oids);
+	add_chunk(cf, TRIGRAM_CHUNKID_BLOOMINDEXES,
+		  st_mult(ctx.nr, sizeof(uint64_t)),
+		  write_trigram_chunk_bloom_indexes);
+	add_chunk(cf, TRIGRAM_CHUNKID_BLOOMDATA,
+		  TRIGRAM_BLOOMDATA_HEADER_SIZE + ctx.total_filter_size,
+		  write_trigram_chunk_bloom_data);
+
+	hashwrite_be32(f, TRIGRAM_INDEX_SIGNATURE);
+	hashwrite_u8(f, TRIGRAM_INDEX_VERSION);
+	hashwrite_u8(f, oid_version(the_hash_algo));
+	hashwrite_u8(f, get_num_chunks(cf));
+	hashwrite_u8(f, 0); /* unused */
+
+	write_chunkfile(cf, &ctx);
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_PACK_METADATA,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	free_chunkfile(cf);
+	if (commit_lock_file(&lk) < 0)
+		ret = error_errno(_("unable to write trigram-index"));
+
+cleanup:
+	for (i = 0; i < ctx.nr; i++)
+		if (ctx.entries[i].owned)
+			free(ctx.entries[i].filter.data);
+	free(ctx.entries);
+	free(ctx.trigrams);
+	free(ctx.seen);
+	free_trigram_index(old);
+	return ret;
+}
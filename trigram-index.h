@@ -0,0 +1,51 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+struct repository;
+struct object_id;
+struct oid_array;
+
+/*
+ * A trigram index stores, for each blob it covers, a Bloom filter of
+ * the three-byte substrings ("trigrams") of the blob's contents. A
+ * blob whose filter lacks any trigram of a literal string cannot
+ * contain that string, which lets "git grep" skip reading it.
+ *
+ * The index lives in "$GIT_OBJECT_DIRECTORY/info/trigram-index" and
+ * is keyed by object name, so it never goes stale; blobs it does not
+ * cover are simply searched as usual.
+ */
+struct trigram_index;
+
+/*
+ * Load the trigram index of 'r', or return NULL if there is none (or
+ * it cannot be used).
+ */
+struct trigram_index *load_trigram_index(struct repository *r);
+
+void free_trigram_index(struct trigram_index *ti);
+
+/*
+ * Register a literal string that a blob must contain to be of
+ * interest. When several literals are registered, a blob is of
+ * interest if it may contain any one of them.
+ */
+void trigram_index_add_literal(struct trigram_index *ti,
+			       const char *literal, size_t len);
+
+/*
+ * Return 0 if the index proves that blob 'oid' contains none of the
+ * registered literals, and 1 otherwise.
+ */
+int trigram_index_may_match(struct trigram_index *ti,
+			    const struct object_id *oid);
+
+/*
+ * Write a trigram index covering exactly the blobs in 'blobs', reusing
+ * the filters of blobs already covered by the existing index. Returns
+ * 0 on success and -1 on error.
+ */
+int write_trigram_index(struct repository *r, struct oid_array *blobs,
+			int report_progress);
+
+#endif
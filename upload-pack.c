@@ -27,6 +27,8 @@
 #include "commit-graph.h"
 #include "commit-reach.h"
 #include "shallow.h"
+#include "lockfile.h"
+#include "dir.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -94,6 +96,7 @@ struct upload_pack_data {
 	struct packet_writer writer;
 
 	const char *pack_objects_hook;
+	unsigned long pack_cache_size;
 
 	unsigned stateless_rpc : 1;				/* v0 only */
 	unsigned no_done : 1;					/* v0 only */
@@ -209,6 +212,16 @@ struct output_state {
 	int used;
 	unsigned packfile_uris_started : 1;
 	unsigned packfile_started : 1;
+
+	/*
+	 * When the pack is being saved to the pack cache, everything read
+	 * from pack-objects is also written to this lock file, until
+	 * 'cache_limit' bytes have been written; then the lock is rolled
+	 * back and 'cache' set to NULL.
+	 */
+	struct lock_file *cache;
+	size_t cache_written;
+	size_t cache_limit;
 };
 
 static int relay_pack_data(int pack_objects_out, struct output_state *os,
@@ -233,6 +246,16 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	}
 	os->used += readsz;
 
+	if (os->cache && readsz) {
+		if (os->cache_written + readsz > os->cache_limit ||
+		    write_in_full(get_lock_file_fd(os->cache),
+				  os->buffer + os->used - readsz, readsz) < 0) {
+			rollback_lock_file(os->cache);
+			os->cache = NULL;
+		} else
+			os->cache_written += readsz;
+	}
+
 	while (!os->packfile_started) {
 		char *p;
 		if (os->used >= 4 && !memcmp(os->buffer, "PACK", 4)) {
@@ -276,11 +299,228 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	return readsz;
 }
 
+/*
+ * With uploadpack.packCacheSize, the packs sent in response to requests
+ * that depend only on the objects asked for are kept under
+ * $GIT_COMMON_DIR/upload-pack-cache/ and sent as-is for later identical
+ * requests, instead of running pack-objects again.
+ */
+static void pack_cache_add_oids(struct strbuf *key, const char *label,
+				const struct object_array *objs)
+{
+	struct oid_array oids = OID_ARRAY_INIT;
+	size_t i;
+
+	for (i = 0; i < objs->nr; i++)
+		oid_array_append(&oids, &objs->objects[i].item->oid);
+	oid_array_sort(&oids);
+	for (i = 0; i < oids.nr; i++)
+		if (!i || !oideq(&oids.oid[i - 1], &oids.oid[i]))
+			strbuf_addf(key, "%s %s\n", label,
+				    oid_to_hex(&oids.oid[i]));
+	oid_array_clear(&oids);
+}
+
+static int pack_cache_add_tag(const char *refname, const struct object_id *oid,
+			      int flags UNUSED, void *cb_data)
+{
+	strbuf_addf(cb_data, "tag %s %s\n", oid_to_hex(oid), refname);
+	return 0;
+}
+
+/*
+ * Find where the pack for this request would be cached, or return -1
+ * if the pack may depend on more than what goes into the key.
+ */
+static int pack_cache_path(struct upload_pack_data *pack_data,
+			   const struct string_list *uri_protocols,
+			   struct strbuf *path)
+{
+	struct strbuf key = STRBUF_INIT;
+	struct object_id oid;
+	git_hash_ctx ctx;
+
+	if (!pack_data->pack_cache_size || pack_data->pack_objects_hook ||
+	    uri_protocols || pack_data->shallow_nr ||
+	    pack_data->extra_edge_obj.nr)
+		return -1;
+
+	strbuf_addstr(&key, "upload-pack-cache v1\n");
+	pack_cache_add_oids(&key, "want", &pack_data->want_obj);
+	pack_cache_add_oids(&key, "have", &pack_data->have_obj);
+	strbuf_addf(&key, "thin %d\nofs-delta %d\n",
+		    pack_data->use_thin_pack, pack_data->use_ofs_delta);
+	if (pack_data->filter_options.choice)
+		strbuf_addf(&key, "filter %s\n",
+			    expand_list_objects_filter_spec(&pack_data->filter_options));
+	/*
+	 * Which tags --include-tag adds depends on the tags that exist
+	 * now; rather than working that out, make any change to the
+	 * tags change the key.
+	 */
+	if (pack_data->use_include_tag)
+		for_each_tag_ref(pack_cache_add_tag, &key);
+
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, key.buf, key.len);
+	the_hash_algo->final_oid_fn(&oid, &ctx);
+	strbuf_release(&key);
+
+	strbuf_git_common_path(path, the_repository, "upload-pack-cache/%s.pack",
+			       oid_to_hex(&oid));
+	return 0;
+}
+
+static int send_cached_pack(struct upload_pack_data *pack_data,
+			    const char *path)
+{
+	struct output_state *output_state;
+	char header[4];
+	int fd, result;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (read_in_full(fd, header, sizeof(header)) != sizeof(header) ||
+	    memcmp(header, "PACK", 4) || lseek(fd, 0, SEEK_SET)) {
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+
+	/* keep entries that are in use from being evicted */
+	utime(path, NULL);
+	trace2_data_string("upload-pack", the_repository, "pack-cache", "hit");
+
+	output_state = xcalloc(1, sizeof(struct output_state));
+	while ((result = relay_pack_data(fd, output_state,
+					 pack_data->use_sideband, 0)) > 0)
+		; /* keep relaying */
+	if (result < 0)
+		die_errno("git upload-pack: unable to read cached pack '%s'",
+			  path);
+	close(fd);
+
+	if (output_state->used > 0)
+		send_client_data(1, output_state->buffer, output_state->used,
+				 pack_data->use_sideband);
+	free(output_state);
+	if (pack_data->use_sideband)
+		packet_flush(1);
+	return 0;
+}
+
+/*
+ * The lock of a pack being saved is written to as the pack is sent, so
+ * one that has not been touched for this long was left behind by an
+ * upload-pack that died.
+ */
+#define PACK_CACHE_STALE_LOCK (60 * 60)
+
+static int pack_cache_lock_is_stale(const char *path)
+{
+	struct stat st;
+
+	return !lstat(path, &st) &&
+		st.st_mtime + PACK_CACHE_STALE_LOCK < time(NULL);
+}
+
+/*
+ * Take the lock for saving the pack at 'path', removing a stale lock
+ * first. Fails without waiting if another upload-pack holds it.
+ */
+static int hold_pack_cache_lock(struct lock_file *lk, const char *path)
+{
+	struct strbuf lock_path = STRBUF_INIT;
+	int fd;
+
+	fd = hold_lock_file_for_update(lk, path, 0);
+	if (fd >= 0 || errno != EEXIST)
+		return fd;
+
+	strbuf_addf(&lock_path, "%s.lock", path);
+	if (pack_cache_lock_is_stale(lock_path.buf) && !unlink(lock_path.buf))
+		fd = hold_lock_file_for_update(lk, path, 0);
+	strbuf_release(&lock_path);
+	return fd;
+}
+
+struct pack_cache_entry {
+	char *path;
+	off_t size;
+	timestamp_t mtime;
+};
+
+static int pack_cache_entry_cmp(const void *a_, const void *b_)
+{
+	const struct pack_cache_entry *a = a_, *b = b_;
+
+	if (a->mtime != b->mtime)
+		return a->mtime < b->mtime ? -1 : 1;
+	return strcmp(a->path, b->path);
+}
+
+/*
+ * Remove the least recently used packs from the cache until it is no
+ * larger than 'limit' bytes, and stale locks of packs that were never
+ * completed.
+ */
+static void evict_cached_packs(const char *dir, unsigned long limit)
+{
+	struct pack_cache_entry *entries = NULL;
+	size_t nr = 0, alloc = 0, i;
+	struct strbuf path = STRBUF_INIT;
+	uintmax_t total = 0;
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	strbuf_addf(&path, "%s/", dir);
+	while ((de = readdir(d))) {
+		size_t baselen = path.len;
+		struct stat st;
+
+		if (ends_with(de->d_name, ".pack.lock")) {
+			strbuf_addstr(&path, de->d_name);
+			if (pack_cache_lock_is_stale(path.buf))
+				unlink(path.buf);
+			strbuf_setlen(&path, baselen);
+			continue;
+		}
+		if (!ends_with(de->d_name, ".pack"))
+			continue;
+		strbuf_addstr(&path, de->d_name);
+		if (!stat(path.buf, &st) && S_ISREG(st.st_mode)) {
+			ALLOC_GROW(entries, nr + 1, alloc);
+			entries[nr].path = xstrdup(path.buf);
+			entries[nr].size = st.st_size;
+			entries[nr].mtime = st.st_mtime;
+			total += st.st_size;
+			nr++;
+		}
+		strbuf_setlen(&path, baselen);
+	}
+	closedir(d);
+
+	QSORT(entries, nr, pack_cache_entry_cmp);
+	for (i = 0; i < nr; i++) {
+		if (total > limit && !unlink(entries[i].path))
+			total -= entries[i].size;
+		free(entries[i].path);
+	}
+	free(entries);
+	strbuf_release(&path);
+}
+
 static void create_pack_file(struct upload_pack_data *pack_data,
 			     const struct string_list *uri_protocols)
 {
 	struct child_process pack_objects = CHILD_PROCESS_INIT;
-	struct output_state *output_state = xcalloc(1, sizeof(struct output_state));
+	struct output_state *output_state;
+	struct lock_file cache_lock = LOCK_INIT;
+	struct strbuf cache_path = STRBUF_INIT;
 	char progress[128];
 	char abort_msg[] = "aborting due to possible repository "
 		"corruption on the remote side.";
@@ -288,6 +528,24 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 	int i;
 	FILE *pipe_fd;
 
+	if (!pack_cache_path(pack_data, uri_protocols, &cache_path) &&
+	    !send_cached_pack(pack_data, cache_path.buf)) {
+		strbuf_release(&cache_path);
+		return;
+	}
+
+	output_state = xcalloc(1, sizeof(struct output_state));
+	/*
+	 * If another upload-pack is already saving this pack, do not wait
+	 * for it; just send ours without saving it.
+	 */
+	if (cache_path.len &&
+	    !safe_create_leading_directories(cache_path.buf) &&
+	    hold_pack_cache_lock(&cache_lock, cache_path.buf) >= 0) {
+		output_state->cache = &cache_lock;
+		output_state->cache_limit = pack_data->pack_cache_size;
+	}
+
 	if (!pack_data->pack_objects_hook)
 		pack_objects.git_cmd = 1;
 	else {
@@ -454,6 +712,17 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 				 pack_data->use_sideband);
 		fprintf(stderr, "flushed.\n");
 	}
+	if (output_state->cache && !commit_lock_file(&cache_lock)) {
+		struct strbuf dir = STRBUF_INIT;
+
+		trace2_data_string("upload-pack", the_repository,
+				   "pack-cache", "stored");
+		strbuf_git_common_path(&dir, the_repository,
+				       "upload-pack-cache");
+		evict_cached_packs(dir.buf, pack_data->pack_cache_size);
+		strbuf_release(&dir);
+	}
+	strbuf_release(&cache_path);
 	free(output_state);
 	if (pack_data->use_sideband)
 		packet_flush(1);
@@ -1327,6 +1596,8 @@ static int upload_pack_config(const char *var, const char *value, void *cb_data)
 		precomposed_unicode = git_config_bool(var, value);
 	} else if (!strcmp("transfer.advertisesid", var)) {
 		data->advertise_sid = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packcachesize", var)) {
+		data->pack_cache_size = git_config_ulong(var, value);
 	}
 
 	if (parse_object_filter_config(var, value, data) < 0)
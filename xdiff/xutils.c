@@ -249,6 +249,16 @@ int xdl_recmatch(const char *l1, long s1, const char *l2, long s2, long flags)
 	return 1;
 }
 
+/* true iff some byte of w is zero */
+#define XDL_HAS_ZERO_BYTE(w) \
+	(((w) - 0x0101010101010101ULL) & ~(w) & 0x8080808080808080ULL)
+
+static inline uint64_t xdl_hash_word(uint64_t ha, uint64_t w)
+{
+	ha = (ha ^ w) * 0x9e3779b97f4a7c15ULL;
+	return ha ^ (ha >> 32);
+}
+
 static unsigned long xdl_hash_record_with_whitespace(char const **data,
 		char const *top, long flags) {
 	unsigned long ha = 5381;
@@ -295,19 +305,35 @@ static unsigned long xdl_hash_record_with_whitespace(char const **data,
 }
 
 unsigned long xdl_hash_record(char const **data, char const *top, long flags) {
-	unsigned long ha = 5381;
+	uint64_t ha = 5381, tail = 0;
 	char const *ptr = *data;
+	int nr = 0;
 
 	if (flags & XDF_WHITESPACE_FLAGS)
 		return xdl_hash_record_with_whitespace(data, top, flags);
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
-		ha += (ha << 5);
-		ha ^= (unsigned long) *ptr;
+	/*
+	 * Without whitespace flags there is no need to look at the bytes
+	 * one by one, so hash eight of them at a time until we reach the
+	 * word with the end of line in it.  The last few bytes are packed
+	 * into one more word along with their count.  This hash does not
+	 * match xdl_hash_record_with_whitespace(), but it does not have
+	 * to, since all records of one diff are hashed with the same flags.
+	 */
+	while (top - ptr >= 8) {
+		uint64_t w = get_be64(ptr);
+		if (XDL_HAS_ZERO_BYTE(w ^ 0x0a0a0a0a0a0a0a0aULL))
+			break;
+		ha = xdl_hash_word(ha, w);
+		ptr += 8;
 	}
+	for (; ptr < top && *ptr != '\n'; ptr++, nr++)
+		tail = (tail << 8) | (unsigned char)*ptr;
+	if (nr)
+		ha = xdl_hash_word(ha, tail | (uint64_t)nr << 56);
 	*data = ptr < top ? ptr + 1: ptr;
 
-	return ha;
+	return (unsigned long)ha;
 }
 
 unsigned int xdl_hashbits(unsigned int size) {